@@ -200,6 +200,22 @@ int appconfig_exists(struct config *root, const char *section, const char *name)
     return 1;
 }
 
+// returns 1 when the option has been given in the config file or set,
+// not just created with the default value of an appconfig_get()
+int appconfig_is_set(struct config *root, const char *section, const char *name) {
+    struct config_option *cv;
+
+    debug(D_CONFIG, "request to check if config in section '%s', name '%s' is set", section, name);
+
+    struct section *co = appconfig_section_find(root, section);
+    if(!co) return 0;
+
+    cv = appconfig_option_index_find(co, name, 0);
+    if(!cv) return 0;
+
+    return (cv->flags & (CONFIG_VALUE_LOADED | CONFIG_VALUE_CHANGED))?1:0;
+}
+
 int appconfig_move(struct config *root, const char *section_old, const char *name_old, const char *section_new, const char *name_new) {
     struct config_option *cv_old, *cv_new;
     int ret = -1;
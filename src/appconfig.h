@@ -43,6 +43,7 @@ extern long long appconfig_set_number(struct config *root, const char *section,
 extern int appconfig_set_boolean(struct config *root, const char *section, const char *name, int value);
 
 extern int appconfig_exists(struct config *root, const char *section, const char *name);
+extern int appconfig_is_set(struct config *root, const char *section, const char *name);
 extern int appconfig_move(struct config *root, const char *section_old, const char *name_old, const char *section_new, const char *name_new);
 
 extern void appconfig_generate(struct config *root, BUFFER *wb, int only_changed);
@@ -62,6 +63,7 @@ extern void appconfig_generate(struct config *root, BUFFER *wb, int only_changed
 #define config_set_boolean(section, name, value) appconfig_set_boolean(&netdata_config, section, name, value)
 
 #define config_exists(section, name) appconfig_exists(&netdata_config, section, name)
+#define config_is_set(section, name) appconfig_is_set(&netdata_config, section, name)
 #define config_move(section_old, name_old, section_new, name_new) appconfig_move(&netdata_config, section_old, name_old, section_new, name_new)
 
 #define config_generate(buffer, only_changed) appconfig_generate(&netdata_config, buffer, only_changed)
@@ -6,6 +6,7 @@
  */
 
 #include "common.h"
+#include "plugins_d_client.h"
 
 // ----------------------------------------------------------------------------
 // per O/S configuration
@@ -2344,16 +2345,22 @@ static void calculate_netdata_statistics(void) {
 
 int print_calculated_number(char *str, calculated_number value) { (void)str; (void)value; return 0; }
 
+// the output to netdata, through shared memory when netdata offers it
+static PLUGINSD_CLIENT *output = NULL;
+static PLUGINSD_CLIENT_CHART *output_chart = NULL;
+
 static inline void send_BEGIN(const char *type, const char *id, usec_t usec) {
-    fprintf(stdout, "BEGIN %s.%s %llu\n", type, id, usec);
+    output_chart = pluginsd_client_chart_find(output, type, id);
+    if(likely(output_chart)) pluginsd_client_begin(output_chart, usec);
 }
 
 static inline void send_SET(const char *name, kernel_uint_t value) {
-    fprintf(stdout, "SET %s = " KERNEL_UINT_FORMAT "\n", name, value);
+    if(likely(output_chart)) pluginsd_client_set_by_id(output_chart, name, (long long)value);
 }
 
 static inline void send_END(void) {
-    fprintf(stdout, "END\n");
+    if(likely(output_chart)) pluginsd_client_end(output_chart);
+    output_chart = NULL;
 }
 
 static usec_t send_resource_usage_to_netdata() {
@@ -2394,91 +2401,64 @@ static usec_t send_resource_usage_to_netdata() {
     if(unlikely(!created_charts)) {
         created_charts = 1;
 
-        fprintf(stdout
-                , "CHART netdata.apps_cpu '' 'Apps Plugin CPU' 'milliseconds/s' apps.plugin netdata.apps_cpu stacked 140000 %1$d\n"
-                        "DIMENSION user '' incremental 1 1000\n"
-                        "DIMENSION system '' incremental 1 1000\n"
-                        "CHART netdata.apps_files '' 'Apps Plugin Files' 'files/s' apps.plugin netdata.apps_files line 140001 %1$d\n"
-                        "DIMENSION calls '' incremental 1 1\n"
-                        "DIMENSION files '' incremental 1 1\n"
-                        "DIMENSION pids '' absolute 1 1\n"
-                        "DIMENSION fds '' absolute 1 1\n"
-                        "DIMENSION targets '' absolute 1 1\n"
-                        "CHART netdata.apps_fix '' 'Apps Plugin Normalization Ratios' 'percentage' apps.plugin netdata.apps_fix line 140002 %1$d\n"
-                        "DIMENSION utime '' absolute 1 %2$llu\n"
-                        "DIMENSION stime '' absolute 1 %2$llu\n"
-                        "DIMENSION gtime '' absolute 1 %2$llu\n"
-                        "DIMENSION minflt '' absolute 1 %2$llu\n"
-                        "DIMENSION majflt '' absolute 1 %2$llu\n"
-                , update_every
-                , RATES_DETAIL
-        );
+        PLUGINSD_CLIENT_CHART *st = pluginsd_client_chart(output, "netdata", "apps_cpu", NULL, "Apps Plugin CPU", "milliseconds/s", "apps.plugin", "netdata.apps_cpu", "stacked", 140000, update_every);
+        pluginsd_client_dimension(st, "user", NULL, "incremental", 1, 1000, 0);
+        pluginsd_client_dimension(st, "system", NULL, "incremental", 1, 1000, 0);
 
-        if(include_exited_childs)
-            fprintf(stdout
-                    , "CHART netdata.apps_children_fix '' 'Apps Plugin Exited Children Normalization Ratios' 'percentage' apps.plugin netdata.apps_children_fix line 140003 %1$d\n"
-                            "DIMENSION cutime '' absolute 1 %2$llu\n"
-                            "DIMENSION cstime '' absolute 1 %2$llu\n"
-                            "DIMENSION cgtime '' absolute 1 %2$llu\n"
-                            "DIMENSION cminflt '' absolute 1 %2$llu\n"
-                            "DIMENSION cmajflt '' absolute 1 %2$llu\n"
-                    , update_every
-                    , RATES_DETAIL
-            );
+        st = pluginsd_client_chart(output, "netdata", "apps_files", NULL, "Apps Plugin Files", "files/s", "apps.plugin", "netdata.apps_files", "line", 140001, update_every);
+        pluginsd_client_dimension(st, "calls", NULL, "incremental", 1, 1, 0);
+        pluginsd_client_dimension(st, "files", NULL, "incremental", 1, 1, 0);
+        pluginsd_client_dimension(st, "pids", NULL, "absolute", 1, 1, 0);
+        pluginsd_client_dimension(st, "fds", NULL, "absolute", 1, 1, 0);
+        pluginsd_client_dimension(st, "targets", NULL, "absolute", 1, 1, 0);
+
+        st = pluginsd_client_chart(output, "netdata", "apps_fix", NULL, "Apps Plugin Normalization Ratios", "percentage", "apps.plugin", "netdata.apps_fix", "line", 140002, update_every);
+        pluginsd_client_dimension(st, "utime", NULL, "absolute", 1, RATES_DETAIL, 0);
+        pluginsd_client_dimension(st, "stime", NULL, "absolute", 1, RATES_DETAIL, 0);
+        pluginsd_client_dimension(st, "gtime", NULL, "absolute", 1, RATES_DETAIL, 0);
+        pluginsd_client_dimension(st, "minflt", NULL, "absolute", 1, RATES_DETAIL, 0);
+        pluginsd_client_dimension(st, "majflt", NULL, "absolute", 1, RATES_DETAIL, 0);
+
+        if(include_exited_childs) {
+            st = pluginsd_client_chart(output, "netdata", "apps_children_fix", NULL, "Apps Plugin Exited Children Normalization Ratios", "percentage", "apps.plugin", "netdata.apps_children_fix", "line", 140003, update_every);
+            pluginsd_client_dimension(st, "cutime", NULL, "absolute", 1, RATES_DETAIL, 0);
+            pluginsd_client_dimension(st, "cstime", NULL, "absolute", 1, RATES_DETAIL, 0);
+            pluginsd_client_dimension(st, "cgtime", NULL, "absolute", 1, RATES_DETAIL, 0);
+            pluginsd_client_dimension(st, "cminflt", NULL, "absolute", 1, RATES_DETAIL, 0);
+            pluginsd_client_dimension(st, "cmajflt", NULL, "absolute", 1, RATES_DETAIL, 0);
+        }
     }
 
-    fprintf(stdout,
-        "BEGIN netdata.apps_cpu %llu\n"
-        "SET user = %llu\n"
-        "SET system = %llu\n"
-        "END\n"
-        "BEGIN netdata.apps_files %llu\n"
-        "SET calls = %zu\n"
-        "SET files = %zu\n"
-        "SET pids = %zu\n"
-        "SET fds = %d\n"
-        "SET targets = %zu\n"
-        "END\n"
-        "BEGIN netdata.apps_fix %llu\n"
-        "SET utime = %u\n"
-        "SET stime = %u\n"
-        "SET gtime = %u\n"
-        "SET minflt = %u\n"
-        "SET majflt = %u\n"
-        "END\n"
-        , usec
-        , cpuuser
-        , cpusyst
-        , usec
-        , calls_counter
-        , file_counter
-        , all_pids_count
-        , all_files_len
-        , apps_groups_targets_count
-        , usec
-        , (unsigned int)(utime_fix_ratio   * 100 * RATES_DETAIL)
-        , (unsigned int)(stime_fix_ratio   * 100 * RATES_DETAIL)
-        , (unsigned int)(gtime_fix_ratio   * 100 * RATES_DETAIL)
-        , (unsigned int)(minflt_fix_ratio  * 100 * RATES_DETAIL)
-        , (unsigned int)(majflt_fix_ratio  * 100 * RATES_DETAIL)
-        );
+    send_BEGIN("netdata", "apps_cpu", usec);
+    send_SET("user", cpuuser);
+    send_SET("system", cpusyst);
+    send_END();
 
-    if(include_exited_childs)
-        fprintf(stdout,
-            "BEGIN netdata.apps_children_fix %llu\n"
-            "SET cutime = %u\n"
-            "SET cstime = %u\n"
-            "SET cgtime = %u\n"
-            "SET cminflt = %u\n"
-            "SET cmajflt = %u\n"
-            "END\n"
-            , usec
-            , (unsigned int)(cutime_fix_ratio  * 100 * RATES_DETAIL)
-            , (unsigned int)(cstime_fix_ratio  * 100 * RATES_DETAIL)
-            , (unsigned int)(cgtime_fix_ratio  * 100 * RATES_DETAIL)
-            , (unsigned int)(cminflt_fix_ratio * 100 * RATES_DETAIL)
-            , (unsigned int)(cmajflt_fix_ratio * 100 * RATES_DETAIL)
-            );
+    send_BEGIN("netdata", "apps_files", usec);
+    send_SET("calls", calls_counter);
+    send_SET("files", file_counter);
+    send_SET("pids", all_pids_count);
+    send_SET("fds", (kernel_uint_t)all_files_len);
+    send_SET("targets", apps_groups_targets_count);
+    send_END();
+
+    send_BEGIN("netdata", "apps_fix", usec);
+    send_SET("utime", (unsigned int)(utime_fix_ratio   * 100 * RATES_DETAIL));
+    send_SET("stime", (unsigned int)(stime_fix_ratio   * 100 * RATES_DETAIL));
+    send_SET("gtime", (unsigned int)(gtime_fix_ratio   * 100 * RATES_DETAIL));
+    send_SET("minflt", (unsigned int)(minflt_fix_ratio  * 100 * RATES_DETAIL));
+    send_SET("majflt", (unsigned int)(majflt_fix_ratio  * 100 * RATES_DETAIL));
+    send_END();
+
+    if(include_exited_childs) {
+        send_BEGIN("netdata", "apps_children_fix", usec);
+        send_SET("cutime", (unsigned int)(cutime_fix_ratio  * 100 * RATES_DETAIL));
+        send_SET("cstime", (unsigned int)(cstime_fix_ratio  * 100 * RATES_DETAIL));
+        send_SET("cgtime", (unsigned int)(cgtime_fix_ratio  * 100 * RATES_DETAIL));
+        send_SET("cminflt", (unsigned int)(cminflt_fix_ratio * 100 * RATES_DETAIL));
+        send_SET("cmajflt", (unsigned int)(cmajflt_fix_ratio * 100 * RATES_DETAIL));
+        send_END();
+    }
 
     return usec;
 }
@@ -2760,6 +2740,22 @@ static void send_collected_data_to_netdata(struct target *root, const char *type
 // ----------------------------------------------------------------------------
 // generate the charts
 
+// defines a chart with a dimension for each exposed target
+// the title is formatted with the title of the targets and detail
+static void send_chart_of_targets(struct target *root, const char *type, const char *id, const char *context_id, const char *title_format, const char *title, const char *detail, const char *units, const char *family, long priority, long multiplier, long divisor, int hidden) {
+    char chart_title[RRD_ID_LENGTH_MAX + 1], context[RRD_ID_LENGTH_MAX + 1];
+    snprintfz(chart_title, RRD_ID_LENGTH_MAX, title_format, title, detail);
+    snprintfz(context, RRD_ID_LENGTH_MAX, "%s.%s", type, context_id);
+
+    PLUGINSD_CLIENT_CHART *st = pluginsd_client_chart(output, type, id, NULL, chart_title, units, family, context, "stacked", priority, update_every);
+
+    struct target *w;
+    for (w = root; w ; w = w->next) {
+        if(unlikely(w->exposed))
+            pluginsd_client_dimension(st, w->name, NULL, "absolute", multiplier, divisor, hidden && w->hidden);
+    }
+}
+
 static void send_charts_updates_to_netdata(struct target *root, const char *type, const char *title)
 {
     struct target *w;
@@ -2780,113 +2776,31 @@ static void send_charts_updates_to_netdata(struct target *root, const char *type
 
     // we have something new to show
     // update the charts
-    fprintf(stdout, "CHART %s.cpu '' '%s CPU Time (%d%% = %d core%s)' 'cpu time %%' cpu %s.cpu stacked 20001 %d\n", type, title, (processors * 100), processors, (processors>1)?"s":"", type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu %s\n", w->name, hz * RATES_DETAIL / 100, w->hidden ? "hidden" : "");
-    }
-
-    fprintf(stdout, "CHART %s.mem '' '%s Real Memory (w/o shared)' 'MB' mem %s.mem stacked 20003 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute %ld %ld\n", w->name, sysconf(_SC_PAGESIZE), 1024L*1024L);
-    }
-
-    fprintf(stdout, "CHART %s.vmem '' '%s Virtual Memory Size' 'MB' mem %s.vmem stacked 20004 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute %ld %ld\n", w->name, sysconf(_SC_PAGESIZE), 1024L*1024L);
-    }
-
-    fprintf(stdout, "CHART %s.threads '' '%s Threads' 'threads' processes %s.threads stacked 20005 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 1\n", w->name);
-    }
-
-    fprintf(stdout, "CHART %s.processes '' '%s Processes' 'processes' processes %s.processes stacked 20004 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 1\n", w->name);
-    }
-
-    fprintf(stdout, "CHART %s.cpu_user '' '%s CPU User Time (%d%% = %d core%s)' 'cpu time %%' cpu %s.cpu_user stacked 20020 %d\n", type, title, (processors * 100), processors, (processors>1)?"s":"", type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, hz * RATES_DETAIL / 100LLU);
-    }
-
-    fprintf(stdout, "CHART %s.cpu_system '' '%s CPU System Time (%d%% = %d core%s)' 'cpu time %%' cpu %s.cpu_system stacked 20021 %d\n", type, title, (processors * 100), processors, (processors>1)?"s":"", type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, hz * RATES_DETAIL / 100LLU);
-    }
-
-    if(show_guest_time) {
-        fprintf(stdout, "CHART %s.cpu_guest '' '%s CPU Guest Time (%d%% = %d core%s)' 'cpu time %%' cpu %s.cpu_system stacked 20022 %d\n", type, title, (processors * 100), processors, (processors > 1) ? "s" : "", type, update_every);
-        for (w = root; w; w = w->next) {
-            if(unlikely(w->exposed))
-                fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, hz * RATES_DETAIL / 100LLU);
-        }
-    }
-
-    fprintf(stdout, "CHART %s.major_faults '' '%s Major Page Faults (swap read)' 'page faults/s' swap %s.major_faults stacked 20010 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, RATES_DETAIL);
-    }
-
-    fprintf(stdout, "CHART %s.minor_faults '' '%s Minor Page Faults' 'page faults/s' mem %s.minor_faults stacked 20011 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, RATES_DETAIL);
-    }
-
-    fprintf(stdout, "CHART %s.lreads '' '%s Disk Logical Reads' 'kilobytes/s' disk %s.lreads stacked 20042 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, 1024LLU * RATES_DETAIL);
-    }
-
-    fprintf(stdout, "CHART %s.lwrites '' '%s I/O Logical Writes' 'kilobytes/s' disk %s.lwrites stacked 20042 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, 1024LLU * RATES_DETAIL);
-    }
-
-    fprintf(stdout, "CHART %s.preads '' '%s Disk Reads' 'kilobytes/s' disk %s.preads stacked 20002 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, 1024LLU * RATES_DETAIL);
-    }
-
-    fprintf(stdout, "CHART %s.pwrites '' '%s Disk Writes' 'kilobytes/s' disk %s.pwrites stacked 20002 %d\n", type, title, type, update_every);
-    for (w = root; w ; w = w->next) {
-        if(unlikely(w->exposed))
-            fprintf(stdout, "DIMENSION %s '' absolute 1 %llu\n", w->name, 1024LLU * RATES_DETAIL);
-    }
+    char cpu_title[RRD_ID_LENGTH_MAX + 1];
+    snprintfz(cpu_title, RRD_ID_LENGTH_MAX, "%d%% = %d core%s", (processors * 100), processors, (processors>1)?"s":"");
+
+    send_chart_of_targets(root, type, "cpu", "cpu", "%s CPU Time (%s)", title, cpu_title, "cpu time %", "cpu", 20001, 1, hz * RATES_DETAIL / 100, 1);
+    send_chart_of_targets(root, type, "mem", "mem", "%s Real Memory (w/o shared)", title, NULL, "MB", "mem", 20003, sysconf(_SC_PAGESIZE), 1024L*1024L, 0);
+    send_chart_of_targets(root, type, "vmem", "vmem", "%s Virtual Memory Size", title, NULL, "MB", "mem", 20004, sysconf(_SC_PAGESIZE), 1024L*1024L, 0);
+    send_chart_of_targets(root, type, "threads", "threads", "%s Threads", title, NULL, "threads", "processes", 20005, 1, 1, 0);
+    send_chart_of_targets(root, type, "processes", "processes", "%s Processes", title, NULL, "processes", "processes", 20004, 1, 1, 0);
+    send_chart_of_targets(root, type, "cpu_user", "cpu_user", "%s CPU User Time (%s)", title, cpu_title, "cpu time %", "cpu", 20020, 1, hz * RATES_DETAIL / 100LLU, 0);
+    send_chart_of_targets(root, type, "cpu_system", "cpu_system", "%s CPU System Time (%s)", title, cpu_title, "cpu time %", "cpu", 20021, 1, hz * RATES_DETAIL / 100LLU, 0);
+
+    if(show_guest_time)
+        send_chart_of_targets(root, type, "cpu_guest", "cpu_system", "%s CPU Guest Time (%s)", title, cpu_title, "cpu time %", "cpu", 20022, 1, hz * RATES_DETAIL / 100LLU, 0);
+
+    send_chart_of_targets(root, type, "major_faults", "major_faults", "%s Major Page Faults (swap read)", title, NULL, "page faults/s", "swap", 20010, 1, RATES_DETAIL, 0);
+    send_chart_of_targets(root, type, "minor_faults", "minor_faults", "%s Minor Page Faults", title, NULL, "page faults/s", "mem", 20011, 1, RATES_DETAIL, 0);
+    send_chart_of_targets(root, type, "lreads", "lreads", "%s Disk Logical Reads", title, NULL, "kilobytes/s", "disk", 20042, 1, 1024LLU * RATES_DETAIL, 0);
+    send_chart_of_targets(root, type, "lwrites", "lwrites", "%s I/O Logical Writes", title, NULL, "kilobytes/s", "disk", 20042, 1, 1024LLU * RATES_DETAIL, 0);
+    send_chart_of_targets(root, type, "preads", "preads", "%s Disk Reads", title, NULL, "kilobytes/s", "disk", 20002, 1, 1024LLU * RATES_DETAIL, 0);
+    send_chart_of_targets(root, type, "pwrites", "pwrites", "%s Disk Writes", title, NULL, "kilobytes/s", "disk", 20002, 1, 1024LLU * RATES_DETAIL, 0);
 
     if(enable_file_charts) {
-        fprintf(stdout, "CHART %s.files '' '%s Open Files' 'open files' disk %s.files stacked 20050 %d\n", type,
-                       title, type, update_every);
-        for (w = root; w; w = w->next) {
-            if (unlikely(w->exposed))
-                fprintf(stdout, "DIMENSION %s '' absolute 1 1\n", w->name);
-        }
-
-        fprintf(stdout, "CHART %s.sockets '' '%s Open Sockets' 'open sockets' net %s.sockets stacked 20051 %d\n",
-                       type, title, type, update_every);
-        for (w = root; w; w = w->next) {
-            if (unlikely(w->exposed))
-                fprintf(stdout, "DIMENSION %s '' absolute 1 1\n", w->name);
-        }
-
-        fprintf(stdout, "CHART %s.pipes '' '%s Pipes' 'open pipes' processes %s.pipes stacked 20053 %d\n", type,
-                       title, type, update_every);
-        for (w = root; w; w = w->next) {
-            if (unlikely(w->exposed))
-                fprintf(stdout, "DIMENSION %s '' absolute 1 1\n", w->name);
-        }
+        send_chart_of_targets(root, type, "files", "files", "%s Open Files", title, NULL, "open files", "disk", 20050, 1, 1, 0);
+        send_chart_of_targets(root, type, "sockets", "sockets", "%s Open Sockets", title, NULL, "open sockets", "net", 20051, 1, 1, 0);
+        send_chart_of_targets(root, type, "pipes", "pipes", "%s Pipes", title, NULL, "open pipes", "processes", 20053, 1, 1, 0);
     }
 }
 
@@ -3178,6 +3092,10 @@ int main(int argc, char **argv) {
 
     all_pids          = callocz(sizeof(struct pid_stat *), (size_t) pid_max);
 
+    output = pluginsd_client_create(stdout);
+    if(pluginsd_client_shm(output))
+        info("sending data to netdata through shared memory");
+
     usec_t step = update_every * USEC_PER_SEC;
     global_iterations_counter = 1;
     heartbeat_t hb;
@@ -3195,7 +3113,8 @@ int main(int argc, char **argv) {
 
         if(!collect_data_for_all_processes()) {
             error("Cannot collect /proc data for running processes. Disabling apps.plugin...");
-            printf("DISABLE\n");
+            pluginsd_client_printf(output, "DISABLE\n");
+            pluginsd_client_flush(output);
             exit(1);
         }
 
@@ -3221,7 +3140,10 @@ int main(int argc, char **argv) {
         if(likely(enable_groups_charts))
             send_collected_data_to_netdata(groups_root_target, "groups", dt);
 
-        fflush(stdout);
+        if(unlikely(pluginsd_client_flush(output) == -1)) {
+            error("Cannot send the collected data to netdata. Exiting...");
+            exit(1);
+        }
 
         show_guest_time_old = show_guest_time;
 
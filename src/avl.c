@@ -306,6 +306,7 @@ int avl_walker(avl *node, int (*callback)(void *entry, void *data), void *data)
 }
 
 int avl_traverse(avl_tree *t, int (*callback)(void *entry, void *data), void *data) {
+    if(!t->root) return 0;
     return avl_walker(t->root, callback, data);
 }
 
@@ -7,17 +7,21 @@
 //    (for example, once every 10 seconds)
 //
 // 2. Every time it wakes, it calls the backend formatting functions to build
-//    a buffer of data. This is a very fast, memory only operation.
+//    a batch of data. This is a very fast, memory only operation.
 //
-// 3. If the buffer already includes data, the new data are appended.
-//    If the buffer becomes too big, because the data cannot be sent, a
-//    log is written and the buffer is discarded.
+// 3. The batch is queued to the spool (backends_spool.c). If too many
+//    batches are queued, because the data cannot be sent, a log is written
+//    and the oldest batches are discarded.
 //
-// 4. Then it tries to send all the data. It blocks until all the data are sent
-//    or the socket returns an error.
-//    If the time required for this is above the interval, it starts skipping
-//    intervals, but the calculated values include the entire database, without
-//    gaps (it remembers the timestamps and continues from where it stopped).
+// 4. A sender thread writes the queued batches to the backend server, without
+//    blocking and without waiting for responses. It reconnects when the
+//    connection breaks and sends again the batch it was sending.
+//    The HTTP backends (opentsdb:http) split each batch into requests,
+//    and a few requests are sent before their responses are received -
+//    the requests not responded are sent again after a reconnection.
+//    So the formatting never waits for the backend server: the calculated
+//    values include the entire database, without gaps (it remembers the
+//    timestamps and continues from where it stopped).
 //
 // 5. repeats the above forever.
 //
@@ -260,6 +264,262 @@ static inline int process_opentsdb_response(BUFFER *b) {
     return discard_response(b, "opentsdb");
 }
 
+// the HTTP API of opentsdb gets the data points as JSON objects (/api/put)
+// each data point is formatted on its own line - the lines are put in
+// JSON arrays by backend_opentsdb_http_requests()
+
+static inline int format_dimension_collected_opentsdb_http(
+          BUFFER *b                 // the buffer to write data to
+        , const char *prefix        // the prefix to use
+        , RRDHOST *host             // the host this chart comes from
+        , const char *hostname      // the hostname (to override host->hostname)
+        , RRDSET *st                // the chart
+        , RRDDIM *rd                // the dimension
+        , time_t after              // the start timestamp
+        , time_t before             // the end timestamp
+        , uint32_t options          // BACKEND_SOURCE_* bitmap
+) {
+    (void)host;
+    (void)after;
+    (void)before;
+    (void)options;
+
+    buffer_sprintf(
+            b
+            , "{\"metric\":\"%s.%s.%s\",\"timestamp\":%u,\"value\":" COLLECTED_NUMBER_FORMAT ",\"tags\":{\"host\":\"%s\"}}\n"
+            , prefix
+            , st->id
+            , rd->id
+            , (uint32_t)rd->last_collected_time.tv_sec
+            , rd->last_collected_value
+            , hostname
+    );
+
+    return 1;
+}
+
+static inline int format_dimension_stored_opentsdb_http(
+          BUFFER *b                 // the buffer to write data to
+        , const char *prefix        // the prefix to use
+        , RRDHOST *host             // the host this chart comes from
+        , const char *hostname      // the hostname (to override host->hostname)
+        , RRDSET *st                // the chart
+        , RRDDIM *rd                // the dimension
+        , time_t after              // the start timestamp
+        , time_t before             // the end timestamp
+        , uint32_t options          // BACKEND_SOURCE_* bitmap
+) {
+    (void)host;
+
+    calculated_number value = backend_calculate_value_from_stored_data(st, rd, after, before, options);
+
+    if(!isnan(value)) {
+
+        buffer_sprintf(
+                b
+                , "{\"metric\":\"%s.%s.%s\",\"timestamp\":%u,\"value\":" CALCULATED_NUMBER_FORMAT ",\"tags\":{\"host\":\"%s\"}}\n"
+                , prefix
+                , st->id
+                , rd->id
+                , (uint32_t) before
+                , value
+                , hostname
+        );
+
+        return 1;
+    }
+    return 0;
+}
+
+// finds the end of a chunked HTTP body, starting at body
+// returns NULL when it has not been received completely, or body when it is invalid
+static inline const char *opentsdb_http_chunked_body_end(const char *body, const char *end) {
+    const char *s = body;
+
+    for(;;) {
+        const char *eol = strstr(s, "\r\n");
+        if(!eol) return NULL;
+
+        char *e;
+        size_t size = strtoul(s, &e, 16);
+        if(unlikely(e == s || (*e != '\r' && *e != ';')))
+            return body;
+
+        if(!size) {
+            // the last chunk, followed by the trailers (if any) and an empty line
+            const char *t = strstr(eol, "\r\n\r\n");
+            return (t)?t + 4:NULL;
+        }
+
+        if((size_t)(end - (eol + 2)) < size + 2) return NULL;
+        s = eol + 2 + size + 2;
+    }
+}
+
+// consumes the complete HTTP responses received
+// returns their number - each one acknowledges a request -
+// or -1 when the first one is a server error, so that its request is sent again
+// responses following a server error are left in the buffer, for the next call
+static inline int process_opentsdb_http_response(BUFFER *b) {
+    int responses = 0;
+    const char *s = buffer_tostring(b), *buffer_end = &b->buffer[b->len];
+
+    for(;;) {
+        const char *end = strstr(s, "\r\n\r\n");
+        if(!end) break;
+
+        const char *body = end + 4, *body_end = NULL;
+        int status = 0, chunked = 0;
+        size_t content_length = 0;
+
+        if(sscanf(s, "HTTP/%*s %d", &status) != 1) {
+            error("Received an invalid HTTP response from opentsdb backend. Ignoring %zu bytes.", strlen(s));
+            s += strlen(s);
+            break;
+        }
+
+        const char *h;
+        for(h = strstr(s, "\r\n"); h && h < end ; h = strstr(h + 2, "\r\n")) {
+            if(!strncasecmp(h + 2, "Content-Length:", 15))
+                content_length = strtoul(h + 17, NULL, 10);
+
+            else if(!strncasecmp(h + 2, "Transfer-Encoding:", 18)) {
+                const char *v = h + 20;
+                while(*v == ' ') v++;
+                chunked = !strncasecmp(v, "chunked", 7);
+            }
+        }
+
+        if(chunked) {
+            body_end = opentsdb_http_chunked_body_end(body, buffer_end);
+            if(!body_end) break;
+
+            if(unlikely(body_end == body)) {
+                errno = 0;
+                error("Received an invalid chunked HTTP response from opentsdb backend. Will re-connect.");
+                return -1;
+            }
+        }
+        else {
+            if((size_t)(buffer_end - body) < content_length) break;
+            body_end = body + content_length;
+        }
+
+        // 4xx are not retried, the request will be rejected again
+        int acknowledged = ((status >= 200 && status <= 299) || (status >= 400 && status <= 499));
+
+        if(unlikely(!acknowledged && responses))
+            break;
+
+        if(unlikely(status < 200 || status > 299)) {
+            char sample[1024];
+            size_t len = (size_t)(body_end - body);
+            if(len > sizeof(sample) - 1) len = sizeof(sample) - 1;
+            strncpyz(sample, body, len);
+
+            char *c;
+            for(c = sample; *c ; c++)
+                if(unlikely(!isprint(*c))) *c = ' ';
+
+            errno = 0;
+            error("opentsdb backend responded with HTTP code %d: '%s'%s", status, sample, (acknowledged)?"":" - the request will be sent again.");
+        }
+
+        if(unlikely(!acknowledged))
+            return -1;
+
+        s = body_end;
+        responses++;
+    }
+
+    // keep the incomplete response, if any
+    size_t consumed = s - b->buffer;
+    if(consumed) {
+        memmove(b->buffer, s, b->len - consumed);
+        b->len -= consumed;
+        b->buffer[b->len] = '\0';
+    }
+
+    return responses;
+}
+
+// puts the data points formatted by format_dimension_*_opentsdb_http()
+// in HTTP requests of up to batch_size data points each, and queues them
+static void backend_opentsdb_http_requests(struct backend_spool *spool, BUFFER *b, const char *host_header, size_t batch_size, int compression_level) {
+    BUFFER *body = buffer_create(1);
+    const char *s = buffer_tostring(b);
+
+    while(*s) {
+        size_t metrics = 0;
+
+        buffer_flush(body);
+        buffer_strcat(body, "[");
+
+        while(*s && metrics < batch_size) {
+            const char *eol = strchr(s, '\n');
+            if(!eol) eol = &s[strlen(s)];
+
+            size_t len = eol - s;
+            buffer_need_bytes(body, len + 2);
+            if(metrics) body->buffer[body->len++] = ',';
+            memcpy(&body->buffer[body->len], s, len);
+            body->len += len;
+
+            metrics++;
+            s = (*eol)?eol + 1:eol;
+        }
+
+        buffer_strcat(body, "]");
+
+        BUFFER *content = body, *gz = NULL;
+#ifdef NETDATA_WITH_ZLIB
+        if(compression_level > 0) {
+            gz = web_gzip_buffer(body, compression_level);
+            if(gz) content = gz;
+        }
+#else
+        (void)compression_level;
+#endif
+
+        BUFFER *request = buffer_create(content->len + 200);
+        buffer_sprintf(request,
+                "POST /api/put HTTP/1.1\r\n"
+                "Host: %s\r\n"
+                "Content-Type: application/json\r\n"
+                "%s"
+                "Content-Length: %zu\r\n"
+                "\r\n"
+                , host_header
+                , (gz)?"Content-Encoding: gzip\r\n":""
+                , content->len
+        );
+
+        buffer_need_bytes(request, content->len + 1);
+        memcpy(&request->buffer[request->len], content->buffer, content->len);
+        request->len += content->len;
+
+        if(gz) buffer_free(gz);
+
+        backend_spool_add(spool, request, metrics);
+    }
+
+    buffer_free(body);
+}
+
+// the Host header of the HTTP requests: the first destination, without its protocol
+static void backend_http_host_header(char *dst, size_t size, const char *destination) {
+    while(*destination && isspace(*destination)) destination++;
+
+    if(!strncmp(destination, "tcp:", 4) || !strncmp(destination, "udp:", 4))
+        destination += 4;
+
+    size_t i;
+    for(i = 0; i < size - 1 && destination[i] && !isspace(destination[i]) ; i++)
+        dst[i] = destination[i];
+
+    dst[i] = '\0';
+}
+
 
 // ----------------------------------------------------------------------------
 // json backend
@@ -375,16 +635,276 @@ static inline int process_json_response(BUFFER *b) {
 }
 
 
+// ----------------------------------------------------------------------------
+// the formatting workers
+//
+// On every iteration, each host is a work item, formatted into its own buffer
+// by a small pool of threads (the backend thread is one of them). A worker
+// keeps the hosts index read locked only while it finds its host and read
+// locks it (a read locked host cannot be freed), and the host read locked only
+// while it formats one chart. Between charts, it lets other threads change the
+// host and finds again the host and where it stopped, so neither host nor chart
+// creation is blocked for more than the formatting of one chart.
+
+typedef int (*backend_request_formatter_t)(BUFFER *, const char *, RRDHOST *, const char *, RRDSET *, RRDDIM *, time_t, time_t, uint32_t);
+
+struct backend_formatting_item {
+    RRDHOST *host;                      // it is only compared until found again in the hosts index
+    char machine_guid[GUID_LEN + 1];    // to tell it from another host allocated at the same address
+    uint32_t hash_machine_guid;
+    BUFFER *b;
+    size_t metrics;
+};
+
+struct backend_formatting_pool {
+    backend_request_formatter_t formatter;
+    const char *prefix;
+    const char *hostname;
+    uint32_t options;
+    time_t after;
+    time_t before;
+
+    struct backend_formatting_item *items;
+    size_t items_count;                 // the work items of this iteration
+    size_t items_size;                  // the work items allocated
+    size_t next;                        // the next work item to be taken
+    size_t done;                        // the work items completed
+
+    size_t iteration;                   // incremented to wake up the threads
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_start;
+    pthread_cond_t cond_done;
+
+    size_t threads;
+    pthread_t *thread;
+    int exit;
+};
+
+// finds the host of the item again in the hosts index and read locks it
+// returns NULL when the host has been freed
+static inline RRDHOST *backend_host_rdlock(struct backend_formatting_item *item) {
+    // hosts are freed with the hosts write locked, so it is kept only for the lookup
+    rrd_rdlock();
+
+    RRDHOST *host = rrdhost_find_by_guid(item->machine_guid, item->hash_machine_guid);
+    if(likely(host == item->host))
+        rrdhost_rdlock(host);
+    else
+        host = NULL;
+
+    rrd_unlock();
+    return host;
+}
+
+static void backend_format_host(struct backend_formatting_pool *pool, struct backend_formatting_item *item) {
+    RRDHOST *host = backend_host_rdlock(item);
+    if(unlikely(!host))
+        return;
+
+    const char *hostname = (host == localhost)?pool->hostname:host->hostname;
+    char id[RRD_ID_LENGTH_MAX + 1];
+
+    RRDSET *st = host->rrdset_root;
+    while(st) {
+        if(likely(st->backend_formatted_t != pool->before)) {
+            rrdset_rdlock(st);
+
+            RRDDIM *rd;
+            rrddim_foreach_read(rd, st) {
+                if(rd->last_collected_time.tv_sec >= pool->after)
+                    item->metrics += pool->formatter(item->b, pool->prefix, host, hostname, st, rd, pool->after, pool->before, pool->options);
+            }
+
+            rrdset_unlock(st);
+            st->backend_formatted_t = pool->before;
+        }
+
+        // let others change the host, between charts
+        RRDSET *last = st;
+        strncpyz(id, st->id, RRD_ID_LENGTH_MAX);
+
+        rrdhost_unlock(host);
+        if(unlikely(!backend_host_rdlock(item)))
+            return;
+
+        // if the chart is gone, start over, skipping the charts already formatted
+        st = rrdset_find(host, id);
+        st = (st == last)?st->next:host->rrdset_root;
+    }
+
+    rrdhost_unlock(host);
+}
+
+// it has to be called with the pool mutex held
+static void backend_formatting_work(struct backend_formatting_pool *pool) {
+    int pthreadoldcancelstate;
+
+    if(unlikely(pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &pthreadoldcancelstate) != 0))
+        error("Cannot set pthread cancel state to DISABLE.");
+
+    while(pool->next < pool->items_count) {
+        struct backend_formatting_item *item = &pool->items[pool->next++];
+
+        pthread_mutex_unlock(&pool->mutex);
+        backend_format_host(pool, item);
+        pthread_mutex_lock(&pool->mutex);
+
+        if(++pool->done == pool->items_count)
+            pthread_cond_signal(&pool->cond_done);
+    }
+
+    if(unlikely(pthread_setcancelstate(pthreadoldcancelstate, NULL) != 0))
+        error("Cannot set pthread cancel state to RESTORE (%d).", pthreadoldcancelstate);
+}
+
+static void *backend_formatting_thread(void *ptr) {
+    struct backend_formatting_pool *pool = (struct backend_formatting_pool *)ptr;
+
+    info("BACKEND formatting thread created with task id %d", gettid());
+
+    pthread_mutex_lock(&pool->mutex);
+
+    size_t iteration = pool->iteration;
+    while(!pool->exit) {
+        if(iteration == pool->iteration) {
+            pthread_cond_wait(&pool->cond_start, &pool->mutex);
+            continue;
+        }
+
+        iteration = pool->iteration;
+        backend_formatting_work(pool);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    info("BACKEND formatting thread exiting");
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+static void backend_formatting_pool_init(struct backend_formatting_pool *pool, size_t threads, backend_request_formatter_t formatter, const char *prefix, const char *hostname, uint32_t options) {
+    pool->formatter = formatter;
+    pool->prefix = prefix;
+    pool->hostname = hostname;
+    pool->options = options;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond_start, NULL);
+    pthread_cond_init(&pool->cond_done, NULL);
+
+    // the backend thread is one of them
+    if(threads > 1) {
+        pool->thread = callocz(threads - 1, sizeof(pthread_t));
+
+        size_t i;
+        for(i = 0; i < threads - 1 ; i++) {
+            if(pthread_create(&pool->thread[pool->threads], NULL, backend_formatting_thread, (void *)pool)) {
+                error("BACKEND: failed to create formatting thread %zu.", i);
+                break;
+            }
+            pool->threads++;
+        }
+    }
+}
+
+static void backend_formatting_pool_cleanup(struct backend_formatting_pool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->exit = 1;
+    pthread_cond_broadcast(&pool->cond_start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    size_t i;
+    for(i = 0; i < pool->threads ; i++)
+        if(pthread_join(pool->thread[i], NULL))
+            error("BACKEND: cannot join formatting thread %zu.", i);
+
+    for(i = 0; i < pool->items_size ; i++)
+        buffer_free(pool->items[i].b);
+
+    freez(pool->items);
+    freez(pool->thread);
+
+    pthread_cond_destroy(&pool->cond_done);
+    pthread_cond_destroy(&pool->cond_start);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+// formats the metrics of all hosts between after and before, and appends them to b
+// returns the number of metrics formatted
+static size_t backend_formatting_pool_run(struct backend_formatting_pool *pool, BUFFER *b, time_t after, time_t before) {
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->after = after;
+    pool->before = before;
+    pool->items_count = 0;
+
+    rrd_rdlock();
+    RRDHOST *host;
+    rrdhost_foreach_read(host) {
+        if(host->rrd_memory_mode == RRD_MEMORY_MODE_NONE)
+            continue;
+
+        if(unlikely(pool->items_count == pool->items_size)) {
+            pool->items_size = (pool->items_size)?pool->items_size * 2:16;
+            pool->items = reallocz(pool->items, pool->items_size * sizeof(struct backend_formatting_item));
+
+            size_t i;
+            for(i = pool->items_count; i < pool->items_size ; i++)
+                pool->items[i].b = buffer_create(1);
+        }
+
+        struct backend_formatting_item *item = &pool->items[pool->items_count++];
+        item->host = host;
+        strncpyz(item->machine_guid, host->machine_guid, GUID_LEN);
+        item->hash_machine_guid = host->hash_machine_guid;
+        item->metrics = 0;
+        buffer_flush(item->b);
+    }
+    rrd_unlock();
+
+    pool->next = 0;
+    pool->done = 0;
+    pool->iteration++;
+    pthread_cond_broadcast(&pool->cond_start);
+
+    backend_formatting_work(pool);
+
+    while(pool->done < pool->items_count)
+        pthread_cond_wait(&pool->cond_done, &pool->mutex);
+
+    size_t i, metrics = 0;
+    for(i = 0; i < pool->items_count ; i++) {
+        struct backend_formatting_item *item = &pool->items[i];
+        size_t len = buffer_strlen(item->b);
+
+        if(len) {
+            buffer_need_bytes(b, len + 1);
+            memcpy(&b->buffer[b->len], item->b->buffer, len);
+            b->len += len;
+            b->buffer[b->len] = '\0';
+        }
+
+        metrics += item->metrics;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return metrics;
+}
+
+
 // ----------------------------------------------------------------------------
 // the backend thread
 
 void *backends_main(void *ptr) {
     int default_port = 0;
-    int sock = -1;
     struct netdata_static_thread *static_thread = (struct netdata_static_thread *)ptr;
 
-    BUFFER *b = buffer_create(1), *response = buffer_create(1);
-    int (*backend_request_formatter)(BUFFER *, const char *, RRDHOST *, const char *, RRDSET *, RRDDIM *, time_t, time_t, uint32_t) = NULL;
+    struct backend_spool *spool = NULL;
+    struct backend_formatting_pool pool = { 0 };
+    int pool_initialized = 0;
+    backend_request_formatter_t backend_request_formatter = NULL;
     int (*backend_response_checker)(BUFFER *) = NULL;
 
     info("BACKEND thread created with task id %d", gettid());
@@ -412,6 +932,11 @@ void *backends_main(void *ptr) {
     int frequency           = (int)config_get_number(CONFIG_SECTION_BACKEND, "update every", 10);
     int buffer_on_failures  = (int)config_get_number(CONFIG_SECTION_BACKEND, "buffer on failures", 10);
     long timeoutms          = config_get_number(CONFIG_SECTION_BACKEND, "timeout ms", frequency * 2 * 1000);
+    int formatting_threads  = (int)config_get_number(CONFIG_SECTION_BACKEND, "formatting threads", (processors < 4)?processors:4);
+    int http_requests       = 0;
+    long http_batch_size    = 0;
+    int http_compression    = 0;
+    char http_host[HOSTNAME_MAX + 1] = "";
 
     // ------------------------------------------------------------------------
     // validate configuration options
@@ -467,6 +992,39 @@ void *backends_main(void *ptr) {
             backend_request_formatter = format_dimension_stored_opentsdb_telnet;
 
     }
+    else if(!strcmp(type, "opentsdb:http")) {
+
+        default_port = 4242;
+        backend_response_checker = process_opentsdb_http_response;
+
+        if(options == BACKEND_SOURCE_DATA_AS_COLLECTED)
+            backend_request_formatter = format_dimension_collected_opentsdb_http;
+        else
+            backend_request_formatter = format_dimension_stored_opentsdb_http;
+
+        // the data points per request, the requests sent before their responses
+        // are received, and the gzip level of the requests (0 to disable it)
+        http_batch_size  = config_get_number(CONFIG_SECTION_BACKEND, "http batch size", 50);
+        http_requests    = (int)config_get_number(CONFIG_SECTION_BACKEND, "http concurrent requests", 4);
+        http_compression = (int)config_get_number(CONFIG_SECTION_BACKEND, "http compression level", 1);
+
+        if(http_batch_size < 1) {
+            error("BACKEND invalid http batch size %ld given. Assuming 50.", http_batch_size);
+            http_batch_size = 50;
+        }
+
+        if(http_requests < 1) {
+            error("BACKEND invalid http concurrent requests %d given. Assuming 1.", http_requests);
+            http_requests = 1;
+        }
+
+        if(http_compression < 0 || http_compression > 9) {
+            error("BACKEND invalid http compression level %d given. Assuming 1.", http_compression);
+            http_compression = 1;
+        }
+
+        backend_http_host_header(http_host, HOSTNAME_MAX, destination);
+    }
     else if (!strcmp(type, "json") || !strcmp(type, "json:plaintext")) {
 
         default_port = 5448;
@@ -488,26 +1046,30 @@ void *backends_main(void *ptr) {
         goto cleanup;
     }
 
+    if(buffer_on_failures < 1) {
+        error("BACKEND invalid buffer on failures %d given. Assuming 1.", buffer_on_failures);
+        buffer_on_failures = 1;
+    }
+
+    if(formatting_threads < 1) {
+        error("BACKEND invalid formatting threads %d given. Assuming 1.", formatting_threads);
+        formatting_threads = 1;
+    }
+
+    spool = backend_spool_create(destination, default_port, &timeout, backend_response_checker, (size_t)buffer_on_failures, (size_t)http_requests, (usec_t)frequency * USEC_PER_SEC);
+    if(!spool) {
+        error("backend cannot start sending data - disabling it.");
+        goto cleanup;
+    }
+
 
     // ------------------------------------------------------------------------
     // prepare the charts for monitoring the backend operation
 
     struct rusage thread;
 
-    collected_number
-            chart_buffered_metrics = 0,
-            chart_lost_metrics = 0,
-            chart_sent_metrics = 0,
-            chart_buffered_bytes = 0,
-            chart_received_bytes = 0,
-            chart_sent_bytes = 0,
-            chart_receptions = 0,
-            chart_transmission_successes = 0,
-            chart_transmission_failures = 0,
-            chart_data_lost_events = 0,
-            chart_lost_bytes = 0,
-            chart_backend_reconnects = 0,
-            chart_backend_latency = 0;
+    struct backend_spool_stats stats;
+    size_t buffered_metrics, buffered_bytes;
 
     RRDSET *chart_metrics = rrdset_create_localhost("netdata", "backend_metrics", NULL, "backend", NULL, "Netdata Buffered Metrics", "metrics", 130600, frequency, RRDSET_TYPE_LINE);
     rrddim_add(chart_metrics, "buffered", NULL,  1, 1, RRD_ALGORITHM_ABSOLUTE);
@@ -546,11 +1108,14 @@ void *backends_main(void *ptr) {
     // ------------------------------------------------------------------------
     // prepare the backend main loop
 
-    info("BACKEND configured ('%s' on '%s' sending '%s' data, every %d seconds, as host '%s', with prefix '%s')", type, destination, source, frequency, hostname, prefix);
+    info("BACKEND configured ('%s' on '%s' sending '%s' data, every %d seconds, as host '%s', with prefix '%s', using %d formatting threads)", type, destination, source, frequency, hostname, prefix, formatting_threads);
+
+    backend_formatting_pool_init(&pool, (size_t)formatting_threads, backend_request_formatter, prefix, hostname, options);
+    pool_initialized = 1;
 
     usec_t step_ut = frequency * USEC_PER_SEC;
     time_t after = now_realtime_sec();
-    int failures = 0;
+    size_t batch_size = 1;
     heartbeat_t hb;
     heartbeat_init(&hb);
 
@@ -563,56 +1128,15 @@ void *backends_main(void *ptr) {
 
 
         // ------------------------------------------------------------------------
-        // add to the buffer the data we need to send to the backend
-
-        int pthreadoldcancelstate;
-
-        if(unlikely(pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &pthreadoldcancelstate) != 0))
-            error("Cannot set pthread cancel state to DISABLE.");
-
-        rrd_rdlock();
-        RRDHOST *host;
-        rrdhost_foreach_read(host) {
-            if(host->rrd_memory_mode == RRD_MEMORY_MODE_NONE)
-                continue;
-
-            rrdhost_rdlock(host);
+        // format a batch of the data we need to send to the backend
 
-            RRDSET *st;
-            rrdset_foreach_read(st, host) {
-                rrdset_rdlock(st);
+        BUFFER *b = buffer_create(batch_size);
+        size_t metrics = backend_formatting_pool_run(&pool, b, after, before);
 
-                RRDDIM *rd;
-                rrddim_foreach_read(rd, st) {
-                    if(rd->last_collected_time.tv_sec >= after)
-                        chart_buffered_metrics += backend_request_formatter(b, prefix, host, (host == localhost)?hostname:host->hostname, st, rd, after, before, options);
-                }
-                rrdset_unlock(st);
-            }
-            rrdhost_unlock(host);
+        if(unlikely(netdata_exit)) {
+            buffer_free(b);
+            break;
         }
-        rrd_unlock();
-
-        if(unlikely(pthread_setcancelstate(pthreadoldcancelstate, NULL) != 0))
-            error("Cannot set pthread cancel state to RESTORE (%d).", pthreadoldcancelstate);
-
-        // ------------------------------------------------------------------------
-
-        chart_buffered_bytes = (collected_number)buffer_strlen(b);
-
-        // reset the monitoring chart counters
-        chart_received_bytes =
-        chart_sent_bytes =
-        chart_sent_metrics =
-        chart_lost_metrics =
-        chart_transmission_successes =
-        chart_transmission_failures =
-        chart_data_lost_events =
-        chart_lost_bytes =
-        chart_backend_reconnects =
-        chart_backend_latency = 0;
-
-        if(unlikely(netdata_exit)) break;
 
         //fprintf(stderr, "\nBACKEND BEGIN:\n%s\nBACKEND END\n", buffer_tostring(b)); // FIXME
         //fprintf(stderr, "after = %lu, before = %lu\n", after, before);
@@ -622,164 +1146,67 @@ void *backends_main(void *ptr) {
         after = before;
 
         // ------------------------------------------------------------------------
-        // if we are connected, receive a response, without blocking
+        // give it to the sender thread
 
-        if(likely(sock != -1)) {
-            errno = 0;
-
-            // loop through to collect all data
-            while(sock != -1 && errno != EWOULDBLOCK) {
-                buffer_need_bytes(response, 4096);
-
-                ssize_t r = recv(sock, &response->buffer[response->len], response->size - response->len, MSG_DONTWAIT);
-                if(likely(r > 0)) {
-                    // we received some data
-                    response->len += r;
-                    chart_received_bytes += r;
-                    chart_receptions++;
-                }
-                else if(r == 0) {
-                    error("Backend '%s' closed the socket", destination);
-                    close(sock);
-                    sock = -1;
-                }
-                else {
-                    // failed to receive data
-                    if(errno != EAGAIN && errno != EWOULDBLOCK) {
-                        error("Cannot receive data from backend '%s'.", destination);
-                    }
-                }
-            }
-
-            // if we received data, process them
-            if(buffer_strlen(response))
-                backend_response_checker(response);
-        }
-
-        // ------------------------------------------------------------------------
-        // if we are not connected, connect to a backend server
-
-        if(unlikely(sock == -1)) {
-            usec_t start_ut = now_monotonic_usec();
-            size_t reconnects = 0;
-
-            sock = connect_to_one_of(destination, default_port, &timeout, &reconnects, NULL, 0);
-
-            chart_backend_reconnects += reconnects;
-            chart_backend_latency += now_monotonic_usec() - start_ut;
-        }
-
-        if(unlikely(netdata_exit)) break;
-
-        // ------------------------------------------------------------------------
-        // if we are connected, send our buffer to the backend server
-
-        if(likely(sock != -1)) {
-            size_t len = buffer_strlen(b);
-            usec_t start_ut = now_monotonic_usec();
-            int flags = 0;
-#ifdef MSG_NOSIGNAL
-            flags += MSG_NOSIGNAL;
-#endif
+        if(likely(buffer_strlen(b))) {
+            // the next batch will probably be of the same size
+            batch_size = buffer_strlen(b) + 1;
 
-            ssize_t written = send(sock, buffer_tostring(b), len, flags);
-            chart_backend_latency += now_monotonic_usec() - start_ut;
-            if(written != -1 && (size_t)written == len) {
-                // we sent the data successfully
-                chart_transmission_successes++;
-                chart_sent_bytes += written;
-                chart_sent_metrics = chart_buffered_metrics;
+            if(http_batch_size) {
+                // each iteration is sent with many requests,
+                // so buffer on failures is converted to requests
+                size_t requests = (metrics + http_batch_size - 1) / http_batch_size;
+                backend_spool_set_max_batches(spool, (size_t)buffer_on_failures * ((requests)?requests:1));
 
-                // reset the failures count
-                failures = 0;
-
-                // empty the buffer
-                buffer_flush(b);
-            }
-            else {
-                // oops! we couldn't send (all or some of the) data
-                error("Failed to write data to database backend '%s'. Willing to write %zu bytes, wrote %zd bytes. Will re-connect.", destination, len, written);
-                chart_transmission_failures++;
-
-                if(written != -1)
-                    chart_sent_bytes += written;
-
-                // increment the counter we check for data loss
-                failures++;
-
-                // close the socket - we will re-open it next time
-                close(sock);
-                sock = -1;
+                backend_opentsdb_http_requests(spool, b, http_host, (size_t)http_batch_size, http_compression);
+                buffer_free(b);
             }
+            else
+                backend_spool_add(spool, b, metrics);
         }
-        else {
-            error("Failed to update database backend '%s'", destination);
-            chart_transmission_failures++;
-
-            // increment the counter we check for data loss
-            failures++;
-        }
-
-        if(failures > buffer_on_failures) {
-            // too bad! we are going to lose data
-            chart_lost_bytes += buffer_strlen(b);
-            error("Reached %d backend failures. Flushing buffers to protect this host - this results in data loss on back-end server '%s'", failures, destination);
-            buffer_flush(b);
-            failures = 0;
-            chart_data_lost_events++;
-            chart_lost_metrics = chart_buffered_metrics;
-        }
-
-        if(unlikely(netdata_exit)) break;
+        else
+            buffer_free(b);
 
         // ------------------------------------------------------------------------
         // update the monitoring charts
 
+        backend_spool_stats(spool, &stats, &buffered_metrics, &buffered_bytes);
+
         if(likely(chart_ops->counter_done)) rrdset_next(chart_ops);
-        rrddim_set(chart_ops, "read",         chart_receptions);
-        rrddim_set(chart_ops, "write",        chart_transmission_successes);
-        rrddim_set(chart_ops, "discard",      chart_data_lost_events);
-        rrddim_set(chart_ops, "failure",      chart_transmission_failures);
-        rrddim_set(chart_ops, "reconnect",    chart_backend_reconnects);
+        rrddim_set(chart_ops, "read",         (collected_number)stats.receptions);
+        rrddim_set(chart_ops, "write",        (collected_number)stats.transmission_successes);
+        rrddim_set(chart_ops, "discard",      (collected_number)stats.data_lost_events);
+        rrddim_set(chart_ops, "failure",      (collected_number)stats.transmission_failures);
+        rrddim_set(chart_ops, "reconnect",    (collected_number)stats.reconnects);
         rrdset_done(chart_ops);
 
         if(likely(chart_metrics->counter_done)) rrdset_next(chart_metrics);
-        rrddim_set(chart_metrics, "buffered", chart_buffered_metrics);
-        rrddim_set(chart_metrics, "lost",     chart_lost_metrics);
-        rrddim_set(chart_metrics, "sent",     chart_sent_metrics);
+        rrddim_set(chart_metrics, "buffered", (collected_number)buffered_metrics);
+        rrddim_set(chart_metrics, "lost",     (collected_number)stats.lost_metrics);
+        rrddim_set(chart_metrics, "sent",     (collected_number)stats.sent_metrics);
         rrdset_done(chart_metrics);
 
         if(likely(chart_bytes->counter_done)) rrdset_next(chart_bytes);
-        rrddim_set(chart_bytes, "buffered",   chart_buffered_bytes);
-        rrddim_set(chart_bytes, "lost",       chart_lost_bytes);
-        rrddim_set(chart_bytes, "sent",       chart_sent_bytes);
-        rrddim_set(chart_bytes, "received",   chart_received_bytes);
+        rrddim_set(chart_bytes, "buffered",   (collected_number)buffered_bytes);
+        rrddim_set(chart_bytes, "lost",       (collected_number)stats.lost_bytes);
+        rrddim_set(chart_bytes, "sent",       (collected_number)stats.sent_bytes);
+        rrddim_set(chart_bytes, "received",   (collected_number)stats.received_bytes);
         rrdset_done(chart_bytes);
 
-        /*
-        if(likely(chart_latency->counter_done)) rrdset_next(chart_latency);
-        rrddim_set(chart_latency, "latency",  chart_backend_latency);
-        rrdset_done(chart_latency);
-        */
-
         getrusage(RUSAGE_THREAD, &thread);
         if(likely(chart_rusage->counter_done)) rrdset_next(chart_rusage);
         rrddim_set(chart_rusage, "user",   thread.ru_utime.tv_sec * 1000000ULL + thread.ru_utime.tv_usec);
         rrddim_set(chart_rusage, "system", thread.ru_stime.tv_sec * 1000000ULL + thread.ru_stime.tv_usec);
         rrdset_done(chart_rusage);
 
-        if(likely(buffer_strlen(b) == 0))
-            chart_buffered_metrics = 0;
-
         if(unlikely(netdata_exit)) break;
     }
 
 cleanup:
-    if(sock != -1)
-        close(sock);
+    if(pool_initialized)
+        backend_formatting_pool_cleanup(&pool);
 
-    buffer_free(b);
-    buffer_free(response);
+    backend_spool_free(spool);
 
     info("BACKEND thread exiting");
 
@@ -0,0 +1,472 @@
+#include "common.h"
+
+static inline void backend_batch_free(struct backend_batch *bt) {
+    buffer_free(bt->b);
+    freez(bt);
+}
+
+// ----------------------------------------------------------------------------
+// waking up the sender
+
+static inline void backend_spool_wakeup(struct backend_spool *s) {
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t one = 1;
+    if(write(s->fd[1], &one, sizeof(one)) == -1 && errno != EAGAIN)
+#else
+    if(write(s->fd[1], " ", 1) == -1 && errno != EAGAIN)
+#endif
+        error("BACKEND: cannot wake up the sender thread.");
+}
+
+static inline void backend_spool_wakeup_received(struct backend_spool *s) {
+    char buffer[1000];
+    if(read(s->fd[0], buffer, sizeof(buffer)) == -1 && errno != EAGAIN)
+        error("BACKEND: cannot read the wake ups of the sender thread.");
+}
+
+// ----------------------------------------------------------------------------
+// the queue
+
+void backend_spool_add(struct backend_spool *s, BUFFER *b, size_t metrics) {
+    struct backend_batch *bt = callocz(1, sizeof(struct backend_batch));
+    bt->b = b;
+    bt->metrics = metrics;
+
+    size_t dropped = 0;
+
+    pthread_mutex_lock(&s->mutex);
+
+    if(s->last) s->last->next = bt;
+    else s->first = bt;
+    s->last = bt;
+
+    s->batches++;
+    s->buffered_metrics += metrics;
+    s->buffered_bytes += buffer_strlen(b);
+
+    while(s->batches > s->max_batches) {
+        struct backend_batch *t = s->first;
+        s->first = t->next;
+        if(!s->first) s->last = NULL;
+        s->batches--;
+
+        s->buffered_metrics -= t->metrics;
+        s->buffered_bytes -= buffer_strlen(t->b);
+        s->stats.lost_metrics += t->metrics;
+        s->stats.lost_bytes += buffer_strlen(t->b);
+        s->stats.data_lost_events++;
+
+        backend_batch_free(t);
+        dropped++;
+    }
+
+    pthread_mutex_unlock(&s->mutex);
+
+    if(unlikely(dropped))
+        error("BACKEND: %zu batches have not been sent to backend '%s' for too long. Dropped them to protect this host - this results in data loss on the backend server.", dropped, s->destination);
+
+    backend_spool_wakeup(s);
+}
+
+static inline struct backend_batch *backend_spool_get(struct backend_spool *s) {
+    pthread_mutex_lock(&s->mutex);
+
+    struct backend_batch *bt = s->first;
+    if(bt) {
+        s->first = bt->next;
+        if(!s->first) s->last = NULL;
+        s->batches--;
+        bt->next = NULL;
+    }
+
+    pthread_mutex_unlock(&s->mutex);
+    return bt;
+}
+
+static inline void backend_spool_sent(struct backend_spool *s, struct backend_batch *bt) {
+    pthread_mutex_lock(&s->mutex);
+    s->buffered_metrics -= bt->metrics;
+    s->buffered_bytes -= buffer_strlen(bt->b);
+    s->stats.sent_metrics += bt->metrics;
+    s->stats.transmission_successes++;
+    pthread_mutex_unlock(&s->mutex);
+
+    backend_batch_free(bt);
+}
+
+// a batch has been written completely - it is sent, or it waits for its response
+static inline void backend_spool_written(struct backend_spool *s, struct backend_batch *bt) {
+    if(!s->max_in_flight) {
+        backend_spool_sent(s, bt);
+        return;
+    }
+
+    if(s->in_flight_last) s->in_flight_last->next = bt;
+    else s->in_flight_first = bt;
+    s->in_flight_last = bt;
+    s->in_flight++;
+}
+
+// the backend server responded to the oldest batches in flight
+static inline void backend_spool_acknowledged(struct backend_spool *s, size_t acks) {
+    while(acks-- && s->in_flight_first) {
+        struct backend_batch *bt = s->in_flight_first;
+        s->in_flight_first = bt->next;
+        if(!s->in_flight_first) s->in_flight_last = NULL;
+        s->in_flight--;
+
+        bt->next = NULL;
+        backend_spool_sent(s, bt);
+    }
+}
+
+// puts the batches in flight and the one being sent back in front of the queue,
+// so that they are sent first on the next connection
+static inline void backend_spool_requeue(struct backend_spool *s, struct backend_batch **bt) {
+    struct backend_batch *first = s->in_flight_first, *last = s->in_flight_last;
+    size_t count = s->in_flight;
+
+    s->in_flight_first = s->in_flight_last = NULL;
+    s->in_flight = 0;
+
+    if(*bt) {
+        if(last) last->next = *bt;
+        else first = *bt;
+        last = *bt;
+        count++;
+        *bt = NULL;
+    }
+
+    if(!first) return;
+
+    pthread_mutex_lock(&s->mutex);
+    last->next = s->first;
+    s->first = first;
+    if(!s->last) s->last = last;
+    s->batches += count;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+void backend_spool_set_max_batches(struct backend_spool *s, size_t max_batches) {
+    pthread_mutex_lock(&s->mutex);
+    s->max_batches = (max_batches)?max_batches:1;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+void backend_spool_stats(struct backend_spool *s, struct backend_spool_stats *stats, size_t *buffered_metrics, size_t *buffered_bytes) {
+    pthread_mutex_lock(&s->mutex);
+    *stats = s->stats;
+    memset(&s->stats, 0, sizeof(struct backend_spool_stats));
+    *buffered_metrics = s->buffered_metrics;
+    *buffered_bytes = s->buffered_bytes;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+#define backend_spool_stats_add(s, field, value) do { \
+    pthread_mutex_lock(&(s)->mutex); \
+    (s)->stats.field += (value); \
+    pthread_mutex_unlock(&(s)->mutex); \
+} while(0)
+
+// ----------------------------------------------------------------------------
+// the sender thread
+
+static inline void backend_spool_disconnect(struct backend_spool *s, int *sock, struct backend_batch **bt, BUFFER *response) {
+    backend_spool_stats_add(s, transmission_failures, 1);
+    close(*sock);
+    *sock = -1;
+
+    backend_spool_requeue(s, bt);
+    buffer_flush(response);
+}
+
+// receives whatever the backend server sent, without blocking
+// returns the number of batches acknowledged
+static inline size_t backend_spool_receive(struct backend_spool *s, int *sock, struct backend_batch **bt, BUFFER *response) {
+    int failed = 0;
+
+    for(;;) {
+        buffer_need_bytes(response, 4096);
+
+        ssize_t r = recv(*sock, &response->buffer[response->len], response->size - response->len - 1, MSG_DONTWAIT);
+        if(likely(r > 0)) {
+            // we received some data
+            response->len += r;
+            response->buffer[response->len] = '\0';
+            pthread_mutex_lock(&s->mutex);
+            s->stats.received_bytes += r;
+            s->stats.receptions++;
+            pthread_mutex_unlock(&s->mutex);
+        }
+        else if(r == 0) {
+            error("Backend '%s' closed the socket", s->destination);
+            failed = 1;
+            break;
+        }
+        else {
+            // failed to receive data
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                error("Cannot receive data from backend '%s'. Will re-connect.", s->destination);
+                failed = 1;
+            }
+            break;
+        }
+    }
+
+    // if we received data, process them
+    // (the responses received before a disconnection still acknowledge their batches)
+    // the response checker returns -1 when the batch has to be sent again
+    size_t acks = 0;
+    while(buffer_strlen(response)) {
+        int ret = s->response_checker(response);
+        if(unlikely(ret < 0)) {
+            failed = 1;
+            break;
+        }
+
+        if(!s->max_in_flight || !ret)
+            break;
+
+        acks += (size_t)ret;
+        backend_spool_acknowledged(s, (size_t)ret);
+    }
+
+    if(unlikely(failed))
+        backend_spool_disconnect(s, sock, bt, response);
+
+    return acks;
+}
+
+static void *backend_spool_sender_thread(void *ptr) {
+    struct backend_spool *s = (struct backend_spool *)ptr;
+
+    info("BACKEND sender thread created with task id %d", gettid());
+
+    if(pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL) != 0)
+        error("Cannot set pthread cancel type to DEFERRED.");
+
+    if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
+        error("Cannot set pthread cancel state to ENABLE.");
+
+    int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+
+    int sock = -1;
+    struct backend_batch *bt = NULL;    // the batch being sent
+    size_t offset = 0;                  // the bytes of it sent on this connection
+    BUFFER *response = buffer_create(1);
+
+    usec_t timeout_ut = s->timeout.tv_sec * USEC_PER_SEC + s->timeout.tv_usec;
+    usec_t retry_ut = 0, retry_delay_ut = 0, last_progress_ut = 0;
+
+    while(!s->exit && !netdata_exit) {
+        if(!bt && (!s->max_in_flight || s->in_flight < s->max_in_flight)) {
+            bt = backend_spool_get(s);
+            offset = 0;
+
+            // the time without progress is counted while something is pending
+            if(!s->in_flight) last_progress_ut = now_monotonic_usec();
+        }
+
+        // ------------------------------------------------------------------------
+        // connect, only when there is something to send
+
+        if(unlikely(sock == -1 && bt && now_monotonic_usec() >= retry_ut)) {
+            size_t reconnects = 0;
+
+            sock = connect_to_one_of(s->destination, s->default_port, &s->timeout, &reconnects, NULL, 0);
+            backend_spool_stats_add(s, reconnects, reconnects);
+
+            if(unlikely(sock == -1)) {
+                retry_delay_ut = (retry_delay_ut)?retry_delay_ut * 2:USEC_PER_SEC;
+                if(retry_delay_ut > s->max_retry_ut) retry_delay_ut = s->max_retry_ut;
+                retry_ut = now_monotonic_usec() + retry_delay_ut;
+
+                error("Failed to connect to backend '%s'. Will retry in %llu ms.", s->destination, retry_delay_ut / USEC_PER_MS);
+                backend_spool_stats_add(s, transmission_failures, 1);
+            }
+            else {
+                if(fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) == -1)
+                    error("Cannot set non-blocking mode on the socket of backend '%s'.", s->destination);
+
+                // a batch is sent again from its beginning, on a new connection
+                retry_delay_ut = 0;
+                offset = 0;
+                last_progress_ut = now_monotonic_usec();
+            }
+        }
+
+        // ------------------------------------------------------------------------
+        // send as many batches as the socket accepts
+
+        while(sock != -1 && bt) {
+            size_t len = buffer_strlen(bt->b);
+
+            ssize_t written = (offset < len)?send(sock, &bt->b->buffer[offset], len - offset, flags):0;
+            if(likely(written >= 0)) {
+                offset += written;
+                last_progress_ut = now_monotonic_usec();
+                backend_spool_stats_add(s, sent_bytes, (size_t)written);
+
+                if(offset >= len) {
+                    backend_spool_written(s, bt);
+                    bt = (!s->max_in_flight || s->in_flight < s->max_in_flight)?backend_spool_get(s):NULL;
+                    offset = 0;
+                }
+            }
+            else if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                break;
+
+            else {
+                error("Failed to write data to database backend '%s'. Willing to write %zu bytes, wrote %zu bytes. Will re-connect.", s->destination, len, offset);
+                backend_spool_disconnect(s, &sock, &bt, response);
+            }
+        }
+
+        if(unlikely(sock != -1 && (bt || s->in_flight) && now_monotonic_usec() - last_progress_ut > timeout_ut)) {
+            error("Backend '%s' has not accepted or acknowledged any data for %llu ms. Will re-connect.", s->destination, timeout_ut / USEC_PER_MS);
+            backend_spool_disconnect(s, &sock, &bt, response);
+        }
+
+        // ------------------------------------------------------------------------
+        // wait for the socket, the next batch, or the next connection attempt
+
+        struct pollfd fds[2];
+        nfds_t fdmax = 1;
+        int timeout = 1000;
+
+        fds[0].fd = s->fd[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        if(sock != -1) {
+            fds[1].fd = sock;
+            fds[1].events = POLLIN | ((bt)?POLLOUT:0);
+            fds[1].revents = 0;
+            fdmax = 2;
+        }
+        else if(bt) {
+            usec_t now_ut = now_monotonic_usec();
+            timeout = (retry_ut > now_ut)?(int)((retry_ut - now_ut) / USEC_PER_MS):0;
+        }
+
+        if(s->exit || netdata_exit) break;
+        int retval = poll(fds, fdmax, timeout);
+        if(s->exit || netdata_exit) break;
+
+        if(unlikely(retval == -1)) {
+            if(errno == EAGAIN || errno == EINTR)
+                continue;
+
+            error("BACKEND: failed to poll().");
+            break;
+        }
+
+        if(fds[0].revents & POLLIN)
+            backend_spool_wakeup_received(s);
+
+        if(fdmax == 2) {
+            if(fds[1].revents & POLLIN) {
+                if(backend_spool_receive(s, &sock, &bt, response))
+                    last_progress_ut = now_monotonic_usec();
+            }
+
+            else if(fds[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                error("Backend '%s' closed the socket", s->destination);
+                backend_spool_disconnect(s, &sock, &bt, response);
+            }
+        }
+    }
+
+    if(sock != -1)
+        close(sock);
+
+    if(bt)
+        backend_batch_free(bt);
+
+    while(s->in_flight_first) {
+        bt = s->in_flight_first;
+        s->in_flight_first = bt->next;
+        backend_batch_free(bt);
+    }
+    s->in_flight_last = NULL;
+    s->in_flight = 0;
+
+    buffer_free(response);
+
+    info("BACKEND sender thread exiting");
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// create / free
+
+struct backend_spool *backend_spool_create(const char *destination, int default_port, struct timeval *timeout, int (*response_checker)(BUFFER *), size_t max_batches, size_t max_in_flight, usec_t max_retry_ut) {
+    struct backend_spool *s = callocz(1, sizeof(struct backend_spool));
+
+    s->destination = destination;
+    s->default_port = default_port;
+    s->timeout = *timeout;
+    s->response_checker = response_checker;
+    s->max_batches = (max_batches)?max_batches:1;
+    s->max_in_flight = max_in_flight;
+    s->max_retry_ut = (max_retry_ut > USEC_PER_SEC)?max_retry_ut:USEC_PER_SEC;
+
+    pthread_mutex_init(&s->mutex, NULL);
+
+#ifdef HAVE_SYS_EVENTFD_H
+    s->fd[0] = s->fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(s->fd[0] == -1) {
+        error("BACKEND: cannot create the eventfd of the sender thread.");
+        goto failed;
+    }
+#else
+    if(pipe(s->fd) == -1) {
+        error("BACKEND: cannot create the pipe of the sender thread.");
+        goto failed;
+    }
+
+    fcntl(s->fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(s->fd[1], F_SETFL, O_NONBLOCK);
+#endif
+
+    if(pthread_create(&s->thread, NULL, backend_spool_sender_thread, (void *)s)) {
+        error("BACKEND: failed to create the sender thread.");
+        close(s->fd[0]);
+        if(s->fd[1] != s->fd[0]) close(s->fd[1]);
+        goto failed;
+    }
+
+    return s;
+
+failed:
+    pthread_mutex_destroy(&s->mutex);
+    freez(s);
+    return NULL;
+}
+
+void backend_spool_free(struct backend_spool *s) {
+    if(!s) return;
+
+    s->exit = 1;
+    backend_spool_wakeup(s);
+
+    if(pthread_join(s->thread, NULL))
+        error("BACKEND: cannot join the sender thread.");
+
+    while(s->first) {
+        struct backend_batch *bt = s->first;
+        s->first = bt->next;
+        backend_batch_free(bt);
+    }
+
+    close(s->fd[0]);
+    if(s->fd[1] != s->fd[0]) close(s->fd[1]);
+
+    pthread_mutex_destroy(&s->mutex);
+    freez(s);
+}
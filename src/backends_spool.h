@@ -0,0 +1,85 @@
+#ifndef NETDATA_BACKENDS_SPOOL_H
+#define NETDATA_BACKENDS_SPOOL_H 1
+
+// ----------------------------------------------------------------------------
+// the spool of the backends
+//
+// The backend thread formats the metrics of each iteration into a batch and
+// queues it here. A sender thread takes the batches in order and writes them
+// to the backend server, one after the other, without waiting for responses.
+//
+// So a slow or unreachable backend server does not delay the formatting of
+// the next iterations: their batches are queued, up to a limit. When the
+// limit is reached, the oldest batches are dropped.
+//
+// A batch that could not be sent completely, because the connection broke,
+// is sent again from its beginning on the next connection.
+//
+// Backend servers that respond to each batch (like HTTP servers) are used
+// with max_in_flight > 0: up to that many batches are sent on the connection
+// before their responses are received, and a batch is sent only when the
+// response checker acknowledges it. When the connection breaks, the batches
+// that have not been acknowledged are sent again on the next connection.
+// The response checker breaks the connection itself, when the backend server
+// failed to process a batch (e.g. an HTTP 5xx), so that it is sent again.
+
+struct backend_batch {
+    BUFFER *b;                          // the data to be sent
+    size_t metrics;                     // the number of metrics in it
+    struct backend_batch *next;
+};
+
+struct backend_spool_stats {
+    size_t sent_metrics;
+    size_t sent_bytes;
+    size_t lost_metrics;
+    size_t lost_bytes;
+    size_t received_bytes;
+    size_t receptions;
+    size_t transmission_successes;      // batches sent completely
+    size_t transmission_failures;
+    size_t data_lost_events;
+    size_t reconnects;
+};
+
+struct backend_spool {
+    const char *destination;            // the backend servers to connect to
+    int default_port;
+    struct timeval timeout;             // for connecting and for writing
+    int (*response_checker)(BUFFER *);  // gets what the backend server sends back, returns the batches it acknowledges, or -1 to re-connect and send them again
+    usec_t max_retry_ut;                // the longest to wait between connection attempts
+
+    pthread_mutex_t mutex;
+    struct backend_batch *first;        // the batches waiting to be sent, oldest first
+    struct backend_batch *last;
+    size_t batches;
+    size_t max_batches;                 // when more are queued, the oldest are dropped
+    size_t max_in_flight;               // the batches waiting for a response, 0 when the backend server does not respond
+
+    struct backend_batch *in_flight_first;  // the batches sent and not acknowledged yet, oldest first
+    struct backend_batch *in_flight_last;   // (used only by the sender thread)
+    size_t in_flight;
+
+    size_t buffered_metrics;            // the metrics queued and being sent
+    size_t buffered_bytes;              // the bytes queued and being sent
+
+    struct backend_spool_stats stats;   // since the last call to backend_spool_stats()
+
+    int fd[2];                          // to wake up the sender
+    pthread_t thread;
+    volatile int exit;
+};
+
+extern struct backend_spool *backend_spool_create(const char *destination, int default_port, struct timeval *timeout, int (*response_checker)(BUFFER *), size_t max_batches, size_t max_in_flight, usec_t max_retry_ut);
+extern void backend_spool_free(struct backend_spool *s);
+
+// queues a batch - the spool takes ownership of b
+extern void backend_spool_add(struct backend_spool *s, BUFFER *b, size_t metrics);
+
+// changes the number of batches kept queued
+extern void backend_spool_set_max_batches(struct backend_spool *s, size_t max_batches);
+
+// returns and resets the statistics, with the buffered metrics and bytes
+extern void backend_spool_stats(struct backend_spool *s, struct backend_spool_stats *stats, size_t *buffered_metrics, size_t *buffered_bytes);
+
+#endif /* NETDATA_BACKENDS_SPOOL_H */
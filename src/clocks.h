@@ -44,6 +44,7 @@ int clock_gettime(clockid_t clk_id, struct timespec *ts);
 #define NSEC_PER_MSEC   1000000ULL
 #define NSEC_PER_USEC   1000ULL
 #define USEC_PER_SEC    1000000ULL
+#define USEC_PER_MS     1000ULL
 
 #ifndef HAVE_CLOCK_GETTIME
 /* Fallback function for POSIX.1-2001 clock_gettime() function.
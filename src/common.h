@@ -71,6 +71,18 @@
 #include <sys/prctl.h>
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -208,6 +220,8 @@
 #include "rrd2json.h"
 #include "rrd2json_api_old.h"
 #include "web_client.h"
+#include "web_files_cache.h"
+#include "web_push.h"
 #include "web_server.h"
 #include "registry.h"
 #include "daemon.h"
@@ -215,6 +229,7 @@
 #include "unit_test.h"
 #include "ipc.h"
 #include "backends.h"
+#include "backends_spool.h"
 #include "inlined.h"
 #include "adaptive_resortable_list.h"
 #include "rrdpush.h"
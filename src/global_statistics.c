@@ -7,11 +7,42 @@ volatile struct global_statistics global_statistics = {
         .bytes_received = 0,
         .bytes_sent = 0,
         .content_size = 0,
-        .compressed_content_size = 0
+        .compressed_content_size = 0,
+        .compressed_requests = 0,
+        .compression_usec = 0
 };
 
 pthread_mutex_t global_statistics_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static volatile uint64_t web_latency[WEB_ENDPOINT_MAX][WEB_LATENCY_BUCKETS];
+
+static const char *web_endpoint_names[WEB_ENDPOINT_MAX] = {
+        [WEB_ENDPOINT_OTHER]      = "other",
+        [WEB_ENDPOINT_DATA]       = "data",
+        [WEB_ENDPOINT_CHARTS]     = "charts",
+        [WEB_ENDPOINT_BADGE]      = "badge",
+        [WEB_ENDPOINT_ALLMETRICS] = "allmetrics",
+        [WEB_ENDPOINT_REGISTRY]   = "registry",
+        [WEB_ENDPOINT_FILES]      = "files"
+};
+
+inline const char *web_endpoint_name(WEB_ENDPOINT endpoint) {
+    if(unlikely(endpoint >= WEB_ENDPOINT_MAX)) endpoint = WEB_ENDPOINT_OTHER;
+    return web_endpoint_names[endpoint];
+}
+
+static inline int web_latency_bucket(uint64_t dt) {
+    uint64_t v = dt / WEB_LATENCY_FIRST_BUCKET_USEC;
+    int bucket = 0;
+
+    while(v && bucket < WEB_LATENCY_BUCKETS - 1) {
+        bucket++;
+        v >>= 1;
+    }
+
+    return bucket;
+}
+
 inline void global_statistics_lock(void) {
     pthread_mutex_lock(&global_statistics_mutex);
 }
@@ -20,22 +51,33 @@ inline void global_statistics_unlock(void) {
     pthread_mutex_unlock(&global_statistics_mutex);
 }
 
-void finished_web_request_statistics(uint64_t dt,
+void finished_web_request_statistics(WEB_ENDPOINT endpoint,
+                                     uint64_t dt,
                                      uint64_t bytes_received,
                                      uint64_t bytes_sent,
                                      uint64_t content_size,
-                                     uint64_t compressed_content_size) {
+                                     uint64_t compressed_content_size,
+                                     uint64_t compression_usec,
+                                     int compressed) {
 #if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
     uint64_t old_web_usec_max = global_statistics.web_usec_max;
     while(dt > old_web_usec_max)
         __atomic_compare_exchange(&global_statistics.web_usec_max, &old_web_usec_max, &dt, 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
 
+    if(unlikely(endpoint >= WEB_ENDPOINT_MAX)) endpoint = WEB_ENDPOINT_OTHER;
+
+    __atomic_fetch_add(&web_latency[endpoint][web_latency_bucket(dt)], 1, __ATOMIC_RELAXED);
     __atomic_fetch_add(&global_statistics.web_requests, 1, __ATOMIC_SEQ_CST);
     __atomic_fetch_add(&global_statistics.web_usec, dt, __ATOMIC_SEQ_CST);
     __atomic_fetch_add(&global_statistics.bytes_received, bytes_received, __ATOMIC_SEQ_CST);
     __atomic_fetch_add(&global_statistics.bytes_sent, bytes_sent, __ATOMIC_SEQ_CST);
     __atomic_fetch_add(&global_statistics.content_size, content_size, __ATOMIC_SEQ_CST);
     __atomic_fetch_add(&global_statistics.compressed_content_size, compressed_content_size, __ATOMIC_SEQ_CST);
+
+    if(compressed) {
+        __atomic_fetch_add(&global_statistics.compressed_requests, 1, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&global_statistics.compression_usec, compression_usec, __ATOMIC_SEQ_CST);
+    }
 #else
 #warning NOT using atomic operations - using locks for global statistics
     if (web_server_mode == WEB_SERVER_MODE_MULTI_THREADED)
@@ -44,6 +86,9 @@ void finished_web_request_statistics(uint64_t dt,
     if (dt > global_statistics.web_usec_max)
         global_statistics.web_usec_max = dt;
 
+    if(unlikely(endpoint >= WEB_ENDPOINT_MAX)) endpoint = WEB_ENDPOINT_OTHER;
+    web_latency[endpoint][web_latency_bucket(dt)]++;
+
     global_statistics.web_requests++;
     global_statistics.web_usec += dt;
     global_statistics.bytes_received += bytes_received;
@@ -51,6 +96,11 @@ void finished_web_request_statistics(uint64_t dt,
     global_statistics.content_size += content_size;
     global_statistics.compressed_content_size += compressed_content_size;
 
+    if(compressed) {
+        global_statistics.compressed_requests++;
+        global_statistics.compression_usec += compression_usec;
+    }
+
     if (web_server_mode == WEB_SERVER_MODE_MULTI_THREADED)
         global_statistics_unlock();
 #endif
@@ -95,6 +145,8 @@ inline void global_statistics_copy(struct global_statistics *gs, uint8_t options
     gs->bytes_sent              = __atomic_fetch_add(&global_statistics.bytes_sent, 0, __ATOMIC_SEQ_CST);
     gs->content_size            = __atomic_fetch_add(&global_statistics.content_size, 0, __ATOMIC_SEQ_CST);
     gs->compressed_content_size = __atomic_fetch_add(&global_statistics.compressed_content_size, 0, __ATOMIC_SEQ_CST);
+    gs->compressed_requests     = __atomic_fetch_add(&global_statistics.compressed_requests, 0, __ATOMIC_SEQ_CST);
+    gs->compression_usec        = __atomic_fetch_add(&global_statistics.compression_usec, 0, __ATOMIC_SEQ_CST);
 
     if(options & GLOBAL_STATS_RESET_WEB_USEC_MAX) {
         uint64_t n = 0;
@@ -113,14 +165,61 @@ inline void global_statistics_copy(struct global_statistics *gs, uint8_t options
 #endif
 }
 
+static void web_latency_charts(void) {
+    static RRDSET *st[WEB_ENDPOINT_MAX] = { NULL };
+    static RRDDIM *rd[WEB_ENDPOINT_MAX][WEB_LATENCY_BUCKETS];
+
+    int e, b;
+    for(e = 0; e < WEB_ENDPOINT_MAX ; e++) {
+        if(unlikely(!st[e])) {
+            char id[RRD_ID_LENGTH_MAX + 1], title[100 + 1];
+            snprintfz(id, RRD_ID_LENGTH_MAX, "web_latency_%s", web_endpoint_name(e));
+            snprintfz(title, 100, "NetData API Response Time Histogram, for %s requests", web_endpoint_name(e));
+
+            st[e] = rrdset_find_bytype_localhost("netdata", id);
+            if(!st[e])
+                st[e] = rrdset_create_localhost("netdata", id, NULL, "web latency", NULL, title, "requests/s"
+                                                , 130410 + e, localhost->rrd_update_every, RRDSET_TYPE_STACKED);
+
+            for(b = 0; b < WEB_LATENCY_BUCKETS ; b++) {
+                char name[50 + 1];
+                uint64_t usec = (uint64_t)WEB_LATENCY_FIRST_BUCKET_USEC << b;
+
+                if(b == WEB_LATENCY_BUCKETS - 1)
+                    snprintfz(name, 50, "slower");
+                else if(usec < 1000)
+                    snprintfz(name, 50, "%0.2fms", usec / 1000.0);
+                else
+                    snprintfz(name, 50, "%llums", (unsigned long long)(usec / 1000));
+
+                rd[e][b] = rrddim_find(st[e], name);
+                if(!rd[e][b]) rd[e][b] = rrddim_add(st[e], name, NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+            }
+        }
+        else rrdset_next(st[e]);
+
+        for(b = 0; b < WEB_LATENCY_BUCKETS ; b++) {
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+            uint64_t v = __atomic_load_n(&web_latency[e][b], __ATOMIC_RELAXED);
+#else
+            uint64_t v = web_latency[e][b];
+#endif
+            rrddim_set_by_pointer(st[e], rd[e][b], (collected_number)v);
+        }
+
+        rrdset_done(st[e]);
+    }
+}
+
 void global_statistics_charts(void) {
     static unsigned long long old_web_requests = 0, old_web_usec = 0,
-            old_content_size = 0, old_compressed_content_size = 0;
+            old_content_size = 0, old_compressed_content_size = 0,
+            old_compressed_requests = 0, old_compression_usec = 0;
 
-    static collected_number compression_ratio = -1, average_response_time = -1;
+    static collected_number compression_ratio = -1, average_response_time = -1, average_compression_time = -1;
 
     static RRDSET *stcpu = NULL, *stcpu_thread = NULL, *stclients = NULL, *streqs = NULL, *stbytes = NULL, *stduration = NULL,
-            *stcompression = NULL;
+            *stcompression = NULL, *stcompression_time = NULL;
 
     struct global_statistics gs;
     struct rusage me, thread;
@@ -260,4 +359,41 @@ void global_statistics_charts(void) {
         rrddim_set(stcompression, "savings", compression_ratio);
 
     rrdset_done(stcompression);
+
+    // ----------------------------------------------------------------
+
+    if (!stcompression_time) stcompression_time = rrdset_find_localhost("netdata.compression_time");
+    if (!stcompression_time) {
+        stcompression_time = rrdset_create_localhost("netdata", "compression_time", NULL, "netdata", NULL
+                                                     , "NetData API Responses Compression CPU Time", "ms/request"
+                                                     , 130510, localhost->rrd_update_every, RRDSET_TYPE_LINE);
+
+        rrddim_add(stcompression_time, "average", NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+    } else rrdset_next(stcompression_time);
+
+    uint64_t gcompression_usec = gs.compression_usec;
+    uint64_t gcompressed_requests = gs.compressed_requests;
+
+    uint64_t compression_usec = (gcompression_usec >= old_compression_usec) ? gcompression_usec - old_compression_usec : 0;
+    uint64_t compressed_requests = (gcompressed_requests >= old_compressed_requests) ? gcompressed_requests - old_compressed_requests : 0;
+
+    old_compression_usec = gcompression_usec;
+    old_compressed_requests = gcompressed_requests;
+
+    if (compressed_requests)
+        average_compression_time = (collected_number) (compression_usec / compressed_requests);
+
+    if (average_compression_time != -1)
+        rrddim_set(stcompression_time, "average", average_compression_time);
+    else
+        rrddim_set(stcompression_time, "average", 0);
+
+    rrdset_done(stcompression_time);
+
+    // ----------------------------------------------------------------
+
+    web_latency_charts();
+    rrdpush_compression_charts();
+    rrdpush_ring_charts();
+    rrdpush_receiver_charts();
 }
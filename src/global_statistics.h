@@ -14,17 +14,44 @@ struct global_statistics {
     volatile uint64_t bytes_sent;
     volatile uint64_t content_size;
     volatile uint64_t compressed_content_size;
+    volatile uint64_t compressed_requests;
+    volatile uint64_t compression_usec;
 };
 
 extern volatile struct global_statistics global_statistics;
 
+// ----------------------------------------------------------------------------
+// web requests latency histograms, per endpoint
+
+typedef enum web_endpoint {
+    WEB_ENDPOINT_OTHER = 0,
+    WEB_ENDPOINT_DATA,
+    WEB_ENDPOINT_CHARTS,
+    WEB_ENDPOINT_BADGE,
+    WEB_ENDPOINT_ALLMETRICS,
+    WEB_ENDPOINT_REGISTRY,
+    WEB_ENDPOINT_FILES,
+
+    WEB_ENDPOINT_MAX                // always last
+} WEB_ENDPOINT;
+
+// bucket i counts the requests that completed in less than (250 << i) microseconds
+// the last bucket counts all the slower ones
+#define WEB_LATENCY_BUCKETS 14
+#define WEB_LATENCY_FIRST_BUCKET_USEC 250
+
+extern const char *web_endpoint_name(WEB_ENDPOINT endpoint);
+
 extern void global_statistics_lock(void);
 extern void global_statistics_unlock(void);
-extern void finished_web_request_statistics(uint64_t dt,
+extern void finished_web_request_statistics(WEB_ENDPOINT endpoint,
+                                     uint64_t dt,
                                      uint64_t bytes_received,
                                      uint64_t bytes_sent,
                                      uint64_t content_size,
-                                     uint64_t compressed_content_size);
+                                     uint64_t compressed_content_size,
+                                     uint64_t compression_usec,
+                                     int compressed);
 
 extern void web_client_connected(void);
 extern void web_client_disconnected(void);
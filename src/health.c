@@ -25,7 +25,7 @@ void health_init(void) {
 // re-load health configuration
 
 void health_reload_host(RRDHOST *host) {
-    if(unlikely(!host->health_enabled))
+    if(unlikely(!host->health_enabled || host->lazy_indexes))
         return;
 
     char *path = health_config_dir();
@@ -372,6 +372,9 @@ void *health_main(void *ptr) {
             if(unlikely(!host->health_enabled))
                 continue;
 
+            // replication only hosts load their alarms the first time health runs for them
+            rrdhost_build_indexes(host);
+
             if(unlikely(apply_hibernation_delay)) {
 
                 info("Postponing alarm checks for %ld seconds, on host '%s', due to boottime discrepancy (realtime dt: %ld, boottime dt: %ld)."
@@ -420,6 +423,7 @@ void *health_main(void *ptr) {
                                                   , &rc->db_after
                                                   , &rc->db_before
                                                   , &value_is_null
+                                                  , NULL
                     );
 
                     if(unlikely(ret != 200)) {
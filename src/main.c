@@ -76,6 +76,10 @@ void web_server_threading_selection(void) {
 
     web_client_timeout = (int) config_get_number(CONFIG_SECTION_WEB, "disconnect idle clients after seconds", DEFAULT_DISCONNECT_IDLE_WEB_CLIENTS_AFTER_SECONDS);
 
+    long long slow_query_ms = config_get_number(CONFIG_SECTION_WEB, "log queries slower than ms", DEFAULT_WEB_SLOW_QUERY_MS);
+    if(slow_query_ms < 0) slow_query_ms = 0;
+    web_slow_query_usec = (usec_t)slow_query_ms * USEC_PER_MS;
+
     respect_web_browser_do_not_track_policy = config_get_boolean(CONFIG_SECTION_WEB, "respect do not track policy", respect_web_browser_do_not_track_policy);
     web_x_frame_options = config_get(CONFIG_SECTION_WEB, "x-frame-options response header", "");
     if(!*web_x_frame_options) web_x_frame_options = NULL;
@@ -108,7 +112,19 @@ void web_server_threading_selection(void) {
         error("Invalid compression level %d. Valid levels are 1 (fastest) to 9 (best ratio). Proceeding with level 9 (best compression).", web_gzip_level);
         web_gzip_level = 9;
     }
+
+    web_gzip_adaptive_level = config_get_boolean(CONFIG_SECTION_WEB, "adaptive gzip compression level", web_gzip_adaptive_level);
+
+    long long min_size = config_get_number(CONFIG_SECTION_WEB, "gzip compression minimum response size", WEB_GZIP_MIN_SIZE);
+    if(min_size < 0) {
+        error("Invalid minimum response size for compression %lld. Proceeding with 0 (compress all responses).", min_size);
+        min_size = 0;
+    }
+    web_gzip_min_size = (size_t)min_size;
 #endif /* NETDATA_WITH_ZLIB */
+
+    web_files_cache_init();
+    buffer_svg_init();
 }
 
 
@@ -300,6 +316,8 @@ void help(int exitcode) {
             "  -W unittest              Run internal unittests and exit.\n\n"
             "  -W simple-pattern pattern string\n"
             "                           Check if string matches pattern and exit.\n\n"
+            "  -W pluginsd-benchmark file [loops]\n"
+            "                           Time the parsing of a recorded plugins.d stream and exit.\n\n"
     );
 
     fprintf(stream, "\n Signals netdata handles:\n\n"
@@ -528,6 +546,9 @@ int main(int argc, char **argv) {
     // set the name for logging
     program_name = "netdata";
 
+    // calculate the hashes of the web API keywords
+    web_client_api_v1_init();
+
     // parse depercated options
     // TODO: Remove this block with the next major release.
     {
@@ -631,10 +652,37 @@ int main(int argc, char **argv) {
                             rrd_init("unittest");
                             default_rrdpush_enabled = 0;
                             if(run_all_mockup_tests()) exit(1);
+                            if(unit_test_web_api()) exit(1);
+                            if(unit_test_pluginsd()) exit(1);
                             if(unit_test_storage()) exit(1);
                             fprintf(stderr, "\n\nALL TESTS PASSED\n\n");
                             exit(0);
                         }
+                        else if(strcmp(optarg, "pluginsd-benchmark") == 0) {
+                            if(optind + 1 > argc) {
+                                fprintf(stderr, "%s", "\nUSAGE: -W pluginsd-benchmark 'file' [loops]\n\n"
+                                        " Replays 'file' through the plugins.d parser 'loops' times (default 10).\n"
+                                        " 'file' can be the output of a plugin, e.g.:\n"
+                                        "\n"
+                                        "   timeout 60 /usr/libexec/netdata/plugins.d/apps.plugin 1 >apps.txt\n"
+                                        "\n"
+                                );
+                                exit(1);
+                            }
+
+                            default_rrd_update_every = 1;
+                            default_rrd_memory_mode = RRD_MEMORY_MODE_RAM;
+                            if(!config_loaded) config_load(NULL, 0);
+                            get_netdata_configured_variables();
+                            default_rrd_update_every = 1;
+                            default_rrd_memory_mode = RRD_MEMORY_MODE_RAM;
+                            default_health_enabled = 0;
+                            rrd_init("pluginsd-benchmark");
+                            localhost->rrdpush_enabled = 0;
+
+                            size_t loops = (optind + 1 < argc)?str2ul(argv[optind + 1]):10;
+                            exit(benchmark_pluginsd(argv[optind], (loops)?loops:10));
+                        }
                         else if(strcmp(optarg, "simple-pattern") == 0) {
                             if(optind + 2 > argc) {
                                 fprintf(stderr, "%s", "\nUSAGE: -W simple-pattern 'pattern' 'string'\n\n"
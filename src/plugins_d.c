@@ -4,19 +4,26 @@ struct plugind *pluginsd_root = NULL;
 
 #define MAX_WORDS 20
 
-static inline int pluginsd_space(char c) {
-    switch(c) {
-    case ' ':
-    case '\t':
-    case '\r':
-    case '\n':
-    case '=':
-        return 1;
-
-    default:
-        return 0;
-    }
-}
+// the classes of characters the words of a line are split on
+#define PLUGINSD_CHAR_WORD   0
+#define PLUGINSD_CHAR_SPACE  1
+#define PLUGINSD_CHAR_QUOTE  2
+#define PLUGINSD_CHAR_ESCAPE 3
+#define PLUGINSD_CHAR_END    4
+
+static const unsigned char pluginsd_char_class[256] = {
+    ['\0'] = PLUGINSD_CHAR_END,
+    [' ']  = PLUGINSD_CHAR_SPACE,
+    ['\t'] = PLUGINSD_CHAR_SPACE,
+    ['\r'] = PLUGINSD_CHAR_SPACE,
+    ['\n'] = PLUGINSD_CHAR_SPACE,
+    ['=']  = PLUGINSD_CHAR_SPACE,
+    ['\''] = PLUGINSD_CHAR_QUOTE,
+    ['"']  = PLUGINSD_CHAR_QUOTE,
+    ['\\'] = PLUGINSD_CHAR_ESCAPE
+};
+
+#define pluginsd_space(c) (pluginsd_char_class[(unsigned char)(c)] == PLUGINSD_CHAR_SPACE)
 
 static int pluginsd_split_words(char *str, char **words, int max_words) {
     char *s = str, quote = 0;
@@ -34,24 +41,35 @@ static int pluginsd_split_words(char *str, char **words, int max_words) {
     // store the first word
     words[i++] = s;
 
-    // while we have something
-    while(likely(*s)) {
+    for(;;) {
+        // skip the characters of the word, with one lookup for each
+        while(likely(pluginsd_char_class[(unsigned char)*s] == PLUGINSD_CHAR_WORD)) s++;
+
+        unsigned char c = pluginsd_char_class[(unsigned char)*s];
+
+        // if it is the end of the line
+        if(unlikely(c == PLUGINSD_CHAR_END))
+            break;
+
         // if it is escape
-        if(unlikely(*s == '\\' && s[1])) {
-            s += 2;
-            continue;
-        }
+        else if(unlikely(c == PLUGINSD_CHAR_ESCAPE))
+            s += (s[1])?2:1;
 
         // if it is quote
-        else if(unlikely(*s == quote)) {
-            quote = 0;
-            *s = ' ';
-            continue;
+        else if(unlikely(c == PLUGINSD_CHAR_QUOTE)) {
+            if(*s == quote) {
+                quote = 0;
+                *s = ' ';
+            }
+            else s++;
         }
 
-        // if it is a space
-        else if(unlikely(quote == 0 && pluginsd_space(*s))) {
+        // a space in quotes
+        else if(unlikely(quote))
+            s++;
 
+        // a space
+        else {
             // terminate the word
             *s++ = '\0';
 
@@ -64,16 +82,12 @@ static int pluginsd_split_words(char *str, char **words, int max_words) {
                 s++;        // skip the quote
             }
 
-            // if we reached the end, stop
-            if(unlikely(!*s)) break;
+            // if we reached the end, or we have all the words, stop
+            if(unlikely(!*s || i >= max_words)) break;
 
             // store the next word
-            if(likely(i < max_words)) words[i++] = s;
-            else break;
+            words[i++] = s;
         }
-
-        // anything else
-        else s++;
     }
 
     // terminate the words
@@ -83,286 +97,937 @@ static int pluginsd_split_words(char *str, char **words, int max_words) {
     return i;
 }
 
-inline size_t pluginsd_process(RRDHOST *host, struct plugind *cd, FILE *fp, int trust_durations) {
-    int enabled = cd->enabled;
+// parses a collected value
+// decimal numbers are parsed here, anything else (hex, octal, too many digits) by strtoll()
+static inline collected_number pluginsd_str2collected(const char *value) {
+    const char *s = value;
+    int negative = 0;
 
-    if(!fp || !enabled) {
-        cd->enabled = 0;
-        return 0;
+    if(*s == '-') { negative = 1; s++; }
+    else if(*s == '+') s++;
+
+    if(unlikely(*s == '0' && s[1] >= '0' && s[1] <= '9'))
+        return strtoll(value, NULL, 0);
+
+    if(unlikely(*s == '0' && (s[1] == 'x' || s[1] == 'X')))
+        return strtoll(value, NULL, 0);
+
+    unsigned long long n = 0;
+    int digits = 0;
+    for(; *s >= '0' && *s <= '9' ; s++, digits++)
+        n = n * 10 + (unsigned long long)(*s - '0');
+
+    if(unlikely(digits > 18))
+        return strtoll(value, NULL, 0);
+
+    return (negative)?-(collected_number)n:(collected_number)n;
+}
+
+// ----------------------------------------------------------------------------
+// the binary streaming protocol (see rrdpush.h)
+
+// the maximum chart and dimension id we accept
+#define PLUGINSD_BINARY_MAX_SLOT (1024 * 1024)
+
+struct pluginsd_dimension_slot {
+    RRDDIM *rd;
+    collected_number last_value;        // the last value received for this dimension
+};
+
+struct pluginsd_chart_slot {
+    RRDSET *st;
+    size_t dimensions;                  // the number of allocated dimension slots
+    struct pluginsd_dimension_slot *dims;
+};
+
+struct pluginsd_slots {
+    size_t charts;                      // the number of allocated chart slots
+    struct pluginsd_chart_slot *chart;
+};
+
+static inline void *pluginsd_slots_expand(void *array, size_t *allocated, size_t slot, size_t item_size) {
+    size_t old = *allocated, size = (old)?old:16;
+    while(size <= slot) size *= 2;
+
+    array = reallocz(array, size * item_size);
+    memset((char *)array + old * item_size, 0, (size - old) * item_size);
+    *allocated = size;
+    return array;
+}
+
+static struct pluginsd_chart_slot *pluginsd_chart_slot(struct pluginsd_slots *slots, size_t slot, RRDSET *st) {
+    if(unlikely(!slot || slot > PLUGINSD_BINARY_MAX_SLOT))
+        return NULL;
+
+    if(unlikely(slot >= slots->charts))
+        slots->chart = pluginsd_slots_expand(slots->chart, &slots->charts, slot, sizeof(struct pluginsd_chart_slot));
+
+    struct pluginsd_chart_slot *c = &slots->chart[slot];
+
+    // a new generation of the sender may give the slot to another chart
+    if(unlikely(c->st != st && c->dimensions))
+        memset(c->dims, 0, c->dimensions * sizeof(struct pluginsd_dimension_slot));
+
+    c->st = st;
+    return c;
+}
+
+static int pluginsd_dimension_slot(struct pluginsd_chart_slot *c, size_t slot, RRDDIM *rd, collected_number last_value) {
+    if(unlikely(!slot || slot > PLUGINSD_BINARY_MAX_SLOT))
+        return -1;
+
+    if(unlikely(slot >= c->dimensions))
+        c->dims = pluginsd_slots_expand(c->dims, &c->dimensions, slot, sizeof(struct pluginsd_dimension_slot));
+
+    // the sender resets its last value when it sends the definition, unless it gives it
+    c->dims[slot].rd = rd;
+    c->dims[slot].last_value = last_value;
+    return 0;
+}
+
+static void pluginsd_slots_free(struct pluginsd_slots *slots) {
+    size_t i;
+    for(i = 0; i < slots->charts ; i++)
+        freez(slots->chart[i].dims);
+
+    freez(slots->chart);
+    slots->chart = NULL;
+    slots->charts = 0;
+}
+
+// ----------------------------------------------------------------------------
+// the parser of the plugins.d protocol
+//
+// It keeps all the state of a connection, so that the data can be given to it
+// in chunks of any size: pluginsd_parser_feed() processes everything complete
+// and returns how much it has consumed, so that the caller keeps the rest.
+
+#define PLUGINSD_CHARTS_CACHE_SIZE 256
+
+struct pluginsd_parser {
+    RRDHOST *host;
+    struct plugind *cd;
+    int trust_durations;
+    int binary;                         // 1 when binary data frames are accepted
+    int enabled;                        // 0 when the connection has to be closed
+    size_t count;                       // the number of completed updates
+
+    size_t lines;                       // the lines processed (binary frames count as the lines they replace)
+    size_t new_charts;                  // the charts created
+
+    // the limits of a streaming connection - see pluginsd_parser_allow()
+    int limited;
+    int throttled;                      // 1 when the last feed stopped because of the limits
+    size_t lines_limit;
+    size_t new_charts_limit;
+
+    RRDSET *st;                         // the chart of the last BEGIN or CHART
+    RRDDIM *rd;                         // the dimension the next SET is expected for (the next of the last one)
+    struct pluginsd_slots slots;
+    struct pluginsd_chart_slot *chart_slot;
+
+    // the chart past values are replayed for, by a streaming netdata
+    RRDSET *replay_st;
+    time_t replay_first_t;
+    size_t replay_points;
+
+    // the charts of BEGIN, by the hash of their id
+    // it is valid while the charts_version of the host does not change
+    size_t charts_cache_version;
+    RRDSET *charts_cache[PLUGINSD_CHARTS_CACHE_SIZE];
+
+    // the shared memory the plugin writes to, after it has asked for it with SHM
+    struct pluginsd_shm *shm;
+
+    char *words[MAX_WORDS];
+};
+
+static uint32_t FLUSH_HASH = 0, CHART_HASH, DIMENSION_HASH, DISABLE_HASH, REPLAY_BEGIN_HASH, REPLAY_SET_HASH, SHM_HASH;
+
+struct pluginsd_parser *pluginsd_parser_create(RRDHOST *host, struct plugind *cd, int trust_durations, int binary) {
+    if(unlikely(!FLUSH_HASH)) {
+        CHART_HASH = simple_hash("CHART");
+        DIMENSION_HASH = simple_hash("DIMENSION");
+        DISABLE_HASH = simple_hash("DISABLE");
+        REPLAY_BEGIN_HASH = simple_hash("REPLAY_BEGIN");
+        REPLAY_SET_HASH = simple_hash("REPLAY_SET");
+        SHM_HASH = simple_hash(PLUGINSD_SHM_KEYWORD);
+        FLUSH_HASH = simple_hash("FLUSH");
     }
 
-    size_t count = 0;
+    struct pluginsd_parser *p = callocz(1, sizeof(struct pluginsd_parser));
+    p->host = host;
+    p->cd = cd;
+    p->trust_durations = trust_durations;
+    p->binary = binary;
+    p->enabled = cd->enabled;
+    return p;
+}
 
-    char line[PLUGINSD_LINE_MAX + 1];
+// frees the parser and updates the statistics of its plugin
+// returns the number of completed updates
+size_t pluginsd_parser_free(struct pluginsd_parser *p) {
+    struct plugind *cd = p->cd;
+    size_t count = p->count;
 
-    char *words[MAX_WORDS] = { NULL };
-    /* uint32_t HOST_HASH = simple_hash("HOST"); */
-    uint32_t BEGIN_HASH = simple_hash("BEGIN");
-    uint32_t END_HASH = simple_hash("END");
-    uint32_t FLUSH_HASH = simple_hash("FLUSH");
-    uint32_t CHART_HASH = simple_hash("CHART");
-    uint32_t DIMENSION_HASH = simple_hash("DIMENSION");
-    uint32_t DISABLE_HASH = simple_hash("DISABLE");
+    pluginsd_slots_free(&p->slots);
+    cd->enabled = p->enabled;
 
-    RRDSET *st = NULL;
-    uint32_t hash;
+    if(unlikely(p->replay_points))
+        info("PLUGINSD: '%s' replayed %zu points of past data, on host '%s'.", cd->fullfilename, p->replay_points, p->host->hostname);
 
-    errno = 0;
-    clearerr(fp);
+    if(likely(count)) {
+        cd->successful_collections += count;
+        cd->serial_failures = 0;
+    }
+    else
+        cd->serial_failures++;
+
+    freez(p);
+    return count;
+}
+
+// returns the length of the STREAM_BINARY_DATA frame at s (without the frame type)
+// 0 when it is not complete yet, -1 when it is invalid
+static inline ssize_t pluginsd_binary_frame_length(const char *s, size_t len) {
+    size_t pos = 0, varints = 0, i;
+    uint64_t v = 0;
+
+    while(pos < len) {
+        v = 0;
+        for(i = 0; i < STREAM_VARINT_MAX_BYTES ; i++) {
+            if(unlikely(pos >= len)) return 0;
+
+            unsigned char c = (unsigned char)s[pos++];
+            v |= (uint64_t)(c & 0x7f);
+            if(likely(!(c & 0x80))) break;
+        }
+        if(unlikely(i == STREAM_VARINT_MAX_BYTES)) return -1;
+
+        varints++;
 
-    if(unlikely(fileno(fp) == -1)) {
-        error("PLUGINSD: %s: file is not a valid stream.", cd->fullfilename);
-        goto cleanup;
+        // after the chart id and the microseconds, a zero dimension id delta ends the frame
+        if(varints > 2 && (varints & 1) && !v)
+            return (ssize_t)pos;
     }
 
-    while(!ferror(fp)) {
-        if(unlikely(netdata_exit)) break;
+    return 0;
+}
 
-        char *r = fgets(line, PLUGINSD_LINE_MAX, fp);
-        if(unlikely(!r)) {
-            error("PLUGINSD: %s : read failed.", cd->fullfilename);
-            break;
+// decodes a varint of a frame already checked by pluginsd_binary_frame_length()
+static inline uint64_t pluginsd_read_varint(const char **s) {
+    const unsigned char *p = (const unsigned char *)*s;
+    uint64_t v = 0;
+    int shift = 0;
+
+    while(*p & 0x80) {
+        v |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    v |= (uint64_t)(*p++) << shift;
+
+    *s = (const char *)p;
+    return v;
+}
+
+static inline void pluginsd_begin(RRDSET *st, usec_t microseconds, int trust_durations) {
+    if(likely(st->counter_done)) {
+        if(likely(microseconds)) {
+            if(trust_durations)
+                rrdset_next_usec_unfiltered(st, microseconds);
+            else
+                rrdset_next_usec(st, microseconds);
         }
+        else rrdset_next(st);
+    }
+}
 
-        if(unlikely(netdata_exit)) break;
+// process a STREAM_BINARY_DATA frame - s points just after the frame type
+// returns 0 on success, -1 on failure
+static int pluginsd_process_binary_data(struct pluginsd_parser *p, const char *s) {
+    RRDHOST *host = p->host;
+    struct plugind *cd = p->cd;
+    struct pluginsd_slots *slots = &p->slots;
+
+    uint64_t chart_slot = pluginsd_read_varint(&s);
+    uint64_t microseconds = pluginsd_read_varint(&s);
 
-        line[PLUGINSD_LINE_MAX] = '\0';
+    if(unlikely(chart_slot >= slots->charts || !slots->chart[chart_slot].st)) {
+        error("PLUGINSD: '%s' sent binary data for chart id %llu, which has not been defined on host '%s'.", cd->fullfilename, (unsigned long long)chart_slot, host->hostname);
+        return -1;
+    }
 
-        // debug(D_PLUGINSD, "PLUGINSD: %s: %s", cd->filename, line);
+    struct pluginsd_chart_slot *c = &slots->chart[chart_slot];
+    RRDSET *st = c->st;
 
-        int w = pluginsd_split_words(line, words, MAX_WORDS);
-        char *s = words[0];
-        if(unlikely(!s || !*s || !w)) {
-            // debug(D_PLUGINSD, "PLUGINSD: empty line");
-            continue;
+    pluginsd_begin(st, microseconds, p->trust_durations);
+
+    uint64_t dim_slot = 0, delta, value;
+    while((delta = pluginsd_read_varint(&s))) {
+        dim_slot += delta;
+        value = pluginsd_read_varint(&s);
+
+        if(unlikely(dim_slot >= c->dimensions || !c->dims[dim_slot].rd)) {
+            error("PLUGINSD: '%s' sent binary data for dimension id %llu of chart '%s', which has not been defined on host '%s'.", cd->fullfilename, (unsigned long long)dim_slot, st->id, host->hostname);
+            return -1;
         }
 
-        // debug(D_PLUGINSD, "PLUGINSD: words 0='%s' 1='%s' 2='%s' 3='%s' 4='%s' 5='%s' 6='%s' 7='%s' 8='%s' 9='%s'", words[0], words[1], words[2], words[3], words[4], words[5], words[6], words[7], words[8], words[9]);
+        struct pluginsd_dimension_slot *d = &c->dims[dim_slot];
+        d->last_value = stream_zigzag_decode(value, d->last_value);
+        rrddim_set_by_pointer(st, d->rd, d->last_value);
+        p->lines++;
+    }
 
-        if(likely(!simple_hash_strcmp(s, "SET", &hash))) {
-            char *dimension = words[1];
-            char *value = words[2];
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG))) debug(D_PLUGINSD, "PLUGINSD: '%s' sent binary data for chart %s", cd->fullfilename, st->id);
 
-            if(unlikely(!dimension || !*dimension)) {
-                error("PLUGINSD: '%s' is requesting a SET on chart '%s' of host '%s', without a dimension. Disabling it.", cd->fullfilename, st->id, host->hostname);
-                enabled = 0;
-                break;
-            }
+    rrdset_done(st);
 
-            if(unlikely(!value || !*value)) value = NULL;
+    // BEGIN and END
+    p->lines += 2;
+    return 0;
+}
 
-            if(unlikely(!st)) {
-                error("PLUGINSD: '%s' is requesting a SET on dimension %s with value %s on host '%s', without a BEGIN. Disabling it.", cd->fullfilename, dimension, value?value:"<nothing>", host->hostname);
-                enabled = 0;
-                break;
-            }
+static inline int pluginsd_parser_disable(struct pluginsd_parser *p) {
+    p->enabled = 0;
+    return -1;
+}
 
-            if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG))) debug(D_PLUGINSD, "PLUGINSD: '%s' is setting dimension %s/%s to %s", cd->fullfilename, st->id, dimension, value?value:"<nothing>");
+static inline RRDSET *pluginsd_find_chart(struct pluginsd_parser *p, const char *id) {
+    size_t version = p->host->charts_version;
+    if(unlikely(version != p->charts_cache_version)) {
+        memset(p->charts_cache, 0, sizeof(p->charts_cache));
+        p->charts_cache_version = version;
+    }
+
+    uint32_t hash = simple_hash(id);
+    RRDSET **cached = &p->charts_cache[hash & (PLUGINSD_CHARTS_CACHE_SIZE - 1)];
+
+    if(likely(*cached && (*cached)->hash == hash && !strcmp((*cached)->id, id)))
+        return *cached;
+
+    *cached = rrdset_find(p->host, id);
+    return *cached;
+}
+
+static inline int pluginsd_parser_set(struct pluginsd_parser *p, char **words) {
+    char *dimension = words[1];
+    char *value = words[2];
+    RRDSET *st = p->st;
+
+    if(unlikely(!st)) {
+        error("PLUGINSD: '%s' is requesting a SET on dimension %s with value %s on host '%s', without a BEGIN. Disabling it.", p->cd->fullfilename, dimension?dimension:"<nothing>", value?value:"<nothing>", p->host->hostname);
+        return pluginsd_parser_disable(p);
+    }
+
+    if(unlikely(!dimension || !*dimension)) {
+        error("PLUGINSD: '%s' is requesting a SET on chart '%s' of host '%s', without a dimension. Disabling it.", p->cd->fullfilename, st->id, p->host->hostname);
+        return pluginsd_parser_disable(p);
+    }
+
+    if(unlikely(!value || !*value)) value = NULL;
+
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG))) debug(D_PLUGINSD, "PLUGINSD: '%s' is setting dimension %s/%s to %s", p->cd->fullfilename, st->id, dimension, value?value:"<nothing>");
 
-            if(value) rrddim_set(st, dimension, strtoll(value, NULL, 0));
+    if(unlikely(!value)) return 0;
+
+    // dimensions are usually set in the order they have been defined
+    RRDDIM *rd = p->rd;
+    if(unlikely(!rd || strcmp(rd->id, dimension))) {
+        rd = rrddim_find(st, dimension);
+        if(unlikely(!rd)) {
+            error("Cannot find dimension with id '%s' on stats '%s' (%s).", dimension, st->name, st->id);
+            return 0;
         }
-        else if(likely(hash == BEGIN_HASH && !strcmp(s, "BEGIN"))) {
-            char *id = words[1];
-            char *microseconds_txt = words[2];
+    }
 
-            if(unlikely(!id)) {
-                error("PLUGINSD: '%s' is requesting a BEGIN without a chart id for host '%s'. Disabling it.", cd->fullfilename, host->hostname);
-                enabled = 0;
-                break;
-            }
+    rrddim_set_by_pointer(st, rd, pluginsd_str2collected(value));
+    p->rd = rd->next;
+    return 0;
+}
 
-            st = rrdset_find(host, id);
-            if(unlikely(!st)) {
-                error("PLUGINSD: '%s' is requesting a BEGIN on chart '%s', which does not exist on host '%s'. Disabling it.", cd->fullfilename, id, host->hostname);
-                enabled = 0;
-                break;
-            }
+static inline int pluginsd_parser_begin(struct pluginsd_parser *p, char **words) {
+    char *id = words[1];
+    char *microseconds_txt = words[2];
 
-            if(likely(st->counter_done)) {
-                usec_t microseconds = 0;
-                if(microseconds_txt && *microseconds_txt) microseconds = str2ull(microseconds_txt);
+    if(unlikely(!id)) {
+        error("PLUGINSD: '%s' is requesting a BEGIN without a chart id for host '%s'. Disabling it.", p->cd->fullfilename, p->host->hostname);
+        return pluginsd_parser_disable(p);
+    }
 
-                if(likely(microseconds)) {
-                    if(trust_durations)
-                        rrdset_next_usec_unfiltered(st, microseconds);
-                    else
-                        rrdset_next_usec(st, microseconds);
-                }
-                else rrdset_next(st);
+    p->st = pluginsd_find_chart(p, id);
+    if(unlikely(!p->st)) {
+        error("PLUGINSD: '%s' is requesting a BEGIN on chart '%s', which does not exist on host '%s'. Disabling it.", p->cd->fullfilename, id, p->host->hostname);
+        return pluginsd_parser_disable(p);
+    }
+
+    p->rd = p->st->dimensions;
+
+    usec_t microseconds = 0;
+    if(microseconds_txt && *microseconds_txt) microseconds = str2ull(microseconds_txt);
+
+    pluginsd_begin(p->st, microseconds, p->trust_durations);
+    return 0;
+}
+
+static inline int pluginsd_parser_end(struct pluginsd_parser *p) {
+    RRDSET *st = p->st;
+
+    if(unlikely(!st)) {
+        error("PLUGINSD: '%s' is requesting an END, without a BEGIN on host '%s'. Disabling it.", p->cd->fullfilename, p->host->hostname);
+        return pluginsd_parser_disable(p);
+    }
+
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG))) debug(D_PLUGINSD, "PLUGINSD: '%s' is requesting an END on chart %s", p->cd->fullfilename, st->id);
+
+    rrdset_done(st);
+    p->st = NULL;
+    p->rd = NULL;
+
+    p->count++;
+    return 0;
+}
+
+// process a text line
+// returns 0 on success, -1 when the plugin has to be disabled
+static int pluginsd_parser_line(struct pluginsd_parser *p, char *line) {
+    RRDHOST *host = p->host;
+    struct plugind *cd = p->cd;
+    char **words = p->words;
+    uint32_t hash;
+
+    // debug(D_PLUGINSD, "PLUGINSD: %s: %s", cd->filename, line);
+
+    int w = pluginsd_split_words(line, words, MAX_WORDS);
+    char *s = words[0];
+    if(unlikely(!s || !*s || !w)) {
+        // debug(D_PLUGINSD, "PLUGINSD: empty line");
+        return 0;
+    }
+
+    // debug(D_PLUGINSD, "PLUGINSD: words 0='%s' 1='%s' 2='%s' 3='%s' 4='%s' 5='%s' 6='%s' 7='%s' 8='%s' 9='%s'", words[0], words[1], words[2], words[3], words[4], words[5], words[6], words[7], words[8], words[9]);
+
+    // the keywords of data collection are recognized without hashing
+    switch(*s) {
+        case 'S':
+            if(likely(s[1] == 'E' && s[2] == 'T' && !s[3])) return pluginsd_parser_set(p, words);
+            break;
+
+        case 'B':
+            if(likely(!strcmp(s, "BEGIN"))) return pluginsd_parser_begin(p, words);
+            break;
+
+        case 'E':
+            if(likely(s[1] == 'N' && s[2] == 'D' && !s[3])) return pluginsd_parser_end(p);
+            break;
+    }
+
+    hash = simple_hash(s);
+
+    if(likely(hash == FLUSH_HASH && !strcmp(s, "FLUSH"))) {
+        debug(D_PLUGINSD, "PLUGINSD: '%s' is requesting a FLUSH", cd->fullfilename);
+        p->st = NULL;
+        p->rd = NULL;
+    }
+    else if(likely(hash == CHART_HASH && !strcmp(s, "CHART"))) {
+        int noname = 0;
+        RRDSET *st = NULL;
+        p->st = NULL;
+        p->rd = NULL;
+        p->chart_slot = NULL;
+
+        if((words[1]) != NULL && (words[2]) != NULL && strcmp(words[1], words[2]) == 0)
+            noname = 1;
+
+        char *type = words[1];
+        char *id = NULL;
+        if(likely(type)) {
+            id = strchr(type, '.');
+            if(likely(id)) { *id = '\0'; id++; }
+        }
+        char *name = words[2];
+        char *title = words[3];
+        char *units = words[4];
+        char *family = words[5];
+        char *context = words[6];
+        char *chart = words[7];
+        char *priority_s = words[8];
+        char *update_every_s = words[9];
+        char *slot_s = words[10];
+
+        if(unlikely(!type || !*type || !id || !*id)) {
+            error("PLUGINSD: '%s' is requesting a CHART, without a type.id, on host '%s'. Disabling it.", cd->fullfilename, host->hostname);
+            return pluginsd_parser_disable(p);
+        }
+
+        int priority = 1000;
+        if(likely(priority_s)) priority = str2i(priority_s);
+
+        int update_every = cd->update_every;
+        if(likely(update_every_s)) update_every = str2i(update_every_s);
+        if(unlikely(!update_every)) update_every = cd->update_every;
+
+        RRDSET_TYPE chart_type = RRDSET_TYPE_LINE;
+        if(unlikely(chart)) chart_type = rrdset_type_id(chart);
+
+        if(unlikely(noname || !name || !*name || strcasecmp(name, "NULL") == 0 || strcasecmp(name, "(NULL)") == 0)) name = NULL;
+        if(unlikely(!family || !*family)) family = NULL;
+        if(unlikely(!context || !*context)) context = NULL;
+
+        st = rrdset_find_bytype(host, type, id);
+        if(unlikely(!st)) {
+            debug(D_PLUGINSD, "PLUGINSD: Creating chart type='%s', id='%s', name='%s', family='%s', context='%s', chart='%s', priority=%d, update_every=%d"
+                  , type, id
+                  , name?name:""
+                  , family?family:""
+                  , context?context:""
+                  , rrdset_type_name(chart_type)
+                  , priority
+                  , update_every
+            );
+
+            st = rrdset_create(host, type, id, name, family, context, title, units, priority, update_every, chart_type);
+            cd->update_every = update_every;
+            p->new_charts++;
+        }
+        else debug(D_PLUGINSD, "PLUGINSD: Chart '%s' already exists. Not adding it again.", st->id);
+
+        p->st = st;
+
+        if(p->binary && slot_s && *slot_s) {
+            p->chart_slot = pluginsd_chart_slot(&p->slots, str2ul(slot_s), st);
+            if(unlikely(!p->chart_slot)) {
+                error("PLUGINSD: '%s' is requesting CHART '%s' with invalid id '%s', on host '%s'. Disabling it.", cd->fullfilename, st->id, slot_s, host->hostname);
+                return pluginsd_parser_disable(p);
             }
         }
-        else if(likely(hash == END_HASH && !strcmp(s, "END"))) {
-            if(unlikely(!st)) {
-                error("PLUGINSD: '%s' is requesting an END, without a BEGIN on host '%s'. Disabling it.", cd->fullfilename, host->hostname);
-                enabled = 0;
-                break;
+    }
+    else if(likely(hash == DIMENSION_HASH && !strcmp(s, "DIMENSION"))) {
+        char *id = words[1];
+        char *name = words[2];
+        char *algorithm = words[3];
+        char *multiplier_s = words[4];
+        char *divisor_s = words[5];
+        char *options = words[6];
+        char *slot_s = words[7];
+        char *last_value_s = words[8];
+        RRDSET *st = p->st;
+
+        if(unlikely(!id || !*id)) {
+            error("PLUGINSD: '%s' is requesting a DIMENSION, without an id, host '%s' and chart '%s'. Disabling it.", cd->fullfilename, host->hostname, st?st->id:"UNSET");
+            return pluginsd_parser_disable(p);
+        }
+
+        if(unlikely(!st)) {
+            error("PLUGINSD: '%s' is requesting a DIMENSION, without a CHART, on host '%s'. Disabling it.", cd->fullfilename, host->hostname);
+            return pluginsd_parser_disable(p);
+        }
+
+        long multiplier = 1;
+        if(multiplier_s && *multiplier_s) multiplier = strtol(multiplier_s, NULL, 0);
+        if(unlikely(!multiplier)) multiplier = 1;
+
+        long divisor = 1;
+        if(likely(divisor_s && *divisor_s)) divisor = strtol(divisor_s, NULL, 0);
+        if(unlikely(!divisor)) divisor = 1;
+
+        if(unlikely(!algorithm || !*algorithm)) algorithm = "absolute";
+
+        if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG)))
+            debug(D_PLUGINSD, "PLUGINSD: Creating dimension in chart %s, id='%s', name='%s', algorithm='%s', multiplier=%ld, divisor=%ld, hidden='%s'"
+                  , st->id
+                  , id
+                  , name?name:""
+                  , rrd_algorithm_name(rrd_algorithm_id(algorithm))
+                  , multiplier
+                  , divisor
+                  , options?options:""
+            );
+
+        RRDDIM *rd = rrddim_find(st, id);
+        if(unlikely(!rd)) {
+            rd = rrddim_add(st, id, name, multiplier, divisor, rrd_algorithm_id(algorithm));
+            rrddim_flag_clear(rd, RRDDIM_FLAG_HIDDEN);
+            rrddim_flag_clear(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS);
+            if(options && *options) {
+                if(strstr(options, "hidden") != NULL) rrddim_flag_set(rd, RRDDIM_FLAG_HIDDEN);
+                if(strstr(options, "noreset") != NULL) rrddim_flag_set(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS);
+                if(strstr(options, "nooverflow") != NULL) rrddim_flag_set(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS);
             }
+            rrdset_metadata_changed(st);
+        }
+        else if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG)))
+            debug(D_PLUGINSD, "PLUGINSD: dimension %s/%s already exists. Not adding it again.", st->id, id);
 
-            if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG))) debug(D_PLUGINSD, "PLUGINSD: '%s' is requesting an END on chart %s", cd->fullfilename, st->id);
+        if(p->chart_slot && slot_s && *slot_s && unlikely(pluginsd_dimension_slot(p->chart_slot, str2ul(slot_s), rd, (last_value_s && *last_value_s)?pluginsd_str2collected(last_value_s):0))) {
+            error("PLUGINSD: '%s' is requesting DIMENSION '%s' of chart '%s' with invalid id '%s', on host '%s'. Disabling it.", cd->fullfilename, id, st->id, slot_s, host->hostname);
+            return pluginsd_parser_disable(p);
+        }
+    }
+    else if(likely(hash == REPLAY_SET_HASH && !strcmp(s, "REPLAY_SET"))) {
+        if(unlikely(!p->replay_st || !words[1])) return 0;
 
-            rrdset_done(st);
-            st = NULL;
+        RRDDIM *rd = rrddim_find(p->replay_st, words[1]);
+        if(unlikely(!rd)) return 0;
+
+        int i;
+        for(i = 2; i < MAX_WORDS && words[i] ; i++)
+            p->replay_points += rrddim_replay_value(p->replay_st, rd, p->replay_first_t + (time_t)(i - 2) * p->replay_st->update_every, (storage_number)str2ul(words[i]));
+    }
+    else if(likely(hash == REPLAY_BEGIN_HASH && !strcmp(s, "REPLAY_BEGIN"))) {
+        char *id = words[1];
+        char *first_t_txt = words[2];
+        char *update_every_txt = words[3];
 
-            count++;
+        p->replay_st = NULL;
+
+        if(unlikely(!id || !first_t_txt || !update_every_txt)) {
+            error("PLUGINSD: '%s' is requesting a REPLAY_BEGIN with missing parameters, on host '%s'. Ignoring it.", cd->fullfilename, host->hostname);
+            return 0;
         }
-/*        else if(likely(hash == HOST_HASH && !strcmp(s, "HOST"))) {
-            char *guid = words[1];
-            char *hostname = words[2];
 
-            if(unlikely(!guid || !*guid)) {
-                error("PLUGINSD: '%s' is requesting HOST with guid '%s' and hostname '%s', without a guid. Disabling it.", cd->fullfilename, guid?guid:"", hostname?hostname:"");
-                enabled = 0;
-                break;
-            }
-            if(unlikely(!hostname || !*hostname)) {
-                error("PLUGINSD: '%s' is requesting HOST with guid '%s' and hostname '%s', without a hostname. Disabling it.", cd->fullfilename, guid?guid:"", hostname?hostname:"");
-                enabled = 0;
-                break;
-            }
+        // the past values of charts we do not have, or have with a different resolution, are ignored
+        p->replay_st = rrdset_find(host, id);
+        if(p->replay_st && p->replay_st->update_every != str2i(update_every_txt))
+            p->replay_st = NULL;
 
-            host = rrdhost_find_or_create(hostname, guid);
-        } */
-        else if(likely(hash == FLUSH_HASH && !strcmp(s, "FLUSH"))) {
-            debug(D_PLUGINSD, "PLUGINSD: '%s' is requesting a FLUSH", cd->fullfilename);
-            st = NULL;
+        p->replay_first_t = (time_t)str2l(first_t_txt);
+    }
+    else if(unlikely(hash == SHM_HASH && !strcmp(s, PLUGINSD_SHM_KEYWORD))) {
+        if(unlikely(!cd->shm || p->shm)) {
+            error("PLUGINSD: '%s' is requesting shared memory, which has not been offered to it, on host '%s'. Disabling it.", cd->fullfilename, host->hostname);
+            return pluginsd_parser_disable(p);
         }
-        else if(likely(hash == CHART_HASH && !strcmp(s, "CHART"))) {
-            int noname = 0;
-            st = NULL;
-
-            if((words[1]) != NULL && (words[2]) != NULL && strcmp(words[1], words[2]) == 0)
-                noname = 1;
-
-            char *type = words[1];
-            char *id = NULL;
-            if(likely(type)) {
-                id = strchr(type, '.');
-                if(likely(id)) { *id = '\0'; id++; }
-            }
-            char *name = words[2];
-            char *title = words[3];
-            char *units = words[4];
-            char *family = words[5];
-            char *context = words[6];
-            char *chart = words[7];
-            char *priority_s = words[8];
-            char *update_every_s = words[9];
-
-            if(unlikely(!type || !*type || !id || !*id)) {
-                error("PLUGINSD: '%s' is requesting a CHART, without a type.id, on host '%s'. Disabling it.", cd->fullfilename, host->hostname);
-                enabled = 0;
+
+        if(unlikely(!words[1] || str2i(words[1]) != PLUGINSD_SHM_VERSION)) {
+            error("PLUGINSD: '%s' is requesting shared memory version '%s', but netdata supports only version %d. Disabling it.", cd->fullfilename, (words[1])?words[1]:"", PLUGINSD_SHM_VERSION);
+            return pluginsd_parser_disable(p);
+        }
+
+        info("PLUGINSD: '%s' switched to shared memory '%s'.", cd->fullfilename, cd->shm->name);
+
+        // the values of charts come in binary frames from now on
+        p->shm = cd->shm;
+        p->binary = 1;
+    }
+    else if(unlikely(hash == DISABLE_HASH && !strcmp(s, "DISABLE"))) {
+        info("PLUGINSD: '%s' called DISABLE. Disabling it.", cd->fullfilename);
+        return pluginsd_parser_disable(p);
+    }
+    else {
+        error("PLUGINSD: '%s' is sending command '%s' which is not known by netdata, for host '%s'. Disabling it.", cd->fullfilename, s, host->hostname);
+        return pluginsd_parser_disable(p);
+    }
+
+    return 0;
+}
+
+// processes all the complete lines and frames of data
+// the lines are modified in place
+// returns the number of bytes consumed, or -1 when the plugin has to be disabled
+ssize_t pluginsd_parser_feed(struct pluginsd_parser *p, char *data, size_t len) {
+    size_t pos = 0;
+
+    p->throttled = 0;
+
+    while(pos < len) {
+        if(unlikely(netdata_exit)) return -1;
+
+        if(unlikely(p->limited)) {
+            if(unlikely(p->lines >= p->lines_limit
+                        || (p->new_charts >= p->new_charts_limit && len - pos > 6 && !strncmp(&data[pos], "CHART ", 6)))) {
+                p->throttled = 1;
                 break;
             }
+        }
+
+        if(p->binary && data[pos] == STREAM_BINARY_DATA) {
+            ssize_t frame = pluginsd_binary_frame_length(&data[pos + 1], len - pos - 1);
+            if(!frame) break;
 
-            int priority = 1000;
-            if(likely(priority_s)) priority = str2i(priority_s);
-
-            int update_every = cd->update_every;
-            if(likely(update_every_s)) update_every = str2i(update_every_s);
-            if(unlikely(!update_every)) update_every = cd->update_every;
-
-            RRDSET_TYPE chart_type = RRDSET_TYPE_LINE;
-            if(unlikely(chart)) chart_type = rrdset_type_id(chart);
-
-            if(unlikely(noname || !name || !*name || strcasecmp(name, "NULL") == 0 || strcasecmp(name, "(NULL)") == 0)) name = NULL;
-            if(unlikely(!family || !*family)) family = NULL;
-            if(unlikely(!context || !*context)) context = NULL;
-
-            st = rrdset_find_bytype(host, type, id);
-            if(unlikely(!st)) {
-                debug(D_PLUGINSD, "PLUGINSD: Creating chart type='%s', id='%s', name='%s', family='%s', context='%s', chart='%s', priority=%d, update_every=%d"
-                      , type, id
-                      , name?name:""
-                      , family?family:""
-                      , context?context:""
-                      , rrdset_type_name(chart_type)
-                      , priority
-                      , update_every
-                );
-
-                st = rrdset_create(host, type, id, name, family, context, title, units, priority, update_every, chart_type);
-                cd->update_every = update_every;
+            if(unlikely(frame < 0)) {
+                error("PLUGINSD: '%s' sent an invalid binary data frame for host '%s'.", p->cd->fullfilename, p->host->hostname);
+                return pluginsd_parser_disable(p);
             }
-            else debug(D_PLUGINSD, "PLUGINSD: Chart '%s' already exists. Not adding it again.", st->id);
+
+            if(unlikely(pluginsd_process_binary_data(p, &data[pos + 1])))
+                return pluginsd_parser_disable(p);
+
+            p->count++;
+            pos += 1 + frame;
+            continue;
         }
-        else if(likely(hash == DIMENSION_HASH && !strcmp(s, "DIMENSION"))) {
-            char *id = words[1];
-            char *name = words[2];
-            char *algorithm = words[3];
-            char *multiplier_s = words[4];
-            char *divisor_s = words[5];
-            char *options = words[6];
-
-            if(unlikely(!id || !*id)) {
-                error("PLUGINSD: '%s' is requesting a DIMENSION, without an id, host '%s' and chart '%s'. Disabling it.", cd->fullfilename, host->hostname, st?st->id:"UNSET");
-                enabled = 0;
-                break;
+
+        char *line = &data[pos];
+        char *nl = memchr(line, '\n', len - pos);
+        if(!nl) {
+            if(unlikely(len - pos >= PLUGINSD_LINE_MAX)) {
+                error("PLUGINSD: '%s' sent a line longer than %d bytes, for host '%s'. Disabling it.", p->cd->fullfilename, PLUGINSD_LINE_MAX, p->host->hostname);
+                return pluginsd_parser_disable(p);
             }
+            break;
+        }
 
-            if(unlikely(!st)) {
-                error("PLUGINSD: '%s' is requesting a DIMENSION, without a CHART, on host '%s'. Disabling it.", cd->fullfilename, host->hostname);
-                enabled = 0;
-                break;
+        *nl = '\0';
+        pos = nl - data + 1;
+
+        if(unlikely(pluginsd_parser_line(p, line)))
+            return -1;
+
+        p->lines++;
+    }
+
+    return (ssize_t)pos;
+}
+
+// limits the next feeds to this many more lines and new charts, (size_t)-1 = unlimited
+// a feed stops before the line or binary frame that would exceed them
+void pluginsd_parser_allow(struct pluginsd_parser *p, size_t lines, size_t new_charts) {
+    p->limited = 1;
+    p->lines_limit = (lines > SIZE_MAX - p->lines)?SIZE_MAX:p->lines + lines;
+    p->new_charts_limit = (new_charts > SIZE_MAX - p->new_charts)?SIZE_MAX:p->new_charts + new_charts;
+}
+
+// returns 1 when the last feed stopped because of the limits
+int pluginsd_parser_throttled(struct pluginsd_parser *p) {
+    return p->throttled;
+}
+
+void pluginsd_parser_counters(struct pluginsd_parser *p, size_t *lines, size_t *new_charts) {
+    *lines = p->lines;
+    *new_charts = p->new_charts;
+}
+
+// the output of plugins is read in chunks of this size
+#define PLUGINSD_READ_BUFFER_SIZE (64 * 1024)
+
+// ----------------------------------------------------------------------------
+// the shared memory transport (see plugins_d_shm.h)
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+#define PLUGINSD_SHM 1
+#endif
+
+// creates the shared memory offered to a plugin
+// returns NULL when it is not available
+static struct pluginsd_shm *pluginsd_shm_create(struct plugind *cd) {
+#ifdef PLUGINSD_SHM
+    struct pluginsd_shm *shm = callocz(1, sizeof(struct pluginsd_shm));
+    snprintfz(shm->name, NAME_MAX, "/netdata-%d-%d", getpid(), gettid());
+    shm->size = PLUGINSD_SHM_RING_SIZE;
+
+    // a left over of a crashed netdata
+    shm_unlink(shm->name);
+
+    size_t size = sizeof(struct pluginsd_shm_header) + shm->size;
+
+    int fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if(fd == -1) {
+        error("PLUGINSD: '%s' cannot create shared memory '%s'.", cd->fullfilename, shm->name);
+        freez(shm);
+        return NULL;
+    }
+
+    if(ftruncate(fd, (off_t)size) == -1) {
+        error("PLUGINSD: '%s' cannot set the size of shared memory '%s' to %zu bytes.", cd->fullfilename, shm->name, size);
+        close(fd);
+        shm_unlink(shm->name);
+        freez(shm);
+        return NULL;
+    }
+
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(mem == MAP_FAILED) {
+        error("PLUGINSD: '%s' cannot map shared memory '%s'.", cd->fullfilename, shm->name);
+        shm_unlink(shm->name);
+        freez(shm);
+        return NULL;
+    }
+
+    shm->header = (struct pluginsd_shm_header *)mem;
+    shm->header->magic = PLUGINSD_SHM_MAGIC;
+    shm->header->version = PLUGINSD_SHM_VERSION;
+    shm->header->size = shm->size;
+
+    debug(D_PLUGINSD, "PLUGINSD: '%s' is offered shared memory '%s'.", cd->fullfilename, shm->name);
+    return shm;
+#else
+    (void)cd;
+    return NULL;
+#endif
+}
+
+static void pluginsd_shm_unlink(struct pluginsd_shm *shm) {
+#ifdef PLUGINSD_SHM
+    if(!shm->unlinked && shm_unlink(shm->name) == -1)
+        error("PLUGINSD: cannot remove shared memory '%s'.", shm->name);
+#endif
+
+    shm->unlinked = 1;
+}
+
+static void pluginsd_shm_free(struct pluginsd_shm *shm) {
+    if(!shm) return;
+
+    pluginsd_shm_unlink(shm);
+    munmap(shm->header, sizeof(struct pluginsd_shm_header) + shm->size);
+    freez(shm);
+}
+
+#ifdef PLUGINSD_SHM
+
+// copies to data up to size bytes written by the plugin
+// returns the number of bytes copied, or -1 when the ring is corrupted
+static ssize_t pluginsd_shm_read(struct pluginsd_shm *shm, char *data, size_t size) {
+    struct pluginsd_shm_header *h = shm->header;
+    const char *ring = pluginsd_shm_ring(h);
+
+    uint64_t tail = h->tail;
+    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_SEQ_CST);
+
+    // the plugin may have written anything there
+    if(unlikely(head - tail > shm->size))
+        return -1;
+
+    size_t len = (size_t)(head - tail);
+    if(len > size) len = size;
+    if(!len) return 0;
+
+    size_t offset = (size_t)(tail & (shm->size - 1));
+    size_t first = shm->size - offset;
+    if(first > len) first = len;
+
+    memcpy(data, &ring[offset], first);
+    if(unlikely(first < len))
+        memcpy(&data[first], ring, len - first);
+
+    __atomic_store_n(&h->tail, tail + len, __ATOMIC_RELEASE);
+    return (ssize_t)len;
+}
+
+// processes what the plugin writes to the shared memory, until it exits
+// its standard output (fd) is used only to wake us up
+static void pluginsd_process_shm(struct pluginsd_parser *p, int fd, char *buffer) {
+    struct plugind *cd = p->cd;
+    struct pluginsd_shm *shm = p->shm;
+    size_t len = 0;
+    char wakeups[1024];
+
+    // the plugin has mapped it already
+    pluginsd_shm_unlink(shm);
+
+    for(;;) {
+        if(unlikely(netdata_exit)) break;
+
+        // whatever the plugin writes after this, will wake us up again
+        __atomic_store_n(&shm->header->wakeup_pending, 0, __ATOMIC_SEQ_CST);
+
+        for(;;) {
+            ssize_t bytes = pluginsd_shm_read(shm, &buffer[len], PLUGINSD_READ_BUFFER_SIZE - len);
+            if(!bytes) break;
+
+            if(unlikely(bytes < 0)) {
+                error("PLUGINSD: '%s' has corrupted its shared memory '%s'. Disabling it.", cd->fullfilename, shm->name);
+                pluginsd_parser_disable(p);
+                return;
             }
 
-            long multiplier = 1;
-            if(multiplier_s && *multiplier_s) multiplier = strtol(multiplier_s, NULL, 0);
-            if(unlikely(!multiplier)) multiplier = 1;
-
-            long divisor = 1;
-            if(likely(divisor_s && *divisor_s)) divisor = strtol(divisor_s, NULL, 0);
-            if(unlikely(!divisor)) divisor = 1;
-
-            if(unlikely(!algorithm || !*algorithm)) algorithm = "absolute";
-
-            if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG)))
-                debug(D_PLUGINSD, "PLUGINSD: Creating dimension in chart %s, id='%s', name='%s', algorithm='%s', multiplier=%ld, divisor=%ld, hidden='%s'"
-                      , st->id
-                      , id
-                      , name?name:""
-                      , rrd_algorithm_name(rrd_algorithm_id(algorithm))
-                      , multiplier
-                      , divisor
-                      , options?options:""
-                );
-
-            RRDDIM *rd = rrddim_find(st, id);
-            if(unlikely(!rd)) {
-                rd = rrddim_add(st, id, name, multiplier, divisor, rrd_algorithm_id(algorithm));
-                rrddim_flag_clear(rd, RRDDIM_FLAG_HIDDEN);
-                rrddim_flag_clear(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS);
-                if(options && *options) {
-                    if(strstr(options, "hidden") != NULL) rrddim_flag_set(rd, RRDDIM_FLAG_HIDDEN);
-                    if(strstr(options, "noreset") != NULL) rrddim_flag_set(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS);
-                    if(strstr(options, "nooverflow") != NULL) rrddim_flag_set(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS);
-                }
+            len += bytes;
+            buffer[len] = '\0';
+
+            ssize_t consumed = pluginsd_parser_feed(p, buffer, len);
+            if(unlikely(consumed < 0)) return;
+
+            if(consumed) {
+                len -= consumed;
+                memmove(buffer, &buffer[consumed], len);
+            }
+            else if(unlikely(len == PLUGINSD_READ_BUFFER_SIZE)) {
+                error("PLUGINSD: '%s' sent a data frame bigger than %d bytes. Disabling it.", cd->fullfilename, PLUGINSD_READ_BUFFER_SIZE);
+                pluginsd_parser_disable(p);
+                return;
             }
-            else if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_DEBUG)))
-                debug(D_PLUGINSD, "PLUGINSD: dimension %s/%s already exists. Not adding it again.", st->id, id);
         }
-        else if(unlikely(hash == DISABLE_HASH && !strcmp(s, "DISABLE"))) {
-            info("PLUGINSD: '%s' called DISABLE. Disabling it.", cd->fullfilename);
-            enabled = 0;
+
+        ssize_t bytes = read(fd, wakeups, sizeof(wakeups));
+        if(unlikely(bytes <= 0)) {
+            if(bytes == -1 && errno == EINTR) continue;
+
+            error("PLUGINSD: %s : read failed.", cd->fullfilename);
             break;
         }
-        else {
-            error("PLUGINSD: '%s' is sending command '%s' which is not known by netdata, for host '%s'. Disabling it.", cd->fullfilename, s, host->hostname);
-            enabled = 0;
+    }
+}
+
+#endif /* PLUGINSD_SHM */
+
+// ----------------------------------------------------------------------------
+
+size_t pluginsd_process(RRDHOST *host, struct plugind *cd, FILE *fp, int trust_durations) {
+    if(!fp || !cd->enabled) {
+        cd->enabled = 0;
+        return 0;
+    }
+
+    // read with read(), bypassing the buffering of fp
+    int fd = fileno(fp);
+
+    struct pluginsd_parser *p = pluginsd_parser_create(host, cd, trust_durations, 0);
+    char *buffer = mallocz(PLUGINSD_READ_BUFFER_SIZE + 2);
+    size_t len = 0;
+
+    errno = 0;
+
+    for(;;) {
+        if(unlikely(netdata_exit)) break;
+
+        ssize_t bytes = read(fd, &buffer[len], PLUGINSD_READ_BUFFER_SIZE - len);
+        if(unlikely(bytes <= 0)) {
+            if(bytes == -1 && errno == EINTR) continue;
+
+            // the last line may not be terminated
+            if(!bytes && len && !netdata_exit) {
+                buffer[len++] = '\n';
+                buffer[len] = '\0';
+                pluginsd_parser_feed(p, buffer, len);
+            }
+
+            error("PLUGINSD: %s : read failed.", cd->fullfilename);
             break;
         }
-    }
 
-cleanup:
-    cd->enabled = enabled;
+        if(unlikely(netdata_exit)) break;
 
-    if(likely(count)) {
-        cd->successful_collections += count;
-        cd->serial_failures = 0;
+        len += bytes;
+        buffer[len] = '\0';
+
+        // lines longer than PLUGINSD_LINE_MAX disable the plugin, so the buffer never fills up
+        ssize_t consumed = pluginsd_parser_feed(p, buffer, len);
+        if(unlikely(consumed < 0)) break;
+
+#ifdef PLUGINSD_SHM
+        // the rest of the pipe are wake ups
+        if(unlikely(p->shm)) {
+            pluginsd_process_shm(p, fd, buffer);
+            break;
+        }
+#endif
+
+        // SHM has to be the first line, so the plugin does not want it
+        if(unlikely(cd->shm && consumed)) {
+            pluginsd_shm_free(cd->shm);
+            cd->shm = NULL;
+        }
+
+        if(consumed) {
+            len -= consumed;
+            memmove(buffer, &buffer[consumed], len);
+        }
     }
-    else
-        cd->serial_failures++;
 
-    return count;
+    freez(buffer);
+    return pluginsd_parser_free(p);
 }
 
 void *pluginsd_worker_thread(void *arg) {
@@ -374,9 +1039,17 @@ void *pluginsd_worker_thread(void *arg) {
     for(;;) {
         if(unlikely(netdata_exit)) break;
 
-        FILE *fp = mypopen(cd->cmd, &cd->pid);
+        // the plugin finds the shared memory in its environment
+        char command[PLUGINSD_CMD_MAX + NAME_MAX + 100 + 1];
+        cd->shm = (cd->shm_enabled)?pluginsd_shm_create(cd):NULL;
+        if(cd->shm) snprintfz(command, PLUGINSD_CMD_MAX + NAME_MAX + 100, PLUGINSD_SHM_ENV "='%s' %s", cd->shm->name, cd->cmd);
+        else strncpyz(command, cd->cmd, PLUGINSD_CMD_MAX + NAME_MAX + 100);
+
+        FILE *fp = mypopen(command, &cd->pid);
         if(unlikely(!fp)) {
-            error("Cannot popen(\"%s\", \"r\").", cd->cmd);
+            error("Cannot popen(\"%s\", \"r\").", command);
+            pluginsd_shm_free(cd->shm);
+            cd->shm = NULL;
             break;
         }
 
@@ -392,6 +1065,9 @@ void *pluginsd_worker_thread(void *arg) {
         // get the return code
         int code = mypclose(fp, cd->pid);
 
+        pluginsd_shm_free(cd->shm);
+        cd->shm = NULL;
+
         if(unlikely(netdata_exit)) break;
         else if(code != 0) {
             // the plugin reports failure
@@ -457,6 +1133,7 @@ void *pluginsd_main(void *ptr) {
 
     int automatic_run = config_get_boolean(CONFIG_SECTION_PLUGINS, "enable running new plugins", 1);
     int scan_frequency = (int) config_get_number(CONFIG_SECTION_PLUGINS, "check for new plugins every", 60);
+    int shm_enabled = config_get_boolean(CONFIG_SECTION_PLUGINS, "offer shared memory to plugins", 1);
     DIR *dir = NULL;
     struct dirent *file = NULL;
     struct plugind *cd;
@@ -519,6 +1196,7 @@ void *pluginsd_main(void *ptr) {
 
                 cd->enabled = enabled;
                 cd->update_every = (int) config_get_number(cd->id, "update every", localhost->rrd_update_every);
+                cd->shm_enabled = config_get_boolean(cd->id, "offer shared memory", shm_enabled);
                 cd->started_t = now_realtime_sec();
 
                 char *def = "";
@@ -6,6 +6,16 @@
 #define PLUGINSD_CMD_MAX (FILENAME_MAX*2)
 #define PLUGINSD_LINE_MAX 1024
 
+#include "plugins_d_shm.h"
+
+// the shared memory netdata offers to a plugin
+struct pluginsd_shm {
+    char name[NAME_MAX + 1];
+    int unlinked;                       // 1 when the name has been removed
+    size_t size;                        // the size of the ring
+    struct pluginsd_shm_header *header;
+};
+
 struct plugind {
     char id[CONFIG_MAX_NAME+1];         // config node id
 
@@ -26,6 +36,9 @@ struct plugind {
     volatile int obsolete;              // do not touch this structure after setting this to 1
     volatile int enabled;               // if this is enabled or not
 
+    int shm_enabled;                    // 1 when the plugin is offered the shared memory transport
+    struct pluginsd_shm *shm;           // the shared memory of the running plugin, or NULL
+
     time_t started_t;
 
     struct plugind *next;
@@ -36,4 +49,12 @@ extern struct plugind *pluginsd_root;
 extern void *pluginsd_main(void *ptr);
 extern size_t pluginsd_process(RRDHOST *host, struct plugind *cd, FILE *fp, int trust_durations);
 
+struct pluginsd_parser;
+extern struct pluginsd_parser *pluginsd_parser_create(RRDHOST *host, struct plugind *cd, int trust_durations, int binary);
+extern ssize_t pluginsd_parser_feed(struct pluginsd_parser *p, char *data, size_t len);
+extern size_t pluginsd_parser_free(struct pluginsd_parser *p);
+extern void pluginsd_parser_allow(struct pluginsd_parser *p, size_t lines, size_t new_charts);
+extern int pluginsd_parser_throttled(struct pluginsd_parser *p);
+extern void pluginsd_parser_counters(struct pluginsd_parser *p, size_t *lines, size_t *new_charts);
+
 #endif /* NETDATA_PLUGINS_D_H */
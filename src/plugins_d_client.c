@@ -0,0 +1,490 @@
+// the plugins.d client library - see plugins_d_client.h
+// it has to depend only on the C library
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "plugins_d_shm.h"
+#include "plugins_d_client.h"
+
+#if defined(__ATOMIC_SEQ_CST) && defined(_POSIX_SHARED_MEMORY_OBJECTS) && (_POSIX_SHARED_MEMORY_OBJECTS > 0)
+#define PLUGINSD_CLIENT_SHM 1
+#endif
+
+// the same as STREAM_BINARY_DATA and STREAM_VARINT_MAX_BYTES in rrdpush.h
+#define PLUGINSD_CLIENT_BINARY_DATA 0x01
+#define PLUGINSD_CLIENT_VARINT_MAX_BYTES 10
+
+// the output is sent when this much has been buffered, even without pluginsd_client_flush()
+#define PLUGINSD_CLIENT_FLUSH_SIZE (64 * 1024)
+
+struct pluginsd_client_dimension {
+    char *id;
+    size_t slot;                        // its id in the binary frames, starting at 1
+
+    int updated;                        // 1 when it has been set in the current update
+    long long value;                    // the value of the current update
+    long long last_value;               // the last value sent in a binary frame
+
+    PLUGINSD_CLIENT_CHART *st;
+    PLUGINSD_CLIENT_DIMENSION *next;
+};
+
+struct pluginsd_client_chart {
+    char *type;
+    char *id;
+    size_t slot;                        // its id in the binary frames, starting at 1
+    uint64_t usec;                      // the usec of the current update
+
+    size_t dimensions;                  // the number of its dimensions
+    PLUGINSD_CLIENT_DIMENSION *dimensions_root;
+    PLUGINSD_CLIENT_DIMENSION *dimensions_last;
+    PLUGINSD_CLIENT_DIMENSION *cursor;  // the dimension pluginsd_client_set_by_id() checks first
+
+    PLUGINSD_CLIENT *c;
+    PLUGINSD_CLIENT_CHART *next;
+};
+
+struct pluginsd_client {
+    FILE *fp;
+    int fd;                             // the file descriptor of fp, to wake up netdata
+
+    struct pluginsd_shm_header *shm;    // NULL when the shared memory is not used
+    size_t shm_size;
+
+    char *buffer;                       // the output not sent yet
+    size_t len;
+    size_t size;
+
+    size_t charts;                      // the number of charts
+    PLUGINSD_CLIENT_CHART *charts_root;
+    PLUGINSD_CLIENT_CHART *charts_last;
+    PLUGINSD_CLIENT_CHART *cursor;      // the chart pluginsd_client_chart_find() checks first
+};
+
+// ----------------------------------------------------------------------------
+// memory
+
+static void *pluginsd_client_callocz(size_t nmemb, size_t size) {
+    void *p = calloc(nmemb, size);
+    if(!p) {
+        fprintf(stderr, "PLUGINSD CLIENT: cannot allocate %zu bytes of memory.\n", nmemb * size);
+        exit(1);
+    }
+    return p;
+}
+
+static char *pluginsd_client_strdupz(const char *s) {
+    size_t len = strlen(s);
+    char *t = pluginsd_client_callocz(1, len + 1);
+    memcpy(t, s, len);
+    return t;
+}
+
+// makes sure there are at least size bytes available in the output buffer
+static inline char *pluginsd_client_need(PLUGINSD_CLIENT *c, size_t size) {
+    if(c->len + size > c->size) {
+        size_t wanted = (c->size)?c->size:PLUGINSD_CLIENT_FLUSH_SIZE;
+        while(c->len + size > wanted) wanted *= 2;
+
+        char *b = realloc(c->buffer, wanted);
+        if(!b) {
+            fprintf(stderr, "PLUGINSD CLIENT: cannot allocate %zu bytes of memory.\n", wanted);
+            exit(1);
+        }
+
+        c->buffer = b;
+        c->size = wanted;
+    }
+
+    return &c->buffer[c->len];
+}
+
+// ----------------------------------------------------------------------------
+// formatting
+
+static void pluginsd_client_vprintf(PLUGINSD_CLIENT *c, const char *fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+
+    if(len <= 0) return;
+
+    vsnprintf(pluginsd_client_need(c, (size_t)len + 1), (size_t)len + 1, fmt, args);
+    c->len += len;
+}
+
+void pluginsd_client_printf(PLUGINSD_CLIENT *c, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    pluginsd_client_vprintf(c, fmt, args);
+    va_end(args);
+}
+
+// appends s as a single word of the plugins.d protocol
+static void pluginsd_client_word(PLUGINSD_CLIENT *c, const char *s) {
+    if(!s) s = "";
+    char quote = (strchr(s, '\''))?'"':'\'';
+    pluginsd_client_printf(c, " %c%s%c", quote, s, quote);
+}
+
+static inline void pluginsd_client_varint(PLUGINSD_CLIENT *c, uint64_t value) {
+    char *s = pluginsd_client_need(c, PLUGINSD_CLIENT_VARINT_MAX_BYTES), *start = s;
+
+    while(value >= 0x80) {
+        *s++ = (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    *s++ = (char)value;
+
+    c->len += s - start;
+}
+
+static inline uint64_t pluginsd_client_zigzag(long long value, long long last) {
+    uint64_t d = (uint64_t)value - (uint64_t)last;
+    return (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+}
+
+// ----------------------------------------------------------------------------
+// the shared memory
+
+#ifdef PLUGINSD_CLIENT_SHM
+
+static void pluginsd_client_shm_attach(PLUGINSD_CLIENT *c, const char *name) {
+    // only the objects created by netdata
+    if(strncmp(name, "/netdata-", 9) != 0) return;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if(fd == -1) return;
+
+    // a set-user-id plugin should not write to objects of other users
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_uid != getuid() || (size_t)st.st_size <= sizeof(struct pluginsd_shm_header)) {
+        close(fd);
+        return;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mem == MAP_FAILED) return;
+
+    struct pluginsd_shm_header *h = (struct pluginsd_shm_header *)mem;
+    if(h->magic != PLUGINSD_SHM_MAGIC || h->version != PLUGINSD_SHM_VERSION
+       || !h->size || (h->size & (h->size - 1)) || h->size + sizeof(struct pluginsd_shm_header) != size) {
+        munmap(mem, size);
+        return;
+    }
+
+    // from now on, everything goes to the ring
+    fprintf(c->fp, PLUGINSD_SHM_KEYWORD " %d\n", PLUGINSD_SHM_VERSION);
+    if(fflush(c->fp) == EOF) {
+        munmap(mem, size);
+        return;
+    }
+
+    c->shm = h;
+    c->shm_size = size;
+}
+
+// returns 0 on success, -1 when netdata has closed our standard output
+static int pluginsd_client_shm_wakeup(PLUGINSD_CLIENT *c) {
+    if(__atomic_exchange_n(&c->shm->wakeup_pending, 1, __ATOMIC_SEQ_CST))
+        return 0;
+
+    while(write(c->fd, "\n", 1) == -1) {
+        if(errno != EINTR && errno != EAGAIN)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int pluginsd_client_shm_write(PLUGINSD_CLIENT *c, const char *data, size_t len) {
+    struct pluginsd_shm_header *h = c->shm;
+    char *ring = pluginsd_shm_ring(h);
+    uint64_t size = h->size;
+    uint64_t head = h->head;
+
+    while(len) {
+        uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+        uint64_t available = size - (head - tail);
+
+        if(!available) {
+            // the ring is full - make sure netdata knows and wait for it
+            if(pluginsd_client_shm_wakeup(c) == -1)
+                return -1;
+
+            struct pollfd pfd = { .fd = c->fd, .events = 0, .revents = 0 };
+            if(poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+                return -1;
+
+            struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000 };
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        size_t bytes = (len < available)?len:(size_t)available;
+        size_t offset = (size_t)(head & (size - 1));
+        size_t first = (size_t)size - offset;
+        if(first > bytes) first = bytes;
+
+        memcpy(&ring[offset], data, first);
+        if(first < bytes)
+            memcpy(ring, &data[first], bytes - first);
+
+        head += bytes;
+        __atomic_store_n(&h->head, head, __ATOMIC_SEQ_CST);
+
+        data += bytes;
+        len -= bytes;
+    }
+
+    return pluginsd_client_shm_wakeup(c);
+}
+
+#endif /* PLUGINSD_CLIENT_SHM */
+
+// ----------------------------------------------------------------------------
+// the client
+
+PLUGINSD_CLIENT *pluginsd_client_create(FILE *fp) {
+    PLUGINSD_CLIENT *c = pluginsd_client_callocz(1, sizeof(PLUGINSD_CLIENT));
+    c->fp = fp;
+    c->fd = fileno(fp);
+
+#ifdef PLUGINSD_CLIENT_SHM
+    const char *name = getenv(PLUGINSD_SHM_ENV);
+    if(name && *name)
+        pluginsd_client_shm_attach(c, name);
+#endif
+
+    // it is ours - the processes we start should not use it
+    unsetenv(PLUGINSD_SHM_ENV);
+
+    return c;
+}
+
+void pluginsd_client_free(PLUGINSD_CLIENT *c) {
+    if(!c) return;
+
+    pluginsd_client_flush(c);
+
+    while(c->charts_root) {
+        PLUGINSD_CLIENT_CHART *st = c->charts_root;
+        c->charts_root = st->next;
+
+        while(st->dimensions_root) {
+            PLUGINSD_CLIENT_DIMENSION *rd = st->dimensions_root;
+            st->dimensions_root = rd->next;
+            free(rd->id);
+            free(rd);
+        }
+
+        free(st->type);
+        free(st->id);
+        free(st);
+    }
+
+#ifdef PLUGINSD_CLIENT_SHM
+    if(c->shm)
+        munmap(c->shm, c->shm_size);
+#endif
+
+    free(c->buffer);
+    free(c);
+}
+
+int pluginsd_client_shm(PLUGINSD_CLIENT *c) {
+    return (c->shm)?1:0;
+}
+
+int pluginsd_client_flush(PLUGINSD_CLIENT *c) {
+    int ret = 0;
+
+#ifdef PLUGINSD_CLIENT_SHM
+    if(c->shm) {
+        if(c->len)
+            ret = pluginsd_client_shm_write(c, c->buffer, c->len);
+
+        c->len = 0;
+        return ret;
+    }
+#endif
+
+    if(c->len && fwrite(c->buffer, c->len, 1, c->fp) != 1)
+        ret = -1;
+
+    c->len = 0;
+
+    if(fflush(c->fp) == EOF)
+        ret = -1;
+
+    return ret;
+}
+
+// ----------------------------------------------------------------------------
+// charts and dimensions
+
+PLUGINSD_CLIENT_CHART *pluginsd_client_chart_find(PLUGINSD_CLIENT *c, const char *type, const char *id) {
+    // charts are usually updated in the order they have been defined
+    PLUGINSD_CLIENT_CHART *st = c->cursor;
+    if(st && !strcmp(st->id, id) && !strcmp(st->type, type)) {
+        c->cursor = (st->next)?st->next:c->charts_root;
+        return st;
+    }
+
+    for(st = c->charts_root; st ; st = st->next) {
+        if(!strcmp(st->id, id) && !strcmp(st->type, type)) {
+            c->cursor = (st->next)?st->next:c->charts_root;
+            return st;
+        }
+    }
+
+    return NULL;
+}
+
+PLUGINSD_CLIENT_CHART *pluginsd_client_chart(PLUGINSD_CLIENT *c, const char *type, const char *id, const char *name, const char *title, const char *units, const char *family, const char *context, const char *charttype, long priority, int update_every) {
+    PLUGINSD_CLIENT_CHART *st = pluginsd_client_chart_find(c, type, id);
+    if(!st) {
+        st = pluginsd_client_callocz(1, sizeof(PLUGINSD_CLIENT_CHART));
+        st->type = pluginsd_client_strdupz(type);
+        st->id = pluginsd_client_strdupz(id);
+        st->slot = ++c->charts;
+        st->c = c;
+
+        if(c->charts_last) c->charts_last->next = st;
+        else c->charts_root = st;
+        c->charts_last = st;
+    }
+
+    pluginsd_client_printf(c, "CHART %s.%s", type, id);
+    pluginsd_client_word(c, name);
+    pluginsd_client_word(c, title);
+    pluginsd_client_word(c, units);
+    pluginsd_client_word(c, family);
+    pluginsd_client_word(c, context);
+    pluginsd_client_printf(c, " %s %ld %d", charttype, priority, update_every);
+
+    if(c->shm) pluginsd_client_printf(c, " %zu\n", st->slot);
+    else pluginsd_client_printf(c, "\n");
+
+    return st;
+}
+
+PLUGINSD_CLIENT_DIMENSION *pluginsd_client_dimension(PLUGINSD_CLIENT_CHART *st, const char *id, const char *name, const char *algorithm, long multiplier, long divisor, int hidden) {
+    PLUGINSD_CLIENT *c = st->c;
+
+    PLUGINSD_CLIENT_DIMENSION *rd;
+    for(rd = st->dimensions_root; rd ; rd = rd->next)
+        if(!strcmp(rd->id, id)) break;
+
+    if(!rd) {
+        rd = pluginsd_client_callocz(1, sizeof(PLUGINSD_CLIENT_DIMENSION));
+        rd->id = pluginsd_client_strdupz(id);
+        rd->slot = ++st->dimensions;
+        rd->st = st;
+
+        if(st->dimensions_last) st->dimensions_last->next = rd;
+        else st->dimensions_root = rd;
+        st->dimensions_last = rd;
+    }
+
+    // netdata forgets the last value sent, when a dimension is defined
+    rd->last_value = 0;
+
+    pluginsd_client_printf(c, "DIMENSION");
+    pluginsd_client_word(c, id);
+    pluginsd_client_word(c, name);
+    pluginsd_client_printf(c, " %s %ld %ld", algorithm, multiplier, divisor);
+    pluginsd_client_word(c, (hidden)?"hidden":"");
+
+    if(c->shm) pluginsd_client_printf(c, " %zu\n", rd->slot);
+    else pluginsd_client_printf(c, "\n");
+
+    return rd;
+}
+
+// ----------------------------------------------------------------------------
+// updates
+
+void pluginsd_client_begin(PLUGINSD_CLIENT_CHART *st, uint64_t usec) {
+    st->usec = usec;
+    st->cursor = st->dimensions_root;
+}
+
+void pluginsd_client_set(PLUGINSD_CLIENT_DIMENSION *rd, long long value) {
+    rd->value = value;
+    rd->updated = 1;
+}
+
+// returns 0 on success, -1 when the chart has no such dimension
+int pluginsd_client_set_by_id(PLUGINSD_CLIENT_CHART *st, const char *id, long long value) {
+    // dimensions are usually set in the order they have been defined
+    PLUGINSD_CLIENT_DIMENSION *rd = st->cursor;
+    if(!rd || strcmp(rd->id, id) != 0) {
+        for(rd = st->dimensions_root; rd ; rd = rd->next)
+            if(!strcmp(rd->id, id)) break;
+
+        if(!rd) return -1;
+    }
+
+    pluginsd_client_set(rd, value);
+    st->cursor = rd->next;
+    return 0;
+}
+
+void pluginsd_client_end(PLUGINSD_CLIENT_CHART *st) {
+    PLUGINSD_CLIENT *c = st->c;
+    PLUGINSD_CLIENT_DIMENSION *rd;
+
+    if(c->shm) {
+        // a binary frame, with the dimensions in the order of their ids
+        *pluginsd_client_need(c, 1) = PLUGINSD_CLIENT_BINARY_DATA;
+        c->len++;
+
+        pluginsd_client_varint(c, st->slot);
+        pluginsd_client_varint(c, st->usec);
+
+        size_t last_slot = 0;
+        for(rd = st->dimensions_root; rd ; rd = rd->next) {
+            if(!rd->updated) continue;
+
+            pluginsd_client_varint(c, rd->slot - last_slot);
+            pluginsd_client_varint(c, pluginsd_client_zigzag(rd->value, rd->last_value));
+
+            last_slot = rd->slot;
+            rd->last_value = rd->value;
+            rd->updated = 0;
+        }
+
+        pluginsd_client_varint(c, 0);
+    }
+    else {
+        if(st->usec) pluginsd_client_printf(c, "BEGIN %s.%s %llu\n", st->type, st->id, (unsigned long long)st->usec);
+        else pluginsd_client_printf(c, "BEGIN %s.%s\n", st->type, st->id);
+
+        for(rd = st->dimensions_root; rd ; rd = rd->next) {
+            if(!rd->updated) continue;
+
+            pluginsd_client_printf(c, "SET");
+            pluginsd_client_word(c, rd->id);
+            pluginsd_client_printf(c, " = %lld\n", rd->value);
+            rd->updated = 0;
+        }
+
+        pluginsd_client_printf(c, "END\n");
+    }
+
+    if(c->len >= PLUGINSD_CLIENT_FLUSH_SIZE)
+        pluginsd_client_flush(c);
+}
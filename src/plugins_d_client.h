@@ -0,0 +1,63 @@
+#ifndef NETDATA_PLUGINS_D_CLIENT_H
+#define NETDATA_PLUGINS_D_CLIENT_H 1
+
+// ----------------------------------------------------------------------------
+// the plugins.d client library
+//
+// A small library for external plugins written in C. It speaks the plugins.d
+// protocol on the standard output of the plugin, or when netdata offers it,
+// writes the values of the charts as binary frames to a shared memory ring
+// (see plugins_d_shm.h), so that they are neither formatted nor parsed.
+//
+// It depends only on the C library, so that it can be copied to other
+// projects. It is not thread safe: use one client per thread.
+//
+//  PLUGINSD_CLIENT *c = pluginsd_client_create(stdout);
+//  PLUGINSD_CLIENT_CHART *st = pluginsd_client_chart(c, "example", "random", NULL, "A Random Number", "number", "random", "example.random", "line", 1000, 1);
+//  PLUGINSD_CLIENT_DIMENSION *rd = pluginsd_client_dimension(st, "random", NULL, "absolute", 1, 1, 0);
+//
+//  for(;;) {
+//      pluginsd_client_begin(st, usec_since_last_update);
+//      pluginsd_client_set(rd, random());
+//      pluginsd_client_end(st);
+//      pluginsd_client_flush(c);
+//      sleep(1);
+//  }
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct pluginsd_client PLUGINSD_CLIENT;
+typedef struct pluginsd_client_chart PLUGINSD_CLIENT_CHART;
+typedef struct pluginsd_client_dimension PLUGINSD_CLIENT_DIMENSION;
+
+// uses the shared memory offered by netdata, if any, otherwise writes to fp
+extern PLUGINSD_CLIENT *pluginsd_client_create(FILE *fp);
+extern void pluginsd_client_free(PLUGINSD_CLIENT *c);
+
+// returns 1 when the shared memory transport is used
+extern int pluginsd_client_shm(PLUGINSD_CLIENT *c);
+
+// defines a chart, or defines again an existing one (its dimensions have to be defined again too)
+// name and context may be NULL
+extern PLUGINSD_CLIENT_CHART *pluginsd_client_chart(PLUGINSD_CLIENT *c, const char *type, const char *id, const char *name, const char *title, const char *units, const char *family, const char *context, const char *charttype, long priority, int update_every);
+extern PLUGINSD_CLIENT_CHART *pluginsd_client_chart_find(PLUGINSD_CLIENT *c, const char *type, const char *id);
+
+// defines a dimension of a chart, or defines again an existing one - name may be NULL
+extern PLUGINSD_CLIENT_DIMENSION *pluginsd_client_dimension(PLUGINSD_CLIENT_CHART *st, const char *id, const char *name, const char *algorithm, long multiplier, long divisor, int hidden);
+
+// an update of a chart: begin, set any of its dimensions, end
+// usec is the time since its last update, or 0 to let netdata decide
+extern void pluginsd_client_begin(PLUGINSD_CLIENT_CHART *st, uint64_t usec);
+extern void pluginsd_client_set(PLUGINSD_CLIENT_DIMENSION *rd, long long value);
+extern int pluginsd_client_set_by_id(PLUGINSD_CLIENT_CHART *st, const char *id, long long value);
+extern void pluginsd_client_end(PLUGINSD_CLIENT_CHART *st);
+
+// sends anything else of the plugins.d protocol, e.g. "DISABLE\n"
+extern void pluginsd_client_printf(PLUGINSD_CLIENT *c, const char *fmt, ...) __attribute__ ((format(__printf__, 2, 3)));
+
+// sends everything buffered so far - call it at the end of each iteration
+// returns 0 on success, -1 when netdata is not there any more
+extern int pluginsd_client_flush(PLUGINSD_CLIENT *c);
+
+#endif /* NETDATA_PLUGINS_D_CLIENT_H */
@@ -0,0 +1,48 @@
+#ifndef NETDATA_PLUGINS_D_SHM_H
+#define NETDATA_PLUGINS_D_SHM_H 1
+
+// ----------------------------------------------------------------------------
+// the shared memory transport of external plugins
+//
+// Before starting a plugin, netdata creates a POSIX shared memory object
+// and gives its name to the plugin, in the environment variable
+// PLUGINSD_SHM_ENV. Plugins that do not know it just ignore it.
+//
+// A plugin that wants to use it maps the object, checks its header and
+// writes "SHM 1" as the first line of its standard output (netdata drops the
+// object when the first line is anything else). From then on, everything
+// it sends (the same plugins.d protocol, plus the binary data frames of the
+// streaming protocol - see rrdpush.h) is written to the ring that follows
+// the header, and its standard output is used only to wake up netdata.
+//
+// The ring is a stream of bytes, with a single producer (the plugin) and a
+// single consumer (netdata). The plugin copies its data at head and then
+// advances head. netdata copies the data between tail and head and then
+// advances tail. Wake ups are coalesced: the plugin writes a byte to its
+// standard output only when wakeup_pending was 0, and netdata sets it to 0
+// before it looks for new data.
+//
+// This header is shared by netdata and the plugins.d client library,
+// so it has to depend only on the C library.
+
+#include <stdint.h>
+
+#define PLUGINSD_SHM_ENV "NETDATA_PLUGINS_SHM"
+#define PLUGINSD_SHM_KEYWORD "SHM"
+#define PLUGINSD_SHM_MAGIC 0x6e647368      // "ndsh"
+#define PLUGINSD_SHM_VERSION 1
+#define PLUGINSD_SHM_RING_SIZE (1024 * 1024)
+
+struct pluginsd_shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;                      // the size of the ring, a power of 2
+    volatile uint64_t head;             // the bytes written by the plugin, so far
+    volatile uint64_t tail;             // the bytes read by netdata, so far
+    volatile uint32_t wakeup_pending;   // 1 when the plugin has woken up netdata and netdata has not noticed it yet
+    uint32_t reserved[7];
+};
+
+#define pluginsd_shm_ring(h) ((char *)(h) + sizeof(struct pluginsd_shm_header))
+
+#endif /* NETDATA_PLUGINS_D_SHM_H */
@@ -145,7 +145,17 @@ struct rrddim {
     char *cache_filename;                           // the filename we load/save from/to this set
 
     size_t collections_counter;                     // the number of times we added values to this rrdim
-    size_t unused[10];
+
+    char *prometheus_name;                          // the prometheus metric name of this dimension (chart_dimension)
+                                                    // it takes the place of one of the unused members, so that
+                                                    // the size of the mmap'd files does not change
+
+    size_t rrdpush_slot;                            // the id of this dimension in the binary streaming protocol
+    collected_number rrdpush_last_value;            // the last value streamed with the binary protocol
+    collected_number rrdpush_aggregated_value;      // the sum of the values collected since the chart was last streamed aggregated
+    size_t rrdpush_aggregated_count;                // the number of values in rrdpush_aggregated_value
+                                                    // they take the place of unused members too
+    size_t unused[9 - 2 - 2 * sizeof(collected_number) / sizeof(size_t)];
 
     int updated:1;                                  // 1 when the dimension has been updated since the last processing
     int exposed:1;                                  // 1 when set what have sent this dimension to the central netdata
@@ -214,7 +224,11 @@ typedef enum rrdset_flags {
     RRDSET_FLAG_DETAIL   = 1 << 1, // if set, the data set should be considered as a detail of another
                                    // (the master data set should be the one that has the same family and is not detail)
     RRDSET_FLAG_DEBUG    = 1 << 2, // enables or disables debugging for a chart
-    RRDSET_FLAG_OBSOLETE = 1 << 3  // this is marked by the collector/module as obsolete
+    RRDSET_FLAG_OBSOLETE = 1 << 3, // this is marked by the collector/module as obsolete
+    RRDSET_FLAG_WEB_PUSH = 1 << 4, // web clients have subscribed to live updates of this chart
+    RRDSET_FLAG_UPSTREAM_SEND      = 1 << 5, // this chart is streamed (it matches "send charts matching")
+    RRDSET_FLAG_UPSTREAM_IGNORE    = 1 << 6, // this chart is not streamed
+    RRDSET_FLAG_UPSTREAM_AGGREGATE = 1 << 7  // this chart is streamed aggregated (it matches "aggregate charts matching")
 } RRDSET_FLAGS;
 
 #define rrdset_flag_check(st, flag) ((st)->flags & flag)
@@ -279,7 +293,21 @@ struct rrdset {
     size_t counter_done;                            // the number of times rrdset_done() has been called
 
     time_t last_accessed_time;                      // the last time this RRDSET has been accessed
-    size_t unused[9];
+
+    size_t metadata_version;                        // the charts_version of the host, when the metadata of
+                                                    // this chart (or its dimensions) were last changed
+    struct rrdset_json_cache *json_cache;           // the cached /api/v1/charts JSON of this chart
+                                                    // they take the place of two of the unused members, so that
+                                                    // the size of the mmap'd files does not change
+
+    size_t rrdpush_slot;                            // the id of this chart in the binary streaming protocol
+    size_t rrdpush_generation;                      // the streaming connection the definition of this chart was sent on
+    BUFFER *rrdpush_wb;                             // the updates of this chart are serialized here, before queued for streaming
+    size_t rrdpush_aggregated;                      // the collections aggregated since the chart was last streamed
+    usec_t rrdpush_aggregated_usec;                 // the microseconds of the collections aggregated
+    time_t backend_formatted_t;                     // the end of the last backend pass that formatted this chart
+                                                    // they take the place of unused members too
+    size_t unused[4 - 1 - sizeof(usec_t) / sizeof(size_t) - sizeof(time_t) / sizeof(size_t)];
 
     uint32_t hash;                                  // a simple hash on the id, to speed up searching
                                                     // we first compare hashes, and only if the hashes are equal we do string comparisons
@@ -358,6 +386,30 @@ typedef enum rrdhost_flags {
 // ----------------------------------------------------------------------------
 // RRD HOST
 
+// the statistics of a compressed streaming connection
+struct rrdpush_compression_stats {
+    volatile size_t uncompressed;                   // the bytes before compression
+    volatile size_t compressed;                     // the bytes after compression
+    volatile usec_t usec;                           // the time spent compressing or decompressing
+
+    RRDSET *st_bytes;                               // the charts of them, on localhost
+    RRDSET *st_savings;
+    RRDSET *st_cpu;
+    size_t last_uncompressed;
+    size_t last_compressed;
+};
+
+// the statistics of the metrics received from streaming netdata
+struct rrdpush_receiver_stats {
+    volatile size_t lines;                          // the lines processed (binary frames count as the lines they replace)
+    volatile size_t new_charts;                     // the charts created
+    volatile usec_t throttled_usec;                 // the time the connections were not read, because of their limits
+
+    RRDSET *st_lines;                               // the charts of them, on localhost
+    RRDSET *st_charts;
+    RRDSET *st_throttled;
+};
+
 struct rrdhost {
     avl avl;                                        // the index of hosts
 
@@ -388,15 +440,22 @@ struct rrdhost {
     int rrdpush_enabled:1;                          // 1 when this host sends metrics to another netdata
     char *rrdpush_destination;                      // where to send metrics to
     char *rrdpush_api_key;                          // the api key at the receiving netdata
-    volatile int rrdpush_connected:1;               // 1 when the sender is ready to push metrics
+    SIMPLE_PATTERN *rrdpush_send_charts_matching;   // the charts to be streamed
+    SIMPLE_PATTERN *rrdpush_aggregate_charts_matching; // the charts to be streamed aggregated
+    int rrdpush_aggregate_iterations;               // the collections aggregated into each streamed update
+    volatile int rrdpush_connected;                 // 1 when the sender is ready to push metrics
     volatile int rrdpush_spawn:1;                   // 1 when the sender thread has been spawn
-    volatile int rrdpush_error_shown:1;             // 1 when we have logged a communication error
-    int rrdpush_socket;                             // the fd of the socket to the remote host, or -1
+    volatile int rrdpush_stopping;                  // 1 while the sender thread is being stopped and joined
+    volatile int rrdpush_error_shown;               // 1 when we have logged a communication error
     pthread_t rrdpush_thread;                       // the sender thread
-    pthread_mutex_t rrdpush_mutex;                  // exclusive access to rrdpush_buffer
-    int rrdpush_pipe[2];                            // collector to sender thread communication
-    BUFFER *rrdpush_buffer;                         // collector fills it, sender sends them
-
+    pthread_mutex_t rrdpush_mutex;                  // serializes starting and stopping the sender thread
+    struct rrdpush_ring *rrdpush_ring;              // collectors queue chart updates here, the sender takes them
+    volatile uint32_t rrdpush_generation;           // the id of the current chart definitions, records of other generations are dropped
+    BUFFER *rrdpush_buffer;                         // the data all destinations are sending, each from its own offset
+    int rrdpush_binary;                             // 1 when all connected destinations accepted the binary protocol
+    size_t rrdpush_charts_slots;                    // the last chart id given for the binary protocol
+    struct rrdpush_destination *rrdpush_destinations; // the remote netdata metrics are sent to, simultaneously
+    struct rrdpush_compression_stats rrdpush_sent_compression;
 
     // ------------------------------------------------------------------------
     // streaming of data from remote hosts - rrdpush
@@ -406,10 +465,15 @@ struct rrdhost {
 
     time_t senders_disconnected_time;               // the time the last sender was disconnected
 
+    struct rrdpush_compression_stats rrdpush_received_compression;
+    struct rrdpush_receiver_stats rrdpush_received;
+
     // ------------------------------------------------------------------------
     // health monitoring options
 
     int health_enabled:1;                           // 1 when this host has health enabled
+    volatile int lazy_indexes;                      // 1 while the families, the variables and the health configuration
+                                                    // of a replication only host have not been built yet
     time_t health_delay_up_to;                      // a timestamp to delay alarms processing up to
     char *health_default_exec;                      // the full path of the alarms notifications program
     char *health_default_recipient;                 // the default recipient for all alarms
@@ -436,6 +500,18 @@ struct rrdhost {
     RRDSET *rrdset_root;                            // the host charts
 
 
+    // ------------------------------------------------------------------------
+    // caches of API responses
+
+    struct prometheus_cache *prometheus_cache;      // the cached /api/v1/allmetrics?format=prometheus
+
+    volatile size_t charts_version;                 // incremented every time a chart or a dimension is added,
+                                                    // removed, renamed, hidden or shown
+    usec_t charts_epoch;                            // when this host started counting charts_version, so that
+                                                    // versions of a previous run (or host) are not mistaken for ours
+    pthread_mutex_t charts_json_mutex;              // protects the json_cache of the host charts
+
+
     // ------------------------------------------------------------------------
     // locks
 
@@ -495,8 +571,14 @@ extern RRDHOST *rrdhost_find_or_create(
         , int rrdpush_enabled
         , char *rrdpush_destination
         , char *rrdpush_api_key
+        , char *rrdpush_send_charts_matching
+        , char *rrdpush_aggregate_charts_matching
+        , int rrdpush_aggregate_iterations
+        , int replication_only
 );
 
+extern void rrdhost_build_indexes(RRDHOST *host);
+
 #ifdef NETDATA_INTERNAL_CHECKS
 extern void rrdhost_check_wrlock_int(RRDHOST *host, const char *file, const char *function, const unsigned long line);
 extern void rrdhost_check_rdlock_int(RRDHOST *host, const char *file, const char *function, const unsigned long line);
@@ -525,6 +607,9 @@ extern void rrd_check_wrlock_int(const char *file, const char *function, const u
 // RRDSET functions
 
 extern void rrdset_set_name(RRDSET *st, const char *name);
+extern void rrdset_build_indexes(RRDSET *st);
+extern void rrdset_metadata_changed(RRDSET *st);
+extern void rrdset_set_enabled(RRDSET *st, int enabled);
 
 extern RRDSET *rrdset_create(RRDHOST *host
                              , const char *type
@@ -605,7 +690,9 @@ extern void rrdset_done(RRDSET *st);
 extern RRDDIM *rrddim_add(RRDSET *st, const char *id, const char *name, collected_number multiplier, collected_number divisor, RRD_ALGORITHM algorithm);
 
 extern void rrddim_set_name(RRDSET *st, RRDDIM *rd, const char *name);
+extern void rrddim_create_variables(RRDDIM *rd);
 extern RRDDIM *rrddim_find(RRDSET *st, const char *id);
+extern int rrddim_replay_value(RRDSET *st, RRDDIM *rd, time_t t, storage_number n);
 
 extern int rrddim_hide(RRDSET *st, const char *id);
 extern int rrddim_unhide(RRDSET *st, const char *id);
@@ -78,42 +78,216 @@ void rrd_stats_api_v1_chart(RRDSET *st, BUFFER *wb) {
     rrd_stats_api_v1_chart_with_data(st, wb, NULL, NULL);
 }
 
-void rrd_stats_api_v1_charts(RRDHOST *host, BUFFER *wb)
+// ----------------------------------------------------------------------------
+// the cached JSON of the charts, for /api/v1/charts
+//
+// The metadata of the charts do not change, unless the charts or their
+// dimensions are added, removed, renamed, hidden or shown, which gives them a
+// new metadata_version (rrdset_metadata_changed()).
+// So, the JSON of each chart is generated once per metadata version.
+// Only the first and the last entry of the chart change on every request.
+// These are added to the response at the split position of the cached JSON.
+
+struct rrdset_json_cache {
+    size_t version;                 // the metadata_version of the chart, the JSON has been generated for
+    BUFFER *json;                   // the JSON of the chart
+    size_t split;                   // the position in the JSON to add the first and last entry
+    size_t dimensions;              // the number of visible dimensions of the chart
+    size_t memory;                  // the memory used by the chart and its dimensions
+};
+
+void rrd_stats_api_v1_chart_json_cache_free(RRDSET *st) {
+    if(!st->json_cache) return;
+
+    buffer_free(st->json_cache->json);
+    freez(st->json_cache);
+    st->json_cache = NULL;
+}
+
+// must be called with the charts_json_mutex of the host locked
+static inline struct rrdset_json_cache *rrd_stats_api_v1_chart_json_cache(RRDSET *st) {
+    struct rrdset_json_cache *c = st->json_cache;
+    if(unlikely(!c)) {
+        c = callocz(1, sizeof(struct rrdset_json_cache));
+        c->json = buffer_create(1024);
+        st->json_cache = c;
+    }
+    else if(likely(c->version == st->metadata_version))
+        return c;
+
+    // read the version before generating the JSON, so that if it
+    // is changed while we generate it, it will be generated again
+    c->version = st->metadata_version;
+
+    BUFFER *wb = c->json;
+    buffer_flush(wb);
+
+    rrdset_rdlock(st);
+
+    buffer_sprintf(wb,
+        "\t\t{\n"
+        "\t\t\t\"id\": \"%s\",\n"
+        "\t\t\t\"name\": \"%s\",\n"
+        "\t\t\t\"type\": \"%s\",\n"
+        "\t\t\t\"family\": \"%s\",\n"
+        "\t\t\t\"context\": \"%s\",\n"
+        "\t\t\t\"title\": \"%s\",\n"
+        "\t\t\t\"priority\": %ld,\n"
+        "\t\t\t\"enabled\": %s,\n"
+        "\t\t\t\"units\": \"%s\",\n"
+        "\t\t\t\"data_url\": \"/api/v1/data?chart=%s\",\n"
+        "\t\t\t\"chart_type\": \"%s\",\n"
+        "\t\t\t\"duration\": %ld,\n"
+        , st->id
+        , st->name
+        , st->type
+        , st->family
+        , st->context
+        , st->title
+        , st->priority
+        , rrdset_flag_check(st, RRDSET_FLAG_ENABLED)?"true":"false"
+        , st->units
+        , st->name
+        , rrdset_type_name(st->chart_type)
+        , st->entries * st->update_every
+        );
+
+    c->split = wb->len;
+
+    buffer_sprintf(wb,
+        "\t\t\t\"update_every\": %d,\n"
+        "\t\t\t\"dimensions\": {\n"
+        , st->update_every
+        );
+
+    c->memory = st->memsize;
+    c->dimensions = 0;
+
+    RRDDIM *rd;
+    rrddim_foreach_read(rd, st) {
+        if(rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN)) continue;
+
+        c->memory += rd->memsize;
+
+        buffer_sprintf(wb,
+            "%s"
+            "\t\t\t\t\"%s\": { \"name\": \"%s\" }"
+            , c->dimensions?",\n":""
+            , rd->id
+            , rd->name
+            );
+
+        c->dimensions++;
+    }
+
+    buffer_strcat(wb, "\n\t\t\t},\n\t\t\t\"green\": ");
+    buffer_rrd_value(wb, st->green);
+    buffer_strcat(wb, ",\n\t\t\t\"red\": ");
+    buffer_rrd_value(wb, st->red);
+    buffer_strcat(wb, "\n\t\t}");
+
+    rrdset_unlock(st);
+
+    return c;
+}
+
+// if if_version is not zero, only the charts changed after this version of
+// the host charts are included, together with the ids of all the available
+// charts, so that the client can remove the ones deleted
+// the version is valid only with the charts_epoch of the host it came with
+void rrd_stats_api_v1_charts(RRDHOST *host, BUFFER *wb, size_t if_version, usec_t if_epoch)
 {
     size_t c, dimensions = 0, memory = 0, alarms = 0;
     RRDSET *st;
 
     time_t now = now_realtime_sec();
 
+    // the version we report has to be read before we traverse the charts,
+    // so that any change made while we traverse them is sent again
+    size_t charts_version = host->charts_version;
+    if(if_version > charts_version || if_epoch != host->charts_epoch) if_version = 0;
+
     buffer_sprintf(wb, "{\n"
            "\t\"hostname\": \"%s\""
         ",\n\t\"version\": \"%s\""
         ",\n\t\"os\": \"%s\""
         ",\n\t\"update_every\": %d"
         ",\n\t\"history\": %d"
+        ",\n\t\"charts_version\": %zu"
+        ",\n\t\"charts_epoch\": %llu"
+        ",\n\t\"incremental\": %s"
         ",\n\t\"charts\": {"
         , host->hostname
         , program_version
         , host->os
         , host->rrd_update_every
         , host->rrd_history_entries
+        , charts_version
+        , (unsigned long long)host->charts_epoch
+        , (if_version)?"true":"false"
         );
 
+    size_t sent = 0;
     c = 0;
     rrdhost_rdlock(host);
     rrdset_foreach_read(st, host) {
         if(rrdset_is_available_for_viewers(st)) {
-            if(c) buffer_strcat(wb, ",");
-            buffer_strcat(wb, "\n\t\t\"");
-            buffer_strcat(wb, st->id);
-            buffer_strcat(wb, "\": ");
-            rrd_stats_api_v1_chart_with_data(st, wb, &dimensions, &memory);
+            pthread_mutex_lock(&host->charts_json_mutex);
+
+            struct rrdset_json_cache *jc = rrd_stats_api_v1_chart_json_cache(st);
+            dimensions += jc->dimensions;
+            memory += jc->memory;
+
+            if(!if_version || jc->version > if_version) {
+                if(sent) buffer_strcat(wb, ",");
+                buffer_strcat(wb, "\n\t\t\"");
+                buffer_strcat(wb, st->id);
+                buffer_strcat(wb, "\": ");
+
+                buffer_need_bytes(wb, jc->json->len + 200);
+                memcpy(&wb->buffer[wb->len], jc->json->buffer, jc->split);
+                wb->len += jc->split;
+
+                rrdset_rdlock(st);
+                buffer_sprintf(wb,
+                    "\t\t\t\"first_entry\": %ld,\n"
+                    "\t\t\t\"last_entry\": %ld,\n"
+                    , rrdset_first_entry_t(st)
+                    , rrdset_last_entry_t(st)
+                    );
+                rrdset_unlock(st);
+
+                buffer_need_bytes(wb, jc->json->len - jc->split + 1);
+                memcpy(&wb->buffer[wb->len], &jc->json->buffer[jc->split], jc->json->len - jc->split);
+                wb->len += jc->json->len - jc->split;
+                wb->buffer[wb->len] = '\0';
+
+                sent++;
+            }
+
+            pthread_mutex_unlock(&host->charts_json_mutex);
 
             c++;
             st->last_accessed_time = now;
         }
     }
 
+    buffer_strcat(wb, "\n\t}");
+
+    if(if_version) {
+        size_t ids = 0;
+        buffer_strcat(wb, ",\n\t\"charts_available\": [");
+        rrdset_foreach_read(st, host) {
+            if(rrdset_is_available_for_viewers(st)) {
+                buffer_strcat(wb, (ids)?", \"":"\"");
+                buffer_strcat(wb, st->id);
+                buffer_strcat(wb, "\"");
+                ids++;
+            }
+        }
+        buffer_strcat(wb, "]");
+    }
+
     RRDCALC *rc;
     for(rc = host->alarms; rc ; rc = rc->next) {
         if(rc->rrdset)
@@ -121,8 +295,7 @@ void rrd_stats_api_v1_charts(RRDHOST *host, BUFFER *wb)
     }
     rrdhost_unlock(host);
 
-    buffer_sprintf(wb, "\n\t}"
-                    ",\n\t\"charts_count\": %zu"
+    buffer_sprintf(wb, ",\n\t\"charts_count\": %zu"
                     ",\n\t\"dimensions_count\": %zu"
                     ",\n\t\"alarms_count\": %zu"
                     ",\n\t\"rrd_memory_bytes\": %zu"
@@ -181,58 +354,584 @@ static inline size_t prometheus_name_copy(char *d, const char *s, size_t usable)
 
 #define PROMETHEUS_ELEMENT_MAX 256
 
-void rrd_stats_api_v1_charts_allmetrics_prometheus(RRDHOST *host, BUFFER *wb) {
+// the metric name of a dimension - called once per dimension, by rrddim_add()
+char *prometheus_metric_name_strdupz(const char *chart, const char *dimension) {
+    char name[PROMETHEUS_ELEMENT_MAX * 2 + 2];
+
+    size_t n = prometheus_name_copy(name, chart, PROMETHEUS_ELEMENT_MAX);
+    name[n++] = '_';
+    prometheus_name_copy(&name[n], dimension, PROMETHEUS_ELEMENT_MAX);
+
+    return strdupz(name);
+}
+
+// copy a prometheus label value or HELP text, escaping what has to be escaped
+static inline void prometheus_label_copy(char *d, const char *s, size_t usable, int quotes) {
+    char *e = &d[usable - 1];
+
+    for(; *s && d < e ; s++) {
+        register char c = *s;
+
+        if(unlikely(c == '\\' || c == '\n' || (quotes && c == '"'))) {
+            if(unlikely(d + 1 >= e)) break;
+            *d++ = '\\';
+            if(c == '\n') c = 'n';
+        }
+
+        *d++ = c;
+    }
+    *d = '\0';
+}
+
+// the average of the values stored in the database, after the time given
+// it is already rate converted, multiplied and divided
+static inline calculated_number prometheus_stored_average(RRDSET *st, RRDDIM *rd, time_t after, time_t before) {
+    time_t first = rrdset_first_entry_t(st);
+    if(after < first) after = first;
+
+    calculated_number sum = 0;
+    size_t count = 0;
+
+    time_t t;
+    for(t = before; t > after ; t -= st->update_every) {
+        storage_number n = rd->values[rrdset_time2slot(st, t)];
+        if(unlikely(!does_storage_number_exist(n))) continue;
+
+        sum += unpack_storage_number(n);
+        count++;
+    }
+
+    if(unlikely(!count)) return NAN;
+    return sum / (calculated_number)count;
+}
+
+// the value of a dimension, as it will be exposed
+// returns 0 when there is no value to expose
+// (the collected values are printed as integers by prometheus_print_value())
+static inline int prometheus_value(RRDSET *st, RRDDIM *rd, uint32_t options, time_t after, calculated_number *value, unsigned long long *timestamp) {
+    if(options & PROMETHEUS_OUTPUT_AVERAGE) {
+        time_t before = rrdset_last_entry_t(st);
+
+        // without a previous scrape, give the last value stored
+        if(!after || after >= before) after = before - st->update_every;
+
+        *value = prometheus_stored_average(st, rd, after, before);
+        *timestamp = (unsigned long long)before * 1000;
+
+        return !(isnan(*value) || isinf(*value));
+    }
+
+    *value = (calculated_number)rd->last_collected_value;
+    *timestamp = (unsigned long long)((rd->last_collected_time.tv_sec * 1000) + (rd->last_collected_time.tv_usec / 1000));
+    return 1;
+}
+
+// collected values are integers that may be too big for print_calculated_number(),
+// so only the averages are printed as calculated numbers
+static inline void prometheus_print_value(BUFFER *wb, RRDDIM *rd, uint32_t options, calculated_number value, unsigned long long timestamp) {
+    if(options & PROMETHEUS_OUTPUT_AVERAGE) {
+        buffer_rrd_value(wb, value);
+        buffer_sprintf(wb, " %llu\n", timestamp);
+    }
+    else
+        buffer_sprintf(wb, COLLECTED_NUMBER_FORMAT " %llu\n", rd->last_collected_value, timestamp);
+}
+
+static inline const char *prometheus_type(RRD_ALGORITHM algorithm) {
+    switch(algorithm) {
+        case RRD_ALGORITHM_INCREMENTAL:
+        case RRD_ALGORITHM_PCENT_OVER_DIFF_TOTAL:
+            return "counter";
+
+        default:
+            return "gauge";
+    }
+}
+
+// a metric per dimension, named chart_dimension
+static void prometheus_generate_per_dimension(RRDSET *st, BUFFER *wb, const char *hostname, uint32_t options, time_t after) {
+    RRDDIM *rd;
+    rrddim_foreach_read(rd, st) {
+        if(rd->collections_counter) {
+            calculated_number value;
+            unsigned long long timestamp;
+            if(!prometheus_value(st, rd, options, after, &value, &timestamp)) continue;
+
+            // buffer_sprintf(wb, "# HELP %s.%s %s\n", st->id, rd->id, st->units);
+
+            if(options & PROMETHEUS_OUTPUT_TYPES)
+                buffer_sprintf(wb, "# TYPE %s %s\n", rd->prometheus_name, (options & PROMETHEUS_OUTPUT_AVERAGE)?"gauge":prometheus_type(rd->algorithm));
+
+            buffer_sprintf(wb, "%s{instance=\"%s\"} ", rd->prometheus_name, hostname);
+            prometheus_print_value(wb, rd, options, value, timestamp);
+        }
+    }
+}
+
+// a chart or a dimension to be exposed, with the instance label of its host
+// order keeps the order of the hosts, among the samples of a metric family
+struct prometheus_source {
+    RRDSET *st;
+    RRDDIM *rd;
+    const char *hostname;
+    size_t order;
+};
+
+static inline void prometheus_source_add(struct prometheus_source **sources, size_t *count, size_t *size, RRDSET *st, RRDDIM *rd, const char *hostname, size_t order) {
+    if(*count == *size) {
+        *size = (*size)?*size * 2:256;
+        *sources = reallocz(*sources, *size * sizeof(struct prometheus_source));
+    }
+
+    struct prometheus_source *ps = &(*sources)[(*count)++];
+    ps->st = st;
+    ps->rd = rd;
+    ps->hostname = hostname;
+    ps->order = order;
+}
+
+static int prometheus_compare_context(const void *a, const void *b) {
+    const struct prometheus_source *ps1 = a, *ps2 = b;
+    RRDSET *st1 = ps1->st, *st2 = ps2->st;
+
+    if(st1->hash_context < st2->hash_context) return -1;
+    if(st1->hash_context > st2->hash_context) return 1;
+    return strcmp(st1->context, st2->context);
+}
+
+static int prometheus_compare_context_order(const void *a, const void *b) {
+    int ret = prometheus_compare_context(a, b);
+    if(ret) return ret;
+
+    const struct prometheus_source *ps1 = a, *ps2 = b;
+    return (ps1->order < ps2->order)?-1:(ps1->order > ps2->order);
+}
+
+// a metric family per context, with chart, family and dimension labels
+// the charts of a context have the same dimensions, so the family is typed
+// according to the dimensions of its first chart
+static void prometheus_generate_per_context(struct prometheus_source *charts, size_t count, BUFFER *wb, uint32_t options, time_t after) {
+    RRDSET *st = charts[0].st;
+
+    char name[PROMETHEUS_ELEMENT_MAX + 1];
+    size_t n = prometheus_name_copy(name, "netdata_", PROMETHEUS_ELEMENT_MAX);
+    n += prometheus_name_copy(&name[n], st->context, PROMETHEUS_ELEMENT_MAX - n);
+
+    if(options & PROMETHEUS_OUTPUT_AVERAGE) {
+        if(n < PROMETHEUS_ELEMENT_MAX) name[n++] = '_';
+        n += prometheus_name_copy(&name[n], st->units, PROMETHEUS_ELEMENT_MAX - n);
+        prometheus_name_copy(&name[n], "_average", PROMETHEUS_ELEMENT_MAX - n);
+    }
+
+    if(options & PROMETHEUS_OUTPUT_TYPES) {
+        const char *type = "gauge";
+
+        if(!(options & PROMETHEUS_OUTPUT_AVERAGE)) {
+            RRDDIM *rd;
+            rrdset_rdlock(st);
+            for(rd = st->dimensions, type = NULL; rd ; rd = rd->next) {
+                const char *t = prometheus_type(rd->algorithm);
+                if(!type) type = t;
+                else if(strcmp(type, t)) { type = "untyped"; break; }
+            }
+            rrdset_unlock(st);
+            if(!type) type = "gauge";
+        }
+
+        char title[PROMETHEUS_ELEMENT_MAX + 1];
+        char help[PROMETHEUS_ELEMENT_MAX + 1];
+        snprintfz(title, PROMETHEUS_ELEMENT_MAX, "%s (%s)", st->title, st->units);
+        prometheus_label_copy(help, title, PROMETHEUS_ELEMENT_MAX, 0);
+        buffer_sprintf(wb, "\n# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+    else
+        buffer_strcat(wb, "\n");
+
+    size_t i;
+    for(i = 0; i < count ; i++) {
+        st = charts[i].st;
+        const char *hostname = charts[i].hostname;
+
+        char chart[PROMETHEUS_ELEMENT_MAX + 1];
+        char family[PROMETHEUS_ELEMENT_MAX + 1];
+        prometheus_label_copy(chart, st->id, PROMETHEUS_ELEMENT_MAX, 1);
+        prometheus_label_copy(family, st->family, PROMETHEUS_ELEMENT_MAX, 1);
+
+        rrdset_rdlock(st);
+
+        RRDDIM *rd;
+        rrddim_foreach_read(rd, st) {
+            if(rd->collections_counter) {
+                calculated_number value;
+                unsigned long long timestamp;
+                if(!prometheus_value(st, rd, options, after, &value, &timestamp)) continue;
+
+                char dimension[PROMETHEUS_ELEMENT_MAX + 1];
+                prometheus_label_copy(dimension, rd->name, PROMETHEUS_ELEMENT_MAX, 1);
+
+                buffer_sprintf(wb, "%s{chart=\"%s\",family=\"%s\",dimension=\"%s\",instance=\"%s\"} ", name, chart, family, dimension, hostname);
+                prometheus_print_value(wb, rd, options, value, timestamp);
+            }
+        }
+
+        rrdset_unlock(st);
+    }
+}
+
+// the metric families of the charts given, a family per context
+static void prometheus_generate_per_context_all(struct prometheus_source *charts, size_t count, BUFFER *wb, uint32_t options, time_t after) {
+    if(!count) return;
+
+    // group the charts per context, so that the samples of each family are together
+    qsort(charts, count, sizeof(struct prometheus_source), prometheus_compare_context_order);
+
+    size_t i, first;
+    for(i = 1, first = 0; i <= count ; i++) {
+        if(i == count || prometheus_compare_context(&charts[first], &charts[i])) {
+            prometheus_generate_per_context(&charts[first], i - first, wb, options, after);
+            first = i;
+        }
+    }
+}
+
+static void rrd_stats_api_v1_charts_allmetrics_prometheus_generate(RRDHOST *host, BUFFER *wb, uint32_t options, time_t after) {
     rrdhost_rdlock(host);
 
+    // the instance label is given as a metric name, as it has always been,
+    // unless labels are requested
     char hostname[PROMETHEUS_ELEMENT_MAX + 1];
-    prometheus_name_copy(hostname, host->hostname, PROMETHEUS_ELEMENT_MAX);
+    if(options & PROMETHEUS_OUTPUT_LABELS)
+        prometheus_label_copy(hostname, host->hostname, PROMETHEUS_ELEMENT_MAX, 1);
+    else
+        prometheus_name_copy(hostname, host->hostname, PROMETHEUS_ELEMENT_MAX);
 
-    // for each chart
     RRDSET *st;
-    rrdset_foreach_read(st, host) {
-        char chart[PROMETHEUS_ELEMENT_MAX + 1];
-        prometheus_name_copy(chart, st->id, PROMETHEUS_ELEMENT_MAX);
 
-        buffer_strcat(wb, "\n");
-        if(rrdset_is_available_for_viewers(st)) {
-            rrdset_rdlock(st);
+    if(options & PROMETHEUS_OUTPUT_LABELS) {
+        size_t count = 0, size = 0;
+        struct prometheus_source *charts = NULL;
 
-            // for each dimension
-            RRDDIM *rd;
-            rrddim_foreach_read(rd, st) {
-                if(rd->collections_counter) {
-                    char dimension[PROMETHEUS_ELEMENT_MAX + 1];
-                    prometheus_name_copy(dimension, rd->id, PROMETHEUS_ELEMENT_MAX);
+        rrdset_foreach_read(st, host) {
+            if(rrdset_is_available_for_viewers(st))
+                prometheus_source_add(&charts, &count, &size, st, NULL, hostname, count);
+        }
 
-                    // buffer_sprintf(wb, "# HELP %s.%s %s\n", st->id, rd->id, st->units);
+        prometheus_generate_per_context_all(charts, count, wb, options, after);
+        freez(charts);
+    }
+    else {
+        // for each chart
+        rrdset_foreach_read(st, host) {
+            buffer_strcat(wb, "\n");
+            if(rrdset_is_available_for_viewers(st)) {
+                rrdset_rdlock(st);
+                prometheus_generate_per_dimension(st, wb, hostname, options, after);
+                rrdset_unlock(st);
+            }
+        }
+    }
 
-                    switch(rd->algorithm) {
-                        case RRD_ALGORITHM_INCREMENTAL:
-                        case RRD_ALGORITHM_PCENT_OVER_DIFF_TOTAL:
-                            buffer_sprintf(wb, "# TYPE %s_%s counter\n", chart, dimension);
-                            break;
+    rrdhost_unlock(host);
+}
 
-                        default:
-                            buffer_sprintf(wb, "# TYPE %s_%s gauge\n", chart, dimension);
-                            break;
-                    }
+static int prometheus_compare_dimension_order(const void *a, const void *b) {
+    const struct prometheus_source *ps1 = a, *ps2 = b;
+
+    int ret = strcmp(ps1->rd->prometheus_name, ps2->rd->prometheus_name);
+    if(ret) return ret;
+
+    return (ps1->order < ps2->order)?-1:(ps1->order > ps2->order);
+}
+
+// a metric family per dimension, with the samples of all the hosts
+// the dimensions are sorted by name, so the ones of the same family are together
+static void prometheus_generate_per_dimension_all(struct prometheus_source *dims, size_t count, BUFFER *wb, uint32_t options, time_t after) {
+    if(!count) return;
+
+    qsort(dims, count, sizeof(struct prometheus_source), prometheus_compare_dimension_order);
+
+    size_t i;
+    const char *family = NULL;
+    for(i = 0; i < count ; i++) {
+        RRDSET *st = dims[i].st;
+        RRDDIM *rd = dims[i].rd;
+
+        calculated_number value;
+        unsigned long long timestamp;
+
+        rrdset_rdlock(st);
+
+        if(prometheus_value(st, rd, options, after, &value, &timestamp)) {
+            // the TYPE of the family, before its first sample
+            if(!family || strcmp(family, rd->prometheus_name)) {
+                family = rd->prometheus_name;
+                buffer_strcat(wb, "\n");
+
+                if(options & PROMETHEUS_OUTPUT_TYPES)
+                    buffer_sprintf(wb, "# TYPE %s %s\n", rd->prometheus_name, (options & PROMETHEUS_OUTPUT_AVERAGE)?"gauge":prometheus_type(rd->algorithm));
+            }
+
+            buffer_sprintf(wb, "%s{instance=\"%s\"} ", rd->prometheus_name, dims[i].hostname);
+            prometheus_print_value(wb, rd, options, value, timestamp);
+        }
+
+        rrdset_unlock(st);
+    }
+}
+
+// each metric family is given once, with the samples of all the hosts in it
+static void rrd_stats_api_v1_charts_allmetrics_prometheus_hosts_generate(const char *hosts, BUFFER *wb, uint32_t options, time_t after) {
+    SIMPLE_PATTERN *pattern = simple_pattern_create(hosts, SIMPLE_PATTERN_EXACT);
+
+    struct prometheus_host {
+        RRDHOST *host;
+        char hostname[PROMETHEUS_ELEMENT_MAX + 1];
+    } *matched = NULL;
+    size_t matched_count = 0, matched_size = 0;
+
+    size_t count = 0, size = 0;
+    struct prometheus_source *sources = NULL;
+
+    rrd_rdlock();
+
+    // the hosts stay read locked while their samples are generated,
+    // so that their charts and dimensions cannot be freed
+    RRDHOST *h;
+    rrdhost_foreach_read(h) {
+        if(!simple_pattern_matches(pattern, h->hostname)) continue;
 
-                    // calculated_number n = (calculated_number)rd->last_collected_value * (calculated_number)(abs(rd->multiplier)) / (calculated_number)(abs(rd->divisor));
-                    // buffer_sprintf(wb, "%s.%s " CALCULATED_NUMBER_FORMAT " %llu\n", st->id, rd->id, n,
-                    //        (unsigned long long)((rd->last_collected_time.tv_sec * 1000) + (rd->last_collected_time.tv_usec / 1000)));
+        if(matched_count == matched_size) {
+            matched_size = (matched_size)?matched_size * 2:16;
+            matched = reallocz(matched, matched_size * sizeof(struct prometheus_host));
+        }
+
+        struct prometheus_host *ph = &matched[matched_count++];
+        ph->host = h;
+        if(options & PROMETHEUS_OUTPUT_LABELS)
+            prometheus_label_copy(ph->hostname, h->hostname, PROMETHEUS_ELEMENT_MAX, 1);
+        else
+            prometheus_name_copy(ph->hostname, h->hostname, PROMETHEUS_ELEMENT_MAX);
+
+        rrdhost_rdlock(h);
+    }
 
-                    buffer_sprintf(wb, "%s_%s{instance=\"%s\"} " COLLECTED_NUMBER_FORMAT " %llu\n",
-                            chart, dimension, hostname, rd->last_collected_value,
-                            (unsigned long long)((rd->last_collected_time.tv_sec * 1000) + (rd->last_collected_time.tv_usec / 1000)));
+    size_t i;
+    for(i = 0; i < matched_count ; i++) {
+        RRDSET *st;
+        rrdset_foreach_read(st, matched[i].host) {
+            if(!rrdset_is_available_for_viewers(st)) continue;
 
+            if(options & PROMETHEUS_OUTPUT_LABELS)
+                prometheus_source_add(&sources, &count, &size, st, NULL, matched[i].hostname, count);
+
+            else {
+                RRDDIM *rd;
+                rrdset_rdlock(st);
+                rrddim_foreach_read(rd, st) {
+                    if(rd->collections_counter)
+                        prometheus_source_add(&sources, &count, &size, st, rd, matched[i].hostname, count);
                 }
+                rrdset_unlock(st);
             }
+        }
+    }
 
-            rrdset_unlock(st);
+    if(options & PROMETHEUS_OUTPUT_LABELS)
+        prometheus_generate_per_context_all(sources, count, wb, options, after);
+    else
+        prometheus_generate_per_dimension_all(sources, count, wb, options, after);
+
+    for(i = 0; i < matched_count ; i++)
+        rrdhost_unlock(matched[i].host);
+
+    rrd_unlock();
+
+    freez(sources);
+    freez(matched);
+    simple_pattern_free(pattern);
+}
+
+// Generating the exposition is expensive: it walks all the charts and the
+// dimensions of the host, with the host locked. Since its values change only
+// when data are collected, it is generated at most once per update_every of
+// the host and every scrape in the same update_every gets a copy of it (and
+// of its gzip compressed version). So a scrape may miss the values collected
+// after the copy was generated, within the same update_every.
+// Averages depend on the time of the previous scrape, so they are not cached.
+
+#define PROMETHEUS_CACHE_VARIANTS (PROMETHEUS_OUTPUT_TYPES | PROMETHEUS_OUTPUT_LABELS)
+
+struct prometheus_cache {
+    pthread_mutex_t mutex;
+
+    // indexed by the output options
+    BUFFER *wb[PROMETHEUS_CACHE_VARIANTS + 1];
+    time_t bucket[PROMETHEUS_CACHE_VARIANTS + 1];           // the update_every of the host each one was generated in
+    size_t generation[PROMETHEUS_CACHE_VARIANTS + 1];       // incremented every time each one is generated
+
+#ifdef NETDATA_WITH_ZLIB
+    BUFFER *gz[PROMETHEUS_CACHE_VARIANTS + 1];              // the gzip compressed wb[]
+    size_t gz_generation[PROMETHEUS_CACHE_VARIANTS + 1];
+#endif
+};
+
+// the update_every the time is in, since the epoch
+static inline time_t prometheus_cache_bucket(int update_every) {
+    return now_realtime_sec() / ((update_every > 0)?update_every:1);
+}
+
+static inline struct prometheus_cache *prometheus_cache_get(RRDHOST *host) {
+    // hosts are created and freed with rrd write locked
+    // so, a read lock is enough to attach the cache to the host
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    if(unlikely(!host->prometheus_cache)) {
+        pthread_mutex_lock(&mutex);
+        if(!host->prometheus_cache) {
+            struct prometheus_cache *pc = callocz(1, sizeof(struct prometheus_cache));
+            pthread_mutex_init(&pc->mutex, NULL);
+            host->prometheus_cache = pc;
         }
+        pthread_mutex_unlock(&mutex);
     }
 
-    rrdhost_unlock(host);
+    return host->prometheus_cache;
+}
+
+// returns the cached exposition of the host, with the cache locked
+// the caller has to unlock it
+static inline BUFFER *prometheus_cache_lock(RRDHOST *host, uint32_t options) {
+    struct prometheus_cache *pc = prometheus_cache_get(host);
+    uint32_t v = options & PROMETHEUS_CACHE_VARIANTS;
+
+    pthread_mutex_lock(&pc->mutex);
+
+    time_t bucket = prometheus_cache_bucket(host->rrd_update_every);
+    if(unlikely(!pc->wb[v] || pc->bucket[v] != bucket)) {
+        if(!pc->wb[v]) pc->wb[v] = buffer_create(16384);
+        else buffer_flush(pc->wb[v]);
+
+        rrd_stats_api_v1_charts_allmetrics_prometheus_generate(host, pc->wb[v], v, 0);
+        pc->bucket[v] = bucket;
+        pc->generation[v]++;
+
+        debug(D_WEB_CLIENT, "Regenerated the prometheus exposition of host '%s' (%zu bytes).", host->hostname, pc->wb[v]->len);
+    }
+
+    return pc->wb[v];
+}
+
+static inline void prometheus_buffer_append(BUFFER *wb, BUFFER *src) {
+    buffer_need_bytes(wb, src->len + 1);
+    memcpy(&wb->buffer[wb->len], src->buffer, src->len);
+    wb->len += src->len;
+    wb->buffer[wb->len] = '\0';
+}
+
+// append to wb the prometheus exposition of the host
+// after is the time of the previous scrape, used for averages
+void rrd_stats_api_v1_charts_allmetrics_prometheus(RRDHOST *host, BUFFER *wb, uint32_t options, time_t after) {
+    if(options & PROMETHEUS_OUTPUT_AVERAGE) {
+        rrd_stats_api_v1_charts_allmetrics_prometheus_generate(host, wb, options, after);
+        return;
+    }
+
+    BUFFER *cached = prometheus_cache_lock(host, options);
+    prometheus_buffer_append(wb, cached);
+    pthread_mutex_unlock(&host->prometheus_cache->mutex);
+}
+
+// The exposition of many hosts is cached too, for the last hosts pattern of each
+// variant. It is generated with all the matching hosts locked, so caching it
+// matters even more, but a different pattern replaces it.
+static struct prometheus_hosts_cache {
+    pthread_mutex_t mutex;
+
+    // indexed by the output options
+    char *hosts[PROMETHEUS_CACHE_VARIANTS + 1];             // the hosts pattern each one was generated for
+    BUFFER *wb[PROMETHEUS_CACHE_VARIANTS + 1];
+    time_t bucket[PROMETHEUS_CACHE_VARIANTS + 1];           // the update_every of localhost each one was generated in
+} prometheus_hosts_cache = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+// append to wb the prometheus exposition of all the hosts matching the pattern
+// after is the time of the previous scrape, used for averages
+void rrd_stats_api_v1_charts_allmetrics_prometheus_hosts(const char *hosts, BUFFER *wb, uint32_t options, time_t after) {
+    if(options & PROMETHEUS_OUTPUT_AVERAGE) {
+        rrd_stats_api_v1_charts_allmetrics_prometheus_hosts_generate(hosts, wb, options, after);
+        return;
+    }
+
+    struct prometheus_hosts_cache *pc = &prometheus_hosts_cache;
+    uint32_t v = options & PROMETHEUS_CACHE_VARIANTS;
+
+    pthread_mutex_lock(&pc->mutex);
+
+    time_t bucket = prometheus_cache_bucket(localhost->rrd_update_every);
+    if(unlikely(!pc->wb[v] || pc->bucket[v] != bucket || strcmp(pc->hosts[v], hosts))) {
+        if(!pc->wb[v]) pc->wb[v] = buffer_create(16384);
+        else buffer_flush(pc->wb[v]);
+
+        if(!pc->hosts[v] || strcmp(pc->hosts[v], hosts)) {
+            freez(pc->hosts[v]);
+            pc->hosts[v] = strdupz(hosts);
+        }
+
+        rrd_stats_api_v1_charts_allmetrics_prometheus_hosts_generate(hosts, pc->wb[v], v, 0);
+        pc->bucket[v] = bucket;
+
+        debug(D_WEB_CLIENT, "Regenerated the prometheus exposition of hosts '%s' (%zu bytes).", hosts, pc->wb[v]->len);
+    }
+
+    prometheus_buffer_append(wb, pc->wb[v]);
+    pthread_mutex_unlock(&pc->mutex);
+}
+
+#ifdef NETDATA_WITH_ZLIB
+// copy to wb the gzip compressed exposition of the host
+// returns 1 on success, 0 if it is not available
+int rrd_stats_api_v1_charts_allmetrics_prometheus_gzip(RRDHOST *host, BUFFER *wb, uint32_t options, int level) {
+    if(options & PROMETHEUS_OUTPUT_AVERAGE) return 0;
+
+    int ret = 0;
+    uint32_t v = options & PROMETHEUS_CACHE_VARIANTS;
+    BUFFER *cached = prometheus_cache_lock(host, options);
+    struct prometheus_cache *pc = host->prometheus_cache;
+
+    if(unlikely(!pc->gz[v] || pc->gz_generation[v] != pc->generation[v])) {
+        if(pc->gz[v]) buffer_free(pc->gz[v]);
+        pc->gz[v] = web_gzip_buffer(cached, level);
+        pc->gz_generation[v] = pc->generation[v];
+    }
+
+    if(likely(pc->gz[v])) {
+        buffer_flush(wb);
+        prometheus_buffer_append(wb, pc->gz[v]);
+        ret = 1;
+    }
+
+    pthread_mutex_unlock(&pc->mutex);
+    return ret;
+}
+#endif
+
+void rrd_stats_api_v1_charts_allmetrics_prometheus_free(RRDHOST *host) {
+    struct prometheus_cache *pc = host->prometheus_cache;
+    if(!pc) return;
+
+    host->prometheus_cache = NULL;
+
+    int v;
+    for(v = 0; v <= PROMETHEUS_CACHE_VARIANTS ; v++) {
+        if(pc->wb[v]) buffer_free(pc->wb[v]);
+#ifdef NETDATA_WITH_ZLIB
+        if(pc->gz[v]) buffer_free(pc->gz[v]);
+#endif
+    }
+
+    pthread_mutex_destroy(&pc->mutex);
+    freez(pc);
 }
 
 // ----------------------------------------------------------------------------
@@ -1684,6 +2383,7 @@ int rrdset2value_api_v1(
         , time_t *db_after
         , time_t *db_before
         , int *value_is_null
+        , size_t *rows_scanned
 ) {
     RRDR *r = rrd2rrdr(st, points, after, before, group_method, !(options & RRDR_OPTION_NOT_ALIGNED));
     if(!r) {
@@ -1691,6 +2391,8 @@ int rrdset2value_api_v1(
         return 500;
     }
 
+    if(rows_scanned) *rows_scanned = (size_t)(r->group * rrdr_rows(r));
+
     if(rrdr_rows(r) == 0) {
         rrdr_free(r);
 
@@ -1732,6 +2434,7 @@ int rrdset2anything_api_v1(
         , int group_method
         , uint32_t options
         , time_t *latest_timestamp
+        , size_t *rows_scanned
 ) {
     st->last_accessed_time = now_realtime_sec();
 
@@ -1741,6 +2444,8 @@ int rrdset2anything_api_v1(
         return 500;
     }
 
+    if(rows_scanned) *rows_scanned = (size_t)(r->group * rrdr_rows(r));
+
     if(r->result_options & RRDR_RESULT_OPTION_RELATIVE)
         buffer_no_cacheable(wb);
     else if(r->result_options & RRDR_RESULT_OPTION_ABSOLUTE)
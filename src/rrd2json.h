@@ -37,6 +37,10 @@
 #define ALLMETRICS_SHELL 1
 #define ALLMETRICS_PROMETHEUS 2
 
+#define PROMETHEUS_OUTPUT_TYPES     0x00000001 // add TYPE and HELP lines
+#define PROMETHEUS_OUTPUT_LABELS    0x00000002 // a metric family per context, with chart, family and dimension labels
+#define PROMETHEUS_OUTPUT_AVERAGE   0x00000004 // the average of the stored values since the last scrape, instead of the last collected
+
 #define GROUP_UNDEFINED         0
 #define GROUP_AVERAGE           1
 #define GROUP_MIN               2
@@ -59,16 +63,23 @@
 #define RRDR_OPTION_NOT_ALIGNED     0x00001000 // do not align charts for persistant timeframes
 
 extern void rrd_stats_api_v1_chart(RRDSET *st, BUFFER *wb);
-extern void rrd_stats_api_v1_charts(RRDHOST *host, BUFFER *wb);
+extern void rrd_stats_api_v1_charts(RRDHOST *host, BUFFER *wb, size_t if_version, usec_t if_epoch);
+extern void rrd_stats_api_v1_chart_json_cache_free(RRDSET *st);
 
 extern void rrd_stats_api_v1_charts_allmetrics_shell(RRDHOST *host, BUFFER *wb);
-extern void rrd_stats_api_v1_charts_allmetrics_prometheus(RRDHOST *host, BUFFER *wb);
+extern void rrd_stats_api_v1_charts_allmetrics_prometheus(RRDHOST *host, BUFFER *wb, uint32_t options, time_t after);
+extern void rrd_stats_api_v1_charts_allmetrics_prometheus_hosts(const char *hosts, BUFFER *wb, uint32_t options, time_t after);
+extern void rrd_stats_api_v1_charts_allmetrics_prometheus_free(RRDHOST *host);
+#ifdef NETDATA_WITH_ZLIB
+extern int rrd_stats_api_v1_charts_allmetrics_prometheus_gzip(RRDHOST *host, BUFFER *wb, uint32_t options, int level);
+#endif
+extern char *prometheus_metric_name_strdupz(const char *chart, const char *dimension);
 
 extern int rrdset2anything_api_v1(RRDSET *st, BUFFER *out, BUFFER *dimensions, uint32_t format, long points
                                   , long long after, long long before, int group_method, uint32_t options
-                                  , time_t *latest_timestamp);
+                                  , time_t *latest_timestamp, size_t *rows_scanned);
 extern int rrdset2value_api_v1(RRDSET *st, BUFFER *wb, calculated_number *n, const char *dimensions, long points
                                , long long after, long long before, int group_method, uint32_t options
-                               , time_t *db_before, time_t *db_after, int *value_is_null);
+                               , time_t *db_before, time_t *db_after, int *value_is_null, size_t *rows_scanned);
 
 #endif /* NETDATA_RRD2JSON_H */
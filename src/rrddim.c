@@ -31,6 +31,27 @@ inline RRDDIM *rrddim_find(RRDSET *st, const char *id) {
     return rrddim_index_find(st, id, 0);
 }
 
+// ----------------------------------------------------------------------------
+// RRDDIM store a value replayed by a streaming netdata
+
+// the value is stored only if its slot is in the database and has not been collected
+// returns 1 when the value has been stored, 0 otherwise
+inline int rrddim_replay_value(RRDSET *st, RRDDIM *rd, time_t t, storage_number n) {
+    if(unlikely(st->rrd_memory_mode == RRD_MEMORY_MODE_NONE || !does_storage_number_exist(n)))
+        return 0;
+
+    time_t last_t = rrdset_last_entry_t(st);
+    if(unlikely(t <= rrdset_first_entry_t(st) || t > last_t || (last_t - t) % st->update_every))
+        return 0;
+
+    unsigned long slot = rrdset_time2slot(st, t);
+    if(unlikely(does_storage_number_exist(rd->values[slot])))
+        return 0;
+
+    rd->values[slot] = n;
+    return 1;
+}
+
 
 // ----------------------------------------------------------------------------
 // RRDDIM rename a dimension
@@ -47,8 +68,17 @@ inline void rrddim_set_name(RRDSET *st, RRDDIM *rd, const char *name) {
     rd->hash_name = simple_hash(rd->name);
 
     rrddimvar_rename_all(rd);
+    rrdset_metadata_changed(st);
 }
 
+// ----------------------------------------------------------------------------
+// RRDDIM the variables of a dimension
+
+void rrddim_create_variables(RRDDIM *rd) {
+    rrddimvar_create(rd, RRDVAR_TYPE_CALCULATED, NULL, NULL, &rd->last_stored_value, 0);
+    rrddimvar_create(rd, RRDVAR_TYPE_COLLECTED, NULL, "_raw", &rd->last_collected_value, 0);
+    rrddimvar_create(rd, RRDVAR_TYPE_TIME_T, NULL, "_last_collected_t", &rd->last_collected_time.tv_sec, 0);
+}
 
 // ----------------------------------------------------------------------------
 // RRDDIM create a dimension
@@ -80,6 +110,7 @@ RRDDIM *rrddim_add(RRDSET *st, const char *id, const char *name, collected_numbe
             rd->id = NULL;
             rd->name = NULL;
             rd->cache_filename = NULL;
+            rd->prometheus_name = NULL;
             rd->variables = NULL;
             rd->next = NULL;
             rd->rrdset = NULL;
@@ -144,6 +175,9 @@ RRDDIM *rrddim_add(RRDSET *st, const char *id, const char *name, collected_numbe
 
     rd->cache_filename = strdupz(fullfilename);
 
+    // ids never change, so the metric name is prepared once
+    rd->prometheus_name = prometheus_metric_name_strdupz(st->id, rd->id);
+
     snprintfz(varname, CONFIG_MAX_NAME, "dim %s name", rd->id);
     rd->name = config_get(st->config_section, varname, (name && *name)?name:rd->id);
     rd->hash_name = simple_hash(rd->name);
@@ -164,6 +198,11 @@ RRDDIM *rrddim_add(RRDSET *st, const char *id, const char *name, collected_numbe
     // prevent incremental calculation spikes
     rd->collections_counter = 0;
     rd->updated = 0;
+    rd->exposed = 0;
+    rd->rrdpush_slot = 0;
+    rd->rrdpush_last_value = 0;
+    rd->rrdpush_aggregated_value = 0;
+    rd->rrdpush_aggregated_count = 0;
     rd->flags = 0x00000000;
 
     rd->calculated_value = 0;
@@ -188,17 +227,17 @@ RRDDIM *rrddim_add(RRDSET *st, const char *id, const char *name, collected_numbe
         td->next = rd;
     }
 
-    if(st->rrdhost->health_enabled) {
-        rrddimvar_create(rd, RRDVAR_TYPE_CALCULATED, NULL, NULL, &rd->last_stored_value, 0);
-        rrddimvar_create(rd, RRDVAR_TYPE_COLLECTED, NULL, "_raw", &rd->last_collected_value, 0);
-        rrddimvar_create(rd, RRDVAR_TYPE_TIME_T, NULL, "_last_collected_t", &rd->last_collected_time.tv_sec, 0);
-    }
+    // the chart has no family while its host is replication only
+    if(st->rrdfamily && st->rrdhost->health_enabled)
+        rrddim_create_variables(rd);
 
     rrdset_unlock(st);
 
     if(unlikely(rrddim_index_add(st, rd) != rd))
         error("RRDDIM: INTERNAL ERROR: attempt to index duplicate dimension '%s' on chart '%s'", rd->id, st->id);
 
+    rrdset_metadata_changed(st);
+
     return(rd);
 }
 
@@ -229,6 +268,8 @@ void rrddim_free(RRDSET *st, RRDDIM *rd)
     if(unlikely(rrddim_index_del(st, rd) != rd))
         error("RRDDIM: INTERNAL ERROR: attempt to remove from index dimension '%s' on chart '%s', removed a different dimension.", rd->id, st->id);
 
+    rrdset_metadata_changed(st);
+
     // free(rd->annotations);
 
     switch(rd->rrd_memory_mode) {
@@ -241,6 +282,7 @@ void rrddim_free(RRDSET *st, RRDDIM *rd)
             debug(D_RRD_CALLS, "Unmapping dimension '%s'.", rd->name);
             freez((void *)rd->id);
             freez(rd->cache_filename);
+            freez(rd->prometheus_name);
             munmap(rd, rd->memsize);
             break;
 
@@ -249,6 +291,7 @@ void rrddim_free(RRDSET *st, RRDDIM *rd)
             debug(D_RRD_CALLS, "Removing dimension '%s'.", rd->name);
             freez((void *)rd->id);
             freez(rd->cache_filename);
+            freez(rd->prometheus_name);
             freez(rd);
             break;
     }
@@ -267,7 +310,10 @@ int rrddim_hide(RRDSET *st, const char *id) {
         return 1;
     }
 
-    rrddim_flag_set(rd, RRDDIM_FLAG_HIDDEN);
+    if(!rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN)) {
+        rrddim_flag_set(rd, RRDDIM_FLAG_HIDDEN);
+        rrdset_metadata_changed(st);
+    }
     return 0;
 }
 
@@ -280,7 +326,10 @@ int rrddim_unhide(RRDSET *st, const char *id) {
         return 1;
     }
 
-    rrddim_flag_clear(rd, RRDDIM_FLAG_HIDDEN);
+    if(rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN)) {
+        rrddim_flag_clear(rd, RRDDIM_FLAG_HIDDEN);
+        rrdset_metadata_changed(st);
+    }
     return 0;
 }
 
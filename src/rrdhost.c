@@ -89,6 +89,10 @@ RRDHOST *rrdhost_create(const char *hostname,
         int rrdpush_enabled,
         char *rrdpush_destination,
         char *rrdpush_api_key,
+        char *rrdpush_send_charts_matching,
+        char *rrdpush_aggregate_charts_matching,
+        int rrdpush_aggregate_iterations,
+        int replication_only,
         int is_localhost
 ) {
 
@@ -100,16 +104,19 @@ RRDHOST *rrdhost_create(const char *hostname,
     host->rrd_history_entries = entries;
     host->rrd_memory_mode     = memory_mode;
     host->health_enabled      = (memory_mode == RRD_MEMORY_MODE_NONE)? 0 : health_enabled;
+    host->lazy_indexes        = (replication_only && !is_localhost);
     host->rrdpush_enabled     = (rrdpush_enabled && rrdpush_destination && *rrdpush_destination && rrdpush_api_key && *rrdpush_api_key);
     host->rrdpush_destination = (host->rrdpush_enabled)?strdupz(rrdpush_destination):NULL;
     host->rrdpush_api_key     = (host->rrdpush_enabled)?strdupz(rrdpush_api_key):NULL;
 
-    host->rrdpush_pipe[0] = -1;
-    host->rrdpush_pipe[1] = -1;
-    host->rrdpush_socket  = -1;
+    host->rrdpush_send_charts_matching = simple_pattern_create(rrdpush_send_charts_matching, SIMPLE_PATTERN_EXACT);
+    host->rrdpush_aggregate_charts_matching = simple_pattern_create(rrdpush_aggregate_charts_matching, SIMPLE_PATTERN_EXACT);
+    host->rrdpush_aggregate_iterations = (rrdpush_aggregate_iterations > 1)?rrdpush_aggregate_iterations:1;
 
     pthread_mutex_init(&host->rrdpush_mutex, NULL);
     pthread_rwlock_init(&host->rrdhost_rwlock, NULL);
+    pthread_mutex_init(&host->charts_json_mutex, NULL);
+    host->charts_epoch = now_realtime_usec();
 
     rrdhost_init_hostname(host, hostname);
     rrdhost_init_machine_guid(host, guid);
@@ -194,8 +201,9 @@ RRDHOST *rrdhost_create(const char *hostname,
 
     // ------------------------------------------------------------------------
     // load health configuration
+    // (replication only hosts load it when their indexes are built)
 
-    if(host->health_enabled) {
+    if(host->health_enabled && !host->lazy_indexes) {
         health_alarm_log_load(host);
         health_alarm_log_open(host);
 
@@ -238,6 +246,7 @@ RRDHOST *rrdhost_create(const char *hostname,
                      ", streaming %s"
                      " (to '%s' with api key '%s')"
                      ", health %s"
+                     "%s"
                      ", cache_dir '%s'"
                      ", varlib_dir '%s'"
                      ", health_log '%s'"
@@ -253,6 +262,7 @@ RRDHOST *rrdhost_create(const char *hostname,
              , host->rrdpush_destination?host->rrdpush_destination:""
              , host->rrdpush_api_key?host->rrdpush_api_key:""
              , host->health_enabled?"enabled":"disabled"
+             , host->lazy_indexes?", replication only":""
              , host->cache_dir
              , host->varlib_dir
              , host->health_log_filename
@@ -278,6 +288,10 @@ RRDHOST *rrdhost_find_or_create(
         , int rrdpush_enabled
         , char *rrdpush_destination
         , char *rrdpush_api_key
+        , char *rrdpush_send_charts_matching
+        , char *rrdpush_aggregate_charts_matching
+        , int rrdpush_aggregate_iterations
+        , int replication_only
 ) {
     debug(D_RRDHOST, "Searching for host '%s' with guid '%s'", hostname, guid);
 
@@ -294,6 +308,10 @@ RRDHOST *rrdhost_find_or_create(
                 , rrdpush_enabled
                 , rrdpush_destination
                 , rrdpush_api_key
+                , rrdpush_send_charts_matching
+                , rrdpush_aggregate_charts_matching
+                , rrdpush_aggregate_iterations
+                , replication_only
                 , 0
         );
     }
@@ -315,13 +333,61 @@ RRDHOST *rrdhost_find_or_create(
 
         if(host->rrd_memory_mode != mode)
             error("Host '%s' has memory mode '%s', but the wanted one is '%s'.", host->hostname, rrd_memory_mode_name(host->rrd_memory_mode), rrd_memory_mode_name(mode));
+
+        // once built, the indexes are kept, even if the host becomes replication only again
+        if(!replication_only)
+            rrdhost_build_indexes(host);
     }
 
+    // the sender is counted only after the handshake, so until then
+    // prevent other connections from cleaning up the host as an orphan
+    if(host) host->senders_disconnected_time = now_realtime_sec();
+
     rrdhost_cleanup_orphan(host);
 
     return host;
 }
 
+// ----------------------------------------------------------------------------
+// RRDHOST - build the indexes of a replication only host
+//
+// Replication only hosts just store what they receive, so they are created
+// without the families of their charts, the variables of their charts and
+// dimensions and their health configuration. All these are built here, the
+// first time they are needed: when health runs for the host, or when its
+// variables are queried.
+
+void rrdhost_build_indexes(RRDHOST *host) {
+    if(likely(!host->lazy_indexes))
+        return;
+
+    rrdhost_wrlock(host);
+
+    // another thread may have built them while we were waiting for the lock
+    if(host->lazy_indexes) {
+        info("Host '%s': building the indexes of its charts%s.", host->hostname, host->health_enabled?" and loading its alarms":"");
+
+        RRDSET *st;
+        rrdset_foreach_write(st, host)
+            rrdset_build_indexes(st);
+
+        if(host->health_enabled) {
+            health_alarm_log_load(host);
+            health_alarm_log_open(host);
+            health_readdir(host, health_config_dir());
+
+            rrdset_foreach_write(st, host) {
+                rrdsetcalc_link_matching(st);
+                rrdcalctemplate_link_matching(st);
+            }
+        }
+
+        host->lazy_indexes = 0;
+    }
+
+    rrdhost_unlock(host);
+}
+
 void rrdhost_cleanup_orphan(RRDHOST *protected) {
     time_t now = now_realtime_sec();
 
@@ -372,6 +438,10 @@ void rrd_init(char *hostname) {
             , default_rrdpush_enabled
             , default_rrdpush_destination
             , default_rrdpush_api_key
+            , default_rrdpush_send_charts_matching
+            , default_rrdpush_aggregate_charts_matching
+            , default_rrdpush_aggregate_iterations
+            , 0
             , 1
     );
 }
@@ -463,11 +533,16 @@ void rrdhost_free(RRDHOST *host) {
     // ------------------------------------------------------------------------
     // free it
 
+    rrd_stats_api_v1_charts_allmetrics_prometheus_free(host);
+    rrdpush_ring_free(host->rrdpush_ring);
+
     freez(host->os);
     freez(host->cache_dir);
     freez(host->varlib_dir);
     freez(host->rrdpush_api_key);
     freez(host->rrdpush_destination);
+    simple_pattern_free(host->rrdpush_send_charts_matching);
+    simple_pattern_free(host->rrdpush_aggregate_charts_matching);
     freez(host->health_default_exec);
     freez(host->health_default_recipient);
     freez(host->health_log_filename);
@@ -8,8 +8,8 @@
  * 1. a random data collection thread, calling rrdset_done_push()
  *    this is called for each chart.
  *
- *    the output of this work is kept in a BUFFER in RRDHOST
- *    the sender thread is signalled via a pipe (also in RRDHOST)
+ *    the output of this work is queued in a ring buffer in RRDHOST
+ *    the sender thread is signalled via an eventfd (also in the ring)
  *
  * 2. a sender thread running at the sending netdata
  *    this is spawned automatically on the first chart to be pushed
@@ -19,21 +19,47 @@
  *
  * 3. a receiver thread, running at the receiving netdata
  *    this is spawned automatically when the sender connects to
- *    the receiver.
+ *    the receiver, for the handshake. Then the connection is
+ *    given to a fixed pool of receiver workers (rrdpush_receiver.c).
  *
  */
 
-#define START_STREAMING_PROMPT "Hit me baby, push them over..."
-
 int default_rrdpush_enabled = 0;
 char *default_rrdpush_destination = NULL;
 char *default_rrdpush_api_key = NULL;
+char *default_rrdpush_send_charts_matching = NULL;
+char *default_rrdpush_aggregate_charts_matching = NULL;
+int default_rrdpush_aggregate_iterations = 10;
+static int default_rrdpush_binary = 1;
+static size_t default_rrdpush_buffer_size = 1024 * 1024;
+int default_rrdpush_compression = 1;
+int default_rrdpush_compression_level = 3;
 
 int rrdpush_init() {
     default_rrdpush_enabled     = appconfig_get_boolean(&stream_config, CONFIG_SECTION_STREAM, "enabled", default_rrdpush_enabled);
     default_rrdpush_destination = appconfig_get(&stream_config, CONFIG_SECTION_STREAM, "destination", "");
     default_rrdpush_api_key     = appconfig_get(&stream_config, CONFIG_SECTION_STREAM, "api key", "");
+    default_rrdpush_send_charts_matching = appconfig_get(&stream_config, CONFIG_SECTION_STREAM, "send charts matching", "*");
+    default_rrdpush_aggregate_charts_matching = appconfig_get(&stream_config, CONFIG_SECTION_STREAM, "aggregate charts matching", "");
+    default_rrdpush_aggregate_iterations = (int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "aggregate iterations", default_rrdpush_aggregate_iterations);
     rrdhost_free_orphan_time    = appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "free orphan hosts after seconds", rrdhost_free_orphan_time);
+    default_rrdpush_binary      = appconfig_get_boolean(&stream_config, CONFIG_SECTION_STREAM, "binary protocol", default_rrdpush_binary);
+    default_rrdpush_buffer_size = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "buffer size bytes", (long long)default_rrdpush_buffer_size);
+    default_rrdpush_compression = appconfig_get_boolean(&stream_config, CONFIG_SECTION_STREAM, "compression", default_rrdpush_compression);
+    default_rrdpush_compression_level = (int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "compression level", default_rrdpush_compression_level);
+    default_rrdpush_replay      = appconfig_get_boolean(&stream_config, CONFIG_SECTION_STREAM, "replay", default_rrdpush_replay);
+    default_rrdpush_replay_bytes_per_second = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "replay max bytes per second", (long long)default_rrdpush_replay_bytes_per_second);
+    default_rrdpush_receiver_threads = (int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "receiver threads", processors);
+
+    if(!default_rrdpush_replay_bytes_per_second)
+        default_rrdpush_replay = 0;
+
+    if(default_rrdpush_compression_level < 1 || default_rrdpush_compression_level > 9)
+        default_rrdpush_compression_level = 3;
+
+#ifndef ENABLE_STREAM_COMPRESSION
+    default_rrdpush_compression = 0;
+#endif
 
     if(default_rrdpush_enabled && (!default_rrdpush_destination || !*default_rrdpush_destination || !default_rrdpush_api_key || !*default_rrdpush_api_key)) {
         error("STREAM [send]: cannot enable sending thread - information is missing.");
@@ -43,15 +69,11 @@ int rrdpush_init() {
     return default_rrdpush_enabled;
 }
 
-#define CONNECTED_TO_SIZE 100
-
 // data collection happens from multiple threads
 // each of these threads calls rrdset_done()
 // which in turn calls rrdset_done_push()
-// which uses this pipe to notify the streaming thread
-// that there are more data ready to be sent
-#define PIPE_READ 0
-#define PIPE_WRITE 1
+// which queues the update of the chart to the ring buffer
+// that the streaming thread sends data from
 
 // to have the remote netdata re-sync the charts
 // to its current clock, we send for this many
@@ -62,8 +84,99 @@ static unsigned int remote_clock_resync_iterations = 60;
 #define rrdpush_lock(host) pthread_mutex_lock(&((host)->rrdpush_mutex))
 #define rrdpush_unlock(host) pthread_mutex_unlock(&((host)->rrdpush_mutex))
 
-// checks if the current chart definition has been sent
-static inline int need_to_send_chart_definition(RRDSET *st) {
+// ----------------------------------------------------------------------------
+// the charts streamed and their resolution
+
+// checks (once) if the chart is streamed and if it is aggregated
+static inline int rrdpush_send_chart_matching(RRDSET *st) {
+    if(unlikely(!rrdset_flag_check(st, (RRDSET_FLAG_UPSTREAM_SEND | RRDSET_FLAG_UPSTREAM_IGNORE)))) {
+        RRDHOST *host = st->rrdhost;
+
+        if(simple_pattern_matches(host->rrdpush_send_charts_matching, st->id) || simple_pattern_matches(host->rrdpush_send_charts_matching, st->name))
+            rrdset_flag_set(st, RRDSET_FLAG_UPSTREAM_SEND);
+        else
+            rrdset_flag_set(st, RRDSET_FLAG_UPSTREAM_IGNORE);
+
+        int aggregate = (host->rrdpush_aggregate_iterations > 1 && (simple_pattern_matches(host->rrdpush_aggregate_charts_matching, st->id) || simple_pattern_matches(host->rrdpush_aggregate_charts_matching, st->name)));
+        if(aggregate != (rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_AGGREGATE)?1:0)) {
+            if(aggregate) rrdset_flag_set(st, RRDSET_FLAG_UPSTREAM_AGGREGATE);
+            else rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_AGGREGATE);
+
+            // the resolution has changed, send the definition again
+            st->rrdpush_aggregated = 0;
+            RRDDIM *rd;
+            rrddim_foreach_read(rd, st)
+                rd->exposed = 0;
+        }
+    }
+
+    return rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_SEND);
+}
+
+static inline int rrdpush_update_every(RRDSET *st) {
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_AGGREGATE)))
+        return st->update_every * st->rrdhost->rrdpush_aggregate_iterations;
+
+    return st->update_every;
+}
+
+static inline usec_t rrdpush_usec_since_last_update(RRDSET *st) {
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_AGGREGATE)))
+        return st->rrdpush_aggregated_usec;
+
+    return st->usec_since_last_update;
+}
+
+static inline int rrdpush_dimension_updated(RRDSET *st, RRDDIM *rd) {
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_AGGREGATE)))
+        return (rd->rrdpush_aggregated_count)?1:0;
+
+    return rd->updated;
+}
+
+// aggregated charts send the average of absolute values
+// and the last value of incremental ones, so that the remote netdata calculates the average rate
+static inline collected_number rrdpush_collected_value(RRDSET *st, RRDDIM *rd) {
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_AGGREGATE) && rd->rrdpush_aggregated_count
+                && (rd->algorithm == RRD_ALGORITHM_ABSOLUTE || rd->algorithm == RRD_ALGORITHM_PCENT_OVER_ROW_TOTAL)))
+        return rd->rrdpush_aggregated_value / (collected_number)rd->rrdpush_aggregated_count;
+
+    return rd->collected_value;
+}
+
+// adds the current collection to the aggregated update of the chart
+// returns 1 when the aggregated update is complete and has to be sent
+static inline int rrdpush_aggregate(RRDSET *st) {
+    RRDDIM *rd;
+
+    if(unlikely(!st->rrdpush_aggregated)) {
+        st->rrdpush_aggregated_usec = 0;
+        rrddim_foreach_read(rd, st) {
+            rd->rrdpush_aggregated_value = 0;
+            rd->rrdpush_aggregated_count = 0;
+        }
+    }
+
+    st->rrdpush_aggregated_usec += st->usec_since_last_update;
+    rrddim_foreach_read(rd, st) {
+        if(likely(rd->updated)) {
+            rd->rrdpush_aggregated_value += rd->collected_value;
+            rd->rrdpush_aggregated_count++;
+        }
+    }
+
+    if(++st->rrdpush_aggregated < (size_t)st->rrdhost->rrdpush_aggregate_iterations)
+        return 0;
+
+    st->rrdpush_aggregated = 0;
+    return 1;
+}
+
+// checks if the current chart definition has been sent on this connection
+static inline int need_to_send_chart_definition(RRDSET *st, uint32_t generation) {
+    if(unlikely(st->rrdpush_generation != generation))
+        return 1;
+
     RRDDIM *rd;
     rrddim_foreach_read(rd, st)
         if(!rd->exposed)
@@ -72,9 +185,8 @@ static inline int need_to_send_chart_definition(RRDSET *st) {
     return 0;
 }
 
-// sends the current chart definition
-static inline void send_chart_definition(RRDSET *st) {
-    buffer_sprintf(st->rrdhost->rrdpush_buffer, "CHART '%s' '%s' '%s' '%s' '%s' '%s' '%s' %ld %d\n"
+static inline void send_chart_line(RRDSET *st, BUFFER *wb) {
+    buffer_sprintf(wb, "CHART '%s' '%s' '%s' '%s' '%s' '%s' '%s' %ld %d"
                 , st->id
                 , st->name
                 , st->title
@@ -83,60 +195,168 @@ static inline void send_chart_definition(RRDSET *st) {
                 , st->context
                 , rrdset_type_name(st->chart_type)
                 , st->priority
-                , st->update_every
+                , rrdpush_update_every(st)
     );
+}
 
+static inline void send_dimension_line(RRDDIM *rd, BUFFER *wb) {
+    buffer_sprintf(wb, "DIMENSION '%s' '%s' '%s' " COLLECTED_NUMBER_FORMAT " " COLLECTED_NUMBER_FORMAT " '%s %s'"
+                   , rd->id
+                   , rd->name
+                   , rrd_algorithm_name(rd->algorithm)
+                   , rd->multiplier
+                   , rd->divisor
+                   , rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN)?"hidden":""
+                   , rrddim_flag_check(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS)?"noreset":""
+    );
+}
+
+// sends the current chart definition
+static inline void send_chart_definition(RRDSET *st, BUFFER *wb, uint32_t generation, int binary) {
+    RRDHOST *host = st->rrdhost;
+
+    // the ids of the binary protocol are given per connection
+    if(unlikely(st->rrdpush_generation != generation)) {
+        st->rrdpush_generation = generation;
+        st->rrdpush_slot = 0;
+    }
+
+    send_chart_line(st, wb);
+
+    if(binary) {
+        if(unlikely(!st->rrdpush_slot)) {
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+            st->rrdpush_slot = __atomic_add_fetch(&host->rrdpush_charts_slots, 1, __ATOMIC_SEQ_CST);
+#else
+            rrdpush_lock(host);
+            st->rrdpush_slot = ++host->rrdpush_charts_slots;
+            rrdpush_unlock(host);
+#endif
+        }
+
+        buffer_sprintf(wb, " %zu", st->rrdpush_slot);
+    }
+
+    buffer_strcat(wb, "\n");
+
+    size_t slot = 0;
     RRDDIM *rd;
     rrddim_foreach_read(rd, st) {
-        buffer_sprintf(st->rrdhost->rrdpush_buffer, "DIMENSION '%s' '%s' '%s' " COLLECTED_NUMBER_FORMAT " " COLLECTED_NUMBER_FORMAT " '%s %s'\n"
-                       , rd->id
-                       , rd->name
-                       , rrd_algorithm_name(rd->algorithm)
-                       , rd->multiplier
-                       , rd->divisor
-                       , rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN)?"hidden":""
-                       , rrddim_flag_check(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS)?"noreset":""
-        );
+        send_dimension_line(rd, wb);
+
+        if(binary) {
+            // the receiver resets the last value of the dimension too
+            rd->rrdpush_slot = ++slot;
+            rd->rrdpush_last_value = 0;
+            buffer_sprintf(wb, " %zu", rd->rrdpush_slot);
+        }
+
+        buffer_strcat(wb, "\n");
         rd->exposed = 1;
     }
 }
 
+// sends the chart definition already sent on this generation, to one more destination
+// the ids and the last values of the binary protocol are given as they are, without changing them
+static inline void send_chart_definition_again(RRDSET *st, BUFFER *wb, int binary) {
+    send_chart_line(st, wb);
+
+    if(binary)
+        buffer_sprintf(wb, " %zu", st->rrdpush_slot);
+
+    buffer_strcat(wb, "\n");
+
+    RRDDIM *rd;
+    rrddim_foreach_read(rd, st) {
+        // the dimensions not exposed yet will be defined with the next update of the chart
+        if(!rd->exposed || (binary && !rd->rrdpush_slot))
+            continue;
+
+        send_dimension_line(rd, wb);
+
+        if(binary)
+            buffer_sprintf(wb, " %zu " COLLECTED_NUMBER_FORMAT, rd->rrdpush_slot, rd->rrdpush_last_value);
+
+        buffer_strcat(wb, "\n");
+    }
+}
+
 // sends the current chart dimensions
-static inline void send_chart_metrics(RRDSET *st) {
-    buffer_sprintf(st->rrdhost->rrdpush_buffer, "BEGIN %s %llu\n", st->id, (st->counter_done > remote_clock_resync_iterations)?st->usec_since_last_update:0);
+static inline void send_chart_metrics(RRDSET *st, BUFFER *wb) {
+    buffer_sprintf(wb, "BEGIN %s %llu\n", st->id, (st->counter_done > remote_clock_resync_iterations)?rrdpush_usec_since_last_update(st):0);
 
     RRDDIM *rd;
     rrddim_foreach_read(rd, st) {
-        if(rd->updated && rd->exposed)
-            buffer_sprintf(st->rrdhost->rrdpush_buffer, "SET %s = " COLLECTED_NUMBER_FORMAT "\n"
+        if(rrdpush_dimension_updated(st, rd) && rd->exposed)
+            buffer_sprintf(wb, "SET %s = " COLLECTED_NUMBER_FORMAT "\n"
                        , rd->id
-                       , rd->collected_value
+                       , rrdpush_collected_value(st, rd)
         );
     }
 
-    buffer_strcat(st->rrdhost->rrdpush_buffer, "END\n");
+    buffer_strcat(wb, "END\n");
+}
+
+// sends the current chart dimensions, using the binary protocol
+static inline void send_chart_metrics_binary(RRDSET *st, BUFFER *wb) {
+
+    buffer_need_bytes(wb, 1 + STREAM_VARINT_MAX_BYTES * 3 + 1);
+    char *s = &wb->buffer[wb->len];
+
+    *s++ = STREAM_BINARY_DATA;
+    s = stream_varint_encode(s, st->rrdpush_slot);
+    s = stream_varint_encode(s, (st->counter_done > remote_clock_resync_iterations)?rrdpush_usec_since_last_update(st):0);
+
+    size_t last_slot = 0;
+    RRDDIM *rd;
+    rrddim_foreach_read(rd, st) {
+        if(unlikely(!rrdpush_dimension_updated(st, rd) || !rd->exposed || !rd->rrdpush_slot))
+            continue;
+
+        wb->len = s - wb->buffer;
+        buffer_need_bytes(wb, STREAM_VARINT_MAX_BYTES * 3 + 1);
+        s = &wb->buffer[wb->len];
+
+        collected_number value = rrdpush_collected_value(st, rd);
+        s = stream_varint_encode(s, rd->rrdpush_slot - last_slot);
+        s = stream_varint_encode(s, stream_zigzag_encode(value, rd->rrdpush_last_value));
+
+        last_slot = rd->rrdpush_slot;
+        rd->rrdpush_last_value = value;
+    }
+
+    s = stream_varint_encode(s, 0);
+
+    wb->len = s - wb->buffer;
+    wb->buffer[wb->len] = '\0';
 }
 
 void rrdpush_sender_thread_spawn(RRDHOST *host);
 
+static inline uint32_t rrdpush_generation(RRDHOST *host) {
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+    return __atomic_load_n(&host->rrdpush_generation, __ATOMIC_ACQUIRE);
+#else
+    return host->rrdpush_generation;
+#endif
+}
+
 void rrdset_done_push(RRDSET *st) {
     RRDHOST *host = st->rrdhost;
 
-    if(unlikely(!rrdset_flag_check(st, RRDSET_FLAG_ENABLED)))
+    if(unlikely(!rrdset_flag_check(st, RRDSET_FLAG_ENABLED) || !rrdpush_send_chart_matching(st)))
         return;
 
-    rrdpush_lock(host);
-
     if(unlikely(host->rrdpush_enabled && !host->rrdpush_spawn))
         rrdpush_sender_thread_spawn(host);
 
-    if(unlikely(!host->rrdpush_buffer || !host->rrdpush_connected)) {
+    struct rrdpush_ring *ring = host->rrdpush_ring;
+
+    if(unlikely(!ring || !host->rrdpush_connected)) {
         if(unlikely(!host->rrdpush_error_shown))
             error("STREAM %s [send]: not ready - discarding collected metrics.", host->hostname);
 
         host->rrdpush_error_shown = 1;
-
-        rrdpush_unlock(host);
         return;
     }
     else if(unlikely(host->rrdpush_error_shown)) {
@@ -144,21 +364,46 @@ void rrdset_done_push(RRDSET *st) {
         host->rrdpush_error_shown = 0;
     }
 
-    if(need_to_send_chart_definition(st))
-        send_chart_definition(st);
+    // the sender sets the protocol before it starts a new generation
+    uint32_t generation = rrdpush_generation(host);
+    if(unlikely(!generation)) return;
 
-    send_chart_metrics(st);
+    int binary = host->rrdpush_binary;
 
-    // signal the sender there are more data
-    if(write(host->rrdpush_pipe[PIPE_WRITE], " ", 1) == -1)
-        error("STREAM %s [send]: cannot write to internal pipe", host->hostname);
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_AGGREGATE) && !rrdpush_aggregate(st)))
+        return;
 
-    rrdpush_unlock(host);
+    if(unlikely(!st->rrdpush_wb))
+        st->rrdpush_wb = buffer_create(1024);
+
+    BUFFER *wb = st->rrdpush_wb;
+    buffer_flush(wb);
+
+    if(need_to_send_chart_definition(st, generation))
+        send_chart_definition(st, wb, generation, binary);
+
+    if(binary)
+        send_chart_metrics_binary(st, wb);
+    else
+        send_chart_metrics(st, wb);
+
+    if(unlikely(rrdpush_ring_push(ring, wb->buffer, wb->len, generation))) {
+        // the buffer is full and the update has been dropped
+        // define the chart again with its next update, so that the remote
+        // netdata will have it, with the values the binary protocol is based on
+        RRDDIM *rd;
+        rrddim_foreach_read(rd, st)
+            rd->exposed = 0;
+    }
 }
 
 // ----------------------------------------------------------------------------
 // rrdpush sender thread
 
+static int rrdpush_timeout = 60;
+static int rrdpush_default_port = 19999;
+static unsigned int rrdpush_reconnect_delay = 5;
+
 // resets all the chart, so that their definitions
 // will be resent to the central netdata
 static void rrdpush_sender_thread_reset_all_charts(RRDHOST *host) {
@@ -170,51 +415,408 @@ static void rrdpush_sender_thread_reset_all_charts(RRDHOST *host) {
         // make it re-align the current time
         // on the remote host
         st->counter_done = 0;
+    }
 
-        rrdset_rdlock(st);
+    rrdhost_unlock(host);
+}
 
-        RRDDIM *rd;
-        rrddim_foreach_read(rd, st)
-            rd->exposed = 0;
+// start a new generation: the records queued for the previous one
+// are dropped and all charts are defined again, with new binary ids
+static inline void rrdpush_sender_thread_new_generation(RRDHOST *host, int binary) {
+    // keep what has been queued so far, for the destinations already connected
+    rrdpush_ring_wakeup_clear(host->rrdpush_ring);
+    rrdpush_ring_pop(host->rrdpush_ring, host->rrdpush_buffer, host->rrdpush_generation);
+
+    // collectors read the generation before the protocol, so it is safe to switch it here
+    host->rrdpush_binary = binary;
+
+    rrdpush_sender_thread_reset_all_charts(host);
+    host->rrdpush_charts_slots = 0;
+
+    uint32_t generation = host->rrdpush_generation + 1;
+    if(unlikely(!generation)) generation = 1;
+
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+    __atomic_store_n(&host->rrdpush_generation, generation, __ATOMIC_RELEASE);
+#else
+    host->rrdpush_generation = generation;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// the destinations of the sender thread
+
+static void rrdpush_destinations_create(RRDHOST *host) {
+    struct rrdpush_destination *last = NULL;
+    const char *s = host->rrdpush_destination;
+
+    while(*s) {
+        // each group, up to the next |
+        const char *e = s;
+        while(*e && *e != '|') e++;
+
+        char group[e - s + 1];
+        strncpyz(group, s, e - s);
+        s = (*e)?e + 1:e;
+
+        char *g = trim(group);
+        if(!g || !*g) continue;
+
+        struct rrdpush_destination *d = callocz(1, sizeof(struct rrdpush_destination));
+        d->host = host;
+        d->destination = strdupz(g);
+        d->socket = -1;
+        d->wb = buffer_create(1);
+        d->state = RRDPUSH_DESTINATION_DISCONNECTED;
+
+        if(last) last->next = d;
+        else host->rrdpush_destinations = d;
+        last = d;
+    }
+}
+
+static void rrdpush_destination_disconnect(struct rrdpush_destination *d) {
+    if(d->socket != -1) {
+        close(d->socket);
+        d->socket = -1;
+    }
+
+#ifdef ENABLE_STREAM_COMPRESSION
+    rrdpush_compressor_free(d->compressor);
+    d->compressor = NULL;
+#endif
+
+    buffer_free(d->replay_list);
+    d->replay_list = NULL;
+    rrdpush_replay_free(d);
+
+    buffer_flush(d->wb);
+    d->begin = 0;
+
+    d->state = RRDPUSH_DESTINATION_DISCONNECTED;
+    d->reconnect_after = now_monotonic_sec() + rrdpush_reconnect_delay;
+}
+
+static void rrdpush_destinations_free(RRDHOST *host) {
+    struct rrdpush_destination *d = host->rrdpush_destinations;
+
+    while(d) {
+        struct rrdpush_destination *next = d->next;
+
+        if(d->state == RRDPUSH_DESTINATION_CONNECTING)
+            pthread_cancel(d->thread);
+
+        if(d->state == RRDPUSH_DESTINATION_CONNECTING || d->state == RRDPUSH_DESTINATION_CONNECTED || d->state == RRDPUSH_DESTINATION_FAILED)
+            pthread_join(d->thread, NULL);
+
+        rrdpush_destination_disconnect(d);
+        buffer_free(d->wb);
+        freez(d->destination);
+        freez(d);
+
+        d = next;
+    }
+
+    host->rrdpush_destinations = NULL;
+}
+
+// connects to one of the remote netdata of a destination and completes the handshake
+// it runs in its own thread, so that the other destinations are not blocked
+static void *rrdpush_destination_connector_thread(void *ptr) {
+    struct rrdpush_destination *d = (struct rrdpush_destination *)ptr;
+    RRDHOST *host = d->host;
+
+    struct timeval tv = {
+            .tv_sec = rrdpush_timeout,
+            .tv_usec = 0
+    };
+
+    info("STREAM %s [send to %s]: connecting...", host->hostname, d->destination);
+    d->socket = connect_to_one_of(d->destination, rrdpush_default_port, &tv, &d->reconnects_counter, d->connected_to, CONNECTED_TO_SIZE);
+
+    if(unlikely(d->socket == -1)) {
+        error("STREAM %s [send to %s]: failed to connect", host->hostname, d->destination);
+        goto failed;
+    }
+
+    info("STREAM %s [send to %s]: initializing communication...", host->hostname, d->connected_to);
+
+    char http[1000 + 1];
+    snprintfz(http, 1000,
+            "STREAM key=%s&hostname=%s&machine_guid=%s&os=%s&update_every=%d&ver=%d%s%s HTTP/1.1\r\n"
+            "User-Agent: netdata-push-service/%s\r\n"
+            "Accept: */*\r\n\r\n"
+              , host->rrdpush_api_key
+              , host->hostname
+              , host->machine_guid
+              , host->os
+              , default_rrd_update_every
+              , (default_rrdpush_binary)?STREAMING_PROTOCOL_VERSION_BINARY:STREAMING_PROTOCOL_VERSION_TEXT
+              , (default_rrdpush_compression)?"&compression=" STREAM_COMPRESSION_NAME:""
+              , (default_rrdpush_replay)?"&" STREAM_REPLAY_ACCEPTED:""
+              , program_version
+    );
+
+    if(send_timeout(d->socket, http, strlen(http), 0, rrdpush_timeout) == -1) {
+        error("STREAM %s [send to %s]: failed to send http header to netdata", host->hostname, d->connected_to);
+        goto failed;
+    }
+
+    info("STREAM %s [send to %s]: waiting response from remote netdata...", host->hostname, d->connected_to);
+
+    ssize_t received = recv_timeout(d->socket, http, 1000, 0, rrdpush_timeout);
+    if(received == -1) {
+        error("STREAM %s [send to %s]: failed to initialize communication", host->hostname, d->connected_to);
+        goto failed;
+    }
+
+    http[received] = '\0';
+
+    d->binary = 0;
+    if(default_rrdpush_binary && !strncmp(http, START_STREAMING_PROMPT_BINARY, strlen(START_STREAMING_PROMPT_BINARY)))
+        d->binary = 1;
+
+    else if(strncmp(http, START_STREAMING_PROMPT, strlen(START_STREAMING_PROMPT))) {
+        error("STREAM %s [send to %s]: server is not replying properly.", host->hostname, d->connected_to);
+        goto failed;
+    }
+
+    d->compression = (default_rrdpush_compression && strstr(http, STREAM_COMPRESSION_ACCEPTED))?1:0;
+
+    // the charts to replay follow the acceptance of replay
+    char *replay = (default_rrdpush_replay)?strstr(http, "\n" STREAM_REPLAY_ACCEPTED):NULL;
+    if(replay) {
+        d->replay_list = rrdpush_replay_sender_receive_charts(d->socket, replay + strlen("\n" STREAM_REPLAY_ACCEPTED), rrdpush_timeout);
+        if(!d->replay_list) {
+            error("STREAM %s [send to %s]: failed to receive the charts to replay.", host->hostname, d->connected_to);
+            goto failed;
+        }
+    }
+
+    d->state = RRDPUSH_DESTINATION_CONNECTED;
+    return NULL;
+
+failed:
+    if(d->socket != -1) {
+        close(d->socket);
+        d->socket = -1;
+    }
+
+    d->state = RRDPUSH_DESTINATION_FAILED;
+    return NULL;
+}
+
+// the data to be sent before the buffer of the host
+static inline BUFFER *rrdpush_destination_buffer(struct rrdpush_destination *d) {
+#ifdef ENABLE_STREAM_COMPRESSION
+    if(d->compressor)
+        return d->compressor->wb;
+#endif
+
+    return d->wb;
+}
+
+static inline int rrdpush_destination_sending(RRDHOST *host, struct rrdpush_destination *d) {
+    if(d->begin < buffer_strlen(rrdpush_destination_buffer(d)))
+        return 1;
+
+    // compressed destinations send only from their compressor
+    return (!d->compressor && d->offset < buffer_strlen(host->rrdpush_buffer));
+}
+
+// joins a destination to the ones already streaming the current generation
+// the definitions sent so far are given to it alone, so that the other destinations are not affected
+// returns 0 on success, -1 when the destination has to be disconnected
+static int rrdpush_destination_send_definitions(RRDHOST *host, struct rrdpush_destination *d) {
+    uint32_t generation = host->rrdpush_generation;
+    int binary = host->rrdpush_binary;
+
+    rrdhost_rdlock(host);
+
+    // collectors queue their updates while holding the lock of their chart,
+    // so nothing is queued while the definitions are taken
+    RRDSET *st;
+    rrdset_foreach_read(st, host)
+        rrdset_wrlock(st);
+
+    // what has been queued so far is based on the definitions taken here
+    rrdpush_ring_wakeup_clear(host->rrdpush_ring);
+    rrdpush_ring_pop(host->rrdpush_ring, host->rrdpush_buffer, generation);
+    d->offset = buffer_strlen(host->rrdpush_buffer);
+
+    buffer_flush(d->wb);
+    rrdset_foreach_read(st, host) {
+        if(st->rrdpush_generation == generation)
+            send_chart_definition_again(st, d->wb, binary);
 
         rrdset_unlock(st);
     }
 
     rrdhost_unlock(host);
+
+    int ret = 0;
+
+#ifdef ENABLE_STREAM_COMPRESSION
+    if(d->compressor) {
+        if(buffer_strlen(d->wb) && unlikely(rrdpush_compress(d->compressor, d->wb->buffer, d->wb->len, &host->rrdpush_sent_compression))) {
+            error("STREAM %s [send to %s]: failed to compress the chart definitions - closing connection.", host->hostname, d->connected_to);
+            ret = -1;
+        }
+
+        buffer_flush(d->wb);
+    }
+#endif
+
+    return ret;
 }
 
-static inline void rrdpush_sender_thread_data_flush(RRDHOST *host) {
-    rrdpush_lock(host);
+// the connector thread has completed the handshake - start streaming to the destination
+static void rrdpush_destination_start(RRDHOST *host, struct rrdpush_destination *d) {
+    if(fcntl(d->socket, F_SETFL, O_NONBLOCK) < 0)
+        error("STREAM %s [send to %s]: cannot set non-blocking mode for socket.", host->hostname, d->connected_to);
+
+#ifdef ENABLE_STREAM_COMPRESSION
+    // every connection needs a new compression stream
+    if(d->compression) {
+        d->compressor = rrdpush_compressor_create(default_rrdpush_compression_level);
+        if(!d->compressor) {
+            rrdpush_destination_disconnect(d);
+            return;
+        }
+    }
+#endif
 
-    if(buffer_strlen(host->rrdpush_buffer))
-        error("STREAM %s [send]: discarding %zu bytes of metrics already in the buffer.", host->hostname, buffer_strlen(host->rrdpush_buffer));
+    if(d->replay_list) {
+        rrdpush_replay_sender_add_charts(host, d, d->replay_list);
+        buffer_free(d->replay_list);
+        d->replay_list = NULL;
+    }
 
-    buffer_flush(host->rrdpush_buffer);
+    // the buffer of the host is shared, so it is binary only if all destinations accepted it
+    int binary = d->binary, streaming = 0;
+    struct rrdpush_destination *t;
+    for(t = host->rrdpush_destinations; t ; t = t->next) {
+        if(t->state != RRDPUSH_DESTINATION_STREAMING) continue;
 
-    rrdpush_sender_thread_reset_all_charts(host);
+        streaming++;
+        if(!t->binary) binary = 0;
+    }
 
-    rrdpush_unlock(host);
+    d->begin = 0;
+
+    if(!streaming || binary != host->rrdpush_binary || !host->rrdpush_generation) {
+        // the new destination starts with the definitions of the new generation
+        rrdpush_sender_thread_new_generation(host, binary);
+        d->offset = buffer_strlen(host->rrdpush_buffer);
+    }
+    else if(rrdpush_destination_send_definitions(host, d)) {
+        rrdpush_destination_disconnect(d);
+        return;
+    }
+
+    d->sent_connection = 0;
+    d->last_sent = now_monotonic_sec();
+    d->state = RRDPUSH_DESTINATION_STREAMING;
+
+    info("STREAM %s [send to %s]: established communication - sending metrics using the %s protocol%s, replaying %zu charts...", host->hostname, d->connected_to, (binary)?"binary":"text", (d->compressor)?", compressed":"", d->replay_pending);
 }
 
-static void rrdpush_sender_thread_cleanup_locked_all(RRDHOST *host) {
-    host->rrdpush_connected = 0;
+// takes the next data to be sent to a destination, when everything taken before has been sent
+// returns 0 on success, -1 when the destination has to be disconnected
+static int rrdpush_destination_prepare(RRDHOST *host, struct rrdpush_destination *d) {
+    BUFFER *wb = rrdpush_destination_buffer(d);
+    if(d->begin < buffer_strlen(wb))
+        return 0;
+
+    buffer_flush(wb);
+    d->begin = 0;
+
+    size_t len = buffer_strlen(host->rrdpush_buffer);
+
+#ifdef ENABLE_STREAM_COMPRESSION
+    if(d->compressor && d->offset < len) {
+        if(unlikely(rrdpush_compress(d->compressor, &host->rrdpush_buffer->buffer[d->offset], len - d->offset, &host->rrdpush_sent_compression))) {
+            error("STREAM %s [send to %s]: failed to compress metrics - closing connection.", host->hostname, d->connected_to);
+            return -1;
+        }
+
+        d->offset = len;
+        return 0;
+    }
+#endif
+
+    // replay the data missed by the remote netdata, when all live data have been sent
+    if(unlikely(d->replay_pending && d->offset == len)) {
+        time_t now = now_monotonic_sec();
+        if(now != d->replay_second) {
+            d->replay_second = now;
+            d->replay_bytes = 0;
+        }
+
+        if(d->replay_bytes >= default_rrdpush_replay_bytes_per_second)
+            return 0;
+
+#ifdef ENABLE_STREAM_COMPRESSION
+        if(d->compressor) {
+            // the buffer of compressed destinations is free to format the replayed data
+            buffer_flush(d->wb);
+            rrdpush_replay_sender_chunk(host, d, d->wb, default_rrdpush_replay_bytes_per_second - d->replay_bytes);
+            d->replay_bytes += buffer_strlen(d->wb);
+
+            if(buffer_strlen(d->wb) && unlikely(rrdpush_compress(d->compressor, d->wb->buffer, d->wb->len, &host->rrdpush_sent_compression))) {
+                error("STREAM %s [send to %s]: failed to compress metrics - closing connection.", host->hostname, d->connected_to);
+                return -1;
+            }
 
-    if(host->rrdpush_socket != -1) {
-        close(host->rrdpush_socket);
-        host->rrdpush_socket = -1;
+            buffer_flush(d->wb);
+            return 0;
+        }
+#endif
+
+        rrdpush_replay_sender_chunk(host, d, wb, default_rrdpush_replay_bytes_per_second - d->replay_bytes);
+        d->replay_bytes += buffer_strlen(wb);
     }
 
-    // close the pipe
-    if(host->rrdpush_pipe[PIPE_READ] != -1) {
-        close(host->rrdpush_pipe[PIPE_READ]);
-        host->rrdpush_pipe[PIPE_READ] = -1;
+    return 0;
+}
+
+// returns the bytes sent
+static size_t rrdpush_destination_send(RRDHOST *host, struct rrdpush_destination *d) {
+    BUFFER *wb = rrdpush_destination_buffer(d);
+    const char *data;
+    size_t len, *sent;
+
+    if(d->begin < buffer_strlen(wb)) {
+        data = &wb->buffer[d->begin];
+        len = buffer_strlen(wb) - d->begin;
+        sent = &d->begin;
+    }
+    else {
+        data = &host->rrdpush_buffer->buffer[d->offset];
+        len = buffer_strlen(host->rrdpush_buffer) - d->offset;
+        sent = &d->offset;
     }
 
-    if(host->rrdpush_pipe[PIPE_WRITE] != -1) {
-        close(host->rrdpush_pipe[PIPE_WRITE]);
-        host->rrdpush_pipe[PIPE_WRITE] = -1;
+    ssize_t ret = send(d->socket, data, len, MSG_DONTWAIT);
+    if(ret == -1) {
+        if(errno != EAGAIN && errno != EINTR) {
+            error("STREAM %s [send to %s]: failed to send metrics - closing connection - we have sent %zu bytes on this connection.", host->hostname, d->connected_to, d->sent_connection);
+            rrdpush_destination_disconnect(d);
+        }
+        return 0;
     }
 
+    *sent += ret;
+    d->sent_connection += ret;
+    d->last_sent = now_monotonic_sec();
+    return (size_t)ret;
+}
+
+static void rrdpush_sender_thread_cleanup_locked_all(RRDHOST *host) {
+    host->rrdpush_connected = 0;
+
+    rrdpush_destinations_free(host);
+
     buffer_free(host->rrdpush_buffer);
     host->rrdpush_buffer = NULL;
 
@@ -225,14 +827,27 @@ static void rrdpush_sender_thread_cleanup_locked_all(RRDHOST *host) {
 
 void rrdpush_sender_thread_stop(RRDHOST *host) {
     rrdpush_lock(host);
-    rrdhost_wrlock(host);
 
-    if(host->rrdpush_spawn) {
-        info("STREAM %s [send]: stopping sending thread...", host->hostname);
-        pthread_cancel(host->rrdpush_thread);
-        rrdpush_sender_thread_cleanup_locked_all(host);
+    if(!host->rrdpush_spawn || host->rrdpush_stopping) {
+        rrdpush_unlock(host);
+        return;
     }
 
+    // the sender takes the locks of the host while it runs and when it exits,
+    // so it is joined without holding them
+    host->rrdpush_stopping = 1;
+    pthread_t thread = host->rrdpush_thread;
+    rrdpush_unlock(host);
+
+    info("STREAM %s [send]: stopping sending thread...", host->hostname);
+    pthread_cancel(thread);
+    pthread_join(thread, NULL);
+
+    // the destinations and the buffer are freed after the sender has exited
+    rrdpush_lock(host);
+    rrdhost_wrlock(host);
+    rrdpush_sender_thread_cleanup_locked_all(host);
+    host->rrdpush_stopping = 0;
     rrdhost_unlock(host);
     rrdpush_unlock(host);
 }
@@ -245,15 +860,14 @@ void *rrdpush_sender_thread(void *ptr) {
     if(pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL) != 0)
         error("STREAM %s [send]: cannot set pthread cancel type to DEFERRED.", host->hostname);
 
-    if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
-        error("STREAM %s [send]: cannot set pthread cancel state to ENABLE.", host->hostname);
+    // it is cancelled only while it waits in poll(), never while it holds the locks of the host or its charts
+    if(pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL) != 0)
+        error("STREAM %s [send]: cannot set pthread cancel state to DISABLE.", host->hostname);
 
-    int timeout = (int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "timeout seconds", 60);
-    int default_port = (int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "default port", 19999);
-    size_t max_size = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "buffer size bytes", 1024 * 1024);
-    unsigned int reconnect_delay = (unsigned int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "reconnect delay seconds", 5);
+    rrdpush_timeout = (int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "timeout seconds", rrdpush_timeout);
+    rrdpush_default_port = (int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "default port", rrdpush_default_port);
+    rrdpush_reconnect_delay = (unsigned int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "reconnect delay seconds", rrdpush_reconnect_delay);
     remote_clock_resync_iterations = (unsigned int)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "initial clock resync iterations", remote_clock_resync_iterations);
-    char connected_to[CONNECTED_TO_SIZE + 1] = "";
 
     if(!host->rrdpush_enabled || !host->rrdpush_destination || !*host->rrdpush_destination || !host->rrdpush_api_key || !*host->rrdpush_api_key)
         goto cleanup;
@@ -261,182 +875,168 @@ void *rrdpush_sender_thread(void *ptr) {
     // initialize rrdpush globals
     host->rrdpush_buffer = buffer_create(1);
     host->rrdpush_connected = 0;
-    if(pipe(host->rrdpush_pipe) == -1) fatal("STREAM %s [send]: cannot create required pipe.", host->hostname);
-
-    // initialize local variables
-    size_t begin = 0;
-    size_t reconnects_counter = 0;
-    size_t sent_bytes = 0;
-    size_t sent_connection = 0;
-
-    struct timeval tv = {
-            .tv_sec = timeout,
-            .tv_usec = 0
-    };
-
-    struct pollfd fds[2], *ifd, *ofd;
-    nfds_t fdmax;
+    rrdpush_destinations_create(host);
 
-    ifd = &fds[0];
-    ofd = &fds[1];
+    size_t destinations = 0;
+    struct rrdpush_destination *d;
+    for(d = host->rrdpush_destinations; d ; d = d->next)
+        destinations++;
 
-    for(; host->rrdpush_enabled && !netdata_exit ;) {
-
-        if(unlikely(host->rrdpush_socket == -1)) {
-            // stop appending data into rrdpush_buffer
-            // they will be lost, so there is no point to do it
-            host->rrdpush_connected = 0;
-
-            info("STREAM %s [send to %s]: connecting...", host->hostname, host->rrdpush_destination);
-            host->rrdpush_socket = connect_to_one_of(host->rrdpush_destination, default_port, &tv, &reconnects_counter, connected_to, CONNECTED_TO_SIZE);
-
-            if(unlikely(host->rrdpush_socket == -1)) {
-                error("STREAM %s [send to %s]: failed to connect", host->hostname, host->rrdpush_destination);
-                sleep(reconnect_delay);
-                continue;
-            }
-
-            info("STREAM %s [send to %s]: initializing communication...", host->hostname, connected_to);
-
-            char http[1000 + 1];
-            snprintfz(http, 1000,
-                    "STREAM key=%s&hostname=%s&machine_guid=%s&os=%s&update_every=%d HTTP/1.1\r\n"
-                    "User-Agent: netdata-push-service/%s\r\n"
-                    "Accept: */*\r\n\r\n"
-                      , host->rrdpush_api_key
-                      , host->hostname
-                      , host->machine_guid
-                      , host->os
-                      , default_rrd_update_every
-                      , program_version
-            );
-
-            if(send_timeout(host->rrdpush_socket, http, strlen(http), 0, timeout) == -1) {
-                close(host->rrdpush_socket);
-                host->rrdpush_socket = -1;
-                error("STREAM %s [send to %s]: failed to send http header to netdata", host->hostname, connected_to);
-                sleep(reconnect_delay);
-                continue;
-            }
-
-            info("STREAM %s [send to %s]: waiting response from remote netdata...", host->hostname, connected_to);
+    if(!destinations)
+        goto cleanup;
 
-            if(recv_timeout(host->rrdpush_socket, http, 1000, 0, timeout) == -1) {
-                close(host->rrdpush_socket);
-                host->rrdpush_socket = -1;
-                error("STREAM %s [send to %s]: failed to initialize communication", host->hostname, connected_to);
-                sleep(reconnect_delay);
-                continue;
+    {
+        // initialize local variables
+        size_t sent_bytes = 0;
+        size_t dropped_records = host->rrdpush_ring->dropped_records;
+        time_t dropped_logged = 0;
+
+        // the ring buffer, followed by the sockets of the destinations
+        struct pollfd fds[destinations + 1];
+        struct rrdpush_destination *fds_destination[destinations + 1];
+
+        for(; host->rrdpush_enabled && !netdata_exit ;) {
+            time_t now = now_monotonic_sec();
+            int waiting = 0, replaying = 0, streaming = 0;
+
+            for(d = host->rrdpush_destinations; d ; d = d->next) {
+                switch(d->state) {
+                    case RRDPUSH_DESTINATION_DISCONNECTED:
+                        waiting = 1;
+                        if(now < d->reconnect_after) break;
+
+                        d->state = RRDPUSH_DESTINATION_CONNECTING;
+                        if(pthread_create(&d->thread, NULL, rrdpush_destination_connector_thread, (void *)d)) {
+                            error("STREAM %s [send to %s]: failed to create new thread to connect.", host->hostname, d->destination);
+                            rrdpush_destination_disconnect(d);
+                        }
+                        break;
+
+                    case RRDPUSH_DESTINATION_CONNECTING:
+                        waiting = 1;
+                        break;
+
+                    case RRDPUSH_DESTINATION_FAILED:
+                        pthread_join(d->thread, NULL);
+                        rrdpush_destination_disconnect(d);
+                        waiting = 1;
+                        break;
+
+                    case RRDPUSH_DESTINATION_CONNECTED:
+                        pthread_join(d->thread, NULL);
+                        rrdpush_destination_start(host, d);
+                        break;
+
+                    case RRDPUSH_DESTINATION_STREAMING:
+                        break;
+                }
             }
 
-            if(strncmp(http, START_STREAMING_PROMPT, strlen(START_STREAMING_PROMPT))) {
-                close(host->rrdpush_socket);
-                host->rrdpush_socket = -1;
-                error("STREAM %s [send to %s]: server is not replying properly.", host->hostname, connected_to);
-                sleep(reconnect_delay);
-                continue;
-            }
+            // take the data queued by the collectors, once for all destinations
+            rrdpush_ring_wakeup_clear(host->rrdpush_ring);
+            rrdpush_ring_pop(host->rrdpush_ring, host->rrdpush_buffer, host->rrdpush_generation);
 
-            info("STREAM %s [send to %s]: established communication - sending metrics...", host->hostname, connected_to);
+            size_t len = buffer_strlen(host->rrdpush_buffer), keep = len;
 
-            if(fcntl(host->rrdpush_socket, F_SETFL, O_NONBLOCK) < 0)
-                error("STREAM %s [send to %s]: cannot set non-blocking mode for socket.", host->hostname, connected_to);
+            for(d = host->rrdpush_destinations; d ; d = d->next) {
+                if(d->state != RRDPUSH_DESTINATION_STREAMING) continue;
 
-            rrdpush_sender_thread_data_flush(host);
-            sent_connection = 0;
+                if(unlikely(len - d->offset > default_rrdpush_buffer_size)) {
+                    error("STREAM %s [send to %s]: cannot keep up, %zu bytes behind - closing connection - we have sent %zu bytes on this connection.", host->hostname, d->connected_to, len - d->offset, d->sent_connection);
+                    rrdpush_destination_disconnect(d);
+                    continue;
+                }
 
-            // allow appending data into rrdpush_buffer
-            host->rrdpush_connected = 1;
-        }
+                if(!rrdpush_destination_sending(host, d))
+                    d->last_sent = now;
 
-        ifd->fd = host->rrdpush_pipe[PIPE_READ];
-        ifd->events = POLLIN;
-        ifd->revents = 0;
+                else if(unlikely(now - d->last_sent > rrdpush_timeout)) {
+                    error("STREAM %s [send to %s]: cannot send metrics for %d seconds - closing connection - we have sent %zu bytes on this connection.", host->hostname, d->connected_to, rrdpush_timeout, d->sent_connection);
+                    rrdpush_destination_disconnect(d);
+                    continue;
+                }
 
-        ofd->fd = host->rrdpush_socket;
-        ofd->revents = 0;
-        if(begin < buffer_strlen(host->rrdpush_buffer)) {
-            ofd->events = POLLOUT;
-            fdmax = 2;
-        }
-        else {
-            ofd->events = 0;
-            fdmax = 1;
-        }
+                if(unlikely(rrdpush_destination_prepare(host, d))) {
+                    rrdpush_destination_disconnect(d);
+                    continue;
+                }
 
-        if(netdata_exit) break;
-        int retval = poll(fds, fdmax, timeout * 1000);
-        if(netdata_exit) break;
+                if(d->offset < keep) keep = d->offset;
+                if(d->replay_pending) replaying = 1;
+                streaming++;
+            }
 
-        if(unlikely(retval == -1)) {
-            if(errno == EAGAIN || errno == EINTR)
-                continue;
+            // drop what all destinations have taken, without moving data around on every iteration
+            if(keep && (keep == len || keep > len / 2)) {
+                BUFFER *wb = host->rrdpush_buffer;
+                memmove(wb->buffer, &wb->buffer[keep], len - keep);
+                wb->len = len - keep;
+                wb->buffer[wb->len] = '\0';
 
-            error("STREAM %s [send to %s]: failed to poll().", host->hostname, connected_to);
-            close(host->rrdpush_socket);
-            host->rrdpush_socket = -1;
-            break;
-        }
-        else if(unlikely(!retval)) {
-            // timeout
-            continue;
-        }
+                for(d = host->rrdpush_destinations; d ; d = d->next)
+                    if(d->state == RRDPUSH_DESTINATION_STREAMING)
+                        d->offset -= keep;
+            }
 
-        if(ifd->revents & POLLIN) {
-            char buffer[1000 + 1];
-            if(read(host->rrdpush_pipe[PIPE_READ], buffer, 1000) == -1)
-                error("STREAM %s [send to %s]: cannot read from internal pipe.", host->hostname, connected_to);
-        }
+            // allow (or stop) appending data into the ring buffer
+            host->rrdpush_connected = (streaming)?1:0;
 
-        if(ofd->revents & POLLOUT && begin < buffer_strlen(host->rrdpush_buffer)) {
+            if(unlikely(host->rrdpush_ring->dropped_records != dropped_records)) {
+                if(now - dropped_logged >= 10) {
+                    errno = 0;
+                    error("STREAM %s [send]: the buffer is full - %zu chart updates have been dropped - we have sent %zu bytes in total.", host->hostname, host->rrdpush_ring->dropped_records - dropped_records, sent_bytes);
+                    dropped_records = host->rrdpush_ring->dropped_records;
+                    dropped_logged = now;
+                }
+            }
 
-            // BEGIN RRDPUSH LOCKED SESSION
+            nfds_t fdmax = 1;
+            fds[0].fd = host->rrdpush_ring->fd[0];
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            fds_destination[0] = NULL;
+
+            for(d = host->rrdpush_destinations; d ; d = d->next) {
+                if(d->state != RRDPUSH_DESTINATION_STREAMING) continue;
+
+                // idle sockets are polled too, to detect disconnections
+                fds[fdmax].fd = d->socket;
+                fds[fdmax].events = (rrdpush_destination_sending(host, d))?POLLOUT:0;
+                fds[fdmax].revents = 0;
+                fds_destination[fdmax] = d;
+                fdmax++;
+            }
 
-            // during this session, data collectors
-            // will not be able to append data to our buffer
-            // but the socket is in non-blocking mode
-            // so, we will not block at send()
+            int timeout = rrdpush_timeout * 1000;
+            if(replaying) timeout = 100;
+            else if(waiting) timeout = 1000;
 
-            if(pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL) != 0)
-                error("STREAM %s [send]: cannot set pthread cancel state to DISABLE.", host->hostname);
+            if(netdata_exit) break;
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            int retval = poll(fds, fdmax, timeout);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+            if(netdata_exit) break;
 
-            rrdpush_lock(host);
+            if(unlikely(retval == -1)) {
+                if(errno == EAGAIN || errno == EINTR)
+                    continue;
 
-            ssize_t ret = send(host->rrdpush_socket, &host->rrdpush_buffer->buffer[begin], buffer_strlen(host->rrdpush_buffer) - begin, MSG_DONTWAIT);
-            if(ret == -1) {
-                if(errno != EAGAIN && errno != EINTR) {
-                    error("STREAM %s [send to %s]: failed to send metrics - closing connection - we have sent %zu bytes on this connection.", host->hostname, connected_to, sent_connection);
-                    close(host->rrdpush_socket);
-                    host->rrdpush_socket = -1;
-                }
+                error("STREAM %s [send]: failed to poll().", host->hostname);
+                break;
             }
-            else {
-                sent_connection += ret;
-                sent_bytes += ret;
-                begin += ret;
-                if(begin == buffer_strlen(host->rrdpush_buffer)) {
-                    // we send it all
-
-                    buffer_flush(host->rrdpush_buffer);
-                    begin = 0;
-                }
-            }
-
-            rrdpush_unlock(host);
 
-            if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
-                error("STREAM %s [send]: cannot set pthread cancel state to ENABLE.", host->hostname);
+            nfds_t i;
+            for(i = 1; retval > 0 && i < fdmax ; i++) {
+                d = fds_destination[i];
 
-            // END RRDPUSH LOCKED SESSION
-        }
+                if(fds[i].revents & POLLOUT)
+                    sent_bytes += rrdpush_destination_send(host, d);
 
-        // protection from overflow
-        if(host->rrdpush_buffer->len > max_size) {
-            errno = 0;
-            error("STREAM %s [send to %s]: too many data pending - buffer is %zu bytes long, %zu unsent - we have sent %zu bytes in total, %zu on this connection. Closing connection to flush the data.", host->hostname, connected_to, host->rrdpush_buffer->len, host->rrdpush_buffer->len - begin, sent_bytes, sent_connection);
-            if(host->rrdpush_socket != -1) {
-                close(host->rrdpush_socket);
-                host->rrdpush_socket = -1;
+                else if(fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    errno = 0;
+                    error("STREAM %s [send to %s]: connection closed - we have sent %zu bytes on this connection.", host->hostname, d->connected_to, d->sent_connection);
+                    rrdpush_destination_disconnect(d);
+                }
             }
         }
     }
@@ -448,9 +1048,17 @@ cleanup:
         error("STREAM %s [send]: cannot set pthread cancel state to DISABLE.", host->hostname);
 
     rrdpush_lock(host);
-    rrdhost_wrlock(host);
-    rrdpush_sender_thread_cleanup_locked_all(host);
-    rrdhost_unlock(host);
+
+    // when it is being stopped, the thread is joined and cleaned up by rrdpush_sender_thread_stop()
+    if(!host->rrdpush_stopping) {
+        rrdhost_wrlock(host);
+        rrdpush_sender_thread_cleanup_locked_all(host);
+        rrdhost_unlock(host);
+
+        if(pthread_detach(pthread_self()))
+            error("STREAM %s [send]: cannot request detach of the exiting thread.", host->hostname);
+    }
+
     rrdpush_unlock(host);
 
     if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
@@ -460,11 +1068,10 @@ cleanup:
     return NULL;
 }
 
-
 // ----------------------------------------------------------------------------
 // rrdpush receiver thread
 
-int rrdpush_receive(int fd, const char *key, const char *hostname, const char *machine_guid, const char *os, int update_every, char *client_ip, char *client_port) {
+int rrdpush_receive(int fd, const char *key, const char *hostname, const char *machine_guid, const char *os, int update_every, int version, int compression, int replay, char *client_ip, char *client_port) {
     RRDHOST *host;
     int history = default_rrd_history_entries;
     RRD_MEMORY_MODE mode = default_rrd_memory_mode;
@@ -472,7 +1079,13 @@ int rrdpush_receive(int fd, const char *key, const char *hostname, const char *m
     int rrdpush_enabled = default_rrdpush_enabled;
     char *rrdpush_destination = default_rrdpush_destination;
     char *rrdpush_api_key = default_rrdpush_api_key;
+    char *rrdpush_send_charts_matching = default_rrdpush_send_charts_matching;
+    char *rrdpush_aggregate_charts_matching = default_rrdpush_aggregate_charts_matching;
+    int rrdpush_aggregate_iterations = default_rrdpush_aggregate_iterations;
     time_t alarms_delay = 60;
+    long long max_lines_per_second = 0;
+    long long max_new_charts_per_minute = 0;
+    int replication_only = 0;
 
     update_every = (int)appconfig_get_number(&stream_config, machine_guid, "update every", update_every);
     if(update_every < 0) update_every = 1;
@@ -484,8 +1097,24 @@ int rrdpush_receive(int fd, const char *key, const char *hostname, const char *m
     mode = rrd_memory_mode_id(appconfig_get(&stream_config, key, "default memory mode", rrd_memory_mode_name(mode)));
     mode = rrd_memory_mode_id(appconfig_get(&stream_config, machine_guid, "memory mode", rrd_memory_mode_name(mode)));
 
-    health_enabled = appconfig_get_boolean_ondemand(&stream_config, key, "health enabled by default", health_enabled);
-    health_enabled = appconfig_get_boolean_ondemand(&stream_config, machine_guid, "health enabled", health_enabled);
+    replication_only = appconfig_get_boolean(&stream_config, key, "default replication only", replication_only);
+    replication_only = appconfig_get_boolean(&stream_config, machine_guid, "replication only", replication_only);
+
+    if(!replication_only) {
+        health_enabled = appconfig_get_boolean_ondemand(&stream_config, key, "health enabled by default", health_enabled);
+        health_enabled = appconfig_get_boolean_ondemand(&stream_config, machine_guid, "health enabled", health_enabled);
+    }
+    else {
+        // replication only hosts run health only when it is explicitly enabled
+        // their default is not saved, since the section of the api key is shared with other hosts
+        health_enabled = CONFIG_BOOLEAN_NO;
+
+        if(appconfig_is_set(&stream_config, key, "health enabled by default"))
+            health_enabled = appconfig_get_boolean_ondemand(&stream_config, key, "health enabled by default", health_enabled);
+
+        if(appconfig_is_set(&stream_config, machine_guid, "health enabled"))
+            health_enabled = appconfig_get_boolean_ondemand(&stream_config, machine_guid, "health enabled", health_enabled);
+    }
 
     alarms_delay = appconfig_get_number(&stream_config, key, "default postpone alarms on connect seconds", alarms_delay);
     alarms_delay = appconfig_get_number(&stream_config, machine_guid, "postpone alarms on connect seconds", alarms_delay);
@@ -499,6 +1128,23 @@ int rrdpush_receive(int fd, const char *key, const char *hostname, const char *m
     rrdpush_api_key = appconfig_get(&stream_config, key, "default proxy api key", rrdpush_api_key);
     rrdpush_api_key = appconfig_get(&stream_config, machine_guid, "proxy api key", rrdpush_api_key);
 
+    rrdpush_send_charts_matching = appconfig_get(&stream_config, key, "default proxy send charts matching", rrdpush_send_charts_matching);
+    rrdpush_send_charts_matching = appconfig_get(&stream_config, machine_guid, "proxy send charts matching", rrdpush_send_charts_matching);
+
+    rrdpush_aggregate_charts_matching = appconfig_get(&stream_config, key, "default proxy aggregate charts matching", rrdpush_aggregate_charts_matching);
+    rrdpush_aggregate_charts_matching = appconfig_get(&stream_config, machine_guid, "proxy aggregate charts matching", rrdpush_aggregate_charts_matching);
+
+    rrdpush_aggregate_iterations = (int)appconfig_get_number(&stream_config, key, "default proxy aggregate iterations", rrdpush_aggregate_iterations);
+    rrdpush_aggregate_iterations = (int)appconfig_get_number(&stream_config, machine_guid, "proxy aggregate iterations", rrdpush_aggregate_iterations);
+
+    max_lines_per_second = appconfig_get_number(&stream_config, key, "default max lines per second", max_lines_per_second);
+    max_lines_per_second = appconfig_get_number(&stream_config, machine_guid, "max lines per second", max_lines_per_second);
+    if(max_lines_per_second < 0) max_lines_per_second = 0;
+
+    max_new_charts_per_minute = appconfig_get_number(&stream_config, key, "default max new charts per minute", max_new_charts_per_minute);
+    max_new_charts_per_minute = appconfig_get_number(&stream_config, machine_guid, "max new charts per minute", max_new_charts_per_minute);
+    if(max_new_charts_per_minute < 0) max_new_charts_per_minute = 0;
+
     if(!strcmp(machine_guid, "localhost"))
         host = localhost;
     else
@@ -513,6 +1159,10 @@ int rrdpush_receive(int fd, const char *key, const char *hostname, const char *m
                 , (rrdpush_enabled && rrdpush_destination && *rrdpush_destination && rrdpush_api_key && *rrdpush_api_key)
                 , rrdpush_destination
                 , rrdpush_api_key
+                , rrdpush_send_charts_matching
+                , rrdpush_aggregate_charts_matching
+                , rrdpush_aggregate_iterations
+                , replication_only
         );
 
     if(!host) {
@@ -552,52 +1202,59 @@ int rrdpush_receive(int fd, const char *key, const char *hostname, const char *m
     snprintfz(cd.fullfilename, FILENAME_MAX,     "%s:%s", client_ip, client_port);
     snprintfz(cd.cmd,          PLUGINSD_CMD_MAX, "%s:%s", client_ip, client_port);
 
+    int binary = (version >= STREAMING_PROTOCOL_VERSION_BINARY);
+
+#ifndef ENABLE_STREAM_COMPRESSION
+    compression = 0;
+#endif
+
+    if(host->rrd_memory_mode == RRD_MEMORY_MODE_NONE)
+        replay = 0;
+
+    char prompt[100 + 1];
+    snprintfz(prompt, 100, "%s%s%s"
+              , (binary)?START_STREAMING_PROMPT_BINARY:START_STREAMING_PROMPT
+              , (compression)?"\n" STREAM_COMPRESSION_ACCEPTED:""
+              , (replay)?"\n" STREAM_REPLAY_ACCEPTED:""
+    );
+
     info("STREAM %s [receive from [%s]:%s]: initializing communication...", host->hostname, client_ip, client_port);
-    if(send_timeout(fd, START_STREAMING_PROMPT, strlen(START_STREAMING_PROMPT), 0, 60) != strlen(START_STREAMING_PROMPT)) {
+    ssize_t prompt_len = (ssize_t)strlen(prompt);
+    if(send_timeout(fd, prompt, (size_t)prompt_len, 0, 60) != prompt_len) {
         error("STREAM %s [receive from [%s]:%s]: cannot send ready command.", host->hostname, client_ip, client_port);
         close(fd);
         return 0;
     }
 
-    // remove the non-blocking flag from the socket
-    if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK) == -1)
-        error("STREAM %s [receive from [%s]:%s]: cannot remove the non-blocking flag from socket %d", host->hostname, client_ip, client_port, fd);
-
-    // convert the socket to a FILE *
-    FILE *fp = fdopen(fd, "r");
-    if(!fp) {
-        error("STREAM %s [receive from [%s]:%s]: failed to get a FILE for FD %d.", host->hostname, client_ip, client_port, fd);
+    if(replay && rrdpush_replay_receiver_send_charts(host, fd, 60)) {
+        error("STREAM %s [receive from [%s]:%s]: cannot send the charts to replay.", host->hostname, client_ip, client_port);
         close(fd);
         return 0;
     }
 
+    struct rrdpush_decompressor *decompressor = NULL;
+#ifdef ENABLE_STREAM_COMPRESSION
+    if(compression) {
+        decompressor = rrdpush_decompressor_create(fd, &host->rrdpush_received_compression);
+        if(!decompressor) {
+            error("STREAM %s [receive from [%s]:%s]: failed to decompress the stream of FD %d.", host->hostname, client_ip, client_port, fd);
+            close(fd);
+            return 0;
+        }
+    }
+#endif
+
     rrdhost_wrlock(host);
     host->connected_senders++;
     if(health_enabled != CONFIG_BOOLEAN_NO)
         host->health_delay_up_to = now_realtime_sec() + alarms_delay;
     rrdhost_unlock(host);
 
-    // call the plugins.d processor to receive the metrics
-    info("STREAM %s [receive from [%s]:%s]: receiving metrics...", host->hostname, client_ip, client_port);
-    size_t count = pluginsd_process(host, &cd, fp, 1);
-    error("STREAM %s [receive from [%s]:%s]: disconnected (completed updates %zu).", host->hostname, client_ip, client_port, count);
-
-    rrdhost_wrlock(host);
-    host->connected_senders--;
-    if(!host->connected_senders) {
-        if(health_enabled == CONFIG_BOOLEAN_AUTO)
-            host->health_enabled = 0;
-
-        host->senders_disconnected_time = now_realtime_sec();
-    }
-    rrdhost_unlock(host);
-
-    rrdpush_sender_thread_stop(host);
-
-    // cleanup
-    fclose(fp);
+    // give the socket to the receiver workers, to receive the metrics
+    info("STREAM %s [receive from [%s]:%s]: receiving metrics using the %s protocol%s...", host->hostname, client_ip, client_port, (binary)?"binary":"text", (compression)?", compressed":"");
+    rrdpush_receiver_start(host, fd, &cd, binary, decompressor, health_enabled, (size_t)max_lines_per_second, (size_t)max_new_charts_per_minute);
 
-    return (int)count;
+    return 1;
 }
 
 struct rrdpush_thread {
@@ -609,6 +1266,9 @@ struct rrdpush_thread {
     char *client_ip;
     char *client_port;
     int update_every;
+    int version;
+    int compression;
+    int replay;
 };
 
 void *rrdpush_receiver_thread(void *ptr) {
@@ -622,8 +1282,8 @@ void *rrdpush_receiver_thread(void *ptr) {
 
 
     info("STREAM %s [%s]:%s: receive thread created (task id %d)", rpt->hostname, rpt->client_ip, rpt->client_port, gettid());
-    rrdpush_receive(rpt->fd, rpt->key, rpt->hostname, rpt->machine_guid, rpt->os, rpt->update_every, rpt->client_ip, rpt->client_port);
-    info("STREAM %s [receive from [%s]:%s]: receive thread ended (task id %d)", rpt->hostname, rpt->client_ip, rpt->client_port, gettid());
+    rrdpush_receive(rpt->fd, rpt->key, rpt->hostname, rpt->machine_guid, rpt->os, rpt->update_every, rpt->version, rpt->compression, rpt->replay, rpt->client_ip, rpt->client_port);
+    info("STREAM %s [receive from [%s]:%s]: handshake thread ended (task id %d)", rpt->hostname, rpt->client_ip, rpt->client_port, gettid());
 
     freez(rpt->key);
     freez(rpt->hostname);
@@ -641,12 +1301,14 @@ void rrdpush_sender_thread_spawn(RRDHOST *host) {
     rrdhost_wrlock(host);
 
     if(!host->rrdpush_spawn) {
+        // the ring buffer lives as long as the host, since collectors use it without locking
+        if(!host->rrdpush_ring)
+            host->rrdpush_ring = rrdpush_ring_create(default_rrdpush_buffer_size);
+
+        // the thread is joinable, rrdpush_sender_thread_stop() joins it, otherwise it detaches itself when it exits
         if(pthread_create(&host->rrdpush_thread, NULL, rrdpush_sender_thread, (void *) host))
             error("STREAM %s [send]: failed to create new thread for client.", host->hostname);
 
-        else if(pthread_detach(host->rrdpush_thread))
-            error("STREAM %s [send]: cannot request detach newly created thread.", host->hostname);
-
         rrdhost_flag_clear(host, RRDHOST_ORPHAN);
         host->rrdpush_spawn = 1;
     }
@@ -661,6 +1323,9 @@ int rrdpush_receiver_thread_spawn(RRDHOST *host, struct web_client *w, char *url
 
     char *key = NULL, *hostname = NULL, *machine_guid = NULL, *os = "unknown";
     int update_every = default_rrd_update_every;
+    int version = STREAMING_PROTOCOL_VERSION_TEXT;
+    int compression = 0;
+    int replay = 0;
     char buf[GUID_LEN + 1];
 
     while(url) {
@@ -681,6 +1346,12 @@ int rrdpush_receiver_thread_spawn(RRDHOST *host, struct web_client *w, char *url
             update_every = (int)strtoul(value, NULL, 0);
         else if(!strcmp(name, "os"))
             os = value;
+        else if(!strcmp(name, "ver"))
+            version = (int)strtoul(value, NULL, 0);
+        else if(!strcmp(name, "compression"))
+            compression = !strcmp(value, STREAM_COMPRESSION_NAME);
+        else if(!strcmp(name, "replay"))
+            replay = !strcmp(value, "yes");
     }
 
     if(!key || !*key) {
@@ -741,6 +1412,9 @@ int rrdpush_receiver_thread_spawn(RRDHOST *host, struct web_client *w, char *url
     rpt->client_ip    = strdupz(w->client_ip);
     rpt->client_port  = strdupz(w->client_port);
     rpt->update_every = update_every;
+    rpt->version      = version;
+    rpt->compression  = compression;
+    rpt->replay       = replay;
     pthread_t thread;
 
     debug(D_SYSTEM, "STREAM [receive from [%s]:%s]: starting receiving thread.", w->client_ip, w->client_port);
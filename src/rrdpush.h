@@ -1,9 +1,238 @@
 #ifndef NETDATA_RRDPUSH_H
 #define NETDATA_RRDPUSH_H
 
+// ----------------------------------------------------------------------------
+// the binary streaming protocol
+//
+// The sender asks for it with ver=2 in the STREAM request and the receiver
+// accepts it by replying with START_STREAMING_PROMPT_BINARY. Receivers that
+// do not know it reply with the text prompt, and the text protocol is used.
+//
+// With the binary protocol, CHART and DIMENSION are still sent as text,
+// each with an additional last word: the numeric id of the chart (unique
+// per connection) and the dimension (unique per chart, starting at 1).
+// DIMENSION may have one more word: the last value sent for the dimension,
+// the base of its next difference (0 when missing). A destination connecting
+// while others are streaming gets the definitions this way, so that the ids
+// and the values of the destinations already connected are kept.
+// Then, instead of BEGIN / SET / END lines, the values of each chart are
+// sent as a single frame:
+//
+//  STREAM_BINARY_DATA
+//  varint chart id
+//  varint microseconds since the last update (0 = unknown)
+//  for each updated dimension:
+//      varint the dimension id minus the id of the previous one (ids start at 1)
+//      varint zigzag encoded difference from the last value sent for it
+//  varint 0 (end of dimensions)
+//
+// Varints are little endian base 128 (7 bits per byte, high bit = more bytes).
+
+#define STREAMING_PROTOCOL_VERSION_TEXT 1
+#define STREAMING_PROTOCOL_VERSION_BINARY 2
+#define START_STREAMING_PROMPT "Hit me baby, push them over..."
+#define START_STREAMING_PROMPT_BINARY "Hit me baby, push them over, in binary..."
+
+#define STREAM_BINARY_DATA 0x01
+#define STREAM_VARINT_MAX_BYTES 10
+
+static inline uint64_t stream_zigzag_encode(collected_number value, collected_number last) {
+    uint64_t d = (uint64_t)value - (uint64_t)last;
+    return (d << 1) ^ (uint64_t)((int64_t)d >> 63);
+}
+
+static inline collected_number stream_zigzag_decode(uint64_t zz, collected_number last) {
+    uint64_t d = (zz >> 1) ^ (~(zz & 1) + 1);
+    return (collected_number)((uint64_t)last + d);
+}
+
+// the caller has to make sure there are STREAM_VARINT_MAX_BYTES available
+static inline char *stream_varint_encode(char *s, uint64_t value) {
+    while(value >= 0x80) {
+        *s++ = (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    *s++ = (char)value;
+    return s;
+}
+
+// ----------------------------------------------------------------------------
+// the ring buffer between the data collectors and the sender thread
+//
+// Collectors serialize each chart update into a record and queue it without
+// locking. The sender thread is the only consumer. When the ring is full the
+// record is dropped and the chart is defined again with its next update.
+// Wake ups are coalesced: only the first record queued after the sender has
+// been woken up signals its eventfd again.
+
+struct rrdpush_ring {
+    char *data;
+    size_t size;                        // a power of 2
+    volatile size_t head;               // where the next record will be reserved
+    volatile size_t tail;               // the oldest record not consumed yet
+    volatile int wakeup_pending;        // 1 when the sender has been signalled and has not acknowledged it
+    int fd[2];                          // the eventfd (both the same), or a pipe, to wake up the sender
+
+    volatile size_t records;            // the number of records queued
+    volatile size_t bytes;              // the bytes of the records queued
+    volatile size_t dropped_records;    // the number of records dropped
+    volatile size_t dropped_bytes;      // the bytes of the records dropped
+
+    RRDSET *st_buffer;
+    RRDSET *st_records;
+
+#if !defined(HAVE_C___ATOMIC) || defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+    pthread_mutex_t mutex;
+#endif
+};
+
+extern struct rrdpush_ring *rrdpush_ring_create(size_t size);
+extern void rrdpush_ring_free(struct rrdpush_ring *r);
+extern int rrdpush_ring_push(struct rrdpush_ring *r, const char *data, size_t len, uint32_t generation);
+extern void rrdpush_ring_wakeup_clear(struct rrdpush_ring *r);
+extern size_t rrdpush_ring_pop(struct rrdpush_ring *r, BUFFER *wb, uint32_t generation);
+extern void rrdpush_ring_charts(void);
+
+// ----------------------------------------------------------------------------
+// compression of the streaming connection
+//
+// The sender asks for it with compression=deflate in the STREAM request and
+// the receiver accepts it by adding STREAM_COMPRESSION_ACCEPTED to its prompt.
+// Everything sent after the prompt is then a raw deflate stream, primed with
+// a dictionary of the protocol keywords, flushed at every send.
+
+#ifdef NETDATA_WITH_ZLIB
+#define ENABLE_STREAM_COMPRESSION 1
+#endif
+
+struct rrdpush_decompressor;
+
+#define STREAM_COMPRESSION_NAME "deflate"
+#define STREAM_COMPRESSION_ACCEPTED "compression=" STREAM_COMPRESSION_NAME
+
+#ifdef ENABLE_STREAM_COMPRESSION
+struct rrdpush_compressor {
+    z_stream zs;
+    BUFFER *wb;                         // the compressed data, to be sent
+};
+
+extern struct rrdpush_compressor *rrdpush_compressor_create(int level);
+extern void rrdpush_compressor_free(struct rrdpush_compressor *c);
+extern int rrdpush_compress(struct rrdpush_compressor *c, const char *data, size_t len, struct rrdpush_compression_stats *stats);
+extern struct rrdpush_decompressor *rrdpush_decompressor_create(int fd, struct rrdpush_compression_stats *stats);
+extern void rrdpush_decompressor_free(struct rrdpush_decompressor *d);
+extern ssize_t rrdpush_decompressor_read(struct rrdpush_decompressor *d, char *buf, size_t size);
+#endif
+
+extern void rrdpush_compression_charts(void);
+
+// ----------------------------------------------------------------------------
+// replay of the data collected while disconnected
+//
+// The sender asks for it with replay=yes in the STREAM request and the
+// receiver accepts it by adding STREAM_REPLAY_ACCEPTED to its prompt,
+// followed by a line with the last timestamp it has for each chart:
+//
+//  STREAM_REPLAY_CHART chart_id last_timestamp
+//  ...
+//  STREAM_REPLAY_END
+//
+// The sender replays the missing points as text lines, when there are no
+// live data to be sent, up to STREAM_REPLAY_MAX_POINTS points per line:
+//
+//  REPLAY_BEGIN 'chart_id' first_timestamp update_every
+//  REPLAY_SET 'dimension_id' storage_number storage_number ...
+
+#define STREAM_REPLAY_ACCEPTED "replay=yes"
+#define STREAM_REPLAY_CHART "REPLAY"
+#define STREAM_REPLAY_END "REPLAY_END"
+#define STREAM_REPLAY_MAX_POINTS 16
+
+extern int default_rrdpush_replay;
+extern size_t default_rrdpush_replay_bytes_per_second;
+
+struct rrdpush_destination;
+
+extern int rrdpush_replay_receiver_send_charts(RRDHOST *host, int fd, int timeout);
+extern BUFFER *rrdpush_replay_sender_receive_charts(int fd, const char *received, int timeout);
+extern void rrdpush_replay_sender_add_charts(RRDHOST *host, struct rrdpush_destination *d, BUFFER *list);
+extern void rrdpush_replay_sender_chunk(RRDHOST *host, struct rrdpush_destination *d, BUFFER *wb, size_t max_bytes);
+extern void rrdpush_replay_free(struct rrdpush_destination *d);
+
+// ----------------------------------------------------------------------------
+// the destinations of the sender
+//
+// The destination of a host is a list of groups, separated by |
+// Each group is a list of remote netdata, of which the first available gets
+// the metrics (failover). The sender streams to one netdata of each group
+// simultaneously. Chart updates are serialized once, into the buffer of the
+// host, and each destination sends it from its own offset.
+//
+// A connection is established by a connector thread, so that a remote netdata
+// that does not respond does not stop the others. When it is ready, the sender
+// starts a new generation of chart definitions and the new destination starts
+// sending from there. Old generation data are still sent to the destinations
+// that were already connected.
+
+typedef enum rrdpush_destination_state {
+    RRDPUSH_DESTINATION_DISCONNECTED,   // waiting to connect again
+    RRDPUSH_DESTINATION_CONNECTING,     // the connector thread is running
+    RRDPUSH_DESTINATION_CONNECTED,      // the connector thread has completed the handshake
+    RRDPUSH_DESTINATION_FAILED,         // the connector thread has failed
+    RRDPUSH_DESTINATION_STREAMING       // metrics are sent
+} RRDPUSH_DESTINATION_STATE;
+
+#define CONNECTED_TO_SIZE 100
+
+struct rrdpush_destination {
+    RRDHOST *host;
+    char *destination;                  // the failover list of remote netdata
+    char connected_to[CONNECTED_TO_SIZE + 1];
+
+    volatile RRDPUSH_DESTINATION_STATE state;
+    pthread_t thread;                   // the connector thread
+    time_t reconnect_after;             // when to connect again
+
+    int socket;                         // the fd of the socket, or -1
+    int binary;                         // 1 when the remote netdata accepted the binary protocol
+    int compression;                    // 1 when the remote netdata accepted compression
+    BUFFER *replay_list;                // the charts the remote netdata wants replayed, as received
+
+    size_t offset;                      // what has been taken from the buffer of the host
+    BUFFER *wb;                         // the data sent before the buffer of the host: compressed, or replayed data
+    size_t begin;                       // what has been sent from wb
+    struct rrdpush_compressor *compressor;
+    time_t last_sent;                   // the last time something has been sent, or the connection started
+
+    size_t reconnects_counter;
+    size_t sent_connection;             // the bytes sent on this connection
+
+    struct rrdpush_replay *replay;      // the charts to be replayed to the remote netdata
+    size_t replay_entries;              // the number of charts in replay
+    size_t replay_pending;              // the number of charts not replayed yet
+    size_t replay_points;               // the number of points replayed on this connection
+    size_t replay_bytes;                // the bytes replayed during replay_second
+    time_t replay_second;
+
+    struct rrdpush_destination *next;
+};
+
+// ----------------------------------------------------------------------------
+// the receiver threads
+
+extern int default_rrdpush_receiver_threads;
+
+extern void rrdpush_receiver_start(RRDHOST *host, int fd, struct plugind *cd, int binary, struct rrdpush_decompressor *decompressor, int health_enabled, size_t max_lines_per_second, size_t max_new_charts_per_minute);
+extern void rrdpush_receiver_charts(void);
+
 extern int default_rrdpush_enabled;
 extern char *default_rrdpush_destination;
 extern char *default_rrdpush_api_key;
+extern char *default_rrdpush_send_charts_matching;
+extern char *default_rrdpush_aggregate_charts_matching;
+extern int default_rrdpush_aggregate_iterations;
+extern int default_rrdpush_compression;
+extern int default_rrdpush_compression_level;
 
 extern int rrdpush_init();
 extern void rrdset_done_push(RRDSET *st);
@@ -0,0 +1,260 @@
+#include "common.h"
+
+// ----------------------------------------------------------------------------
+// compression of the streaming connection
+//
+// The sender compresses its buffer just before sending it, with a deflate
+// stream that lives as long as the connection, so that repeated chart ids
+// and keywords are compressed against everything sent before them.
+// The receiver reads the socket through a decompressor that inflates the
+// data, so that its parser gets the stream exactly as if it was not compressed.
+
+#ifdef ENABLE_STREAM_COMPRESSION
+
+// the dictionary both sides prime their deflate streams with
+// deflate prefers matches closer to the end, so the most frequent strings are last
+static const char rrdpush_compression_dictionary[] =
+        "DIMENSION '' '' 'percentage-of-absolute-row' 'percentage-of-incremental-row' 1 1 'hidden noreset'\n"
+        "CHART '' '' '' 'kilobits/s' 'percentage' 'line' 'area' 'stacked' 1000 1\n"
+        "DIMENSION '' '' 'absolute' 1 1 ' '\n"
+        "DIMENSION '' '' 'incremental' 1 1 ' '\n"
+        "BEGIN system. 1000000\n"
+        "SET  = 0\n"
+        "END\n"
+        "BEGIN  1000000\n"
+        "SET  = ";
+
+#define RRDPUSH_DECOMPRESSOR_INPUT_SIZE 16384
+
+struct rrdpush_decompressor {
+    int fd;
+    int output_pending;                 // 1 when inflate() may have more output without more input
+    z_stream zs;
+    struct rrdpush_compression_stats *stats;
+    Bytef in[RRDPUSH_DECOMPRESSOR_INPUT_SIZE];
+};
+
+struct rrdpush_compressor *rrdpush_compressor_create(int level) {
+    struct rrdpush_compressor *c = callocz(1, sizeof(struct rrdpush_compressor));
+
+    // raw deflate: there is no need for the zlib header and checksum, over TCP
+    if(deflateInit2(&c->zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        error("STREAM: cannot initialize the compressor.");
+        freez(c);
+        return NULL;
+    }
+
+    if(deflateSetDictionary(&c->zs, (const Bytef *)rrdpush_compression_dictionary, sizeof(rrdpush_compression_dictionary) - 1) != Z_OK) {
+        error("STREAM: cannot set the dictionary of the compressor.");
+        deflateEnd(&c->zs);
+        freez(c);
+        return NULL;
+    }
+
+    c->wb = buffer_create(16384);
+    return c;
+}
+
+void rrdpush_compressor_free(struct rrdpush_compressor *c) {
+    if(!c) return;
+
+    deflateEnd(&c->zs);
+    buffer_free(c->wb);
+    freez(c);
+}
+
+// appends the compressed data to the buffer of the compressor
+// returns 0 on success, -1 on failure
+int rrdpush_compress(struct rrdpush_compressor *c, const char *data, size_t len, struct rrdpush_compression_stats *stats) {
+    usec_t started = now_monotonic_usec();
+    size_t compressed = c->wb->len;
+
+    c->zs.next_in = (Bytef *)data;
+    c->zs.avail_in = (uInt)len;
+
+    do {
+        buffer_need_bytes(c->wb, len / 2 + 64);
+
+        c->zs.next_out = (Bytef *)&c->wb->buffer[c->wb->len];
+        c->zs.avail_out = (uInt)(c->wb->size - c->wb->len - 1);
+
+        int ret = deflate(&c->zs, Z_SYNC_FLUSH);
+        c->wb->len = (char *)c->zs.next_out - c->wb->buffer;
+
+        if(unlikely(ret != Z_OK && ret != Z_BUF_ERROR)) {
+            error("STREAM: failed to compress %zu bytes (deflate() returned %d).", len, ret);
+            return -1;
+        }
+    } while(c->zs.avail_out == 0);
+
+    c->wb->buffer[c->wb->len] = '\0';
+
+    stats->uncompressed += len;
+    stats->compressed += c->wb->len - compressed;
+    stats->usec += now_monotonic_usec() - started;
+
+    return 0;
+}
+
+// reads from the socket and decompresses up to size bytes into buf
+// it works like read(): it returns the bytes decompressed, 0 at the end of the stream,
+// or -1 with errno set (EAGAIN when a non-blocking socket has nothing more to read)
+ssize_t rrdpush_decompressor_read(struct rrdpush_decompressor *d, char *buf, size_t size) {
+    d->zs.next_out = (Bytef *)buf;
+    d->zs.avail_out = (uInt)size;
+
+    // inflate until we have something to return
+    while(d->zs.avail_out == size) {
+        if(!d->zs.avail_in && !d->output_pending) {
+            ssize_t bytes = read(d->fd, d->in, RRDPUSH_DECOMPRESSOR_INPUT_SIZE);
+            if(bytes <= 0) {
+                if(bytes == -1 && errno == EINTR) continue;
+                return bytes;
+            }
+
+            d->zs.next_in = d->in;
+            d->zs.avail_in = (uInt)bytes;
+            d->stats->compressed += bytes;
+        }
+
+        usec_t started = now_monotonic_usec();
+        int ret = inflate(&d->zs, Z_SYNC_FLUSH);
+        d->stats->usec += now_monotonic_usec() - started;
+
+        // when the output is full, there may be more, even without more input
+        d->output_pending = (d->zs.avail_out == 0);
+
+        if(unlikely(ret == Z_STREAM_END))
+            break;
+
+        if(unlikely(ret != Z_OK && ret != Z_BUF_ERROR)) {
+            error("STREAM: failed to decompress the stream (inflate() returned %d).", ret);
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    size_t bytes = size - d->zs.avail_out;
+    d->stats->uncompressed += bytes;
+    return (ssize_t)bytes;
+}
+
+// the decompressor does not close the socket
+void rrdpush_decompressor_free(struct rrdpush_decompressor *d) {
+    if(!d) return;
+
+    inflateEnd(&d->zs);
+    freez(d);
+}
+
+struct rrdpush_decompressor *rrdpush_decompressor_create(int fd, struct rrdpush_compression_stats *stats) {
+    struct rrdpush_decompressor *d = callocz(1, sizeof(struct rrdpush_decompressor));
+    d->fd = fd;
+    d->stats = stats;
+
+    if(inflateInit2(&d->zs, -15) != Z_OK) {
+        error("STREAM: cannot initialize the decompressor.");
+        freez(d);
+        return NULL;
+    }
+
+    if(inflateSetDictionary(&d->zs, (const Bytef *)rrdpush_compression_dictionary, sizeof(rrdpush_compression_dictionary) - 1) != Z_OK) {
+        error("STREAM: cannot set the dictionary of the decompressor.");
+        inflateEnd(&d->zs);
+        freez(d);
+        return NULL;
+    }
+
+    return d;
+}
+
+#endif /* ENABLE_STREAM_COMPRESSION */
+
+// ----------------------------------------------------------------------------
+// the compression charts of each connection
+
+static void rrdpush_compression_stats_charts(RRDHOST *host, struct rrdpush_compression_stats *stats, const char *direction, long priority) {
+    // read the smaller value first
+    size_t compressed = stats->compressed;
+    size_t uncompressed = stats->uncompressed;
+
+    if(!uncompressed) return;
+
+    char id[RRD_ID_LENGTH_MAX + 1], title[200 + 1];
+
+    if(unlikely(!stats->st_bytes)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_%s_%s_compression", direction, host->hostname);
+        snprintfz(title, 200, "Streaming Compression, data %s for host %s", direction, host->hostname);
+
+        stats->st_bytes = rrdset_find_bytype_localhost("netdata", id);
+        if(!stats->st_bytes) {
+            stats->st_bytes = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "kilobits/s"
+                                                      , priority, localhost->rrd_update_every, RRDSET_TYPE_AREA);
+
+            rrddim_add(stats->st_bytes, "uncompressed", NULL, 8, 1024, RRD_ALGORITHM_INCREMENTAL);
+            rrddim_add(stats->st_bytes, "compressed", NULL, 8, 1024, RRD_ALGORITHM_INCREMENTAL);
+        }
+    }
+    else rrdset_next(stats->st_bytes);
+
+    rrddim_set(stats->st_bytes, "uncompressed", (collected_number)uncompressed);
+    rrddim_set(stats->st_bytes, "compressed", (collected_number)compressed);
+    rrdset_done(stats->st_bytes);
+
+    // ------------------------------------------------------------------------
+
+    if(unlikely(!stats->st_savings)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_%s_%s_compression_ratio", direction, host->hostname);
+        snprintfz(title, 200, "Streaming Compression Savings Ratio, data %s for host %s", direction, host->hostname);
+
+        stats->st_savings = rrdset_find_bytype_localhost("netdata", id);
+        if(!stats->st_savings) {
+            stats->st_savings = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "percentage"
+                                                        , priority + 1, localhost->rrd_update_every, RRDSET_TYPE_LINE);
+
+            rrddim_add(stats->st_savings, "savings", NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+        }
+    }
+    else rrdset_next(stats->st_savings);
+
+    size_t u = uncompressed - stats->last_uncompressed;
+    size_t c = compressed - stats->last_compressed;
+    stats->last_uncompressed = uncompressed;
+    stats->last_compressed = compressed;
+
+    if(u && u >= c)
+        rrddim_set(stats->st_savings, "savings", (collected_number)((u - c) * 100 * 1000 / u));
+
+    rrdset_done(stats->st_savings);
+
+    // ------------------------------------------------------------------------
+
+    if(unlikely(!stats->st_cpu)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_%s_%s_compression_cpu", direction, host->hostname);
+        snprintfz(title, 200, "Streaming Compression CPU Time, data %s for host %s", direction, host->hostname);
+
+        stats->st_cpu = rrdset_find_bytype_localhost("netdata", id);
+        if(!stats->st_cpu) {
+            stats->st_cpu = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "milliseconds/s"
+                                                    , priority + 2, localhost->rrd_update_every, RRDSET_TYPE_LINE);
+
+            rrddim_add(stats->st_cpu, "time", NULL, 1, 1000, RRD_ALGORITHM_INCREMENTAL);
+        }
+    }
+    else rrdset_next(stats->st_cpu);
+
+    rrddim_set(stats->st_cpu, "time", (collected_number)stats->usec);
+    rrdset_done(stats->st_cpu);
+}
+
+void rrdpush_compression_charts(void) {
+    rrd_rdlock();
+
+    RRDHOST *host;
+    rrdhost_foreach_read(host) {
+        rrdpush_compression_stats_charts(host, &host->rrdpush_sent_compression, "sent", 131000);
+        rrdpush_compression_stats_charts(host, &host->rrdpush_received_compression, "received", 131100);
+    }
+
+    rrd_unlock();
+}
@@ -0,0 +1,636 @@
+#include "common.h"
+
+// ----------------------------------------------------------------------------
+// the pool of receiver threads
+//
+// Once the handshake with a streaming netdata is over, its socket is given
+// to one of a fixed number of worker threads. Each worker waits on an epoll
+// set of non-blocking sockets and feeds whatever arrives to the plugins.d
+// parser of the connection, keeping incomplete lines and frames for later.
+// So the number of threads of a parent does not depend on its children.
+//
+// Without epoll, each connection gets its own thread reading a blocking socket.
+//
+// Each connection may be limited to a number of lines per second and new
+// charts per minute, with token buckets. When a bucket is empty, the data
+// already read waits in the buffer and the socket is not read for a while,
+// so TCP slows down the sender, instead of disconnecting it.
+//
+// Stopping the sender of a host may wait for locks held by other threads,
+// so the workers leave it, and the release of the host, to a thread of its own.
+
+// what is read at once - the buffer grows when a line or binary frame is bigger
+#define RRDPUSH_RECEIVER_BUFFER_SIZE (64 * 1024)
+
+// the biggest line or binary frame we accept
+#define RRDPUSH_RECEIVER_BUFFER_MAX (64 * 1024 * 1024)
+
+#define RRDPUSH_RECEIVER_MAX_EVENTS 64
+
+// how long a connection is not read, when it exceeds its limits
+#define RRDPUSH_RECEIVER_THROTTLE_USEC (100 * USEC_PER_MS)
+
+struct rrdpush_receiver_bucket {
+    calculated_number rate;                     // the tokens added per second, 0 = unlimited
+    calculated_number size;                     // the maximum tokens
+    calculated_number tokens;
+};
+
+struct rrdpush_receiver {
+    RRDHOST *host;
+    int fd;
+    int health_enabled;
+
+    struct rrdpush_receiver_bucket lines;
+    struct rrdpush_receiver_bucket new_charts;
+    usec_t refilled_ut;                         // the last time the buckets were refilled
+    usec_t throttled_ut;                        // when the connection started being throttled, 0 = it is not
+    usec_t resume_ut;                           // when a throttled connection will be read again
+    size_t throttled_times;
+    struct rrdpush_receiver *next;              // in the list of throttled connections of a worker
+
+    struct plugind cd;
+    struct pluginsd_parser *parser;
+    struct rrdpush_decompressor *decompressor;  // NULL when the stream is not compressed
+
+    size_t len;                                 // the bytes in buffer, not processed yet
+    size_t size;                                // the bytes buffer can hold, without its terminating zero
+    char *buffer;
+};
+
+int default_rrdpush_receiver_threads = 0;
+
+// ----------------------------------------------------------------------------
+// a connection
+
+static void rrdpush_receiver_bucket_init(struct rrdpush_receiver_bucket *b, calculated_number rate, calculated_number size) {
+    b->rate = rate;
+    b->size = size;
+    b->tokens = size;
+}
+
+static inline void rrdpush_receiver_bucket_refill(struct rrdpush_receiver_bucket *b, usec_t dt) {
+    b->tokens += b->rate * (calculated_number)dt / (calculated_number)USEC_PER_SEC;
+    if(b->tokens > b->size) b->tokens = b->size;
+}
+
+// the tokens available, or (size_t)-1 when unlimited
+static inline size_t rrdpush_receiver_bucket_available(struct rrdpush_receiver_bucket *b) {
+    if(!b->rate) return (size_t)-1;
+    return (b->tokens > 0)?(size_t)b->tokens:0;
+}
+
+// processes the lines and frames in the buffer, within the limits of the connection
+// returns 0 on success, 1 when the limits stopped the processing, -1 when the connection has to be closed
+static int rrdpush_receiver_process(struct rrdpush_receiver *r) {
+    struct rrdpush_receiver_stats *stats = &r->host->rrdpush_received;
+    size_t lines, new_charts, lines_after, new_charts_after;
+
+    int limited = (r->lines.rate || r->new_charts.rate);
+    if(limited) {
+        usec_t now = now_monotonic_usec();
+        rrdpush_receiver_bucket_refill(&r->lines, now - r->refilled_ut);
+        rrdpush_receiver_bucket_refill(&r->new_charts, now - r->refilled_ut);
+        r->refilled_ut = now;
+
+        pluginsd_parser_allow(r->parser, rrdpush_receiver_bucket_available(&r->lines), rrdpush_receiver_bucket_available(&r->new_charts));
+    }
+
+    pluginsd_parser_counters(r->parser, &lines, &new_charts);
+
+    ssize_t consumed = pluginsd_parser_feed(r->parser, r->buffer, r->len);
+    if(unlikely(consumed < 0))
+        return -1;
+
+    pluginsd_parser_counters(r->parser, &lines_after, &new_charts_after);
+    stats->lines += lines_after - lines;
+    stats->new_charts += new_charts_after - new_charts;
+
+    if(consumed) {
+        r->len -= consumed;
+        memmove(r->buffer, &r->buffer[consumed], r->len);
+    }
+
+    if(!limited)
+        return 0;
+
+    // binary frames may take the buckets below zero, the debt is paid later
+    r->lines.tokens -= (calculated_number)(lines_after - lines);
+    r->new_charts.tokens -= (calculated_number)(new_charts_after - new_charts);
+
+    if(unlikely(pluginsd_parser_throttled(r->parser))) {
+        if(!r->throttled_ut) {
+            r->throttled_ut = r->refilled_ut;
+
+            if(!r->throttled_times++)
+                info("STREAM %s [receive from %s]: the connection exceeds its limits, slowing it down.", r->host->hostname, r->cd.fullfilename);
+        }
+
+        r->resume_ut = r->refilled_ut + RRDPUSH_RECEIVER_THROTTLE_USEC;
+        return 1;
+    }
+
+    if(unlikely(r->throttled_ut)) {
+        stats->throttled_usec += r->refilled_ut - r->throttled_ut;
+        r->throttled_ut = 0;
+    }
+
+    return 0;
+}
+
+// reads and processes everything available on the socket
+// returns 0 when the socket has nothing more to read, 1 when the connection exceeds its limits
+// and should not be read before resume_ut, -1 when the connection has to be closed
+static int rrdpush_receiver_read(struct rrdpush_receiver *r) {
+    // what has been left in the buffer by the limits
+    if(unlikely(r->throttled_ut)) {
+        int ret = rrdpush_receiver_process(r);
+        if(ret) return ret;
+    }
+
+    for(;;) {
+        if(unlikely(netdata_exit)) return -1;
+
+        if(unlikely(r->len == r->size)) {
+            if(unlikely(r->size >= RRDPUSH_RECEIVER_BUFFER_MAX)) {
+                error("STREAM %s [receive from %s]: received a line or data frame bigger than %d bytes.", r->host->hostname, r->cd.fullfilename, RRDPUSH_RECEIVER_BUFFER_MAX);
+                return -1;
+            }
+
+            r->size *= 2;
+            r->buffer = reallocz(r->buffer, r->size + 1);
+            debug(D_RRDHOST, "STREAM %s [receive from %s]: receive buffer increased to %zu bytes.", r->host->hostname, r->cd.fullfilename, r->size);
+        }
+
+        size_t size = r->size - r->len;
+
+        ssize_t bytes;
+#ifdef ENABLE_STREAM_COMPRESSION
+        if(r->decompressor)
+            bytes = rrdpush_decompressor_read(r->decompressor, &r->buffer[r->len], size);
+        else
+#endif
+            bytes = read(r->fd, &r->buffer[r->len], size);
+
+        if(unlikely(bytes <= 0)) {
+            if(bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return 0;
+
+            if(bytes == -1 && errno == EINTR)
+                continue;
+
+            if(bytes == 0) {
+                errno = 0;
+                error("STREAM %s [receive from %s]: the connection has been closed.", r->host->hostname, r->cd.fullfilename);
+            }
+            else
+                error("STREAM %s [receive from %s]: read failed.", r->host->hostname, r->cd.fullfilename);
+
+            return -1;
+        }
+
+        r->len += bytes;
+        r->buffer[r->len] = '\0';
+
+        int ret = rrdpush_receiver_process(r);
+        if(ret) return ret;
+    }
+}
+
+// closes the socket of a connection
+// the host is still counted as connected, until rrdpush_receiver_release()
+static void rrdpush_receiver_close(struct rrdpush_receiver *r) {
+    size_t count = pluginsd_parser_free(r->parser);
+    r->parser = NULL;
+
+    error("STREAM %s [receive from %s]: disconnected (completed updates %zu, slowed down %zu times).", r->host->hostname, r->cd.fullfilename, count, r->throttled_times);
+
+#ifdef ENABLE_STREAM_COMPRESSION
+    rrdpush_decompressor_free(r->decompressor);
+    r->decompressor = NULL;
+#endif
+    close(r->fd);
+    r->fd = -1;
+
+    freez(r->buffer);
+    r->buffer = NULL;
+}
+
+// stops the sender of the host and frees a closed connection
+// it may block, while the sender is stopped
+static void rrdpush_receiver_release(struct rrdpush_receiver *r) {
+    RRDHOST *host = r->host;
+
+    // the host cannot be freed as an orphan while it is counted as connected
+    rrdpush_sender_thread_stop(host);
+
+    rrdhost_wrlock(host);
+    host->connected_senders--;
+    if(!host->connected_senders) {
+        if(r->health_enabled == CONFIG_BOOLEAN_AUTO)
+            host->health_enabled = 0;
+
+        host->senders_disconnected_time = now_realtime_sec();
+    }
+    rrdhost_unlock(host);
+
+    freez(r);
+}
+
+static void rrdpush_receiver_disconnected(struct rrdpush_receiver *r) {
+    rrdpush_receiver_close(r);
+    rrdpush_receiver_release(r);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+// ----------------------------------------------------------------------------
+// the workers
+
+struct rrdpush_receiver_worker {
+    size_t id;
+    int efd;                                    // the epoll set of the sockets of this worker
+    size_t connections;                         // the connections of this worker, protected by the pool mutex
+    struct rrdpush_receiver *throttled;         // the connections removed from efd, because of their limits
+    pthread_t thread;
+};
+
+static struct rrdpush_receiver_pool {
+    pthread_mutex_t mutex;
+    size_t workers;
+    struct rrdpush_receiver_worker *worker;
+
+    pthread_cond_t cond;                        // wakes up the releaser, when closed gets a connection
+    struct rrdpush_receiver *closed;            // the closed connections, waiting to be released
+    pthread_t releaser;
+} rrdpush_receiver_pool = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .workers = 0,
+        .worker = NULL,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .closed = NULL
+};
+
+// the connection is released by the releaser thread, so that the worker does not wait for it
+static void rrdpush_receiver_worker_disconnected(struct rrdpush_receiver_worker *w, struct rrdpush_receiver *r) {
+    rrdpush_receiver_close(r);
+
+    pthread_mutex_lock(&rrdpush_receiver_pool.mutex);
+    w->connections--;
+    r->next = rrdpush_receiver_pool.closed;
+    rrdpush_receiver_pool.closed = r;
+    pthread_cond_signal(&rrdpush_receiver_pool.cond);
+    pthread_mutex_unlock(&rrdpush_receiver_pool.mutex);
+}
+
+static void *rrdpush_receiver_releaser_thread(void *ptr) {
+    (void)ptr;
+    struct rrdpush_receiver_pool *pool = &rrdpush_receiver_pool;
+
+    info("STREAM [receive]: receiver releaser created (task id %d)", gettid());
+
+    pthread_mutex_lock(&pool->mutex);
+    while(!netdata_exit) {
+        if(!pool->closed) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+            continue;
+        }
+
+        struct rrdpush_receiver *r = pool->closed;
+        pool->closed = r->next;
+        pthread_mutex_unlock(&pool->mutex);
+
+        rrdpush_receiver_release(r);
+
+        pthread_mutex_lock(&pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    info("STREAM [receive]: receiver releaser exiting");
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+// stops watching the socket of a connection that exceeds its limits, until its resume_ut
+static void rrdpush_receiver_worker_throttle(struct rrdpush_receiver_worker *w, struct rrdpush_receiver *r) {
+    if(epoll_ctl(w->efd, EPOLL_CTL_DEL, r->fd, NULL) == -1)
+        error("STREAM %s [receive from %s]: cannot remove socket %d from receiver worker %zu.", r->host->hostname, r->cd.fullfilename, r->fd, w->id);
+
+    r->next = w->throttled;
+    w->throttled = r;
+}
+
+// reads again the throttled connections that are due
+// returns the milliseconds until the next one is due, or -1 when there is none
+static int rrdpush_receiver_worker_resume(struct rrdpush_receiver_worker *w) {
+    usec_t now = now_monotonic_usec(), next = 0;
+    struct rrdpush_receiver *r, **ptr = &w->throttled;
+
+    while((r = *ptr)) {
+        if(r->resume_ut > now) {
+            if(!next || r->resume_ut < next) next = r->resume_ut;
+            ptr = &r->next;
+            continue;
+        }
+
+        *ptr = r->next;
+        r->next = NULL;
+
+        int ret = rrdpush_receiver_read(r);
+        if(ret > 0) {
+            // still over its limits - it stays in the list
+            r->next = *ptr;
+            *ptr = r;
+            if(!next || r->resume_ut < next) next = r->resume_ut;
+            ptr = &r->next;
+            continue;
+        }
+
+        struct epoll_event ev = {
+                .events = EPOLLIN | EPOLLRDHUP,
+                .data.ptr = r
+        };
+
+        if(ret < 0 || epoll_ctl(w->efd, EPOLL_CTL_ADD, r->fd, &ev) == -1) {
+            if(!ret) error("STREAM %s [receive from %s]: cannot add socket %d back to receiver worker %zu.", r->host->hostname, r->cd.fullfilename, r->fd, w->id);
+            rrdpush_receiver_worker_disconnected(w, r);
+        }
+    }
+
+    if(!next) return -1;
+    return (int)((next - now + USEC_PER_MS - 1) / USEC_PER_MS);
+}
+
+static void *rrdpush_receiver_worker_thread(void *ptr) {
+    struct rrdpush_receiver_worker *w = (struct rrdpush_receiver_worker *)ptr;
+    struct epoll_event events[RRDPUSH_RECEIVER_MAX_EVENTS];
+
+    info("STREAM [receive]: receiver worker %zu created (task id %d)", w->id, gettid());
+
+    int timeout = 1000;
+    while(!netdata_exit) {
+        int n = epoll_wait(w->efd, events, RRDPUSH_RECEIVER_MAX_EVENTS, timeout);
+        if(unlikely(n == -1)) {
+            if(errno == EINTR) continue;
+            error("STREAM [receive]: receiver worker %zu cannot wait for its sockets.", w->id);
+            break;
+        }
+
+        int i;
+        for(i = 0; i < n ; i++) {
+            struct rrdpush_receiver *r = (struct rrdpush_receiver *)events[i].data.ptr;
+
+            // errors and hang ups are detected by read()
+            int ret = rrdpush_receiver_read(r);
+            if(likely(!ret))
+                continue;
+
+            if(ret > 0) {
+                rrdpush_receiver_worker_throttle(w, r);
+                continue;
+            }
+
+            if(epoll_ctl(w->efd, EPOLL_CTL_DEL, r->fd, NULL) == -1)
+                error("STREAM %s [receive from %s]: cannot remove socket %d from receiver worker %zu.", r->host->hostname, r->cd.fullfilename, r->fd, w->id);
+
+            rrdpush_receiver_worker_disconnected(w, r);
+        }
+
+        timeout = 1000;
+        if(unlikely(w->throttled)) {
+            int t = rrdpush_receiver_worker_resume(w);
+            if(t >= 0 && t < timeout) timeout = t;
+        }
+    }
+
+    info("STREAM [receive]: receiver worker %zu exiting", w->id);
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+// the workers are started with the first connection
+// it has to be called with the pool mutex held
+static void rrdpush_receiver_pool_start(void) {
+    struct rrdpush_receiver_pool *pool = &rrdpush_receiver_pool;
+
+    size_t workers = (size_t)((default_rrdpush_receiver_threads > 0)?default_rrdpush_receiver_threads:processors);
+    if(workers < 1) workers = 1;
+
+    pool->worker = callocz(workers, sizeof(struct rrdpush_receiver_worker));
+
+    size_t i;
+    for(i = 0; i < workers ; i++) {
+        struct rrdpush_receiver_worker *w = &pool->worker[pool->workers];
+        w->id = pool->workers;
+
+        w->efd = epoll_create1(EPOLL_CLOEXEC);
+        if(w->efd == -1) {
+            error("STREAM [receive]: cannot create the epoll set of receiver worker %zu.", w->id);
+            break;
+        }
+
+        if(pthread_create(&w->thread, NULL, rrdpush_receiver_worker_thread, (void *)w)) {
+            error("STREAM [receive]: failed to create the thread of receiver worker %zu.", w->id);
+            close(w->efd);
+            break;
+        }
+
+        if(pthread_detach(w->thread))
+            error("STREAM [receive]: cannot request detach of the thread of receiver worker %zu.", w->id);
+
+        pool->workers++;
+    }
+
+    if(!pool->workers)
+        fatal("STREAM [receive]: cannot start any receiver worker.");
+
+    if(pthread_create(&pool->releaser, NULL, rrdpush_receiver_releaser_thread, NULL))
+        fatal("STREAM [receive]: failed to create the thread of the receiver releaser.");
+
+    if(pthread_detach(pool->releaser))
+        error("STREAM [receive]: cannot request detach of the thread of the receiver releaser.");
+
+    info("STREAM [receive]: started %zu receiver workers.", pool->workers);
+}
+
+static int rrdpush_receiver_add(struct rrdpush_receiver *r) {
+    struct rrdpush_receiver_pool *pool = &rrdpush_receiver_pool;
+
+    if(fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL, 0) | O_NONBLOCK) == -1) {
+        error("STREAM %s [receive from %s]: cannot set the non-blocking flag on socket %d", r->host->hostname, r->cd.fullfilename, r->fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if(unlikely(!pool->workers))
+        rrdpush_receiver_pool_start();
+
+    // give it to the worker with the fewest connections
+    struct rrdpush_receiver_worker *w = &pool->worker[0];
+    size_t i;
+    for(i = 1; i < pool->workers ; i++)
+        if(pool->worker[i].connections < w->connections)
+            w = &pool->worker[i];
+
+    w->connections++;
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    debug(D_RRDHOST, "STREAM %s [receive from %s]: giving socket %d to receiver worker %zu.", r->host->hostname, r->cd.fullfilename, r->fd, w->id);
+
+    struct epoll_event ev = {
+            .events = EPOLLIN | EPOLLRDHUP,
+            .data.ptr = r
+    };
+
+    if(epoll_ctl(w->efd, EPOLL_CTL_ADD, r->fd, &ev) == -1) {
+        error("STREAM %s [receive from %s]: cannot add socket %d to receiver worker %zu.", r->host->hostname, r->cd.fullfilename, r->fd, w->id);
+
+        pthread_mutex_lock(&pool->mutex);
+        w->connections--;
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+
+    // from now on, the worker may free it at any time
+    return 0;
+}
+
+#else /* ! HAVE_SYS_EPOLL_H */
+
+static void *rrdpush_receiver_connection_thread(void *ptr) {
+    struct rrdpush_receiver *r = (struct rrdpush_receiver *)ptr;
+
+    // the socket is blocking, so this returns only when the connection has to be closed or throttled
+    int ret;
+    while((ret = rrdpush_receiver_read(r)) >= 0) {
+        if(ret > 0) {
+            usec_t now = now_monotonic_usec();
+            if(r->resume_ut > now) sleep_usec(r->resume_ut - now);
+        }
+    }
+
+    rrdpush_receiver_disconnected(r);
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+static int rrdpush_receiver_add(struct rrdpush_receiver *r) {
+    if(fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL, 0) & ~O_NONBLOCK) == -1)
+        error("STREAM %s [receive from %s]: cannot remove the non-blocking flag from socket %d", r->host->hostname, r->cd.fullfilename, r->fd);
+
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, rrdpush_receiver_connection_thread, (void *)r)) {
+        error("STREAM %s [receive from %s]: failed to create new thread for client.", r->host->hostname, r->cd.fullfilename);
+        return -1;
+    }
+
+    if(pthread_detach(thread))
+        error("STREAM %s [receive from %s]: cannot request detach newly created thread.", r->host->hostname, r->cd.fullfilename);
+
+    return 0;
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+// ----------------------------------------------------------------------------
+
+// starts receiving the metrics of a connection that has completed its handshake
+// the connection has already been counted in host->connected_senders
+// from now on, the receiver owns the socket and the decompressor
+// max_lines_per_second and max_new_charts_per_minute limit the connection, 0 = unlimited
+void rrdpush_receiver_start(RRDHOST *host, int fd, struct plugind *cd, int binary, struct rrdpush_decompressor *decompressor, int health_enabled, size_t max_lines_per_second, size_t max_new_charts_per_minute) {
+    struct rrdpush_receiver *r = callocz(1, sizeof(struct rrdpush_receiver));
+    r->host = host;
+    r->fd = fd;
+    r->health_enabled = health_enabled;
+    rrdpush_receiver_bucket_init(&r->lines, (calculated_number)max_lines_per_second, (calculated_number)max_lines_per_second);
+    rrdpush_receiver_bucket_init(&r->new_charts, (calculated_number)max_new_charts_per_minute / 60.0, (calculated_number)max_new_charts_per_minute);
+    r->refilled_ut = now_monotonic_usec();
+    r->decompressor = decompressor;
+    r->size = RRDPUSH_RECEIVER_BUFFER_SIZE;
+    r->buffer = mallocz(r->size + 1);
+    memcpy(&r->cd, cd, sizeof(struct plugind));
+    r->parser = pluginsd_parser_create(host, &r->cd, 1, binary);
+
+    if(rrdpush_receiver_add(r))
+        rrdpush_receiver_disconnected(r);
+}
+
+// ----------------------------------------------------------------------------
+// the charts of the metrics received from each host
+
+static void rrdpush_receiver_host_charts(RRDHOST *host, struct rrdpush_receiver_stats *stats) {
+    char id[RRD_ID_LENGTH_MAX + 1], title[200 + 1];
+
+    if(unlikely(!stats->st_lines)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_received_%s_lines", host->hostname);
+        snprintfz(title, 200, "Streaming Received Lines for host %s", host->hostname);
+
+        stats->st_lines = rrdset_find_bytype_localhost("netdata", id);
+        if(!stats->st_lines) {
+            stats->st_lines = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "lines/s"
+                                                      , 131300, localhost->rrd_update_every, RRDSET_TYPE_LINE);
+
+            rrddim_add(stats->st_lines, "lines", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+        }
+    }
+    else rrdset_next(stats->st_lines);
+
+    rrddim_set(stats->st_lines, "lines", (collected_number)stats->lines);
+    rrdset_done(stats->st_lines);
+
+    // ------------------------------------------------------------------------
+
+    if(unlikely(!stats->st_charts)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_received_%s_new_charts", host->hostname);
+        snprintfz(title, 200, "Streaming Received New Charts for host %s", host->hostname);
+
+        stats->st_charts = rrdset_find_bytype_localhost("netdata", id);
+        if(!stats->st_charts) {
+            stats->st_charts = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "charts/min"
+                                                       , 131301, localhost->rrd_update_every, RRDSET_TYPE_LINE);
+
+            rrddim_add(stats->st_charts, "new", NULL, 60, 1, RRD_ALGORITHM_INCREMENTAL);
+        }
+    }
+    else rrdset_next(stats->st_charts);
+
+    rrddim_set(stats->st_charts, "new", (collected_number)stats->new_charts);
+    rrdset_done(stats->st_charts);
+
+    // ------------------------------------------------------------------------
+
+    if(unlikely(!stats->st_throttled)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_received_%s_throttled", host->hostname);
+        snprintfz(title, 200, "Streaming Receiver Slowed Down by its Limits, for host %s", host->hostname);
+
+        stats->st_throttled = rrdset_find_bytype_localhost("netdata", id);
+        if(!stats->st_throttled) {
+            stats->st_throttled = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "percentage"
+                                                          , 131302, localhost->rrd_update_every, RRDSET_TYPE_AREA);
+
+            rrddim_add(stats->st_throttled, "throttled", NULL, 100, USEC_PER_SEC, RRD_ALGORITHM_INCREMENTAL);
+        }
+    }
+    else rrdset_next(stats->st_throttled);
+
+    rrddim_set(stats->st_throttled, "throttled", (collected_number)stats->throttled_usec);
+    rrdset_done(stats->st_throttled);
+}
+
+void rrdpush_receiver_charts(void) {
+    rrd_rdlock();
+
+    RRDHOST *host;
+    rrdhost_foreach_read(host) {
+        if(host->rrdpush_received.st_lines || host->connected_senders)
+            rrdpush_receiver_host_charts(host, &host->rrdpush_received);
+    }
+
+    rrd_unlock();
+}
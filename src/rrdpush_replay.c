@@ -0,0 +1,233 @@
+#include "common.h"
+
+// ----------------------------------------------------------------------------
+// replay of the data collected while the streaming connection was down
+//
+// The receiver appends to its prompt the last timestamp it has for each
+// chart of the host. The sender keeps the list and, when there are no live
+// data waiting to be sent, it sends the points collected after these
+// timestamps from its own round robin database. The receiver stores them
+// only in slots that have not been collected (the gap it recorded when live
+// data resumed), so replayed data never overwrite live data.
+
+// how long to wait for live data of a chart, before giving up replaying it
+#define RRDPUSH_REPLAY_WAIT_SECONDS 60
+
+// the maximum size of the list of charts we accept
+#define RRDPUSH_REPLAY_MAX_LIST_SIZE (16 * 1024 * 1024)
+
+struct rrdpush_replay {
+    char *chart_id;                 // NULL when the chart has been replayed
+    time_t after;                   // the last timestamp the remote netdata has
+    time_t before;                  // the last timestamp we had when we connected
+};
+
+int default_rrdpush_replay = 1;
+size_t default_rrdpush_replay_bytes_per_second = 256 * 1024;
+
+// ----------------------------------------------------------------------------
+// receiver
+
+// sends the charts of the host, with the last timestamp of each
+// returns 0 on success, -1 on failure
+int rrdpush_replay_receiver_send_charts(RRDHOST *host, int fd, int timeout) {
+    BUFFER *wb = buffer_create(16384);
+    size_t charts = 0;
+
+    buffer_strcat(wb, "\n");
+
+    rrdhost_rdlock(host);
+
+    RRDSET *st;
+    rrdset_foreach_read(st, host) {
+        if(st->rrd_memory_mode == RRD_MEMORY_MODE_NONE || !st->counter || !rrdset_last_entry_t(st))
+            continue;
+
+        buffer_sprintf(wb, "%s %s %ld\n", STREAM_REPLAY_CHART, st->id, (long)rrdset_last_entry_t(st));
+        charts++;
+    }
+
+    rrdhost_unlock(host);
+
+    buffer_strcat(wb, STREAM_REPLAY_END "\n");
+
+    // send_timeout() sends once and the socket is non-blocking, so send until everything has been sent
+    size_t sent = 0, len = buffer_strlen(wb);
+    while(sent < len) {
+        ssize_t ret = send_timeout(fd, &wb->buffer[sent], len - sent, 0, timeout);
+        if(ret <= 0) {
+            if(ret == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+            buffer_free(wb);
+            return -1;
+        }
+
+        sent += ret;
+    }
+
+    debug(D_RRDHOST, "STREAM %s: sent %zu charts to be replayed (%zu bytes).", host->hostname, charts, len);
+
+    buffer_free(wb);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// sender
+
+void rrdpush_replay_free(struct rrdpush_destination *d) {
+    size_t i;
+    for(i = 0; i < d->replay_entries; i++)
+        freez(d->replay[i].chart_id);
+
+    freez(d->replay);
+    d->replay = NULL;
+    d->replay_entries = 0;
+    d->replay_pending = 0;
+    d->replay_points = 0;
+}
+
+static inline void rrdpush_replay_done(RRDHOST *host, struct rrdpush_destination *d, struct rrdpush_replay *r) {
+    freez(r->chart_id);
+    r->chart_id = NULL;
+
+    if(!--d->replay_pending)
+        info("STREAM %s [send to %s]: replayed %zu points of %zu charts.", host->hostname, d->connected_to, d->replay_points, d->replay_entries);
+}
+
+static void rrdpush_replay_add(RRDHOST *host, struct rrdpush_destination *d, char *line) {
+    char *keyword = mystrsep(&line, " ");
+    char *id = mystrsep(&line, " ");
+    char *after_txt = mystrsep(&line, " ");
+
+    if(!keyword || strcmp(keyword, STREAM_REPLAY_CHART) || !id || !*id || !after_txt || !*after_txt)
+        return;
+
+    // the remote netdata has aggregated charts at a lower resolution, so they are not replayed
+    RRDSET *st = rrdset_find(host, id);
+    if(!st || !rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_SEND) || rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_AGGREGATE)) return;
+
+    time_t after = (time_t)str2l(after_txt);
+    time_t before = rrdset_last_entry_t(st);
+    if(after <= 0 || after >= before)
+        return;
+
+    d->replay = reallocz(d->replay, (d->replay_entries + 1) * sizeof(struct rrdpush_replay));
+
+    struct rrdpush_replay *r = &d->replay[d->replay_entries++];
+    r->chart_id = strdupz(st->id);
+    r->after = after;
+    r->before = before;
+
+    d->replay_pending++;
+}
+
+// receives the charts the remote netdata has, up to STREAM_REPLAY_END
+// received is what has already been received after STREAM_REPLAY_ACCEPTED
+// it runs in the connector thread, so it does not touch the host
+// returns the list, or NULL on failure
+BUFFER *rrdpush_replay_sender_receive_charts(int fd, const char *received, int timeout) {
+    BUFFER *wb = buffer_create(16384);
+    buffer_strcat(wb, received);
+
+    const char *end = "\n" STREAM_REPLAY_END "\n";
+    size_t end_len = strlen(end), searched = 0;
+    char *found;
+
+    while(!(found = strstr(&wb->buffer[searched], end))) {
+        if(wb->len > end_len) searched = wb->len - end_len;
+
+        if(unlikely(wb->len > RRDPUSH_REPLAY_MAX_LIST_SIZE)) {
+            error("STREAM: the list of charts to replay is too big.");
+            buffer_free(wb);
+            return NULL;
+        }
+
+        buffer_need_bytes(wb, 16384 + 1);
+        ssize_t ret = recv_timeout(fd, &wb->buffer[wb->len], 16384, 0, timeout);
+        if(ret <= 0) {
+            if(ret == -1 && errno == EINTR) continue;
+            buffer_free(wb);
+            return NULL;
+        }
+
+        wb->len += ret;
+        wb->buffer[wb->len] = '\0';
+    }
+
+    found[1] = '\0';
+    wb->len = found + 1 - wb->buffer;
+    return wb;
+}
+
+// takes the charts to be replayed to a destination, from the list it has received
+void rrdpush_replay_sender_add_charts(RRDHOST *host, struct rrdpush_destination *d, BUFFER *list) {
+    rrdpush_replay_free(d);
+
+    char *s = list->buffer;
+    while(s && *s) {
+        char *line = mystrsep(&s, "\n");
+        if(line && *line) rrdpush_replay_add(host, d, line);
+    }
+}
+
+// appends to wb up to about max_bytes of replayed data
+// it is called without any lock held, only when there are no live data to be sent to the destination
+void rrdpush_replay_sender_chunk(RRDHOST *host, struct rrdpush_destination *d, BUFFER *wb, size_t max_bytes) {
+    size_t len = buffer_strlen(wb), i;
+    time_t now = now_realtime_sec();
+
+    for(i = 0; i < d->replay_entries && d->replay_pending && buffer_strlen(wb) - len < max_bytes; i++) {
+        struct rrdpush_replay *r = &d->replay[i];
+        if(!r->chart_id) continue;
+
+        RRDSET *st = rrdset_find(host, r->chart_id);
+        if(unlikely(!st || st->rrd_memory_mode == RRD_MEMORY_MODE_NONE)) {
+            rrdpush_replay_done(host, d, r);
+            continue;
+        }
+
+        rrdset_rdlock(st);
+
+        // the remote netdata records the gap when it receives live data again,
+        // so wait until at least one live update of the chart has been sent
+        if(rrdset_last_entry_t(st) <= r->before + st->update_every) {
+            if(now > r->before + st->update_every + RRDPUSH_REPLAY_WAIT_SECONDS)
+                rrdpush_replay_done(host, d, r);
+
+            rrdset_unlock(st);
+            continue;
+        }
+
+        time_t first_t = r->after - (r->after % st->update_every) + st->update_every;
+        time_t oldest_t = rrdset_first_entry_t(st) + st->update_every;
+        if(first_t < oldest_t) first_t = oldest_t;
+
+        while(first_t <= r->before && buffer_strlen(wb) - len < max_bytes) {
+            size_t points = (size_t)((r->before - first_t) / st->update_every) + 1, p;
+            if(points > STREAM_REPLAY_MAX_POINTS) points = STREAM_REPLAY_MAX_POINTS;
+
+            buffer_sprintf(wb, "REPLAY_BEGIN '%s' %ld %d\n", st->id, (long)first_t, st->update_every);
+
+            RRDDIM *rd;
+            rrddim_foreach_read(rd, st) {
+                buffer_sprintf(wb, "REPLAY_SET '%s'", rd->id);
+
+                for(p = 0; p < points; p++) {
+                    time_t t = first_t + (time_t)p * st->update_every;
+                    buffer_sprintf(wb, " %u", rd->values[rrdset_time2slot(st, t)]);
+                }
+
+                buffer_strcat(wb, "\n");
+            }
+
+            first_t += (time_t)points * st->update_every;
+            d->replay_points += points;
+        }
+
+        r->after = first_t - st->update_every;
+
+        rrdset_unlock(st);
+
+        if(first_t > r->before)
+            rrdpush_replay_done(host, d, r);
+    }
+}
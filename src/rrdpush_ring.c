@@ -0,0 +1,297 @@
+#include "common.h"
+
+// ----------------------------------------------------------------------------
+// the ring buffer between the data collectors and the sender thread
+//
+// Each record starts with a header and is aligned to the size of the header,
+// so headers never wrap around the end of the ring (payloads may).
+// Producers reserve space by advancing head, copy their record and then
+// commit it, by setting its generation (which is never 0).
+// The only consumer (the sender thread) takes committed records in the order
+// they were reserved, zeroes their space and releases it by advancing tail.
+// Zeroing makes sure stale bytes are never mistaken for a committed header.
+
+struct rrdpush_ring_record {
+    uint32_t len;                       // the length of the payload that follows
+    volatile uint32_t generation;       // 0 until the record has been committed
+};
+
+#define RRDPUSH_RING_MIN_SIZE (64 * 1024)
+#define rrdpush_ring_record_size(len) ((sizeof(struct rrdpush_ring_record) + (len) + sizeof(struct rrdpush_ring_record) - 1) & ~(sizeof(struct rrdpush_ring_record) - 1))
+
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+#define RRDPUSH_RING_LOCKLESS 1
+#define rrdpush_ring_counter_add(var, value) __atomic_fetch_add(&(var), (value), __ATOMIC_RELAXED)
+#else
+#define rrdpush_ring_counter_add(var, value) (var) += (value)
+#endif
+
+struct rrdpush_ring *rrdpush_ring_create(size_t size) {
+    struct rrdpush_ring *r = callocz(1, sizeof(struct rrdpush_ring));
+
+    r->size = RRDPUSH_RING_MIN_SIZE;
+    while(r->size < size) r->size <<= 1;
+
+    r->data = callocz(1, r->size);
+
+#ifdef HAVE_SYS_EVENTFD_H
+    r->fd[0] = r->fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(r->fd[0] == -1)
+        fatal("STREAM: cannot create the eventfd of the streaming buffer.");
+#else
+    if(pipe(r->fd) == -1)
+        fatal("STREAM: cannot create the pipe of the streaming buffer.");
+
+    fcntl(r->fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(r->fd[1], F_SETFL, O_NONBLOCK);
+#endif
+
+#ifndef RRDPUSH_RING_LOCKLESS
+    pthread_mutex_init(&r->mutex, NULL);
+#endif
+
+    return r;
+}
+
+void rrdpush_ring_free(struct rrdpush_ring *r) {
+    if(!r) return;
+
+    close(r->fd[0]);
+    if(r->fd[1] != r->fd[0]) close(r->fd[1]);
+
+#ifndef RRDPUSH_RING_LOCKLESS
+    pthread_mutex_destroy(&r->mutex);
+#endif
+
+    freez(r->data);
+    freez(r);
+}
+
+static inline void rrdpush_ring_copy_in(struct rrdpush_ring *r, size_t pos, const char *data, size_t len) {
+    size_t offset = pos & (r->size - 1);
+    size_t first = r->size - offset;
+    if(first > len) first = len;
+
+    memcpy(&r->data[offset], data, first);
+    if(unlikely(first < len))
+        memcpy(r->data, &data[first], len - first);
+}
+
+static inline void rrdpush_ring_copy_out(struct rrdpush_ring *r, size_t pos, char *data, size_t len) {
+    size_t offset = pos & (r->size - 1);
+    size_t first = r->size - offset;
+    if(first > len) first = len;
+
+    memcpy(data, &r->data[offset], first);
+    if(unlikely(first < len))
+        memcpy(&data[first], r->data, len - first);
+}
+
+static inline void rrdpush_ring_zero(struct rrdpush_ring *r, size_t pos, size_t len) {
+    size_t offset = pos & (r->size - 1);
+    size_t first = r->size - offset;
+    if(first > len) first = len;
+
+    memset(&r->data[offset], 0, first);
+    if(unlikely(first < len))
+        memset(r->data, 0, len - first);
+}
+
+// wakes up the consumer, only if it has not been woken up already
+static inline void rrdpush_ring_wakeup(struct rrdpush_ring *r) {
+#ifdef RRDPUSH_RING_LOCKLESS
+    if(__atomic_exchange_n(&r->wakeup_pending, 1, __ATOMIC_SEQ_CST))
+        return;
+#else
+    if(r->wakeup_pending) return;
+    r->wakeup_pending = 1;
+#endif
+
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t one = 1;
+    if(write(r->fd[1], &one, sizeof(one)) == -1 && errno != EAGAIN)
+#else
+    if(write(r->fd[1], " ", 1) == -1 && errno != EAGAIN)
+#endif
+        error("STREAM: cannot wake up the sender thread.");
+}
+
+// queues a record of the given generation
+// returns 0 on success, -1 when the record has been dropped because the ring is full
+int rrdpush_ring_push(struct rrdpush_ring *r, const char *data, size_t len, uint32_t generation) {
+    size_t need = rrdpush_ring_record_size(len);
+
+#ifdef RRDPUSH_RING_LOCKLESS
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    do {
+        size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if(unlikely(head + need - tail > r->size)) {
+            rrdpush_ring_counter_add(r->dropped_records, 1);
+            rrdpush_ring_counter_add(r->dropped_bytes, len);
+            return -1;
+        }
+    } while(!__atomic_compare_exchange_n(&r->head, &head, head + need, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    struct rrdpush_ring_record *h = (struct rrdpush_ring_record *)&r->data[head & (r->size - 1)];
+    h->len = (uint32_t)len;
+    rrdpush_ring_copy_in(r, head + sizeof(struct rrdpush_ring_record), data, len);
+    __atomic_store_n(&h->generation, generation, __ATOMIC_RELEASE);
+#else
+    pthread_mutex_lock(&r->mutex);
+
+    size_t head = r->head;
+    if(unlikely(head + need - r->tail > r->size)) {
+        r->dropped_records++;
+        r->dropped_bytes += len;
+        pthread_mutex_unlock(&r->mutex);
+        return -1;
+    }
+    r->head = head + need;
+
+    struct rrdpush_ring_record *h = (struct rrdpush_ring_record *)&r->data[head & (r->size - 1)];
+    h->len = (uint32_t)len;
+    rrdpush_ring_copy_in(r, head + sizeof(struct rrdpush_ring_record), data, len);
+    h->generation = generation;
+#endif
+
+    rrdpush_ring_counter_add(r->records, 1);
+    rrdpush_ring_counter_add(r->bytes, len);
+
+    rrdpush_ring_wakeup(r);
+
+#ifndef RRDPUSH_RING_LOCKLESS
+    pthread_mutex_unlock(&r->mutex);
+#endif
+
+    return 0;
+}
+
+// acknowledges a wake up
+// it has to be called before rrdpush_ring_pop(), so that no wake up is lost
+void rrdpush_ring_wakeup_clear(struct rrdpush_ring *r) {
+#ifdef RRDPUSH_RING_LOCKLESS
+    __atomic_store_n(&r->wakeup_pending, 0, __ATOMIC_SEQ_CST);
+#else
+    pthread_mutex_lock(&r->mutex);
+    r->wakeup_pending = 0;
+    pthread_mutex_unlock(&r->mutex);
+#endif
+
+    char buffer[1000];
+    if(read(r->fd[0], buffer, sizeof(buffer)) == -1 && errno != EAGAIN)
+        error("STREAM: cannot read the wake ups of the sender thread.");
+}
+
+// appends to wb the committed records of the given generation, dropping the records of other generations
+// returns the number of bytes appended
+size_t rrdpush_ring_pop(struct rrdpush_ring *r, BUFFER *wb, uint32_t generation) {
+    size_t appended = 0;
+
+#ifdef RRDPUSH_RING_LOCKLESS
+    size_t tail = r->tail;
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+#else
+    pthread_mutex_lock(&r->mutex);
+    size_t tail = r->tail;
+    size_t head = r->head;
+#endif
+
+    while(tail < head) {
+        struct rrdpush_ring_record *h = (struct rrdpush_ring_record *)&r->data[tail & (r->size - 1)];
+
+#ifdef RRDPUSH_RING_LOCKLESS
+        uint32_t g = __atomic_load_n(&h->generation, __ATOMIC_ACQUIRE);
+#else
+        uint32_t g = h->generation;
+#endif
+        // the next record has not been committed yet
+        if(!g) break;
+
+        size_t len = h->len;
+        size_t size = rrdpush_ring_record_size(len);
+
+        if(likely(g == generation)) {
+            buffer_need_bytes(wb, len + 1);
+            rrdpush_ring_copy_out(r, tail + sizeof(struct rrdpush_ring_record), &wb->buffer[wb->len], len);
+            wb->len += len;
+            appended += len;
+        }
+
+        rrdpush_ring_zero(r, tail, size);
+        tail += size;
+
+#ifdef RRDPUSH_RING_LOCKLESS
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+#else
+        r->tail = tail;
+#endif
+    }
+
+#ifndef RRDPUSH_RING_LOCKLESS
+    pthread_mutex_unlock(&r->mutex);
+#endif
+
+    if(appended)
+        wb->buffer[wb->len] = '\0';
+
+    return appended;
+}
+
+// ----------------------------------------------------------------------------
+// the charts of the ring buffer of each host
+
+static void rrdpush_ring_host_charts(RRDHOST *host, struct rrdpush_ring *r) {
+    char id[RRD_ID_LENGTH_MAX + 1], title[200 + 1];
+
+    if(unlikely(!r->st_buffer)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_sent_%s_buffer", host->hostname);
+        snprintfz(title, 200, "Streaming Buffer Usage for host %s", host->hostname);
+
+        r->st_buffer = rrdset_find_bytype_localhost("netdata", id);
+        if(!r->st_buffer) {
+            r->st_buffer = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "percentage"
+                                                   , 131200, localhost->rrd_update_every, RRDSET_TYPE_AREA);
+
+            rrddim_add(r->st_buffer, "used", NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+        }
+    }
+    else rrdset_next(r->st_buffer);
+
+    size_t tail = r->tail;
+    size_t head = r->head;
+    rrddim_set(r->st_buffer, "used", (collected_number)((head > tail)?(head - tail) * 100 * 1000 / r->size:0));
+    rrdset_done(r->st_buffer);
+
+    // ------------------------------------------------------------------------
+
+    if(unlikely(!r->st_records)) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "stream_sent_%s_records", host->hostname);
+        snprintfz(title, 200, "Streaming Chart Updates for host %s", host->hostname);
+
+        r->st_records = rrdset_find_bytype_localhost("netdata", id);
+        if(!r->st_records) {
+            r->st_records = rrdset_create_localhost("netdata", id, NULL, "streaming", NULL, title, "updates/s"
+                                                    , 131201, localhost->rrd_update_every, RRDSET_TYPE_LINE);
+
+            rrddim_add(r->st_records, "queued", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+            rrddim_add(r->st_records, "dropped", NULL, -1, 1, RRD_ALGORITHM_INCREMENTAL);
+        }
+    }
+    else rrdset_next(r->st_records);
+
+    rrddim_set(r->st_records, "queued", (collected_number)r->records);
+    rrddim_set(r->st_records, "dropped", (collected_number)r->dropped_records);
+    rrdset_done(r->st_records);
+}
+
+void rrdpush_ring_charts(void) {
+    rrd_rdlock();
+
+    RRDHOST *host;
+    rrdhost_foreach_read(host) {
+        if(host->rrdpush_ring)
+            rrdpush_ring_host_charts(host, host->rrdpush_ring);
+    }
+
+    rrd_unlock();
+}
@@ -135,6 +135,38 @@ char *rrdset_strncpyz_name(char *to, const char *from, size_t length) {
     return to;
 }
 
+// ----------------------------------------------------------------------------
+// RRDSET - metadata versioning
+
+// give the chart a new metadata version, so that the cached JSON of it
+// is re-generated and clients asking for changes since an older version get it
+// it has to be called after the change has been made
+void rrdset_metadata_changed(RRDSET *st) {
+    RRDHOST *host = st->rrdhost;
+
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+    st->metadata_version = __atomic_add_fetch(&host->charts_version, 1, __ATOMIC_SEQ_CST);
+#else
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&mutex);
+    st->metadata_version = ++host->charts_version;
+    pthread_mutex_unlock(&mutex);
+#endif
+}
+
+// the enabled state is part of the metadata of the chart
+void rrdset_set_enabled(RRDSET *st, int enabled) {
+    if(!enabled == !rrdset_flag_check(st, RRDSET_FLAG_ENABLED))
+        return;
+
+    if(enabled)
+        rrdset_flag_set(st, RRDSET_FLAG_ENABLED);
+    else
+        rrdset_flag_clear(st, RRDSET_FLAG_ENABLED);
+
+    rrdset_metadata_changed(st);
+}
+
 void rrdset_set_name(RRDSET *st, const char *name) {
     if(unlikely(st->name && !strcmp(st->name, name)))
         return;
@@ -164,8 +196,14 @@ void rrdset_set_name(RRDSET *st, const char *name) {
         rrddimvar_rename_all(rd);
     rrdset_unlock(st);
 
+    // check again if it is streamed, with the new name
+    rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_SEND);
+    rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_IGNORE);
+
     if(unlikely(rrdset_index_add_name(st->rrdhost, st) != st))
         error("RRDSET: INTERNAL ERROR: attempted to index duplicate chart name '%s'", st->name);
+
+    rrdset_metadata_changed(st);
 }
 
 
@@ -251,7 +289,11 @@ void rrdset_free(RRDSET *st) {
     while(st->alarms)     rrdsetcalc_unlink(st->alarms);
     while(st->dimensions) rrddim_free(st, st->dimensions);
 
-    rrdfamily_free(st->rrdhost, st->rrdfamily);
+    rrd_stats_api_v1_chart_json_cache_free(st);
+    buffer_free(st->rrdpush_wb);
+
+    if(st->rrdfamily)
+        rrdfamily_free(st->rrdhost, st->rrdfamily);
 
     // ------------------------------------------------------------------------
     // unlink it from the host
@@ -325,6 +367,34 @@ void rrdset_delete(RRDSET *st) {
     }
 }
 
+// ----------------------------------------------------------------------------
+// RRDSET - the family and the variables of a chart
+// the host has to be write locked
+
+void rrdset_build_indexes(RRDSET *st) {
+    RRDHOST *host = st->rrdhost;
+
+    rrdset_wrlock(st);
+
+    if(likely(!st->rrdfamily)) {
+        st->rrdfamily = rrdfamily_create(host, st->family);
+
+        if(host->health_enabled) {
+            rrdsetvar_create(st, "last_collected_t", RRDVAR_TYPE_TIME_T, &st->last_collected_time.tv_sec, 0);
+            rrdsetvar_create(st, "collected_total_raw", RRDVAR_TYPE_TOTAL, &st->last_collected_total, 0);
+            rrdsetvar_create(st, "green", RRDVAR_TYPE_CALCULATED, &st->green, 0);
+            rrdsetvar_create(st, "red", RRDVAR_TYPE_CALCULATED, &st->red, 0);
+            rrdsetvar_create(st, "update_every", RRDVAR_TYPE_INT, &st->update_every, 0);
+
+            RRDDIM *rd;
+            rrddim_foreach_read(rd, st)
+                rrddim_create_variables(rd);
+        }
+    }
+
+    rrdset_unlock(st);
+}
+
 // ----------------------------------------------------------------------------
 // RRDSET - create a chart
 
@@ -359,7 +429,10 @@ RRDSET *rrdset_create(
 
     RRDSET *st = rrdset_find(host, fullid);
     if(st) {
-        rrdset_flag_clear(st, RRDSET_FLAG_OBSOLETE);
+        if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_OBSOLETE))) {
+            rrdset_flag_clear(st, RRDSET_FLAG_OBSOLETE);
+            rrdset_metadata_changed(st);
+        }
         debug(D_RRD_CALLS, "RRDSET '%s', already exists.", fullid);
         return st;
     }
@@ -418,7 +491,15 @@ RRDSET *rrdset_create(
             st->next = NULL;
             st->variables = NULL;
             st->alarms = NULL;
+            st->rrdfamily = NULL;
             st->flags = 0x00000000;
+            st->json_cache = NULL;
+            st->rrdpush_slot = 0;
+            st->rrdpush_generation = 0;
+            st->rrdpush_wb = NULL;
+            st->rrdpush_aggregated = 0;
+            st->rrdpush_aggregated_usec = 0;
+            st->backend_formatted_t = 0;
 
             if(strcmp(st->magic, RRDSET_MAGIC) != 0) {
                 errno = 0;
@@ -494,10 +575,7 @@ RRDSET *rrdset_create(
     st->hash_context = simple_hash(st->context);
 
     st->priority = config_get_number(st->config_section, "priority", priority);
-    if(enabled)
-        rrdset_flag_set(st, RRDSET_FLAG_ENABLED);
-    else
-        rrdset_flag_clear(st, RRDSET_FLAG_ENABLED);
+    rrdset_set_enabled(st, enabled);
 
     rrdset_flag_clear(st, RRDSET_FLAG_DETAIL);
     rrdset_flag_clear(st, RRDSET_FLAG_DEBUG);
@@ -536,18 +614,12 @@ RRDSET *rrdset_create(
         st->title = config_get(st->config_section, "title", varvalue2);
     }
 
-    st->rrdfamily = rrdfamily_create(host, st->family);
-
     st->next = host->rrdset_root;
     host->rrdset_root = st;
 
-    if(host->health_enabled) {
-        rrdsetvar_create(st, "last_collected_t", RRDVAR_TYPE_TIME_T, &st->last_collected_time.tv_sec, 0);
-        rrdsetvar_create(st, "collected_total_raw", RRDVAR_TYPE_TOTAL, &st->last_collected_total, 0);
-        rrdsetvar_create(st, "green", RRDVAR_TYPE_CALCULATED, &st->green, 0);
-        rrdsetvar_create(st, "red", RRDVAR_TYPE_CALCULATED, &st->red, 0);
-        rrdsetvar_create(st, "update_every", RRDVAR_TYPE_INT, &st->update_every, 0);
-    }
+    // replication only hosts build them later - see rrdhost_build_indexes()
+    if(!host->lazy_indexes)
+        rrdset_build_indexes(st);
 
     if(unlikely(rrdset_index_add(host, st) != st))
         error("RRDSET: INTERNAL ERROR: attempt to index duplicate chart '%s'", st->id);
@@ -735,6 +807,7 @@ void rrdset_done(RRDSET *st) {
     if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_OBSOLETE))) {
         error("Chart '%s' has the OBSOLETE flag set, but it is collected.", st->id);
         rrdset_flag_clear(st, RRDSET_FLAG_OBSOLETE);
+        rrdset_metadata_changed(st);
     }
 
     // check if the chart has a long time to be updated
@@ -1289,6 +1362,10 @@ void rrdset_done(RRDSET *st) {
 
     rrdset_unlock(st);
 
+    // wake up the web clients waiting for live updates of this chart
+    if(unlikely(rrdset_flag_check(st, RRDSET_FLAG_WEB_PUSH)))
+        web_push_rrdset_done(st);
+
     if(unlikely(pthread_setcancelstate(pthreadoldcancelstate, NULL) != 0))
         error("Cannot set pthread cancel state to RESTORE (%d).", pthreadoldcancelstate);
 }
@@ -229,6 +229,254 @@ int unit_test_storage()
     return r;
 }
 
+// ----------------------------------------------------------------------------
+// web API request parsing
+
+static int check_web_api_keywords(void) {
+    char options_string[] = "jsonwrap|nonzero, flip|ms|unknown|abs";
+    uint32_t options = web_client_api_request_v1_data_options(options_string);
+    uint32_t expected = RRDR_OPTION_JSON_WRAP | RRDR_OPTION_NONZERO | RRDR_OPTION_REVERSED | RRDR_OPTION_MILLISECONDS | RRDR_OPTION_ABSOLUTE;
+    if(options != expected) {
+        fprintf(stderr, "Web API options parsed as 0x%08x, expected 0x%08x.\n", options, expected);
+        return 1;
+    }
+
+    if(web_client_api_request_v1_data_group("incremental-sum", -1) != GROUP_INCREMENTAL_SUM
+       || web_client_api_request_v1_data_group("max", -1) != GROUP_MAX
+       || web_client_api_request_v1_data_group("median", -1) != -1) {
+        fprintf(stderr, "Web API group methods are not parsed correctly.\n");
+        return 1;
+    }
+
+    if(web_client_api_request_v1_data_format(DATASOURCE_FORMAT_CSV_JSON_ARRAY) != DATASOURCE_CSV_JSON_ARRAY
+       || web_client_api_request_v1_data_format("tsv-excel") != DATASOURCE_TSV
+       || web_client_api_request_v1_data_format("xml") != DATASOURCE_JSON
+       || web_client_api_request_v1_data_google_format("html") != DATASOURCE_HTML) {
+        fprintf(stderr, "Web API formats are not parsed correctly.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static struct web_api_request_test {
+    const char *url;
+    int code;
+    const char *response;
+} web_api_request_tests[] = {
+        { "data?chart=no.such.chart&after=-600&points=300&group=average&format=json&options=jsonwrap|nonzero&dimensions=user|system", 404, "Chart is not found: no.such.chart" },
+        { "data?tqx=reqId:1;out:html&chart=no.such.chart2", 404, "Chart is not found: no.such.chart2" },
+        { "data?after=-600", 400, "No chart id is given at the request." },
+        { "no.such.command?chart=system.cpu", 404, "Unsupported v1 API command: no.such.command" },
+        { "", 400, "Which API v1 command?" },
+        { NULL, 0, NULL }
+};
+
+int unit_test_web_api(void) {
+    fprintf(stderr, "\n\nChecking web API request parsing...\n");
+
+    if(check_web_api_keywords()) return 1;
+
+    struct web_client *w = callocz(1, sizeof(struct web_client));
+    w->response.data = buffer_create(1024);
+    char url[URL_MAX + 1];
+    int i, code;
+
+    for(i = 0; web_api_request_tests[i].url ; i++) {
+        strncpyz(url, web_api_request_tests[i].url, URL_MAX);
+        code = web_client_api_request_v1(localhost, w, url);
+
+        if(code != web_api_request_tests[i].code || strcmp(buffer_tostring(w->response.data), web_api_request_tests[i].response)) {
+            fprintf(stderr, "Web API request '%s' returned %d '%s', expected %d '%s'.\n"
+                    , web_api_request_tests[i].url
+                    , code, buffer_tostring(w->response.data)
+                    , web_api_request_tests[i].code, web_api_request_tests[i].response);
+
+            buffer_free(w->response.data);
+            freez(w);
+            return 1;
+        }
+
+        buffer_flush(w->response.data);
+    }
+
+    // benchmark the parsing of the requests
+    // the requests are for charts that do not exist, so nothing but the parsing is measured
+    int loop = 1000000, j;
+    struct rusage now, last;
+
+    fprintf(stderr, "Benchmarking %d web API requests, please wait...\n", loop);
+    getrusage(RUSAGE_SELF, &last);
+
+    for(j = 0; j < loop ;) {
+        for(i = 0; web_api_request_tests[i].url && j < loop ; i++, j++) {
+            strncpyz(url, web_api_request_tests[i].url, URL_MAX);
+            web_client_api_request_v1(localhost, w, url);
+            buffer_flush(w->response.data);
+        }
+    }
+
+    getrusage(RUSAGE_SELF, &now);
+    unsigned long long user   = now.ru_utime.tv_sec * 1000000ULL + now.ru_utime.tv_usec - (last.ru_utime.tv_sec * 1000000ULL + last.ru_utime.tv_usec);
+    unsigned long long system = now.ru_stime.tv_sec * 1000000ULL + now.ru_stime.tv_usec - (last.ru_stime.tv_sec * 1000000ULL + last.ru_stime.tv_usec);
+
+    fprintf(stderr, "WEB API REQUEST PARSING: user %0.5Lf, system %0.5Lf, %0.1Lf nanoseconds per request\n"
+            , (long double)(user / 1000000.0), (long double)(system / 1000000.0)
+            , (long double)((user + system) * 1000.0 / loop));
+
+    buffer_free(w->response.data);
+    freez(w);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// plugins.d parsing
+
+int unit_test_pluginsd(void) {
+    fprintf(stderr, "\n\nChecking plugins.d parsing...\n");
+
+    struct plugind cd;
+    memset(&cd, 0, sizeof(struct plugind));
+    strncpyz(cd.filename, "unittest", FILENAME_MAX);
+    strncpyz(cd.fullfilename, "unittest", FILENAME_MAX);
+    cd.update_every = 1;
+    cd.enabled = 1;
+
+    // quoted words, dimensions set out of order, and numbers in all the formats strtoll() accepts
+    char data[] =
+            "CHART unittest.pluginsd '' \"a title with spaces\" 'units' family context line 1 1\n"
+            "DIMENSION a '' absolute 1 1\n"
+            "DIMENSION b '' absolute 1 1\n"
+            "DIMENSION c '' absolute 1 1\n"
+            "DIMENSION d '' absolute 1 1\n"
+            "BEGIN unittest.pluginsd\n"
+            "SET b = -12\n"
+            "SET a = 0x10\n"
+            "SET 'c' = 010\n"
+            "SET d=+123456789012345678901\n"
+            "END\n"
+            "BEGIN unittest.pluginsd 1000000\n"
+            "SET a = 1\n"
+            "SET b = 2\n"
+            "SET c = 0\n"
+            "SET d = 4\n"
+            "END\n"
+            "BEGIN unittest.pluginsd 1000000\n"
+            "SET a = 5\n"
+            "SET c = 7\n";
+
+    struct {
+        const char *id;
+        collected_number first;
+        collected_number second;
+    } expected[] = {
+            { "a", 16, 1 },
+            { "b", -12, 2 },
+            { "c", 8, 0 },
+            { "d", LLONG_MAX, 4 },
+            { NULL, 0, 0 }
+    };
+
+    struct pluginsd_parser *p = pluginsd_parser_create(localhost, &cd, 1, 0);
+
+    // stop after the first update, to check its values
+    size_t first = strstr(data, "BEGIN unittest.pluginsd 1000000") - data;
+    ssize_t consumed = pluginsd_parser_feed(p, data, first);
+    RRDSET *st = rrdset_find_localhost("unittest.pluginsd");
+    if(consumed != (ssize_t)first || !st || strcmp(st->title, "a title with spaces (unittest.pluginsd)")) {
+        fprintf(stderr, "plugins.d chart definition is not parsed correctly.\n");
+        pluginsd_parser_free(p);
+        return 1;
+    }
+
+    int i, ret = 0;
+    for(i = 0; expected[i].id ; i++) {
+        RRDDIM *rd = rrddim_find(st, expected[i].id);
+        if(!rd || rd->last_collected_value != expected[i].first) {
+            fprintf(stderr, "plugins.d dimension '%s' has value " COLLECTED_NUMBER_FORMAT ", expected " COLLECTED_NUMBER_FORMAT ".\n", expected[i].id, rd?rd->last_collected_value:0, expected[i].first);
+            ret = 1;
+        }
+    }
+
+    // the last update is not complete, so it has to be left unprocessed
+    size_t rest = strlen(&data[first]);
+    consumed = pluginsd_parser_feed(p, &data[first], rest - 1);
+    if(consumed != (ssize_t)(rest - strlen("SET c = 7\n"))) {
+        fprintf(stderr, "plugins.d parser consumed %zd bytes of %zu, expected %zu.\n", consumed, rest - 1, rest - strlen("SET c = 7\n"));
+        ret = 1;
+    }
+
+    for(i = 0; expected[i].id ; i++) {
+        RRDDIM *rd = rrddim_find(st, expected[i].id);
+        if(!rd || rd->last_collected_value != expected[i].second) {
+            fprintf(stderr, "plugins.d dimension '%s' has value " COLLECTED_NUMBER_FORMAT ", expected " COLLECTED_NUMBER_FORMAT ".\n", expected[i].id, rd?rd->last_collected_value:0, expected[i].second);
+            ret = 1;
+        }
+    }
+
+    if(pluginsd_parser_free(p) != 2) {
+        fprintf(stderr, "plugins.d parser did not count 2 updates.\n");
+        ret = 1;
+    }
+
+    if(!ret) fprintf(stderr, "plugins.d parsing is OK.\n");
+    return ret;
+}
+
+// replays a recorded plugins.d stream (e.g. the output of a plugin, or a
+// streaming connection using the text protocol) through the parser, to time it
+int benchmark_pluginsd(const char *filename, size_t loops) {
+    struct stat stbuf;
+    if(stat(filename, &stbuf) == -1) {
+        fprintf(stderr, "Cannot stat '%s'.\n", filename);
+        return 1;
+    }
+
+    struct plugind cd;
+    memset(&cd, 0, sizeof(struct plugind));
+    strncpyz(cd.filename, "benchmark", FILENAME_MAX);
+    strncpyz(cd.fullfilename, filename, FILENAME_MAX);
+    cd.update_every = default_rrd_update_every;
+
+    fprintf(stderr, "\n\nReplaying '%s' (%zu bytes) %zu times, please wait...\n\n", filename, (size_t)stbuf.st_size, loops);
+
+    struct rusage now, last;
+    size_t i, count = 0;
+
+    getrusage(RUSAGE_SELF, &last);
+
+    for(i = 0; i < loops ;i++) {
+        FILE *fp = fopen(filename, "r");
+        if(!fp) {
+            fprintf(stderr, "Cannot open '%s'.\n", filename);
+            return 1;
+        }
+
+        cd.enabled = 1;
+        count += pluginsd_process(localhost, &cd, fp, 1);
+        fclose(fp);
+
+        if(!cd.enabled) {
+            fprintf(stderr, "The parser disabled the stream at loop %zu.\n", i);
+            return 1;
+        }
+    }
+
+    getrusage(RUSAGE_SELF, &now);
+    unsigned long long user   = now.ru_utime.tv_sec * 1000000ULL + now.ru_utime.tv_usec - (last.ru_utime.tv_sec * 1000000ULL + last.ru_utime.tv_usec);
+    unsigned long long system = now.ru_stime.tv_sec * 1000000ULL + now.ru_stime.tv_usec - (last.ru_stime.tv_sec * 1000000ULL + last.ru_stime.tv_usec);
+    unsigned long long total  = user + system;
+
+    fprintf(stderr, "user %0.5Lf, system %0.5Lf, total %0.5Lf\n", (long double)(user / 1000000.0), (long double)(system / 1000000.0), (long double)(total / 1000000.0));
+    fprintf(stderr, "%zu chart updates, %0.2Lf nanoseconds per update, %0.2Lf MB/s\n"
+            , count
+            , (long double)((count)?total * 1000.0 / count:0)
+            , (long double)((total)?(long double)stbuf.st_size * loops / total:0));
+
+    return 0;
+}
+
+
 
 // --------------------------------------------------------------------------------------------------------------------
 
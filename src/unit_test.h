@@ -2,7 +2,10 @@
 #define NETDATA_UNIT_TEST_H 1
 
 extern int unit_test_storage(void);
+extern int unit_test_web_api(void);
+extern int unit_test_pluginsd(void);
 extern int unit_test(long delay, long shift);
 extern int run_all_mockup_tests(void);
+extern int benchmark_pluginsd(const char *filename, size_t loops);
 
 #endif /* NETDATA_UNIT_TEST_H */
@@ -1,111 +1,166 @@
 #include "common.h"
 
-inline int web_client_api_request_v1_data_group(char *name, int def) {
-    if(!strcmp(name, "average"))
-        return GROUP_AVERAGE;
-
-    else if(!strcmp(name, "min"))
-        return GROUP_MIN;
-
-    else if(!strcmp(name, "max"))
-        return GROUP_MAX;
+// ----------------------------------------------------------------------------
+// keywords of the API
+//
+// The API keywords are kept in tables, together with their simple_hash(),
+// which is calculated once by web_client_api_v1_init(). So, parsing a
+// request hashes each of its keywords once and compares it with the integer
+// hashes of the table, using strcmp() only for the entry that matches.
+
+struct api_v1_keyword {
+    const char *name;
+    uint32_t hash;
+    uint32_t value;
+};
+
+static struct api_v1_keyword api_v1_data_groups[] = {
+        { "average"        , 0, GROUP_AVERAGE         },
+        { "min"            , 0, GROUP_MIN             },
+        { "max"            , 0, GROUP_MAX             },
+        { "sum"            , 0, GROUP_SUM             },
+        { "incremental-sum", 0, GROUP_INCREMENTAL_SUM },
+        { NULL             , 0, 0                     }
+};
+
+static struct api_v1_keyword api_v1_data_options[] = {
+        { "nonzero"     , 0, RRDR_OPTION_NONZERO      },
+        { "flip"        , 0, RRDR_OPTION_REVERSED     },
+        { "reversed"    , 0, RRDR_OPTION_REVERSED     },
+        { "reverse"     , 0, RRDR_OPTION_REVERSED     },
+        { "jsonwrap"    , 0, RRDR_OPTION_JSON_WRAP    },
+        { "min2max"     , 0, RRDR_OPTION_MIN2MAX      },
+        { "ms"          , 0, RRDR_OPTION_MILLISECONDS },
+        { "milliseconds", 0, RRDR_OPTION_MILLISECONDS },
+        { "abs"         , 0, RRDR_OPTION_ABSOLUTE     },
+        { "absolute"    , 0, RRDR_OPTION_ABSOLUTE     },
+        { "absolute_sum", 0, RRDR_OPTION_ABSOLUTE     },
+        { "absolute-sum", 0, RRDR_OPTION_ABSOLUTE     },
+        { "seconds"     , 0, RRDR_OPTION_SECONDS      },
+        { "null2zero"   , 0, RRDR_OPTION_NULL2ZERO    },
+        { "objectrows"  , 0, RRDR_OPTION_OBJECTSROWS  },
+        { "google_json" , 0, RRDR_OPTION_GOOGLE_JSON  },
+        { "percentage"  , 0, RRDR_OPTION_PERCENTAGE   },
+        { "unaligned"   , 0, RRDR_OPTION_NOT_ALIGNED  },
+        { NULL          , 0, 0                        }
+};
+
+static struct api_v1_keyword api_v1_data_formats[] = {
+        { DATASOURCE_FORMAT_DATATABLE_JSON , 0, DATASOURCE_DATATABLE_JSON  },
+        { DATASOURCE_FORMAT_DATATABLE_JSONP, 0, DATASOURCE_DATATABLE_JSONP },
+        { DATASOURCE_FORMAT_JSON           , 0, DATASOURCE_JSON            },
+        { DATASOURCE_FORMAT_JSONP          , 0, DATASOURCE_JSONP           },
+        { DATASOURCE_FORMAT_SSV            , 0, DATASOURCE_SSV             },
+        { DATASOURCE_FORMAT_CSV            , 0, DATASOURCE_CSV             },
+        { DATASOURCE_FORMAT_TSV            , 0, DATASOURCE_TSV             },
+        { "tsv-excel"                      , 0, DATASOURCE_TSV             },
+        { DATASOURCE_FORMAT_HTML           , 0, DATASOURCE_HTML            },
+        { DATASOURCE_FORMAT_JS_ARRAY       , 0, DATASOURCE_JS_ARRAY        },
+        { DATASOURCE_FORMAT_SSV_COMMA      , 0, DATASOURCE_SSV_COMMA       },
+        { DATASOURCE_FORMAT_CSV_JSON_ARRAY , 0, DATASOURCE_CSV_JSON_ARRAY  },
+        { NULL                             , 0, 0                          }
+};
+
+static struct api_v1_keyword api_v1_data_google_formats[] = {
+        { "json"     , 0, DATASOURCE_DATATABLE_JSONP },
+        { "html"     , 0, DATASOURCE_HTML            },
+        { "csv"      , 0, DATASOURCE_CSV             },
+        { "tsv-excel", 0, DATASOURCE_TSV             },
+        { NULL       , 0, 0                          }
+};
+
+// the parameters of /api/v1/data
+typedef enum api_v1_data_param {
+    API_V1_DATA_PARAM_UNKNOWN = 0,
+    API_V1_DATA_PARAM_CHART,
+    API_V1_DATA_PARAM_DIMENSIONS,
+    API_V1_DATA_PARAM_AFTER,
+    API_V1_DATA_PARAM_BEFORE,
+    API_V1_DATA_PARAM_POINTS,
+    API_V1_DATA_PARAM_GROUP,
+    API_V1_DATA_PARAM_FORMAT,
+    API_V1_DATA_PARAM_OPTIONS,
+    API_V1_DATA_PARAM_CALLBACK,
+    API_V1_DATA_PARAM_FILENAME,
+    API_V1_DATA_PARAM_TQX
+} API_V1_DATA_PARAM;
+
+static struct api_v1_keyword api_v1_data_params[] = {
+        { "chart"     , 0, API_V1_DATA_PARAM_CHART      },
+        { "dimension" , 0, API_V1_DATA_PARAM_DIMENSIONS },
+        { "dim"       , 0, API_V1_DATA_PARAM_DIMENSIONS },
+        { "dimensions", 0, API_V1_DATA_PARAM_DIMENSIONS },
+        { "dims"      , 0, API_V1_DATA_PARAM_DIMENSIONS },
+        { "after"     , 0, API_V1_DATA_PARAM_AFTER      },
+        { "before"    , 0, API_V1_DATA_PARAM_BEFORE     },
+        { "points"    , 0, API_V1_DATA_PARAM_POINTS     },
+        { "group"     , 0, API_V1_DATA_PARAM_GROUP      },
+        { "format"    , 0, API_V1_DATA_PARAM_FORMAT     },
+        { "options"   , 0, API_V1_DATA_PARAM_OPTIONS    },
+        { "callback"  , 0, API_V1_DATA_PARAM_CALLBACK   },
+        { "filename"  , 0, API_V1_DATA_PARAM_FILENAME   },
+        { "tqx"       , 0, API_V1_DATA_PARAM_TQX        },
+        { NULL        , 0, API_V1_DATA_PARAM_UNKNOWN    }
+};
+
+// the Google Visualization API options, given with tqx=
+typedef enum api_v1_tqx_param {
+    API_V1_TQX_PARAM_UNKNOWN = 0,
+    API_V1_TQX_PARAM_VERSION,
+    API_V1_TQX_PARAM_REQID,
+    API_V1_TQX_PARAM_SIG,
+    API_V1_TQX_PARAM_OUT,
+    API_V1_TQX_PARAM_RESPONSE_HANDLER,
+    API_V1_TQX_PARAM_OUT_FILENAME
+} API_V1_TQX_PARAM;
+
+static struct api_v1_keyword api_v1_tqx_params[] = {
+        { "version"        , 0, API_V1_TQX_PARAM_VERSION          },
+        { "reqId"          , 0, API_V1_TQX_PARAM_REQID            },
+        { "sig"            , 0, API_V1_TQX_PARAM_SIG              },
+        { "out"            , 0, API_V1_TQX_PARAM_OUT              },
+        { "responseHandler", 0, API_V1_TQX_PARAM_RESPONSE_HANDLER },
+        { "outFileName"    , 0, API_V1_TQX_PARAM_OUT_FILENAME     },
+        { NULL             , 0, API_V1_TQX_PARAM_UNKNOWN          }
+};
+
+static void api_v1_keywords_init(struct api_v1_keyword *k) {
+    for(; k->name ; k++)
+        k->hash = simple_hash(k->name);
+}
 
-    else if(!strcmp(name, "sum"))
-        return GROUP_SUM;
+static inline uint32_t api_v1_keyword_lookup(struct api_v1_keyword *k, const char *name, uint32_t def) {
+    uint32_t hash = simple_hash(name);
 
-    else if(!strcmp(name, "incremental-sum"))
-        return GROUP_INCREMENTAL_SUM;
+    for(; k->name ; k++)
+        if(unlikely(k->hash == hash && !strcmp(k->name, name)))
+            return k->value;
 
     return def;
 }
 
+inline int web_client_api_request_v1_data_group(char *name, int def) {
+    return (int)api_v1_keyword_lookup(api_v1_data_groups, name, (uint32_t)def);
+}
+
 inline uint32_t web_client_api_request_v1_data_options(char *o) {
     uint32_t ret = 0x00000000;
     char *tok;
 
     while(o && *o && (tok = mystrsep(&o, ", |"))) {
         if(!*tok) continue;
-
-        if(!strcmp(tok, "nonzero"))
-            ret |= RRDR_OPTION_NONZERO;
-        else if(!strcmp(tok, "flip") || !strcmp(tok, "reversed") || !strcmp(tok, "reverse"))
-            ret |= RRDR_OPTION_REVERSED;
-        else if(!strcmp(tok, "jsonwrap"))
-            ret |= RRDR_OPTION_JSON_WRAP;
-        else if(!strcmp(tok, "min2max"))
-            ret |= RRDR_OPTION_MIN2MAX;
-        else if(!strcmp(tok, "ms") || !strcmp(tok, "milliseconds"))
-            ret |= RRDR_OPTION_MILLISECONDS;
-        else if(!strcmp(tok, "abs") || !strcmp(tok, "absolute") || !strcmp(tok, "absolute_sum") || !strcmp(tok, "absolute-sum"))
-            ret |= RRDR_OPTION_ABSOLUTE;
-        else if(!strcmp(tok, "seconds"))
-            ret |= RRDR_OPTION_SECONDS;
-        else if(!strcmp(tok, "null2zero"))
-            ret |= RRDR_OPTION_NULL2ZERO;
-        else if(!strcmp(tok, "objectrows"))
-            ret |= RRDR_OPTION_OBJECTSROWS;
-        else if(!strcmp(tok, "google_json"))
-            ret |= RRDR_OPTION_GOOGLE_JSON;
-        else if(!strcmp(tok, "percentage"))
-            ret |= RRDR_OPTION_PERCENTAGE;
-        else if(!strcmp(tok, "unaligned"))
-            ret |= RRDR_OPTION_NOT_ALIGNED;
+        ret |= api_v1_keyword_lookup(api_v1_data_options, tok, 0);
     }
 
     return ret;
 }
 
 inline uint32_t web_client_api_request_v1_data_format(char *name) {
-    if(!strcmp(name, DATASOURCE_FORMAT_DATATABLE_JSON)) // datatable
-        return DATASOURCE_DATATABLE_JSON;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_DATATABLE_JSONP)) // datasource
-        return DATASOURCE_DATATABLE_JSONP;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_JSON)) // json
-        return DATASOURCE_JSON;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_JSONP)) // jsonp
-        return DATASOURCE_JSONP;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_SSV)) // ssv
-        return DATASOURCE_SSV;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_CSV)) // csv
-        return DATASOURCE_CSV;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_TSV) || !strcmp(name, "tsv-excel")) // tsv
-        return DATASOURCE_TSV;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_HTML)) // html
-        return DATASOURCE_HTML;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_JS_ARRAY)) // array
-        return DATASOURCE_JS_ARRAY;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_SSV_COMMA)) // ssvcomma
-        return DATASOURCE_SSV_COMMA;
-
-    else if(!strcmp(name, DATASOURCE_FORMAT_CSV_JSON_ARRAY)) // csvjsonarray
-        return DATASOURCE_CSV_JSON_ARRAY;
-
-    return DATASOURCE_JSON;
+    return api_v1_keyword_lookup(api_v1_data_formats, name, DATASOURCE_JSON);
 }
 
 inline uint32_t web_client_api_request_v1_data_google_format(char *name) {
-    if(!strcmp(name, "json"))
-        return DATASOURCE_DATATABLE_JSONP;
-
-    else if(!strcmp(name, "html"))
-        return DATASOURCE_HTML;
-
-    else if(!strcmp(name, "csv"))
-        return DATASOURCE_CSV;
-
-    else if(!strcmp(name, "tsv-excel"))
-        return DATASOURCE_TSV;
-
-    return DATASOURCE_JSON;
+    return api_v1_keyword_lookup(api_v1_data_google_formats, name, DATASOURCE_JSON);
 }
 
 
@@ -194,20 +249,130 @@ inline int web_client_api_request_single_chart(RRDHOST *host, struct web_client
 }
 
 inline int web_client_api_request_v1_alarm_variables(RRDHOST *host, struct web_client *w, char *url) {
+    rrdhost_build_indexes(host);
     return web_client_api_request_single_chart(host, w, url, health_api_v1_chart_variables2json);
 }
 
 inline int web_client_api_request_v1_charts(RRDHOST *host, struct web_client *w, char *url) {
-    (void)url;
+    size_t if_version = 0;
+    usec_t if_epoch = 0;
+
+    while(url) {
+        char *value = mystrsep(&url, "?&");
+        if(!value || !*value) continue;
+
+        char *name = mystrsep(&value, "=");
+        if(!name || !*name) continue;
+        if(!value || !*value) continue;
+
+        // return only the charts changed after this charts_version
+        if(!strcmp(name, "if-version"))
+            if_version = (size_t)strtoull(value, NULL, 0);
+
+        // the charts_epoch the charts_version came with
+        else if(!strcmp(name, "if-epoch"))
+            if_epoch = (usec_t)strtoull(value, NULL, 0);
+    }
 
     buffer_flush(w->response.data);
     w->response.data->contenttype = CT_APPLICATION_JSON;
-    rrd_stats_api_v1_charts(host, w->response.data);
+    rrd_stats_api_v1_charts(host, w->response.data, if_version, if_epoch);
     return 200;
 }
 
+// the prometheus servers remembered, at most
+// the server names come from the requests, so they have to be limited
+#define PROMETHEUS_SERVERS_MAX 1000
+
+struct prometheus_server {
+    time_t last_access;
+    char name[];
+};
+
+struct prometheus_servers_expiration {
+    time_t oldest_allowed;
+    size_t count;
+    char **names;
+};
+
+static int web_client_api_request_v1_allmetrics_prometheus_server_expired(void *entry, void *data) {
+    struct prometheus_server *ps = (struct prometheus_server *)entry;
+    struct prometheus_servers_expiration *e = (struct prometheus_servers_expiration *)data;
+
+    if(ps->last_access < e->oldest_allowed && e->count < PROMETHEUS_SERVERS_MAX)
+        e->names[e->count++] = strdupz(ps->name);
+
+    return 0;
+}
+
+// remember the last time each prometheus server scraped us
+// returns the time of its previous scrape, or 0 if this is the first one
+static inline time_t web_client_api_request_v1_allmetrics_prometheus_server(const char *server, time_t now) {
+    static DICTIONARY *servers = NULL;
+    static size_t servers_count = 0;
+    static time_t last_expiration = 0;
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_mutex_lock(&mutex);
+
+    if(unlikely(!servers))
+        servers = dictionary_create(DICTIONARY_FLAG_SINGLE_THREADED);
+
+    time_t after = 0;
+    struct prometheus_server *ps = dictionary_get(servers, server);
+    if(ps) {
+        after = ps->last_access;
+        ps->last_access = now;
+        pthread_mutex_unlock(&mutex);
+        return after;
+    }
+
+    // forget the servers that have not scraped us for longer than the database
+    // keeps (their averages would be the same as the ones of a new server)
+    if(unlikely(servers_count >= PROMETHEUS_SERVERS_MAX || now - last_expiration >= 60)) {
+        struct prometheus_servers_expiration e = {
+                .oldest_allowed = now - (time_t)localhost->rrd_update_every * localhost->rrd_history_entries,
+                .count = 0,
+                .names = mallocz(sizeof(char *) * PROMETHEUS_SERVERS_MAX)
+        };
+
+        dictionary_get_all(servers, web_client_api_request_v1_allmetrics_prometheus_server_expired, &e);
+
+        size_t i;
+        for(i = 0; i < e.count ; i++) {
+            if(dictionary_del(servers, e.names[i]) == 0)
+                servers_count--;
+
+            freez(e.names[i]);
+        }
+
+        freez(e.names);
+        last_expiration = now;
+    }
+
+    if(likely(servers_count < PROMETHEUS_SERVERS_MAX)) {
+        size_t len = strlen(server);
+        struct prometheus_server *t = mallocz(sizeof(struct prometheus_server) + len + 1);
+        t->last_access = now;
+        memcpy(t->name, server, len + 1);
+
+        dictionary_set(servers, server, t, sizeof(struct prometheus_server) + len + 1);
+        servers_count++;
+
+        freez(t);
+    }
+    else
+        debug(D_WEB_CLIENT, "Too many prometheus servers are scraping this netdata. Not remembering server '%s' - it will get the last values instead of averages.", server);
+
+    pthread_mutex_unlock(&mutex);
+
+    return after;
+}
+
 inline int web_client_api_request_v1_allmetrics(RRDHOST *host, struct web_client *w, char *url) {
     int format = ALLMETRICS_SHELL;
+    char *hosts = NULL, *server = NULL;
+    uint32_t options = PROMETHEUS_OUTPUT_TYPES;
 
     while(url) {
         char *value = mystrsep(&url, "?&");
@@ -225,6 +390,29 @@ inline int web_client_api_request_v1_allmetrics(RRDHOST *host, struct web_client
             else
                 format = 0;
         }
+        else if(!strcmp(name, "host"))
+            hosts = value;
+
+        else if(!strcmp(name, "labels")) {
+            if(!strcmp(value, "yes") || !strcmp(value, "1"))
+                options |= PROMETHEUS_OUTPUT_LABELS;
+            else
+                options &= ~PROMETHEUS_OUTPUT_LABELS;
+        }
+        else if(!strcmp(name, "types")) {
+            if(!strcmp(value, "no") || !strcmp(value, "0"))
+                options &= ~PROMETHEUS_OUTPUT_TYPES;
+            else
+                options |= PROMETHEUS_OUTPUT_TYPES;
+        }
+        else if(!strcmp(name, "data")) {
+            if(!strcmp(value, "average"))
+                options |= PROMETHEUS_OUTPUT_AVERAGE;
+            else
+                options &= ~PROMETHEUS_OUTPUT_AVERAGE;
+        }
+        else if(!strcmp(name, "server"))
+            server = value;
     }
 
     buffer_flush(w->response.data);
@@ -236,10 +424,31 @@ inline int web_client_api_request_v1_allmetrics(RRDHOST *host, struct web_client
             rrd_stats_api_v1_charts_allmetrics_shell(host, w->response.data);
             return 200;
 
-        case ALLMETRICS_PROMETHEUS:
+        case ALLMETRICS_PROMETHEUS: {
             w->response.data->contenttype = CT_PROMETHEUS;
-            rrd_stats_api_v1_charts_allmetrics_prometheus(host, w->response.data);
+
+            // averages are calculated since the previous scrape of the same server
+            time_t after = 0;
+            if(options & PROMETHEUS_OUTPUT_AVERAGE)
+                after = web_client_api_request_v1_allmetrics_prometheus_server((server && *server)?server:w->client_ip, now_realtime_sec());
+
+            if(hosts) {
+                rrd_stats_api_v1_charts_allmetrics_prometheus_hosts(hosts, w->response.data, options, after);
+                return 200;
+            }
+
+#ifdef NETDATA_WITH_ZLIB
+            // give the client the cached compressed copy, instead of compressing it again
+            if(w->response.zaccept && rrd_stats_api_v1_charts_allmetrics_prometheus_gzip(host, w->response.data, options, web_gzip_level)) {
+                buffer_strcat(w->response.header, "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n");
+                w->response.zaccept = 0;
+                return 200;
+            }
+#endif
+
+            rrd_stats_api_v1_charts_allmetrics_prometheus(host, w->response.data, options, after);
             return 200;
+        }
 
         default:
             w->response.data->contenttype = CT_TEXT_PLAIN;
@@ -252,6 +461,20 @@ inline int web_client_api_request_v1_chart(RRDHOST *host, struct web_client *w,
     return web_client_api_request_single_chart(host, w, url, rrd_stats_api_v1_chart);
 }
 
+// remember the data query of the request, for the slow queries log
+static inline void web_client_api_request_v1_query(struct web_client *w, RRDSET *st, long long after, long long before, long points, int group, size_t rows_scanned) {
+    if(!w->query.charts) {
+        strncpyz(w->query.chart, st->id, RRD_ID_LENGTH_MAX);
+        w->query.after = after;
+        w->query.before = before;
+        w->query.points = points;
+        w->query.group = group;
+    }
+
+    w->query.charts++;
+    w->query.rows_scanned += rows_scanned;
+}
+
 int web_client_api_request_v1_badge(RRDHOST *host, struct web_client *w, char *url) {
     int ret = 400;
     buffer_flush(w->response.data);
@@ -275,6 +498,11 @@ int web_client_api_request_v1_badge(RRDHOST *host, struct web_client *w, char *u
     int group = GROUP_AVERAGE;
     uint32_t options = 0x00000000;
 
+    // the badges cache is keyed by the host and the query string,
+    // so it has to be copied before we parse it
+    char key[GUID_LEN + 1 + URL_MAX + 1];
+    snprintfz(key, GUID_LEN + 1 + URL_MAX, "%s/%s", host->machine_guid, (url)?url:"");
+
     while(url) {
         char *value = mystrsep(&url, "/?&");
         if(!value || !*value) continue;
@@ -343,6 +571,34 @@ int web_client_api_request_v1_badge(RRDHOST *host, struct web_client *w, char *u
         }
     }
 
+    // the version of the data the badge is rendered from
+    usec_t version;
+    uint32_t version_flags;
+    if(rc) {
+        version = (usec_t)rc->last_updated;
+        version_flags = (uint32_t)rc->status;
+    }
+    else {
+        version = st->last_updated.tv_sec * USEC_PER_SEC + st->last_updated.tv_usec;
+
+        // if the collected value is too old, don't calculate its value
+        version_flags = (rrdset_last_entry_t(st) >= (now_realtime_sec() - (st->update_every * st->gap_when_lost_iterations_above)))?1:0;
+    }
+
+    int refresh = 0;
+    if(badges_cache_get(w->response.data, key, version, version_flags, &refresh)) {
+        debug(D_WEB_CLIENT, "%llu: API command 'badge.svg' served from the badges cache.", w->id);
+
+        if(refresh > 0) {
+            buffer_sprintf(w->response.header, "Refresh: %d\r\n", refresh);
+            w->response.data->expires = now_realtime_sec() + refresh;
+        }
+        else buffer_no_cacheable(w->response.data);
+
+        ret = 200;
+        goto cleanup;
+    }
+
     long long multiply  = (multiply_str  && *multiply_str )?str2l(multiply_str):1;
     long long divide    = (divide_str    && *divide_str   )?str2l(divide_str):1;
     long long before    = (before_str    && *before_str   )?str2l(before_str):0;
@@ -353,7 +609,6 @@ int web_client_api_request_v1_badge(RRDHOST *host, struct web_client *w, char *u
     if(!multiply) multiply = 1;
     if(!divide) divide = 1;
 
-    int refresh = 0;
     if(refresh_str && *refresh_str) {
         if(!strcmp(refresh_str, "auto")) {
             if(rc) refresh = rc->update_every;
@@ -462,10 +717,13 @@ int web_client_api_request_v1_badge(RRDHOST *host, struct web_client *w, char *u
         calculated_number n = NAN;
         ret = 500;
 
-        // if the collected value is too old, don't calculate its value
-        if (rrdset_last_entry_t(st) >= (now_realtime_sec() - (st->update_every * st->gap_when_lost_iterations_above)))
+        if (version_flags) {
+            size_t rows_scanned = 0;
             ret = rrdset2value_api_v1(st, w->response.data, &n, (dimensions) ? buffer_tostring(dimensions) : NULL
-                                      , points, after, before, group, options, NULL, &latest_timestamp, &value_is_null);
+                                      , points, after, before, group, options, NULL, &latest_timestamp, &value_is_null
+                                      , &rows_scanned);
+            web_client_api_request_v1_query(w, st, after, before, points, group, rows_scanned);
+        }
 
         // if the value cannot be calculated, show empty badge
         if (ret != 200) {
@@ -490,6 +748,8 @@ int web_client_api_request_v1_badge(RRDHOST *host, struct web_client *w, char *u
                 precision);
     }
 
+    badges_cache_set(w->response.data, key, version, version_flags, (w->response.data->options & WB_CONTENT_NO_CACHEABLE)?0:refresh);
+
     cleanup:
     buffer_free(dimensions);
     return ret;
@@ -535,59 +795,91 @@ inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, c
         // name and value are now the parameters
         // they are not null and not empty
 
-        if(!strcmp(name, "chart")) chart = value;
-        else if(!strcmp(name, "dimension") || !strcmp(name, "dim") || !strcmp(name, "dimensions") || !strcmp(name, "dims")) {
-            if(!dimensions) dimensions = buffer_create(100);
-            buffer_strcat(dimensions, "|");
-            buffer_strcat(dimensions, value);
-        }
-        else if(!strcmp(name, "after")) after_str = value;
-        else if(!strcmp(name, "before")) before_str = value;
-        else if(!strcmp(name, "points")) points_str = value;
-        else if(!strcmp(name, "group")) {
-            group = web_client_api_request_v1_data_group(value, GROUP_AVERAGE);
-        }
-        else if(!strcmp(name, "format")) {
-            format = web_client_api_request_v1_data_format(value);
-        }
-        else if(!strcmp(name, "options")) {
-            options |= web_client_api_request_v1_data_options(value);
-        }
-        else if(!strcmp(name, "callback")) {
-            responseHandler = value;
-        }
-        else if(!strcmp(name, "filename")) {
-            outFileName = value;
-        }
-        else if(!strcmp(name, "tqx")) {
-            // parse Google Visualization API options
-            // https://developers.google.com/chart/interactive/docs/dev/implementing_data_source
-            char *tqx_name, *tqx_value;
-
-            while(value) {
-                tqx_value = mystrsep(&value, ";");
-                if(!tqx_value || !*tqx_value) continue;
-
-                tqx_name = mystrsep(&tqx_value, ":");
-                if(!tqx_name || !*tqx_name) continue;
-                if(!tqx_value || !*tqx_value) continue;
-
-                if(!strcmp(tqx_name, "version"))
-                    google_version = tqx_value;
-                else if(!strcmp(tqx_name, "reqId"))
-                    google_reqId = tqx_value;
-                else if(!strcmp(tqx_name, "sig")) {
-                    google_sig = tqx_value;
-                    google_timestamp = strtoul(google_sig, NULL, 0);
+        switch(api_v1_keyword_lookup(api_v1_data_params, name, API_V1_DATA_PARAM_UNKNOWN)) {
+            case API_V1_DATA_PARAM_CHART:
+                chart = value;
+                break;
+
+            case API_V1_DATA_PARAM_DIMENSIONS:
+                if(!dimensions) dimensions = buffer_create(100);
+                buffer_strcat(dimensions, "|");
+                buffer_strcat(dimensions, value);
+                break;
+
+            case API_V1_DATA_PARAM_AFTER:
+                after_str = value;
+                break;
+
+            case API_V1_DATA_PARAM_BEFORE:
+                before_str = value;
+                break;
+
+            case API_V1_DATA_PARAM_POINTS:
+                points_str = value;
+                break;
+
+            case API_V1_DATA_PARAM_GROUP:
+                group = web_client_api_request_v1_data_group(value, GROUP_AVERAGE);
+                break;
+
+            case API_V1_DATA_PARAM_FORMAT:
+                format = web_client_api_request_v1_data_format(value);
+                break;
+
+            case API_V1_DATA_PARAM_OPTIONS:
+                options |= web_client_api_request_v1_data_options(value);
+                break;
+
+            case API_V1_DATA_PARAM_CALLBACK:
+                responseHandler = value;
+                break;
+
+            case API_V1_DATA_PARAM_FILENAME:
+                outFileName = value;
+                break;
+
+            case API_V1_DATA_PARAM_TQX: {
+                // parse Google Visualization API options
+                // https://developers.google.com/chart/interactive/docs/dev/implementing_data_source
+                char *tqx_name, *tqx_value;
+
+                while(value) {
+                    tqx_value = mystrsep(&value, ";");
+                    if(!tqx_value || !*tqx_value) continue;
+
+                    tqx_name = mystrsep(&tqx_value, ":");
+                    if(!tqx_name || !*tqx_name) continue;
+                    if(!tqx_value || !*tqx_value) continue;
+
+                    switch(api_v1_keyword_lookup(api_v1_tqx_params, tqx_name, API_V1_TQX_PARAM_UNKNOWN)) {
+                        case API_V1_TQX_PARAM_VERSION:
+                            google_version = tqx_value;
+                            break;
+
+                        case API_V1_TQX_PARAM_REQID:
+                            google_reqId = tqx_value;
+                            break;
+
+                        case API_V1_TQX_PARAM_SIG:
+                            google_sig = tqx_value;
+                            google_timestamp = strtoul(google_sig, NULL, 0);
+                            break;
+
+                        case API_V1_TQX_PARAM_OUT:
+                            google_out = tqx_value;
+                            format = web_client_api_request_v1_data_google_format(google_out);
+                            break;
+
+                        case API_V1_TQX_PARAM_RESPONSE_HANDLER:
+                            responseHandler = tqx_value;
+                            break;
+
+                        case API_V1_TQX_PARAM_OUT_FILENAME:
+                            outFileName = tqx_value;
+                            break;
+                    }
                 }
-                else if(!strcmp(tqx_name, "out")) {
-                    google_out = tqx_value;
-                    format = web_client_api_request_v1_data_google_format(google_out);
-                }
-                else if(!strcmp(tqx_name, "responseHandler"))
-                    responseHandler = tqx_value;
-                else if(!strcmp(tqx_name, "outFileName"))
-                    outFileName = tqx_value;
+                break;
             }
         }
     }
@@ -648,8 +940,10 @@ inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, c
         buffer_strcat(w->response.data, "(");
     }
 
+    size_t rows_scanned = 0;
     ret = rrdset2anything_api_v1(st, w->response.data, dimensions, format, points, after, before, group, options
-                                 , &last_timestamp_in_data);
+                                 , &last_timestamp_in_data, &rows_scanned);
+    web_client_api_request_v1_query(w, st, after, before, points, group, rows_scanned);
 
     if(format == DATASOURCE_DATATABLE_JSONP) {
         if(google_timestamp < last_timestamp_in_data)
@@ -671,6 +965,197 @@ inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, c
     return ret;
 }
 
+// ----------------------------------------------------------------------------
+// batch of data queries
+
+// /api/v1/batch?after=-60&chart=system.cpu&points=60&chart=system.load&dimension=load1
+// each chart= starts a new query, all the parameters following it belong to it
+// parameters given before the first chart= are the defaults of all queries
+// results are returned in the order of the queries, in a single JSON response
+
+struct api_v1_batch_query {
+    char *chart;
+    BUFFER *dimensions;
+
+    char *before_str;
+    char *after_str;
+    char *points_str;
+
+    int group;
+    uint32_t format;
+    uint32_t options;
+};
+
+static void web_client_api_request_v1_batch_execute(RRDHOST *host, struct web_client *w, struct api_v1_batch_query *q, BUFFER *tmp, size_t count) {
+    char chart[RRD_ID_LENGTH_MAX * 2 + 1];
+    json_escape_string(chart, q->chart, sizeof(chart));
+
+    buffer_sprintf(w->response.data, "%s\n\t\t{\n\t\t\t\"chart\": \"%s\",\n", (count)?",":"", chart);
+
+    int ret = 404;
+    RRDSET *st = rrdset_find(host, q->chart);
+    if(!st) st = rrdset_find_byname(host, q->chart);
+    if(st) {
+        long long before = (q->before_str && *q->before_str)?str2l(q->before_str):0;
+        long long after  = (q->after_str  && *q->after_str) ?str2l(q->after_str):0;
+        int       points = (q->points_str && *q->points_str)?str2i(q->points_str):0;
+
+        size_t rows_scanned = 0;
+        buffer_reset(tmp);
+        ret = rrdset2anything_api_v1(st, tmp, q->dimensions, q->format, points, after, before, q->group, q->options, NULL, &rows_scanned);
+        web_client_api_request_v1_query(w, st, after, before, points, q->group, rows_scanned);
+
+        // only JSON results can be embedded in the response
+        if(ret == 200 && tmp->contenttype != CT_APPLICATION_JSON)
+            ret = 400;
+
+        // if any of the results is relative to now, the whole response is
+        if(tmp->options & WB_CONTENT_NO_CACHEABLE)
+            buffer_no_cacheable(w->response.data);
+    }
+
+    buffer_sprintf(w->response.data, "\t\t\t\"status\": %d,\n\t\t\t\"result\": ", ret);
+    if(ret == 200)
+        buffer_strcat(w->response.data, buffer_tostring(tmp));
+    else
+        buffer_strcat(w->response.data, "null");
+    buffer_strcat(w->response.data, "\n\t\t}");
+
+    debug(D_WEB_CLIENT, "%llu: API v1 batch query %zu for chart '%s' returned %d", w->id, count, q->chart, ret);
+}
+
+inline int web_client_api_request_v1_batch(RRDHOST *host, struct web_client *w, char *url) {
+    debug(D_WEB_CLIENT, "%llu: API v1 batch with URL '%s'", w->id, url);
+
+    struct api_v1_batch_query defaults = {
+            .chart = NULL,
+            .dimensions = NULL,
+            .before_str = NULL,
+            .after_str = NULL,
+            .points_str = NULL,
+            .group = GROUP_AVERAGE,
+            .format = DATASOURCE_JSON,
+            .options = 0x00000000
+    }, q = defaults;
+
+    BUFFER *dimensions = buffer_create(100);
+    BUFFER *tmp = buffer_create(16384);
+    size_t count = 0;
+
+    buffer_flush(w->response.data);
+    w->response.data->contenttype = CT_APPLICATION_JSON;
+    buffer_cacheable(w->response.data);
+    buffer_strcat(w->response.data, "{\n\t\"api\": 1,\n\t\"results\": [");
+
+    while(url) {
+        char *value = mystrsep(&url, "?&");
+        if(!value || !*value) continue;
+
+        char *name = mystrsep(&value, "=");
+        if(!name || !*name) continue;
+        if(!value || !*value) continue;
+
+        // the parameters before the first chart are the defaults
+        struct api_v1_batch_query *p = (q.chart)?&q:&defaults;
+
+        // the parameters are the ones of /api/v1/data
+        switch(api_v1_keyword_lookup(api_v1_data_params, name, API_V1_DATA_PARAM_UNKNOWN)) {
+            case API_V1_DATA_PARAM_CHART:
+                if(q.chart)
+                    web_client_api_request_v1_batch_execute(host, w, &q, tmp, count++);
+
+                q = defaults;
+                q.chart = value;
+                buffer_flush(dimensions);
+                break;
+
+            case API_V1_DATA_PARAM_DIMENSIONS:
+                // dimensions are specific to each chart, so they cannot be defaults
+                if(!q.chart) break;
+
+                buffer_strcat(dimensions, "|");
+                buffer_strcat(dimensions, value);
+                q.dimensions = dimensions;
+                break;
+
+            case API_V1_DATA_PARAM_AFTER:
+                p->after_str = value;
+                break;
+
+            case API_V1_DATA_PARAM_BEFORE:
+                p->before_str = value;
+                break;
+
+            case API_V1_DATA_PARAM_POINTS:
+                p->points_str = value;
+                break;
+
+            case API_V1_DATA_PARAM_GROUP:
+                p->group = web_client_api_request_v1_data_group(value, GROUP_AVERAGE);
+                break;
+
+            case API_V1_DATA_PARAM_FORMAT:
+                p->format = web_client_api_request_v1_data_format(value);
+                break;
+
+            case API_V1_DATA_PARAM_OPTIONS:
+                p->options |= web_client_api_request_v1_data_options(value);
+                break;
+
+            default:
+                // callback, filename and tqx do not apply to a batch
+                break;
+        }
+    }
+
+    int ret = 200;
+    if(q.chart)
+        web_client_api_request_v1_batch_execute(host, w, &q, tmp, count++);
+
+    if(!count) {
+        buffer_flush(w->response.data);
+        w->response.data->contenttype = CT_TEXT_PLAIN;
+        buffer_strcat(w->response.data, "No chart id is given at the request.");
+        ret = 400;
+    }
+    else
+        buffer_sprintf(w->response.data, "\n\t],\n\t\"queries\": %zu\n}\n", count);
+
+    buffer_free(tmp);
+    buffer_free(dimensions);
+    return ret;
+}
+
+// ----------------------------------------------------------------------------
+// live updates
+
+// /api/v1/subscribe?chart=system.cpu&chart=system.load
+// the connection is kept open and the new rows of the charts are pushed to it
+
+inline int web_client_api_request_v1_subscribe(RRDHOST *host, struct web_client *w, char *url) {
+    debug(D_WEB_CLIENT, "%llu: API v1 subscribe with URL '%s'", w->id, url);
+
+    char *charts[WEB_PUSH_MAX_CHARTS + 1];
+    size_t count = 0;
+
+    while(url) {
+        char *value = mystrsep(&url, "?&");
+        if(!value || !*value) continue;
+
+        char *name = mystrsep(&value, "=");
+        if(!name || !*name) continue;
+        if(!value || !*value) continue;
+
+        if(!strcmp(name, "chart")) {
+            // one more than the maximum, to let web_push_subscribe() complain
+            if(count <= WEB_PUSH_MAX_CHARTS)
+                charts[count++] = value;
+        }
+    }
+
+    return web_push_subscribe(host, w, charts, count);
+}
+
 inline int web_client_api_request_v1_registry(RRDHOST *host, struct web_client *w, char *url) {
     static uint32_t hash_action = 0, hash_access = 0, hash_hello = 0, hash_delete = 0, hash_search = 0,
             hash_switch = 0, hash_machine = 0, hash_url = 0, hash_name = 0, hash_delete_url = 0, hash_for = 0,
@@ -833,60 +1318,57 @@ inline int web_client_api_request_v1_registry(RRDHOST *host, struct web_client *
     }
 }
 
-inline int web_client_api_request_v1(RRDHOST *host, struct web_client *w, char *url) {
-    static uint32_t hash_data = 0, hash_chart = 0, hash_charts = 0, hash_registry = 0, hash_badge = 0, hash_alarms = 0, hash_alarm_log = 0, hash_alarm_variables = 0, hash_raw = 0;
-
-    if(unlikely(hash_data == 0)) {
-        hash_data = simple_hash("data");
-        hash_chart = simple_hash("chart");
-        hash_charts = simple_hash("charts");
-        hash_registry = simple_hash("registry");
-        hash_badge = simple_hash("badge.svg");
-        hash_alarms = simple_hash("alarms");
-        hash_alarm_log = simple_hash("alarm_log");
-        hash_alarm_variables = simple_hash("alarm_variables");
-        hash_raw = simple_hash("allmetrics");
-    }
+static struct api_command {
+    const char *command;
+    uint32_t hash;
+    WEB_ENDPOINT endpoint;
+    int (*callback)(RRDHOST *host, struct web_client *w, char *url);
+} api_commands[] = {
+        { "data"           , 0, WEB_ENDPOINT_DATA      , web_client_api_request_v1_data            },
+        { "chart"          , 0, WEB_ENDPOINT_CHARTS    , web_client_api_request_v1_chart           },
+        { "charts"         , 0, WEB_ENDPOINT_CHARTS    , web_client_api_request_v1_charts          },
+        { "registry"       , 0, WEB_ENDPOINT_REGISTRY  , web_client_api_request_v1_registry        },
+        { "badge.svg"      , 0, WEB_ENDPOINT_BADGE     , web_client_api_request_v1_badge           },
+        { "alarms"         , 0, WEB_ENDPOINT_OTHER     , web_client_api_request_v1_alarms          },
+        { "alarm_log"      , 0, WEB_ENDPOINT_OTHER     , web_client_api_request_v1_alarm_log       },
+        { "alarm_variables", 0, WEB_ENDPOINT_OTHER     , web_client_api_request_v1_alarm_variables },
+        { "allmetrics"     , 0, WEB_ENDPOINT_ALLMETRICS, web_client_api_request_v1_allmetrics      },
+        { "batch"          , 0, WEB_ENDPOINT_DATA      , web_client_api_request_v1_batch           },
+        { "subscribe"      , 0, WEB_ENDPOINT_OTHER     , web_client_api_request_v1_subscribe       },
+        { NULL             , 0, WEB_ENDPOINT_OTHER     , NULL                                      }
+};
+
+void web_client_api_v1_init(void) {
+    int i;
+    for(i = 0; api_commands[i].command ; i++)
+        api_commands[i].hash = simple_hash(api_commands[i].command);
+
+    api_v1_keywords_init(api_v1_data_groups);
+    api_v1_keywords_init(api_v1_data_options);
+    api_v1_keywords_init(api_v1_data_formats);
+    api_v1_keywords_init(api_v1_data_google_formats);
+    api_v1_keywords_init(api_v1_data_params);
+    api_v1_keywords_init(api_v1_tqx_params);
+}
 
+inline int web_client_api_request_v1(RRDHOST *host, struct web_client *w, char *url) {
     // get the command
     char *tok = mystrsep(&url, "/?&");
     if(tok && *tok) {
         debug(D_WEB_CLIENT, "%llu: Searching for API v1 command '%s'.", w->id, tok);
         uint32_t hash = simple_hash(tok);
 
-        if(hash == hash_data && !strcmp(tok, "data"))
-            return web_client_api_request_v1_data(host, w, url);
-
-        else if(hash == hash_chart && !strcmp(tok, "chart"))
-            return web_client_api_request_v1_chart(host, w, url);
-
-        else if(hash == hash_charts && !strcmp(tok, "charts"))
-            return web_client_api_request_v1_charts(host, w, url);
-
-        else if(hash == hash_registry && !strcmp(tok, "registry"))
-            return web_client_api_request_v1_registry(host, w, url);
-
-        else if(hash == hash_badge && !strcmp(tok, "badge.svg"))
-            return web_client_api_request_v1_badge(host, w, url);
-
-        else if(hash == hash_alarms && !strcmp(tok, "alarms"))
-            return web_client_api_request_v1_alarms(host, w, url);
-
-        else if(hash == hash_alarm_log && !strcmp(tok, "alarm_log"))
-            return web_client_api_request_v1_alarm_log(host, w, url);
-
-        else if(hash == hash_alarm_variables && !strcmp(tok, "alarm_variables"))
-            return web_client_api_request_v1_alarm_variables(host, w, url);
-
-        else if(hash == hash_raw && !strcmp(tok, "allmetrics"))
-            return web_client_api_request_v1_allmetrics(host, w, url);
+        int i;
+        for(i = 0; api_commands[i].command ; i++)
+            if(unlikely(hash == api_commands[i].hash && !strcmp(tok, api_commands[i].command))) {
+                w->endpoint = api_commands[i].endpoint;
+                return api_commands[i].callback(host, w, url);
+            }
 
-        else {
-            buffer_flush(w->response.data);
-            buffer_strcat(w->response.data, "Unsupported v1 API command: ");
-            buffer_strcat_htmlescape(w->response.data, tok);
-            return 404;
-        }
+        buffer_flush(w->response.data);
+        buffer_strcat(w->response.data, "Unsupported v1 API command: ");
+        buffer_strcat_htmlescape(w->response.data, tok);
+        return 404;
     }
     else {
         buffer_flush(w->response.data);
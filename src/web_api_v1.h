@@ -1,6 +1,8 @@
 #ifndef NETDATA_WEB_API_V1_H
 #define NETDATA_WEB_API_V1_H
 
+extern void web_client_api_v1_init(void);
+
 extern int web_client_api_request_v1_data_group(char *name, int def);
 extern uint32_t web_client_api_request_v1_data_options(char *o);
 extern uint32_t web_client_api_request_v1_data_format(char *name);
@@ -15,6 +17,8 @@ extern int web_client_api_request_v1_allmetrics(RRDHOST *host, struct web_client
 extern int web_client_api_request_v1_chart(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1_badge(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, char *url);
+extern int web_client_api_request_v1_batch(RRDHOST *host, struct web_client *w, char *url);
+extern int web_client_api_request_v1_subscribe(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1_registry(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1(RRDHOST *host, struct web_client *w, char *url);
 
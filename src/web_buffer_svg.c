@@ -268,18 +268,36 @@ double verdana11_widths[256] = {
     [255] = 0.0
 };
 
+// the widths of verdana11_widths[], in fixed point, with the kerning added
+// they are calculated once, by buffer_svg_init()
+#define VERDANA_FIXED_POINT 65536
+#define VERDANA_KERNING_FIXED ((long)(VERDANA_KERNING * VERDANA_FIXED_POINT + 0.5))
+#define VERDANA_PADDING_FIXED ((long)(VERDANA_PADDING * VERDANA_FIXED_POINT + 0.5))
+
+static long verdana11_widths_fixed[256];
+
+static void verdana11_widths_init(void) {
+    int i;
+    for(i = 0; i < 256 ; i++) {
+        if(verdana11_widths[i] == 0.0)
+            verdana11_widths_fixed[i] = 0;
+        else
+            verdana11_widths_fixed[i] = (long)(verdana11_widths[i] * VERDANA_FIXED_POINT + 0.5) + VERDANA_KERNING_FIXED;
+    }
+}
+
 // find the width of the string using the verdana 11points font
 // re-write the string in place, skiping zero-length characters
 static inline int verdana11_width(char *s) {
-    double w = 0.0;
+    long w = 0;
     char *d = s;
 
     while(*s) {
-        double t = verdana11_widths[(unsigned char)*s];
-        if(t == 0.0)
+        long t = verdana11_widths_fixed[(unsigned char)*s];
+        if(t == 0)
             s++;
         else {
-            w += t + VERDANA_KERNING;
+            w += t;
             if(d != s)
                 *d++ = *s++;
             else
@@ -288,9 +306,9 @@ static inline int verdana11_width(char *s) {
     }
 
     *d = '\0';
-    w -= VERDANA_KERNING;
-    w += VERDANA_PADDING;
-    return (int)ceil(w);
+    w -= VERDANA_KERNING_FIXED;
+    w += VERDANA_PADDING_FIXED;
+    return (int)((w + VERDANA_FIXED_POINT - 1) / VERDANA_FIXED_POINT);
 }
 
 static inline size_t escape_xmlz(char *dst, const char *src, size_t len) {
@@ -723,6 +741,9 @@ static inline void calc_colorz(const char *color, char *final, size_t len, calcu
 // colors
 #define COLOR_STRING_SIZE 100
 
+// the static part of the svg template
+#define BADGE_SVG_TEMPLATE_SIZE 1024
+
 void buffer_svg(BUFFER *wb, const char *label, calculated_number value, const char *units, const char *label_color, const char *value_color, int precision) {
     char      label_buffer[LABEL_STRING_SIZE + 1]
             , value_color_buffer[COLOR_STRING_SIZE + 1]
@@ -759,33 +780,158 @@ void buffer_svg(BUFFER *wb, const char *label, calculated_number value, const ch
 
     // svg template from:
     // https://raw.githubusercontent.com/badges/shields/master/templates/flat-template.svg
-    buffer_sprintf(wb,
-        "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" width=\"%d\" height=\"20\">"
-            "<linearGradient id=\"smooth\" x2=\"0\" y2=\"100%%\">"
+    // it is split at the variable parts, so that no format string is parsed per badge
+    buffer_need_bytes(wb, BADGE_SVG_TEMPLATE_SIZE + strlen(label_escaped) * 2 + strlen(value_escaped) * 2
+                          + strlen(label_color_escaped) + strlen(value_color_escaped) + 100);
+
+    buffer_strcat(wb, "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" width=\"");
+    buffer_print_llu(wb, (unsigned long long)total_width);
+    buffer_strcat(wb, "\" height=\"20\">"
+            "<linearGradient id=\"smooth\" x2=\"0\" y2=\"100%\">"
                 "<stop offset=\"0\" stop-color=\"#bbb\" stop-opacity=\".1\"/>"
                 "<stop offset=\"1\" stop-opacity=\".1\"/>"
             "</linearGradient>"
             "<mask id=\"round\">"
-                "<rect width=\"%d\" height=\"20\" rx=\"3\" fill=\"#fff\"/>"
+                "<rect width=\"");
+    buffer_print_llu(wb, (unsigned long long)total_width);
+    buffer_strcat(wb, "\" height=\"20\" rx=\"3\" fill=\"#fff\"/>"
             "</mask>"
             "<g mask=\"url(#round)\">"
-                "<rect width=\"%d\" height=\"20\" fill=\"%s\"/>"
-                "<rect x=\"%d\" width=\"%d\" height=\"20\" fill=\"%s\"/>"
-                "<rect width=\"%d\" height=\"20\" fill=\"url(#smooth)\"/>"
+                "<rect width=\"");
+    buffer_print_llu(wb, (unsigned long long)label_width);
+    buffer_strcat(wb, "\" height=\"20\" fill=\"");
+    buffer_strcat(wb, label_color_escaped);
+    buffer_strcat(wb, "\"/><rect x=\"");
+    buffer_print_llu(wb, (unsigned long long)label_width);
+    buffer_strcat(wb, "\" width=\"");
+    buffer_print_llu(wb, (unsigned long long)value_width);
+    buffer_strcat(wb, "\" height=\"20\" fill=\"");
+    buffer_strcat(wb, value_color_escaped);
+    buffer_strcat(wb, "\"/><rect width=\"");
+    buffer_print_llu(wb, (unsigned long long)total_width);
+    buffer_strcat(wb, "\" height=\"20\" fill=\"url(#smooth)\"/>"
             "</g>"
             "<g fill=\"#fff\" text-anchor=\"middle\" font-family=\"DejaVu Sans,Verdana,Geneva,sans-serif\" font-size=\"11\">"
-                "<text x=\"%d\" y=\"15\" fill=\"#010101\" fill-opacity=\".3\">%s</text>"
-                "<text x=\"%d\" y=\"14\">%s</text>"
-                "<text x=\"%d\" y=\"15\" fill=\"#010101\" fill-opacity=\".3\">%s</text>"
-                "<text x=\"%d\" y=\"14\">%s</text>"
+                "<text x=\"");
+    buffer_print_llu(wb, (unsigned long long)(label_width / 2));
+    buffer_strcat(wb, "\" y=\"15\" fill=\"#010101\" fill-opacity=\".3\">");
+    buffer_strcat(wb, label_escaped);
+    buffer_strcat(wb, "</text><text x=\"");
+    buffer_print_llu(wb, (unsigned long long)(label_width / 2));
+    buffer_strcat(wb, "\" y=\"14\">");
+    buffer_strcat(wb, label_escaped);
+    buffer_strcat(wb, "</text><text x=\"");
+    buffer_print_llu(wb, (unsigned long long)(label_width + value_width / 2 - 1));
+    buffer_strcat(wb, "\" y=\"15\" fill=\"#010101\" fill-opacity=\".3\">");
+    buffer_strcat(wb, value_escaped);
+    buffer_strcat(wb, "</text><text x=\"");
+    buffer_print_llu(wb, (unsigned long long)(label_width + value_width / 2 - 1));
+    buffer_strcat(wb, "\" y=\"14\">");
+    buffer_strcat(wb, value_escaped);
+    buffer_strcat(wb, "</text>"
             "</g>"
-        "</svg>",
-        total_width, total_width,
-        label_width, label_color_escaped,
-        label_width, value_width, value_color_escaped,
-        total_width,
-        label_width / 2, label_escaped,
-        label_width / 2, label_escaped,
-        label_width + value_width / 2 -1, value_escaped,
-        label_width + value_width / 2 -1, value_escaped);
+        "</svg>");
+}
+
+// ----------------------------------------------------------------------------
+// badges cache
+//
+// Dashboards embedding badges request the same badges again and again.
+// Rendered badges are kept in a fixed size, direct mapped table, indexed by
+// the hash of their request (the host and the query string). Each entry also
+// has the version of the data it has been rendered from (the last update of
+// the chart or the alarm), so that it is used only while the data have not
+// changed since.
+
+size_t badges_cache_entries = BADGES_CACHE_ENTRIES;
+
+typedef struct badge {
+    uint32_t hash;
+    char *key;                      // the host guid and the query string of the badge
+
+    usec_t version;                 // the last update of the chart or the alarm
+    uint32_t flags;                 // anything else the rendering depends on
+
+    int refresh;                    // the refresh of the badge, or 0 = not cacheable by browsers
+    BUFFER *svg;                    // the rendered badge
+} BADGE;
+
+static struct badges_cache {
+    pthread_mutex_t mutex;
+    BADGE *badges;
+} badges_cache = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .badges = NULL
+};
+
+void buffer_svg_init(void) {
+    verdana11_widths_init();
+
+    long long entries = config_get_number(CONFIG_SECTION_WEB, "badges cache entries", BADGES_CACHE_ENTRIES);
+    if(entries < 0) entries = 0;
+    badges_cache_entries = (size_t)entries;
+
+    if(badges_cache_entries)
+        badges_cache.badges = callocz(badges_cache_entries, sizeof(BADGE));
+
+    debug(D_OPTIONS, "Badges cache set to %zu entries.", badges_cache_entries);
+}
+
+// returns 1 if the badge has been copied to wb, 0 if it has to be rendered
+int badges_cache_get(BUFFER *wb, const char *key, usec_t version, uint32_t flags, int *refresh) {
+    if(unlikely(!badges_cache.badges)) return 0;
+
+    uint32_t hash = simple_hash(key);
+    int ret = 0;
+
+    pthread_mutex_lock(&badges_cache.mutex);
+
+    BADGE *b = &badges_cache.badges[hash % badges_cache_entries];
+    if(b->svg && b->hash == hash && b->version == version && b->flags == flags && !strcmp(b->key, key)) {
+        buffer_flush(wb);
+        buffer_need_bytes(wb, b->svg->len + 1);
+        memcpy(wb->buffer, b->svg->buffer, b->svg->len);
+        wb->len = b->svg->len;
+        wb->buffer[wb->len] = '\0';
+        wb->contenttype = b->svg->contenttype;
+
+        *refresh = b->refresh;
+        ret = 1;
+    }
+
+    pthread_mutex_unlock(&badges_cache.mutex);
+
+    return ret;
+}
+
+void badges_cache_set(BUFFER *wb, const char *key, usec_t version, uint32_t flags, int refresh) {
+    if(unlikely(!badges_cache.badges)) return;
+
+    uint32_t hash = simple_hash(key);
+
+    pthread_mutex_lock(&badges_cache.mutex);
+
+    BADGE *b = &badges_cache.badges[hash % badges_cache_entries];
+
+    if(!b->svg || b->hash != hash || strcmp(b->key, key)) {
+        freez(b->key);
+        b->key = strdupz(key);
+        b->hash = hash;
+    }
+
+    if(!b->svg)
+        b->svg = buffer_create(wb->len + 1);
+
+    buffer_flush(b->svg);
+    buffer_need_bytes(b->svg, wb->len + 1);
+    memcpy(b->svg->buffer, wb->buffer, wb->len);
+    b->svg->len = wb->len;
+    b->svg->buffer[b->svg->len] = '\0';
+    b->svg->contenttype = wb->contenttype;
+
+    b->version = version;
+    b->flags = flags;
+    b->refresh = refresh;
+
+    pthread_mutex_unlock(&badges_cache.mutex);
 }
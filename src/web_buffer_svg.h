@@ -1,7 +1,15 @@
 #ifndef NETDATA_WEB_BUFFER_SVG_H
 #define NETDATA_WEB_BUFFER_SVG_H 1
 
+#define BADGES_CACHE_ENTRIES 1024
+
+extern size_t badges_cache_entries;
+
+extern void buffer_svg_init(void);
 extern void buffer_svg(BUFFER *wb, const char *label, calculated_number value, const char *units, const char *label_color, const char *value_color, int precision);
 extern char *format_value_and_unit(char *value_string, size_t value_string_len, calculated_number value, const char *units, int precision);
 
+extern int badges_cache_get(BUFFER *wb, const char *key, usec_t version, uint32_t flags, int *refresh);
+extern void badges_cache_set(BUFFER *wb, const char *key, usec_t version, uint32_t flags, int refresh);
+
 #endif /* NETDATA_WEB_BUFFER_SVG_H */
@@ -5,16 +5,33 @@
 #define TOO_BIG_REQUEST 16384
 
 int web_client_timeout = DEFAULT_DISCONNECT_IDLE_WEB_CLIENTS_AFTER_SECONDS;
+usec_t web_slow_query_usec = DEFAULT_WEB_SLOW_QUERY_MS * USEC_PER_MS;
 int respect_web_browser_do_not_track_policy = 0;
 char *web_x_frame_options = NULL;
 
 #ifdef NETDATA_WITH_ZLIB
-int web_enable_gzip = 1, web_gzip_level = 3, web_gzip_strategy = Z_DEFAULT_STRATEGY;
+int web_enable_gzip = 1, web_gzip_level = 3, web_gzip_strategy = Z_DEFAULT_STRATEGY, web_gzip_adaptive_level = 1;
+size_t web_gzip_min_size = WEB_GZIP_MIN_SIZE;
+
+// the number of responses being compressed right now
+static volatile int web_gzip_compressing = 0;
 #endif /* NETDATA_WITH_ZLIB */
 
 struct web_client *web_clients = NULL;
 unsigned long long web_clients_count = 0;
 
+// clients are linked by all the listener threads
+// and unlinked by the one that cleans them up
+static pthread_mutex_t web_clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void web_clients_lock(void) {
+    pthread_mutex_lock(&web_clients_mutex);
+}
+
+static inline void web_clients_unlock(void) {
+    pthread_mutex_unlock(&web_clients_mutex);
+}
+
 static inline int web_client_crock_socket(struct web_client *w) {
 #ifdef TCP_CORK
     if(likely(!w->tcp_cork && w->ofd != -1)) {
@@ -49,7 +66,10 @@ struct web_client *web_client_create(int listener) {
     struct web_client *w;
 
     w = callocz(1, sizeof(struct web_client));
+
+    web_clients_lock();
     w->id = ++web_clients_count;
+    web_clients_unlock();
     w->mode = WEB_CLIENT_MODE_NORMAL;
 
     {
@@ -106,12 +126,15 @@ struct web_client *web_client_create(int listener) {
     w->response.data = buffer_create(INITIAL_WEB_DATA_LENGTH);
     w->response.header = buffer_create(HTTP_RESPONSE_HEADER_SIZE);
     w->response.header_output = buffer_create(HTTP_RESPONSE_HEADER_SIZE);
+    w->pending = buffer_create(HTTP_RESPONSE_HEADER_SIZE);
     w->origin[0] = '*';
     w->wait_receive = 1;
 
+    web_clients_lock();
     if(web_clients) web_clients->prev = w;
     w->next = web_clients;
     web_clients = w;
+    web_clients_unlock();
 
     web_client_connected();
 
@@ -129,23 +152,46 @@ void web_client_reset(struct web_client *w) {
 
         size_t size = (w->mode == WEB_CLIENT_MODE_FILECOPY)?w->response.rlen:w->response.data->len;
         size_t sent = size;
+        usec_t compression_usec = 0;
 #ifdef NETDATA_WITH_ZLIB
-        if(likely(w->response.zoutput)) sent = (size_t)w->response.zstream.total_out;
+        if(likely(w->response.zoutput)) {
+            sent = (size_t)w->response.zstream.total_out;
+            compression_usec = w->response.zusec;
+        }
 #endif
 
         // --------------------------------------------------------------------
         // global statistics
 
-        finished_web_request_statistics(dt_usec(&tv, &w->tv_in),
+        finished_web_request_statistics(w->endpoint,
+                                        dt_usec(&tv, &w->tv_in),
                                         w->stats_received_bytes,
                                         w->stats_sent_bytes,
                                         size,
-                                        sent);
+                                        sent,
+                                        compression_usec,
+                                        w->response.zoutput);
 
         w->stats_received_bytes = 0;
         w->stats_sent_bytes = 0;
 
 
+        // --------------------------------------------------------------------
+        // slow queries log
+
+        usec_t prep_usec = dt_usec(&w->tv_ready, &w->tv_in);
+        if(unlikely(web_slow_query_usec && prep_usec >= web_slow_query_usec)) {
+            if(w->query.charts)
+                info("%llu: SLOW QUERY: %s request took %0.2f ms, chart '%s' (%zu charts), after %lld, before %lld, points %ld, group '%s', rows scanned %zu: '%s'",
+                     w->id, web_endpoint_name(w->endpoint), prep_usec / 1000.0,
+                     w->query.chart, w->query.charts, w->query.after, w->query.before, w->query.points,
+                     group_method2string(w->query.group), w->query.rows_scanned,
+                     w->last_url);
+            else
+                info("%llu: SLOW QUERY: %s request took %0.2f ms: '%s'",
+                     w->id, web_endpoint_name(w->endpoint), prep_usec / 1000.0, w->last_url);
+        }
+
         // --------------------------------------------------------------------
         // access log
 
@@ -175,14 +221,18 @@ void web_client_reset(struct web_client *w) {
     w->cookie2[0] = '\0';
     w->origin[0] = '*';
     w->origin[1] = '\0';
+    w->if_none_match[0] = '\0';
 
     w->mode = WEB_CLIENT_MODE_NORMAL;
+    w->endpoint = WEB_ENDPOINT_OTHER;
+    memset(&w->query, 0, sizeof(struct web_client_query));
 
     w->tcp_cork = 0;
     w->donottrack = 0;
     w->tracking_required = 0;
     w->keepalive = 0;
     w->decoded_url[0] = '\0';
+    w->header_parse_last_size = 0;
 
     buffer_reset(w->response.header_output);
     buffer_reset(w->response.header);
@@ -194,46 +244,131 @@ void web_client_reset(struct web_client *w) {
     w->wait_receive = 1;
     w->wait_send = 0;
 
+    // if we had enabled compression, finish it
+    // the compressor is kept, to be reused by the next request of this client
+#ifdef NETDATA_WITH_ZLIB
+    if(w->response.zoutput) {
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+        __atomic_fetch_sub(&web_gzip_compressing, 1, __ATOMIC_SEQ_CST);
+#else
+        web_gzip_compressing--;
+#endif
+    }
+
+    w->response.zsent = 0;
+    w->response.zhave = 0;
+    w->response.zusec = 0;
+    w->response.zaccept = 0;
+#endif // NETDATA_WITH_ZLIB
+
     w->response.zoutput = 0;
+    w->response.gzipped = 0;
+    w->response.etag[0] = '\0';
+    w->response.sendfile = 0;
+
+    // if the client has sent more requests together with the last one,
+    // they become the input of the next request
+    if(unlikely(w->pending->len)) {
+        debug(D_WEB_CLIENT, "%llu: Continuing with %zu bytes of pipelined requests.", w->id, w->pending->len);
+
+        BUFFER *t = w->response.data;
+        w->response.data = w->pending;
+        w->pending = t;
+
+        w->response.data->contenttype = CT_TEXT_PLAIN;
+        w->response.data->options = 0;
+        w->response.data->date = 0;
+        w->response.data->expires = 0;
+
+        w->pipelined = 1;
+    }
+}
+
+// process a request that has been received together with the previous one
+// it has to be called after sending the response of the previous request
+void web_client_process_pipelined(struct web_client *w) {
+    if(likely(!w->pipelined)) return;
+    w->pipelined = 0;
+
+    if(unlikely(w->dead || w->mode != WEB_CLIENT_MODE_NORMAL || !w->response.data->len))
+        return;
+
+    debug(D_WEB_CLIENT, "%llu: Processing pipelined request.", w->id);
+    web_client_process_request(w);
+}
+
+// it has to be called with the clients mutex held
+static inline struct web_client *web_client_unlink_nolock(struct web_client *w) {
+    struct web_client *n = w->next;
+    if(w == web_clients) web_clients = n;
+    if(w->prev) w->prev->next = w->next;
+    if(w->next) w->next->prev = w->prev;
+    return n;
+}
+
+// frees a client that is not linked any more
+static void web_client_release(struct web_client *w) {
+    buffer_flush(w->pending);
+    web_client_reset(w);
 
-    // if we had enabled compression, release it
 #ifdef NETDATA_WITH_ZLIB
     if(w->response.zinitialized) {
         debug(D_DEFLATE, "%llu: Freeing compression resources.", w->id);
         deflateEnd(&w->response.zstream);
-        w->response.zsent = 0;
-        w->response.zhave = 0;
-        w->response.zstream.avail_in = 0;
-        w->response.zstream.avail_out = 0;
-        w->response.zstream.total_in = 0;
-        w->response.zstream.total_out = 0;
         w->response.zinitialized = 0;
     }
 #endif // NETDATA_WITH_ZLIB
-}
-
-struct web_client *web_client_free(struct web_client *w) {
-    web_client_reset(w);
-
-    struct web_client *n = w->next;
-    if(w == web_clients) web_clients = n;
 
     debug(D_WEB_CLIENT_ACCESS, "%llu: Closing web client from %s port %s.", w->id, w->client_ip, w->client_port);
 
-    if(w->prev) w->prev->next = w->next;
-    if(w->next) w->next->prev = w->prev;
     buffer_free(w->response.header_output);
     buffer_free(w->response.header);
     buffer_free(w->response.data);
+    buffer_free(w->pending);
     if(w->ifd != -1) close(w->ifd);
     if(w->ofd != -1 && w->ofd != w->ifd) close(w->ofd);
     freez(w);
 
     web_client_disconnected();
+}
+
+struct web_client *web_client_free(struct web_client *w) {
+    web_clients_lock();
+    struct web_client *n = web_client_unlink_nolock(w);
+    web_clients_unlock();
 
+    web_client_release(w);
     return(n);
 }
 
+// frees the clients whose threads have exited
+// they are unlinked with the clients mutex held, since other listener threads link new ones
+void web_client_free_obsolete(void) {
+    struct web_client *w, *obsolete = NULL;
+
+    web_clients_lock();
+    for(w = web_clients; w;) {
+        if(w->obsolete) {
+            struct web_client *n = web_client_unlink_nolock(w);
+            w->next = obsolete;
+            obsolete = w;
+            w = n;
+        }
+        else w = w->next;
+    }
+    web_clients_unlock();
+
+    while((w = obsolete)) {
+        obsolete = w->next;
+
+        debug(D_WEB_CLIENT, "%llu: Removing client.", w->id);
+        web_client_release(w);
+#ifdef NETDATA_INTERNAL_CHECKS
+        log_allocations();
+#endif
+    }
+}
+
 uid_t web_files_uid(void) {
     static char *web_owner = NULL;
     static uid_t owner_uid = 0;
@@ -291,6 +426,8 @@ gid_t web_files_gid(void) {
 int mysendfile(struct web_client *w, char *filename) {
     debug(D_WEB_CLIENT, "%llu: Looking for file '%s/%s'", w->id, netdata_configured_web_dir, filename);
 
+    w->endpoint = WEB_ENDPOINT_FILES;
+
     // skip leading slashes
     while (*filename == '/') filename++;
 
@@ -363,6 +500,66 @@ int mysendfile(struct web_client *w, char *filename) {
         return 403;
     }
 
+    // pick a Content-Type for the file
+         if(strstr(filename, ".html") != NULL)  w->response.data->contenttype = CT_TEXT_HTML;
+    else if(strstr(filename, ".js")   != NULL)  w->response.data->contenttype = CT_APPLICATION_X_JAVASCRIPT;
+    else if(strstr(filename, ".css")  != NULL)  w->response.data->contenttype = CT_TEXT_CSS;
+    else if(strstr(filename, ".xml")  != NULL)  w->response.data->contenttype = CT_TEXT_XML;
+    else if(strstr(filename, ".xsl")  != NULL)  w->response.data->contenttype = CT_TEXT_XSL;
+    else if(strstr(filename, ".txt")  != NULL)  w->response.data->contenttype = CT_TEXT_PLAIN;
+    else if(strstr(filename, ".svg")  != NULL)  w->response.data->contenttype = CT_IMAGE_SVG_XML;
+    else if(strstr(filename, ".ttf")  != NULL)  w->response.data->contenttype = CT_APPLICATION_X_FONT_TRUETYPE;
+    else if(strstr(filename, ".otf")  != NULL)  w->response.data->contenttype = CT_APPLICATION_X_FONT_OPENTYPE;
+    else if(strstr(filename, ".woff2")!= NULL)  w->response.data->contenttype = CT_APPLICATION_FONT_WOFF2;
+    else if(strstr(filename, ".woff") != NULL)  w->response.data->contenttype = CT_APPLICATION_FONT_WOFF;
+    else if(strstr(filename, ".eot")  != NULL)  w->response.data->contenttype = CT_APPLICATION_VND_MS_FONTOBJ;
+    else if(strstr(filename, ".png")  != NULL)  w->response.data->contenttype = CT_IMAGE_PNG;
+    else if(strstr(filename, ".jpg")  != NULL)  w->response.data->contenttype = CT_IMAGE_JPG;
+    else if(strstr(filename, ".jpeg") != NULL)  w->response.data->contenttype = CT_IMAGE_JPG;
+    else if(strstr(filename, ".gif")  != NULL)  w->response.data->contenttype = CT_IMAGE_GIF;
+    else if(strstr(filename, ".bmp")  != NULL)  w->response.data->contenttype = CT_IMAGE_BMP;
+    else if(strstr(filename, ".ico")  != NULL)  w->response.data->contenttype = CT_IMAGE_XICON;
+    else if(strstr(filename, ".icns") != NULL)  w->response.data->contenttype = CT_IMAGE_ICNS;
+    else w->response.data->contenttype = CT_APPLICATION_OCTET_STREAM;
+
+    // the ETag of the file - it is sent with the header, when the encoding of the response is known
+    char etag[ETAG_MAX + 1];
+    web_file_etag(etag, ETAG_MAX, &stat);
+    strncpyz(w->response.etag, etag, ETAG_MAX);
+
+#ifdef __APPLE__
+    w->response.data->date = stat.st_mtimespec.tv_sec;
+#else
+    w->response.data->date = stat.st_mtim.tv_sec;
+#endif /* __APPLE__ */
+
+    // the client already has this version of the file
+    // the gzip form is acceptable only to clients that accept gzip
+    int gzipped = 0;
+#ifdef NETDATA_WITH_ZLIB
+    if(w->if_none_match[0] && w->response.zaccept) {
+        char gzetag[ETAG_MAX + 1];
+        web_file_etag_gzip(gzetag, ETAG_MAX, etag);
+        gzipped = (strstr(w->if_none_match, gzetag) != NULL);
+    }
+#endif
+    if(w->if_none_match[0] && (gzipped || strstr(w->if_none_match, etag))) {
+        debug(D_WEB_CLIENT_ACCESS, "%llu: File '%s' has not been modified (ETag %s).", w->id, webfilename, etag);
+#ifdef NETDATA_WITH_ZLIB
+        w->response.zaccept = 0;
+#endif
+        w->response.gzipped = gzipped;
+        buffer_flush(w->response.data);
+        buffer_cacheable(w->response.data);
+        return 304;
+    }
+
+    // small files are served from memory
+    if(web_files_cache_send(w, webfilename, &stat, etag)) {
+        buffer_cacheable(w->response.data);
+        return 200;
+    }
+
     // open the file
     w->ifd = open(webfilename, O_NONBLOCK, O_RDONLY);
     if(w->ifd == -1) {
@@ -387,28 +584,6 @@ int mysendfile(struct web_client *w, char *filename) {
     if(fcntl(w->ifd, F_SETFL, O_NONBLOCK) < 0)
         error("%llu: Cannot set O_NONBLOCK on file '%s'.", w->id, webfilename);
 
-    // pick a Content-Type for the file
-         if(strstr(filename, ".html") != NULL)  w->response.data->contenttype = CT_TEXT_HTML;
-    else if(strstr(filename, ".js")   != NULL)  w->response.data->contenttype = CT_APPLICATION_X_JAVASCRIPT;
-    else if(strstr(filename, ".css")  != NULL)  w->response.data->contenttype = CT_TEXT_CSS;
-    else if(strstr(filename, ".xml")  != NULL)  w->response.data->contenttype = CT_TEXT_XML;
-    else if(strstr(filename, ".xsl")  != NULL)  w->response.data->contenttype = CT_TEXT_XSL;
-    else if(strstr(filename, ".txt")  != NULL)  w->response.data->contenttype = CT_TEXT_PLAIN;
-    else if(strstr(filename, ".svg")  != NULL)  w->response.data->contenttype = CT_IMAGE_SVG_XML;
-    else if(strstr(filename, ".ttf")  != NULL)  w->response.data->contenttype = CT_APPLICATION_X_FONT_TRUETYPE;
-    else if(strstr(filename, ".otf")  != NULL)  w->response.data->contenttype = CT_APPLICATION_X_FONT_OPENTYPE;
-    else if(strstr(filename, ".woff2")!= NULL)  w->response.data->contenttype = CT_APPLICATION_FONT_WOFF2;
-    else if(strstr(filename, ".woff") != NULL)  w->response.data->contenttype = CT_APPLICATION_FONT_WOFF;
-    else if(strstr(filename, ".eot")  != NULL)  w->response.data->contenttype = CT_APPLICATION_VND_MS_FONTOBJ;
-    else if(strstr(filename, ".png")  != NULL)  w->response.data->contenttype = CT_IMAGE_PNG;
-    else if(strstr(filename, ".jpg")  != NULL)  w->response.data->contenttype = CT_IMAGE_JPG;
-    else if(strstr(filename, ".jpeg") != NULL)  w->response.data->contenttype = CT_IMAGE_JPG;
-    else if(strstr(filename, ".gif")  != NULL)  w->response.data->contenttype = CT_IMAGE_GIF;
-    else if(strstr(filename, ".bmp")  != NULL)  w->response.data->contenttype = CT_IMAGE_BMP;
-    else if(strstr(filename, ".ico")  != NULL)  w->response.data->contenttype = CT_IMAGE_XICON;
-    else if(strstr(filename, ".icns") != NULL)  w->response.data->contenttype = CT_IMAGE_ICNS;
-    else w->response.data->contenttype = CT_APPLICATION_OCTET_STREAM;
-
     debug(D_WEB_CLIENT_ACCESS, "%llu: Sending file '%s' (%ld bytes, ifd %d, ofd %d).", w->id, webfilename, stat.st_size, w->ifd, w->ofd);
 
     w->mode = WEB_CLIENT_MODE_FILECOPY;
@@ -416,21 +591,87 @@ int mysendfile(struct web_client *w, char *filename) {
     w->wait_send = 0;
     buffer_flush(w->response.data);
     w->response.rlen = stat.st_size;
-#ifdef __APPLE__
-    w->response.data->date = stat.st_mtimespec.tv_sec;
-#else
-    w->response.data->date = stat.st_mtim.tv_sec;
-#endif /* __APPLE__ */
     buffer_cacheable(w->response.data);
 
+#ifdef HAVE_SYS_SENDFILE_H
+    // large files are copied by the kernel, without compression
+    if((size_t)stat.st_size > web_files_cache_max_file_size) {
+        w->response.sendfile = 1;
+#ifdef NETDATA_WITH_ZLIB
+        w->response.zaccept = 0;
+#endif
+    }
+#endif
+
     return 200;
 }
 
 
 #ifdef NETDATA_WITH_ZLIB
+static inline usec_t web_client_thread_cpu_usec(void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if(likely(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0))
+        return (usec_t)ts.tv_sec * USEC_PER_SEC + (usec_t)ts.tv_nsec / NSEC_PER_USEC;
+#endif
+    // deflate() is cpu bound, so this is close enough
+    return now_monotonic_usec();
+}
+
+// compress the contents of a buffer with gzip, at once, at the level given
+// used for responses that are compressed once and sent many times
+// returns a new buffer, or NULL on failure
+BUFFER *web_gzip_buffer(BUFFER *wb, int level) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(z_stream));
+
+    if(deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, web_gzip_strategy) != Z_OK) {
+        error("Failed to initialize zlib for compressing a buffer of %zu bytes.", wb->len);
+        return NULL;
+    }
+
+    BUFFER *gz = buffer_create(deflateBound(&zs, wb->len) + 1);
+
+    zs.next_in = (Bytef *)wb->buffer;
+    zs.avail_in = (uInt)wb->len;
+    zs.next_out = (Bytef *)gz->buffer;
+    zs.avail_out = (uInt)gz->size;
+
+    int ret = deflate(&zs, Z_FINISH);
+    gz->len = (size_t)zs.total_out;
+    deflateEnd(&zs);
+
+    if(ret != Z_STREAM_END) {
+        error("Failed to compress a buffer of %zu bytes.", wb->len);
+        buffer_free(gz);
+        return NULL;
+    }
+
+    gz->contenttype = wb->contenttype;
+    return gz;
+}
+
+// select the compression level, according to the number of responses
+// compressed concurrently - when they are more than the cpus we have,
+// compression is the bottleneck, so we lower the level
+static inline int web_client_gzip_level(int compressing) {
+    if(!web_gzip_adaptive_level || processors < 1)
+        return web_gzip_level;
+
+    if(compressing > processors)
+        return 1;
+
+    if(compressing > processors / 2 && web_gzip_level > 1)
+        return (web_gzip_level + 1) / 2;
+
+    return web_gzip_level;
+}
+
+// called for every response the client accepts gzip for
+// it decides if the response should be compressed, and how
 void web_client_enable_deflate(struct web_client *w, int gzip) {
-    if(unlikely(w->response.zinitialized)) {
-        debug(D_DEFLATE, "%llu: Compression has already be initialized for this client.", w->id);
+    if(unlikely(w->response.zoutput)) {
+        debug(D_DEFLATE, "%llu: Compression has already be enabled for this response.", w->id);
         return;
     }
 
@@ -439,9 +680,56 @@ void web_client_enable_deflate(struct web_client *w, int gzip) {
         return;
     }
 
-    w->response.zstream.zalloc = Z_NULL;
-    w->response.zstream.zfree = Z_NULL;
-    w->response.zstream.opaque = Z_NULL;
+    // small responses are sent uncompressed
+    // rlen is zero when the size of a file is not known
+    size_t size = (w->mode == WEB_CLIENT_MODE_FILECOPY)?w->response.rlen:w->response.data->len;
+    if(size < web_gzip_min_size && !(w->mode == WEB_CLIENT_MODE_FILECOPY && !size)) {
+        debug(D_DEFLATE, "%llu: Response of %zu bytes is too small to be compressed.", w->id, size);
+        return;
+    }
+
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+    int compressing = __atomic_add_fetch(&web_gzip_compressing, 1, __ATOMIC_SEQ_CST);
+#else
+    int compressing = ++web_gzip_compressing;
+#endif
+    int level = web_client_gzip_level(compressing);
+
+    if(likely(w->response.zinitialized)) {
+        // reuse the compressor of the previous request
+        if(unlikely(deflateReset(&w->response.zstream) != Z_OK)) {
+            error("%llu: Failed to reset zlib. Re-initializing it.", w->id);
+            deflateEnd(&w->response.zstream);
+            w->response.zinitialized = 0;
+        }
+        else if(level != w->response.zlevel) {
+            if(deflateParams(&w->response.zstream, level, web_gzip_strategy) != Z_OK)
+                error("%llu: Failed to set compression level %d. Proceeding with level %d.", w->id, level, w->response.zlevel);
+            else
+                w->response.zlevel = level;
+        }
+    }
+
+    if(unlikely(!w->response.zinitialized)) {
+        w->response.zstream.zalloc = Z_NULL;
+        w->response.zstream.zfree = Z_NULL;
+        w->response.zstream.opaque = Z_NULL;
+
+        // Select GZIP compression: windowbits = 15 + 16 = 31
+        if(deflateInit2(&w->response.zstream, level, Z_DEFLATED, 15 + ((gzip)?16:0), 8, web_gzip_strategy) != Z_OK) {
+            error("%llu: Failed to initialize zlib. Proceeding without compression.", w->id);
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+            __atomic_fetch_sub(&web_gzip_compressing, 1, __ATOMIC_SEQ_CST);
+#else
+            web_gzip_compressing--;
+#endif
+            return;
+        }
+
+        w->response.zlevel = level;
+        w->response.zinitialized = 1;
+        debug(D_DEFLATE, "%llu: Initialized compression.", w->id);
+    }
 
     w->response.zstream.next_in = (Bytef *)w->response.data->buffer;
     w->response.zstream.avail_in = 0;
@@ -451,26 +739,12 @@ void web_client_enable_deflate(struct web_client *w, int gzip) {
     w->response.zstream.avail_out = 0;
     w->response.zstream.total_out = 0;
 
-    w->response.zstream.zalloc = Z_NULL;
-    w->response.zstream.zfree = Z_NULL;
-    w->response.zstream.opaque = Z_NULL;
-
-//  if(deflateInit(&w->response.zstream, Z_DEFAULT_COMPRESSION) != Z_OK) {
-//      error("%llu: Failed to initialize zlib. Proceeding without compression.", w->id);
-//      return;
-//  }
-
-    // Select GZIP compression: windowbits = 15 + 16 = 31
-    if(deflateInit2(&w->response.zstream, web_gzip_level, Z_DEFLATED, 15 + ((gzip)?16:0), 8, web_gzip_strategy) != Z_OK) {
-        error("%llu: Failed to initialize zlib. Proceeding without compression.", w->id);
-        return;
-    }
-
     w->response.zsent = 0;
+    w->response.zhave = 0;
+    w->response.zusec = 0;
     w->response.zoutput = 1;
-    w->response.zinitialized = 1;
 
-    debug(D_DEFLATE, "%llu: Initialized compression.", w->id);
+    debug(D_DEFLATE, "%llu: Compressing response of %zu bytes at level %d (%d responses are being compressed).", w->id, size, w->response.zlevel, compressing);
 }
 #endif // NETDATA_WITH_ZLIB
 
@@ -673,6 +947,9 @@ const char *web_response_code_to_string(int code) {
         case 200:
             return "OK";
 
+        case 304:
+            return "Not Modified";
+
         case 307:
             return "Temporary Redirect";
 
@@ -709,13 +986,14 @@ const char *web_response_code_to_string(int code) {
 }
 
 static inline char *http_header_parse(struct web_client *w, char *s) {
-    static uint32_t hash_origin = 0, hash_connection = 0, hash_accept_encoding = 0, hash_donottrack = 0;
+    static uint32_t hash_origin = 0, hash_connection = 0, hash_accept_encoding = 0, hash_donottrack = 0, hash_if_none_match = 0;
 
     if(unlikely(!hash_origin)) {
         hash_origin = simple_uhash("Origin");
         hash_connection = simple_uhash("Connection");
         hash_accept_encoding = simple_uhash("Accept-Encoding");
         hash_donottrack = simple_uhash("DNT");
+        hash_if_none_match = simple_uhash("If-None-Match");
     }
 
     char *e = s;
@@ -754,19 +1032,21 @@ static inline char *http_header_parse(struct web_client *w, char *s) {
         if(strcasestr(v, "keep-alive"))
             w->keepalive = 1;
     }
+    else if(hash == hash_if_none_match && !strcasecmp(s, "If-None-Match"))
+        strncpyz(w->if_none_match, v, ETAG_MAX);
+
     else if(respect_web_browser_do_not_track_policy && hash == hash_donottrack && !strcasecmp(s, "DNT")) {
         if(*v == '0') w->donottrack = 0;
         else if(*v == '1') w->donottrack = 1;
     }
 #ifdef NETDATA_WITH_ZLIB
     else if(hash == hash_accept_encoding && !strcasecmp(s, "Accept-Encoding")) {
+        // compression is decided when the response is ready
         if(web_enable_gzip) {
             if(strcasestr(v, "gzip"))
-                web_client_enable_deflate(w, 1);
+                w->response.zaccept = 1;
             //
-            // does not seem to work
-            // else if(strcasestr(v, "deflate"))
-            //  web_client_enable_deflate(w, 0);
+            // deflate does not seem to work
         }
     }
 #endif /* NETDATA_WITH_ZLIB */
@@ -791,6 +1071,21 @@ typedef enum http_validation {
 static inline HTTP_VALIDATION http_request_validate(struct web_client *w) {
     char *s = w->response.data->buffer, *encoded_url = NULL;
 
+    // an incomplete request has already been checked up to header_parse_last_size
+    // so, check only the data received since then for the end of the header,
+    // instead of parsing the whole request again
+    if(unlikely(w->header_parse_last_size)) {
+        size_t last = (w->header_parse_last_size > 3)?w->header_parse_last_size - 3:0;
+
+        if(w->response.data->len <= last || !strstr(&s[last], "\r\n\r\n")) {
+            w->header_parse_last_size = w->response.data->len;
+            w->wait_receive = 1;
+            return HTTP_VALIDATION_INCOMPLETE;
+        }
+
+        w->header_parse_last_size = 0;
+    }
+
     // is is a valid request?
     if(!strncmp(s, "GET ", 4)) {
         encoded_url = s = &s[4];
@@ -847,6 +1142,18 @@ static inline HTTP_VALIDATION http_request_validate(struct web_client *w) {
                 *ue = '\0';
                 url_decode_r(w->decoded_url, encoded_url, URL_MAX + 1);
                 *ue = ' ';
+
+                // keep any pipelined requests that follow this one
+                // the request buffer will be overwritten by the response
+                s += 2;
+                buffer_flush(w->pending);
+                if(unlikely(*s && w->mode != WEB_CLIENT_MODE_STREAM)) {
+                    size_t len = w->response.data->len - (s - w->response.data->buffer);
+                    buffer_need_bytes(w->pending, len + 1);
+                    memcpy(w->pending->buffer, s, len);
+                    w->pending->len = len;
+                    w->pending->buffer[len] = '\0';
+                }
                 
                 // copy the URL - we are going to overwrite parts of it
                 // FIXME -- we should avoid it
@@ -862,12 +1169,14 @@ static inline HTTP_VALIDATION http_request_validate(struct web_client *w) {
     }
 
     // incomplete request
+    // we have its request line, so from now on only check for the end of its header
+    w->header_parse_last_size = w->response.data->len;
     w->wait_receive = 1;
     return HTTP_VALIDATION_INCOMPLETE;
 }
 
 static inline void web_client_send_http_header(struct web_client *w) {
-    if(unlikely(w->response.code != 200))
+    if(unlikely(w->response.code != 200 && w->response.code != 304))
         buffer_no_cacheable(w->response.data);
 
     // set a proper expiration date, if not already set
@@ -961,6 +1270,19 @@ static inline void web_client_send_http_header(struct web_client *w) {
     if(unlikely(buffer_strlen(w->response.header)))
         buffer_strcat(w->response.header_output, buffer_tostring(w->response.header));
 
+    // files are sent either as they are, or gzip encoded, each form with its own ETag
+    if(w->response.etag[0]) {
+        if(w->response.zoutput || w->response.gzipped) {
+            char gzetag[ETAG_MAX + 1];
+            web_file_etag_gzip(gzetag, ETAG_MAX, w->response.etag);
+            buffer_sprintf(w->response.header_output, "ETag: %s\r\n", gzetag);
+        }
+        else
+            buffer_sprintf(w->response.header_output, "ETag: %s\r\n", w->response.etag);
+
+        buffer_strcat(w->response.header_output, "Vary: Accept-Encoding\r\n");
+    }
+
     // headers related to the transfer method
     if(likely(w->response.zoutput)) {
         buffer_strcat(w->response.header_output,
@@ -973,6 +1295,10 @@ static inline void web_client_send_http_header(struct web_client *w) {
             // we know the content length, put it
             buffer_sprintf(w->response.header_output, "Content-Length: %zu\r\n", w->response.data->len? w->response.data->len: w->response.rlen);
         }
+        else if(w->response.code == 304) {
+            // no content - keep-alive can be preserved
+            ;
+        }
         else {
             // we don't know the content length, disable keep-alive
             w->keepalive = 0;
@@ -1201,6 +1527,7 @@ void web_client_process_request(struct web_client *w) {
             switch(w->mode) {
                 case WEB_CLIENT_MODE_STREAM:
                     w->response.code = rrdpush_receiver_thread_spawn(localhost, w, w->decoded_url);
+                    now_realtime_timeval(&w->tv_ready);
                     return;
 
                 case WEB_CLIENT_MODE_OPTIONS:
@@ -1213,6 +1540,12 @@ void web_client_process_request(struct web_client *w) {
                 case WEB_CLIENT_MODE_FILECOPY:
                 case WEB_CLIENT_MODE_NORMAL:
                     w->response.code = web_client_process_url(localhost, w, w->decoded_url);
+
+                    // the socket may have been handed over for live updates
+                    if(unlikely(w->mode == WEB_CLIENT_MODE_STREAM)) {
+                        now_realtime_timeval(&w->tv_ready);
+                        return;
+                    }
                     break;
             }
             break;
@@ -1251,10 +1584,17 @@ void web_client_process_request(struct web_client *w) {
     if(unlikely(!w->response.data->date))
         w->response.data->date = w->tv_ready.tv_sec;
 
+#ifdef NETDATA_WITH_ZLIB
+    // now that we know the response, decide if we should compress it
+    if(w->response.zaccept && (w->mode == WEB_CLIENT_MODE_NORMAL || w->mode == WEB_CLIENT_MODE_FILECOPY))
+        web_client_enable_deflate(w, 1);
+#endif
+
     web_client_send_http_header(w);
 
     // enable sending immediately if we have data
-    if(w->response.data->len) w->wait_send = 1;
+    // (a 304 has no data, but it has to pass through web_client_send() to finish the request)
+    if(w->response.data->len || w->response.code == 304) w->wait_send = 1;
     else w->wait_send = 0;
 
     switch(w->mode) {
@@ -1273,20 +1613,15 @@ void web_client_process_request(struct web_client *w) {
         case WEB_CLIENT_MODE_FILECOPY:
             if(w->response.rlen) {
                 debug(D_WEB_CLIENT, "%llu: Done preparing the response. Will be sending data file of %zu bytes to client.", w->id, w->response.rlen);
-                w->wait_receive = 1;
-
-                /*
-                // utilize the kernel sendfile() for copying the file to the socket.
-                // this block of code can be commented, without anything missing.
-                // when it is commented, the program will copy the data using async I/O.
-                {
-                    long len = sendfile(w->ofd, w->ifd, NULL, w->response.data->rbytes);
-                    if(len != w->response.data->rbytes)
-                        error("%llu: sendfile() should copy %ld bytes, but copied %ld. Falling back to manual copy.", w->id, w->response.data->rbytes, len);
-                    else
-                        web_client_reset(w);
+
+                if(w->response.sendfile) {
+                    // the kernel will copy the file to the socket
+                    // we only wait for the socket to be writable
+                    w->wait_receive = 0;
+                    w->wait_send = 1;
                 }
-                */
+                else
+                    w->wait_receive = 1;
             }
             else
                 debug(D_WEB_CLIENT, "%llu: Done preparing the response. Will be sending an unknown amount of bytes to client.", w->id);
@@ -1440,7 +1775,11 @@ ssize_t web_client_send_deflate(struct web_client *w)
         }
 
         // compress
-        if(deflate(&w->response.zstream, flush) == Z_STREAM_ERROR) {
+        usec_t cpu_started = web_client_thread_cpu_usec();
+        int ret = deflate(&w->response.zstream, flush);
+        w->response.zusec += web_client_thread_cpu_usec() - cpu_started;
+
+        if(ret == Z_STREAM_ERROR) {
             error("%llu: Compression failed. Closing down client.", w->id);
             web_client_reset(w);
             return(-1);
@@ -1484,11 +1823,55 @@ ssize_t web_client_send_deflate(struct web_client *w)
 }
 #endif // NETDATA_WITH_ZLIB
 
+#ifdef HAVE_SYS_SENDFILE_H
+ssize_t web_client_sendfile(struct web_client *w)
+{
+    if(unlikely(w->response.sent >= w->response.rlen)) {
+        // there is nothing to send
+
+        debug(D_WEB_CLIENT, "%llu: Out of output data. sendfile() copied the whole file.", w->id);
+
+        if(unlikely(!w->keepalive)) {
+            debug(D_WEB_CLIENT, "%llu: Closing (keep-alive is not enabled). %zu bytes sent.", w->id, w->response.sent);
+            WEB_CLIENT_IS_DEAD(w);
+            return 0;
+        }
+
+        web_client_reset(w);
+        debug(D_WEB_CLIENT, "%llu: Done sending all data on socket. Waiting for next request on the same socket.", w->id);
+        return 0;
+    }
+
+    off_t offset = (off_t)w->response.sent;
+    ssize_t bytes = sendfile(w->ofd, w->ifd, &offset, w->response.rlen - w->response.sent);
+    if(likely(bytes > 0)) {
+        w->stats_sent_bytes += bytes;
+        w->response.sent += bytes;
+        debug(D_WEB_CLIENT, "%llu: Sent %zd bytes with sendfile().", w->id, bytes);
+    }
+    else if(bytes == -1 && errno == EAGAIN) {
+        debug(D_WEB_CLIENT, "%llu: sendfile() would block.", w->id);
+        bytes = 0;
+    }
+    else {
+        debug(D_WEB_CLIENT, "%llu: Failed to sendfile() data to client.", w->id);
+        WEB_CLIENT_IS_DEAD(w);
+        if(!bytes) bytes = -1;
+    }
+
+    return(bytes);
+}
+#endif // HAVE_SYS_SENDFILE_H
+
 ssize_t web_client_send(struct web_client *w) {
 #ifdef NETDATA_WITH_ZLIB
     if(likely(w->response.zoutput)) return web_client_send_deflate(w);
 #endif // NETDATA_WITH_ZLIB
 
+#ifdef HAVE_SYS_SENDFILE_H
+    if(unlikely(w->response.sendfile)) return web_client_sendfile(w);
+#endif // HAVE_SYS_SENDFILE_H
+
     ssize_t bytes;
 
     if(unlikely(w->response.data->len - w->response.sent == 0)) {
@@ -1699,6 +2082,8 @@ void *web_client_main(void *ptr)
                 debug(D_WEB_CLIENT, "%llu: Cannot send data to client. Closing client.", w->id);
                 break;
             }
+
+            web_client_process_pipelined(w);
         }
 
         if(unlikely(netdata_exit)) break;
@@ -5,11 +5,21 @@
 extern int web_client_timeout;
 
 #ifdef NETDATA_WITH_ZLIB
+#define WEB_GZIP_MIN_SIZE 1024
+
 extern int web_enable_gzip,
         web_gzip_level,
-        web_gzip_strategy;
+        web_gzip_strategy,
+        web_gzip_adaptive_level;
+
+extern size_t web_gzip_min_size;
+
+extern BUFFER *web_gzip_buffer(BUFFER *wb, int level);
 #endif /* NETDATA_WITH_ZLIB */
 
+#define DEFAULT_WEB_SLOW_QUERY_MS 1000
+extern usec_t web_slow_query_usec;
+
 extern int respect_web_browser_do_not_track_policy;
 extern char *web_x_frame_options;
 
@@ -25,6 +35,7 @@ typedef enum web_client_mode {
 #define HTTP_RESPONSE_HEADER_SIZE 4096
 #define COOKIE_MAX 1024
 #define ORIGIN_MAX 1024
+#define ETAG_MAX 64
 
 struct response {
     BUFFER *header;                 // our response header
@@ -37,16 +48,33 @@ struct response {
     size_t sent;                    // current data length sent to output
 
     int zoutput;                    // if set to 1, web_client_send() will send compressed data
+    int gzipped;                    // if set to 1, data is already gzip encoded (a cached file)
+    char etag[ETAG_MAX + 1];        // the ETag of the file sent, if any - its gzip form gets a suffix
+    int sendfile;                   // if set to 1, web_client_send() will use sendfile() to copy ifd to ofd
 #ifdef NETDATA_WITH_ZLIB
     z_stream zstream;               // zlib stream for sending compressed output to client
     Bytef zbuffer[ZLIB_CHUNK];      // temporary buffer for storing compressed output
     size_t zsent;                   // the compressed bytes we have sent to the client
     size_t zhave;                   // the compressed bytes that we have received from zlib
-    int zinitialized:1;
+    usec_t zusec;                   // the cpu time spent compressing this response
+    int zlevel;                     // the compression level zstream is set to
+    int zaccept:1;                  // 1 = the client accepts gzip and this response may be compressed
+    int zinitialized:1;             // 1 = zstream is initialized - it is reused for all the requests of this client
 #endif /* NETDATA_WITH_ZLIB */
 
 };
 
+// the details of the data query of a request, for the slow queries log
+struct web_client_query {
+    char chart[RRD_ID_LENGTH_MAX + 1];  // the chart queried, or empty if this is not a data query
+    long long after;
+    long long before;
+    long points;
+    int group;
+    size_t charts;                      // the number of charts queried
+    size_t rows_scanned;                // the database rows read for the query
+};
+
 struct web_client {
     unsigned long long id;
 
@@ -64,7 +92,12 @@ struct web_client {
     uint8_t donottrack:1;               // 1 = we should not set cookies on this client
     uint8_t tracking_required:1;        // 1 = if the request requires cookies
 
+    uint8_t pipelined:1;                // 1 = a pipelined request is waiting to be processed
+
     WEB_CLIENT_MODE mode;               // the operational mode of the client
+    WEB_ENDPOINT endpoint;              // the endpoint serving the request, for the latency histograms
+
+    struct web_client_query query;      // the data query of the request, if any
 
     int tcp_cork;                       // 1 = we have a cork on the socket
 
@@ -82,10 +115,15 @@ struct web_client {
     char cookie1[COOKIE_MAX+1];
     char cookie2[COOKIE_MAX+1];
     char origin[ORIGIN_MAX+1];
+    char if_none_match[ETAG_MAX+1]; // the ETag the client has, to respond with 304
 
     struct sockaddr_storage clientaddr;
     struct response response;
 
+    BUFFER *pending;                // pipelined requests received together with the current one
+
+    size_t header_parse_last_size;  // the bytes of an incomplete request already checked for the end of its header
+
     size_t stats_received_bytes;
     size_t stats_sent_bytes;
 
@@ -104,9 +142,11 @@ extern uid_t web_files_gid(void);
 
 extern struct web_client *web_client_create(int listener);
 extern struct web_client *web_client_free(struct web_client *w);
+extern void web_client_free_obsolete(void);
 extern ssize_t web_client_send(struct web_client *w);
 extern ssize_t web_client_receive(struct web_client *w);
 extern void web_client_process_request(struct web_client *w);
+extern void web_client_process_pipelined(struct web_client *w);
 extern void web_client_reset(struct web_client *w);
 
 extern void *web_client_main(void *ptr);
@@ -0,0 +1,337 @@
+#include "common.h"
+
+// ----------------------------------------------------------------------------
+// in-memory cache of the static web files
+//
+// Small web files are kept in memory, together with a gzip compressed copy
+// of them, so that they are not read from disk and compressed again for
+// every client requesting them.
+// Entries are validated with the ETag of the file, which is calculated from
+// the stat() mysendfile() does on every request anyway, so that changes on
+// disk are picked up immediately.
+//
+// When the cache is full, the least recently used files are evicted.
+// Every WEB_FILES_CACHE_REVALIDATE_EVERY seconds, all the cached files are
+// checked on disk, so that deleted or replaced files that are not requested
+// any more do not stay in memory.
+
+#define WEB_FILES_CACHE_REVALIDATE_EVERY 60
+
+size_t web_files_cache_size = WEB_FILES_CACHE_SIZE;
+size_t web_files_cache_max_file_size = WEB_FILES_CACHE_MAX_FILE_SIZE;
+
+typedef struct web_file {
+    char *filename;
+    uint32_t hash;
+
+    char etag[ETAG_MAX + 1];
+    time_t mtime;
+    volatile usec_t last_used;      // updated under the read lock - only an approximation is needed
+
+    BUFFER *data;                   // the contents of the file
+    BUFFER *gzdata;                 // the gzip compressed contents, or NULL if compression does not pay off
+
+    struct web_file *next;
+} WEB_FILE;
+
+static struct web_files_cache {
+    pthread_rwlock_t rwlock;
+
+    size_t memory;                  // the bytes of file contents we keep
+    size_t files;
+    volatile time_t last_revalidated;
+
+    WEB_FILE *root;
+} web_files_cache = {
+        .rwlock = PTHREAD_RWLOCK_INITIALIZER,
+        .memory = 0,
+        .files = 0,
+        .last_revalidated = 0,
+        .root = NULL
+};
+
+void web_files_cache_init(void) {
+    long long size = config_get_number(CONFIG_SECTION_WEB, "files cache size", WEB_FILES_CACHE_SIZE);
+    long long max_file_size = config_get_number(CONFIG_SECTION_WEB, "files cache max file size", WEB_FILES_CACHE_MAX_FILE_SIZE);
+
+    if(size < 0) size = 0;
+    if(max_file_size < 0) max_file_size = 0;
+    if(max_file_size > size) max_file_size = size;
+
+    web_files_cache_size = (size_t)size;
+    web_files_cache_max_file_size = (size_t)max_file_size;
+
+    debug(D_OPTIONS, "Web files cache size set to %zu bytes, for files up to %zu bytes.", web_files_cache_size, web_files_cache_max_file_size);
+}
+
+// the ETag of the gzip form of a file, given the ETag of the file
+void web_file_etag_gzip(char *gzetag, size_t len, const char *etag) {
+    size_t l = strlen(etag);
+    if(l && etag[l - 1] == '"') l--;
+
+    snprintfz(gzetag, len, "%.*s-gzip\"", (int)l, etag);
+}
+
+void web_file_etag(char *etag, size_t len, struct stat *stat) {
+#ifdef __APPLE__
+    time_t mtime = stat->st_mtimespec.tv_sec;
+#else
+    time_t mtime = stat->st_mtim.tv_sec;
+#endif /* __APPLE__ */
+
+    snprintfz(etag, len, "\"%llx-%llx-%llx\""
+              , (unsigned long long)stat->st_ino
+              , (unsigned long long)stat->st_size
+              , (unsigned long long)mtime
+    );
+}
+
+static inline size_t web_file_memory(WEB_FILE *wf) {
+    return wf->data->size + ((wf->gzdata)?wf->gzdata->size:0);
+}
+
+static void web_file_free(WEB_FILE *wf) {
+    buffer_free(wf->data);
+    if(wf->gzdata) buffer_free(wf->gzdata);
+    freez(wf->filename);
+    freez(wf);
+}
+
+#ifdef NETDATA_WITH_ZLIB
+static BUFFER *web_file_gzip(const char *filename, BUFFER *data) {
+    // we compress each file once, so use the best compression
+    BUFFER *gz = web_gzip_buffer(data, Z_BEST_COMPRESSION);
+    if(!gz) {
+        error("Failed to compress web file '%s'.", filename);
+        return NULL;
+    }
+
+    // do not keep it, if it does not save at least 10%
+    if(gz->len >= data->len - data->len / 10) {
+        debug(D_WEB_CLIENT, "Web file '%s' is not compressible (%zu bytes, compressed %zu bytes).", filename, data->len, gz->len);
+        buffer_free(gz);
+        return NULL;
+    }
+
+    // gz has been allocated for the worst case - keep only what is needed
+    BUFFER *copy = buffer_create(gz->len + 1);
+    memcpy(copy->buffer, gz->buffer, gz->len);
+    copy->len = gz->len;
+    copy->buffer[copy->len] = '\0';
+    buffer_free(gz);
+
+    return copy;
+}
+#endif /* NETDATA_WITH_ZLIB */
+
+static WEB_FILE *web_file_load(const char *filename, struct stat *stat, const char *etag) {
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1) {
+        error("Cannot open web file '%s' for caching it.", filename);
+        return NULL;
+    }
+
+    size_t size = (size_t)stat->st_size;
+    BUFFER *data = buffer_create(size + 1);
+
+    while(data->len < size) {
+        ssize_t bytes = read(fd, &data->buffer[data->len], size - data->len);
+        if(bytes <= 0) {
+            if(bytes == -1 && errno == EINTR) continue;
+            break;
+        }
+        data->len += bytes;
+    }
+    close(fd);
+
+    if(data->len != size) {
+        error("Cannot read web file '%s' for caching it (expected %zu bytes, got %zu bytes).", filename, size, data->len);
+        buffer_free(data);
+        return NULL;
+    }
+    data->buffer[data->len] = '\0';
+
+    WEB_FILE *wf = callocz(1, sizeof(WEB_FILE));
+    wf->filename = strdupz(filename);
+    wf->hash = simple_hash(wf->filename);
+    strncpyz(wf->etag, etag, ETAG_MAX);
+#ifdef __APPLE__
+    wf->mtime = stat->st_mtimespec.tv_sec;
+#else
+    wf->mtime = stat->st_mtim.tv_sec;
+#endif /* __APPLE__ */
+    wf->data = data;
+
+#ifdef NETDATA_WITH_ZLIB
+    wf->gzdata = web_file_gzip(filename, data);
+#endif
+
+    return wf;
+}
+
+static inline WEB_FILE *web_file_find_nolock(const char *filename, uint32_t hash, WEB_FILE **prev) {
+    WEB_FILE *wf, *p = NULL;
+
+    for(wf = web_files_cache.root; wf ; p = wf, wf = wf->next)
+        if(wf->hash == hash && !strcmp(wf->filename, filename))
+            break;
+
+    if(prev) *prev = p;
+    return wf;
+}
+
+static inline void web_file_unlink_nolock(WEB_FILE *wf, WEB_FILE *prev) {
+    if(prev) prev->next = wf->next;
+    else web_files_cache.root = wf->next;
+
+    web_files_cache.memory -= web_file_memory(wf);
+    web_files_cache.files--;
+    web_file_free(wf);
+}
+
+// drops the least recently used file
+static inline void web_files_cache_evict_nolock(void) {
+    WEB_FILE *wf, *p, *lru = NULL, *lru_prev = NULL;
+
+    for(wf = web_files_cache.root, p = NULL; wf ; p = wf, wf = wf->next) {
+        if(!lru || wf->last_used < lru->last_used) {
+            lru = wf;
+            lru_prev = p;
+        }
+    }
+
+    if(lru) {
+        debug(D_WEB_CLIENT, "Evicting file '%s' from the web files cache.", lru->filename);
+        web_file_unlink_nolock(lru, lru_prev);
+    }
+}
+
+// drops the files that have been deleted or changed on disk
+static void web_files_cache_revalidate(void) {
+    time_t now = now_monotonic_sec();
+    if(likely(now - web_files_cache.last_revalidated < WEB_FILES_CACHE_REVALIDATE_EVERY))
+        return;
+
+    pthread_rwlock_wrlock(&web_files_cache.rwlock);
+
+    // another thread may have done it while we were waiting for the lock
+    if(now - web_files_cache.last_revalidated >= WEB_FILES_CACHE_REVALIDATE_EVERY) {
+        web_files_cache.last_revalidated = now;
+
+        WEB_FILE *wf = web_files_cache.root, *p = NULL;
+        while(wf) {
+            struct stat st;
+            char etag[ETAG_MAX + 1] = "";
+
+            if(stat(wf->filename, &st) != -1)
+                web_file_etag(etag, ETAG_MAX, &st);
+
+            if(strcmp(etag, wf->etag)) {
+                debug(D_WEB_CLIENT, "File '%s' has been deleted or changed on disk. Removing it from the web files cache.", wf->filename);
+
+                WEB_FILE *next = wf->next;
+                web_file_unlink_nolock(wf, p);
+                wf = next;
+            }
+            else {
+                p = wf;
+                wf = wf->next;
+            }
+        }
+    }
+
+    pthread_rwlock_unlock(&web_files_cache.rwlock);
+}
+
+// copy the cached file to the client response
+// must be called with the entry locked, or not yet linked to the cache
+static inline void web_file_to_client(struct web_client *w, WEB_FILE *wf) {
+    BUFFER *src = wf->data;
+
+#ifdef NETDATA_WITH_ZLIB
+    if(wf->gzdata && w->response.zaccept) {
+        src = wf->gzdata;
+        buffer_strcat(w->response.header, "Content-Encoding: gzip\r\n");
+        w->response.gzipped = 1;
+    }
+
+    // the content is either already compressed, or not worth compressing
+    w->response.zaccept = 0;
+#endif
+
+    buffer_flush(w->response.data);
+    buffer_need_bytes(w->response.data, src->len + 1);
+    memcpy(w->response.data->buffer, src->buffer, src->len);
+    w->response.data->len = src->len;
+    w->response.data->buffer[w->response.data->len] = '\0';
+    w->response.data->date = wf->mtime;
+}
+
+// returns 1 if the file has been copied to the response of the client
+// or 0 if it has not, in which case the caller has to send the file itself
+int web_files_cache_send(struct web_client *w, const char *filename, struct stat *stat, const char *etag) {
+    // files that cannot be cached are not loaded at all
+    size_t size = (size_t)stat->st_size;
+    if(!web_files_cache_max_file_size || size > web_files_cache_max_file_size || size + 1 > web_files_cache_size)
+        return 0;
+
+    web_files_cache_revalidate();
+
+    uint32_t hash = simple_hash(filename);
+
+    pthread_rwlock_rdlock(&web_files_cache.rwlock);
+    WEB_FILE *wf = web_file_find_nolock(filename, hash, NULL);
+    if(likely(wf && !strcmp(wf->etag, etag))) {
+        debug(D_WEB_CLIENT, "%llu: Sending file '%s' from the cache.", w->id, filename);
+        wf->last_used = now_monotonic_usec();
+        web_file_to_client(w, wf);
+        pthread_rwlock_unlock(&web_files_cache.rwlock);
+        return 1;
+    }
+    pthread_rwlock_unlock(&web_files_cache.rwlock);
+
+    // not found, or changed on disk - load it
+    wf = web_file_load(filename, stat, etag);
+    if(unlikely(!wf)) return 0;
+
+    web_file_to_client(w, wf);
+    wf->last_used = now_monotonic_usec();
+
+    // keep only the uncompressed copy, if both of them do not fit in the cache
+    if(wf->gzdata && web_file_memory(wf) > web_files_cache_size) {
+        buffer_free(wf->gzdata);
+        wf->gzdata = NULL;
+    }
+
+    pthread_rwlock_wrlock(&web_files_cache.rwlock);
+
+    // remove the old version of it
+    WEB_FILE *prev = NULL, *old = web_file_find_nolock(filename, hash, &prev);
+    if(old)
+        web_file_unlink_nolock(old, prev);
+
+    // make room for it
+    while(web_files_cache.root && web_files_cache.memory + web_file_memory(wf) > web_files_cache_size)
+        web_files_cache_evict_nolock();
+
+    if(web_files_cache.memory + web_file_memory(wf) <= web_files_cache_size) {
+        wf->next = web_files_cache.root;
+        web_files_cache.root = wf;
+        web_files_cache.memory += web_file_memory(wf);
+        web_files_cache.files++;
+
+        debug(D_WEB_CLIENT, "%llu: Cached file '%s' (%zu bytes, gzip %zu bytes). The cache now has %zu files, %zu bytes.",
+              w->id, filename, wf->data->len, (wf->gzdata)?wf->gzdata->len:0, web_files_cache.files, web_files_cache.memory);
+
+        wf = NULL;
+    }
+
+    pthread_rwlock_unlock(&web_files_cache.rwlock);
+
+    if(wf) {
+        debug(D_WEB_CLIENT, "%llu: File '%s' does not fit in the web files cache. Not caching it.", w->id, filename);
+        web_file_free(wf);
+    }
+
+    return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef NETDATA_WEB_FILES_CACHE_H
+#define NETDATA_WEB_FILES_CACHE_H 1
+
+#define WEB_FILES_CACHE_SIZE            (8 * 1024 * 1024)
+#define WEB_FILES_CACHE_MAX_FILE_SIZE   (1024 * 1024)
+
+extern size_t web_files_cache_size;
+extern size_t web_files_cache_max_file_size;
+
+extern void web_files_cache_init(void);
+extern void web_file_etag(char *etag, size_t len, struct stat *stat);
+extern void web_file_etag_gzip(char *gzetag, size_t len, const char *etag);
+extern int web_files_cache_send(struct web_client *w, const char *filename, struct stat *stat, const char *etag);
+
+#endif /* NETDATA_WEB_FILES_CACHE_H */
@@ -0,0 +1,422 @@
+#include "common.h"
+
+// ----------------------------------------------------------------------------
+// live updates of charts, pushed to web clients with Server-Sent Events
+//
+// A web client subscribes to a set of charts at /api/v1/subscribe and its
+// socket is handed over to the web push thread. Every time rrdset_done()
+// is called for a subscribed chart the thread is woken up, and it sends to
+// each client the rows that have been added to its charts since the last
+// time, as an SSE event per chart. So, dashboards do not need to poll the
+// server for every chart, every second.
+
+typedef struct web_push_chart {
+    char *id;
+    time_t last_sent;                   // the timestamp of the last row sent
+} WEB_PUSH_CHART;
+
+typedef struct web_push_client {
+    unsigned long long id;
+    int fd;
+
+    char client_ip[NI_MAXHOST+1];
+    char client_port[NI_MAXSERV+1];
+
+    char machine_guid[GUID_LEN + 1];    // the host the charts belong to
+    uint32_t hash_machine_guid;
+
+    size_t charts_count;
+    WEB_PUSH_CHART *charts;
+
+    BUFFER *out;                        // the data waiting to be sent to the client
+    time_t last_sent_t;                 // the last time we sent something to the client
+
+    struct web_push_client *next;
+} WEB_PUSH_CLIENT;
+
+static struct web_push {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    int thread_started;
+    pthread_t thread;
+
+    int updated;                        // set by rrdset_done() to wake up the thread
+    WEB_PUSH_CLIENT *incoming;          // clients waiting to be picked up by the thread
+} web_push = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .thread_started = 0,
+        .updated = 0,
+        .incoming = NULL
+};
+
+// called by rrdset_done() for the charts that have subscribers
+void web_push_rrdset_done(RRDSET *st) {
+    (void)st;
+
+    pthread_mutex_lock(&web_push.mutex);
+    web_push.updated = 1;
+    pthread_cond_signal(&web_push.cond);
+    pthread_mutex_unlock(&web_push.mutex);
+}
+
+static void web_push_client_free(WEB_PUSH_CLIENT *c) {
+    if(c->fd != -1) {
+        info("%llu: %s port %s unsubscribed from live updates.", c->id, c->client_ip, c->client_port);
+        close(c->fd);
+    }
+
+    size_t i;
+    for(i = 0; i < c->charts_count ; i++)
+        freez(c->charts[i].id);
+
+    freez(c->charts);
+    if(c->out) buffer_free(c->out);
+    freez(c);
+}
+
+// append to the output of the client, the rows of the chart it has not received yet
+static inline void web_push_chart_rows(WEB_PUSH_CLIENT *c, WEB_PUSH_CHART *pc, RRDSET *st) {
+    time_t last = rrdset_last_entry_t(st);
+    if(likely(last <= pc->last_sent)) return;
+
+    time_t first = rrdset_first_entry_t(st);
+    time_t after = pc->last_sent + st->update_every;
+
+    // do not send more rows than the client can use
+    if(after < last - (WEB_PUSH_MAX_ROWS - 1) * st->update_every)
+        after = last - (WEB_PUSH_MAX_ROWS - 1) * st->update_every;
+
+    if(after <= first)
+        after = first + st->update_every;
+
+    pc->last_sent = last;
+    if(unlikely(after > last)) return;
+
+    BUFFER *wb = c->out;
+    RRDDIM *rd;
+    int i;
+
+    buffer_sprintf(wb, "event: %s\ndata: {\"chart\":\"%s\",\"update_every\":%d,\"labels\":[\"time\"", st->id, st->id, st->update_every);
+
+    rrddim_foreach_read(rd, st) {
+        if(unlikely(rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN))) continue;
+
+        char name[RRD_ID_LENGTH_MAX * 2 + 1];
+        json_escape_string(name, rd->name, sizeof(name));
+        buffer_sprintf(wb, ",\"%s\"", name);
+    }
+
+    buffer_strcat(wb, "],\"data\":[");
+
+    time_t t;
+    for(t = after, i = 0; t <= last ; t += st->update_every, i++) {
+        long slot = rrdset_time2slot(st, t);
+
+        buffer_sprintf(wb, "%s[%ld", (i)?",":"", (long)t);
+
+        rrddim_foreach_read(rd, st) {
+            if(unlikely(rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN))) continue;
+
+            storage_number n = rd->values[slot];
+
+            buffer_strcat(wb, ",");
+            if(unlikely(!does_storage_number_exist(n)))
+                buffer_strcat(wb, "null");
+            else
+                buffer_rrd_value(wb, unpack_storage_number(n));
+        }
+
+        buffer_strcat(wb, "]");
+    }
+
+    buffer_strcat(wb, "]}\n\n");
+}
+
+// returns -1 when the client has to be removed
+static inline int web_push_client_send(WEB_PUSH_CLIENT *c, time_t now) {
+    char buf[1024];
+
+    // the client is not supposed to send anything - check if it has closed the connection
+    ssize_t bytes = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if(unlikely(!bytes || (bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))) {
+        debug(D_WEB_CLIENT, "%llu: Live updates client closed the connection.", c->id);
+        return -1;
+    }
+
+    if(unlikely(!c->out->len && now - c->last_sent_t >= WEB_PUSH_KEEPALIVE_SECONDS))
+        buffer_strcat(c->out, ": keepalive\n\n");
+
+    if(!c->out->len) return 0;
+
+    bytes = send(c->fd, c->out->buffer, c->out->len, MSG_DONTWAIT);
+    if(likely(bytes > 0)) {
+        if((size_t)bytes < c->out->len)
+            memmove(c->out->buffer, &c->out->buffer[bytes], c->out->len - bytes);
+
+        c->out->len -= bytes;
+        c->last_sent_t = now;
+    }
+    else if(bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        debug(D_WEB_CLIENT, "%llu: Cannot send live updates to client.", c->id);
+        return -1;
+    }
+
+    if(unlikely(c->out->len > WEB_PUSH_MAX_PENDING_BYTES)) {
+        error("%llu: %s port %s does not receive the live updates fast enough (%zu bytes pending). Disconnecting it.", c->id, c->client_ip, c->client_port, c->out->len);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void web_push_client_update(WEB_PUSH_CLIENT *c) {
+    rrd_rdlock();
+
+    RRDHOST *host = rrdhost_find_by_guid(c->machine_guid, c->hash_machine_guid);
+    if(likely(host)) {
+        rrdhost_rdlock(host);
+
+        size_t i;
+        for(i = 0; i < c->charts_count ; i++) {
+            WEB_PUSH_CHART *pc = &c->charts[i];
+
+            // the chart may have been re-created since the last time
+            RRDSET *st = rrdset_find(host, pc->id);
+            if(unlikely(!st)) continue;
+
+            rrdset_flag_set(st, RRDSET_FLAG_WEB_PUSH);
+
+            rrdset_rdlock(st);
+            web_push_chart_rows(c, pc, st);
+            rrdset_unlock(st);
+        }
+
+        rrdhost_unlock(host);
+    }
+
+    rrd_unlock();
+}
+
+static inline int web_push_chart_has_subscribers(WEB_PUSH_CLIENT *clients, WEB_PUSH_CLIENT *c, const char *id) {
+    WEB_PUSH_CLIENT *t;
+    size_t i;
+
+    for(t = clients; t ; t = t->next) {
+        if(t->hash_machine_guid != c->hash_machine_guid || strcmp(t->machine_guid, c->machine_guid))
+            continue;
+
+        for(i = 0; i < t->charts_count ; i++)
+            if(!strcmp(t->charts[i].id, id))
+                return 1;
+    }
+
+    return 0;
+}
+
+// a client is leaving - stop waking up the thread for the charts
+// nobody else is subscribed to (the clients not picked up yet
+// set the flag again, on their first update)
+static void web_push_client_unsubscribe(WEB_PUSH_CLIENT *clients, WEB_PUSH_CLIENT *c) {
+    rrd_rdlock();
+
+    RRDHOST *host = rrdhost_find_by_guid(c->machine_guid, c->hash_machine_guid);
+    if(likely(host)) {
+        rrdhost_rdlock(host);
+
+        size_t i;
+        for(i = 0; i < c->charts_count ; i++) {
+            if(web_push_chart_has_subscribers(clients, c, c->charts[i].id))
+                continue;
+
+            RRDSET *st = rrdset_find(host, c->charts[i].id);
+            if(likely(st)) rrdset_flag_clear(st, RRDSET_FLAG_WEB_PUSH);
+        }
+
+        rrdhost_unlock(host);
+    }
+
+    rrd_unlock();
+}
+
+static void *web_push_main(void *ptr) {
+    (void)ptr;
+
+    info("Web live updates thread created with task id %d", gettid());
+
+    if(pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL) != 0)
+        error("Cannot set pthread cancel type to DEFERRED.");
+
+    if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
+        error("Cannot set pthread cancel state to ENABLE.");
+
+    WEB_PUSH_CLIENT *clients = NULL;
+
+    while(!netdata_exit) {
+        pthread_mutex_lock(&web_push.mutex);
+
+        if(!web_push.updated && !web_push.incoming) {
+            // wake up at least once per second, to send keepalives
+            // and to catch up with charts that were re-created
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec++;
+            pthread_cond_timedwait(&web_push.cond, &web_push.mutex, &ts);
+        }
+
+        web_push.updated = 0;
+
+        // pick up the new subscribers
+        while(web_push.incoming) {
+            WEB_PUSH_CLIENT *c = web_push.incoming;
+            web_push.incoming = c->next;
+            c->next = clients;
+            clients = c;
+        }
+
+        pthread_mutex_unlock(&web_push.mutex);
+
+        if(unlikely(netdata_exit)) break;
+
+        time_t now = now_realtime_sec();
+        WEB_PUSH_CLIENT *c, *prev = NULL, *next;
+        for(c = clients; c ; c = next) {
+            next = c->next;
+
+            web_push_client_update(c);
+
+            if(unlikely(web_push_client_send(c, now) == -1)) {
+                if(prev) prev->next = next;
+                else clients = next;
+
+                web_push_client_unsubscribe(clients, c);
+                web_push_client_free(c);
+                continue;
+            }
+
+            prev = c;
+        }
+    }
+
+    while(clients) {
+        WEB_PUSH_CLIENT *c = clients;
+        clients = c->next;
+        web_push_client_free(c);
+    }
+
+    info("Web live updates thread exiting");
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+// take over the socket of the web client and subscribe it to the charts given
+// returns the HTTP response code - on success, the web client should not be touched
+int web_push_subscribe(RRDHOST *host, struct web_client *w, char **charts, size_t count) {
+    buffer_flush(w->response.data);
+    w->response.data->contenttype = CT_TEXT_PLAIN;
+
+    if(!count) {
+        buffer_strcat(w->response.data, "No chart id is given at the request.");
+        return 400;
+    }
+
+    if(count > WEB_PUSH_MAX_CHARTS) {
+        buffer_sprintf(w->response.data, "Too many charts requested. The maximum is %d.", WEB_PUSH_MAX_CHARTS);
+        return 400;
+    }
+
+    if(w->ifd != w->ofd) {
+        buffer_strcat(w->response.data, "Live updates are not supported on this connection.");
+        return 400;
+    }
+
+    WEB_PUSH_CLIENT *c = callocz(1, sizeof(WEB_PUSH_CLIENT));
+    c->fd = -1;
+    c->charts = callocz(count, sizeof(WEB_PUSH_CHART));
+
+    size_t i;
+    for(i = 0; i < count ; i++) {
+        RRDSET *st = rrdset_find(host, charts[i]);
+        if(!st) st = rrdset_find_byname(host, charts[i]);
+        if(!st) {
+            buffer_sprintf(w->response.data, "Chart '%s' is not found.", charts[i]);
+            web_push_client_free(c);
+            return 404;
+        }
+
+        rrdset_flag_set(st, RRDSET_FLAG_WEB_PUSH);
+
+        // start with the last row collected
+        c->charts[i].id = strdupz(st->id);
+        c->charts[i].last_sent = rrdset_last_entry_t(st) - st->update_every;
+        c->charts_count++;
+    }
+
+    c->id = w->id;
+    c->fd = w->ofd;
+    strncpyz(c->client_ip, w->client_ip, NI_MAXHOST);
+    strncpyz(c->client_port, w->client_port, NI_MAXSERV);
+    strncpyz(c->machine_guid, host->machine_guid, GUID_LEN);
+    c->hash_machine_guid = host->hash_machine_guid;
+    c->last_sent_t = now_realtime_sec();
+
+    // the response header is sent by the web push thread
+    c->out = buffer_create(HTTP_RESPONSE_HEADER_SIZE);
+    buffer_sprintf(c->out,
+            "HTTP/1.1 200 OK\r\n"
+            "Connection: close\r\n"
+            "Server: NetData Embedded HTTP Server\r\n"
+            "Access-Control-Allow-Origin: %s\r\n"
+            "Access-Control-Allow-Credentials: true\r\n"
+            "Content-Type: text/event-stream; charset=utf-8\r\n"
+            "Cache-Control: no-cache\r\n"
+            "X-Accel-Buffering: no\r\n"
+            "\r\n"
+            "retry: %d\n\n"
+            , w->origin
+            , host->rrd_update_every * 1000
+    );
+
+    info("%llu: %s port %s subscribed to live updates of %zu charts.", c->id, c->client_ip, c->client_port, c->charts_count);
+
+    pthread_mutex_lock(&web_push.mutex);
+
+    if(unlikely(!web_push.thread_started)) {
+        if(pthread_create(&web_push.thread, NULL, web_push_main, NULL))
+            error("Failed to create the web live updates thread.");
+
+        else {
+            if(pthread_detach(web_push.thread))
+                error("Cannot request detach of the web live updates thread.");
+
+            web_push.thread_started = 1;
+        }
+    }
+
+    if(unlikely(!web_push.thread_started)) {
+        pthread_mutex_unlock(&web_push.mutex);
+
+        // the socket still belongs to the web client
+        c->fd = -1;
+        web_push_client_free(c);
+
+        buffer_strcat(w->response.data, "Live updates are not available.");
+        return 503;
+    }
+
+    c->next = web_push.incoming;
+    web_push.incoming = c;
+    pthread_cond_signal(&web_push.cond);
+
+    pthread_mutex_unlock(&web_push.mutex);
+
+    // prevent the caller from using or closing the socket
+    w->ifd = w->ofd = -1;
+    w->mode = WEB_CLIENT_MODE_STREAM;
+    w->wait_receive = 0;
+    w->wait_send = 0;
+
+    return 200;
+}
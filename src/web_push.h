@@ -0,0 +1,12 @@
+#ifndef NETDATA_WEB_PUSH_H
+#define NETDATA_WEB_PUSH_H 1
+
+#define WEB_PUSH_MAX_CHARTS             50
+#define WEB_PUSH_MAX_ROWS               60
+#define WEB_PUSH_MAX_PENDING_BYTES      (1024 * 1024)
+#define WEB_PUSH_KEEPALIVE_SECONDS      15
+
+extern int web_push_subscribe(RRDHOST *host, struct web_client *w, char **charts, size_t count);
+extern void web_push_rrdset_done(RRDSET *st);
+
+#endif /* NETDATA_WEB_PUSH_H */
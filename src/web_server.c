@@ -6,6 +6,10 @@ int listen_fds[MAX_LISTEN_FDS] = { [0 ... 99] = -1 };
 char *listen_fds_names[MAX_LISTEN_FDS] = { [0 ... 99] = NULL };
 int listen_port = LISTEN_PORT;
 
+// the number of SO_REUSEPORT sockets opened on each bind address
+// in multi-threaded mode, each of them is serviced by its own thread
+size_t listen_sockets_per_address = 1;
+
 WEB_SERVER_MODE web_server_mode = WEB_SERVER_MODE_MULTI_THREADED;
 
 static int shown_server_socket_error = 0;
@@ -124,6 +128,12 @@ int create_listen_socket4(const char *ip, int port, int listen_backlog) {
     if(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void*)&sockopt, sizeof(sockopt)) != 0)
         error("Cannot set SO_REUSEADDR on ip '%s' port's %d.", ip, port);
 
+#ifdef SO_REUSEPORT
+    /* allow the kernel to distribute connections among our listeners */
+    if(listen_sockets_per_address > 1 && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (void*)&sockopt, sizeof(sockopt)) != 0)
+        error("Cannot set SO_REUSEPORT on ip '%s' port's %d.", ip, port);
+#endif
+
     struct sockaddr_in name;
     memset(&name, 0, sizeof(struct sockaddr_in));
     name.sin_family = AF_INET;
@@ -173,6 +183,12 @@ int create_listen_socket6(const char *ip, int port, int listen_backlog) {
     if(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (void*)&sockopt, sizeof(sockopt)) != 0)
         error("Cannot set SO_REUSEADDR on ip '%s' port's %d.", ip, port);
 
+#ifdef SO_REUSEPORT
+    /* allow the kernel to distribute connections among our listeners */
+    if(listen_sockets_per_address > 1 && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (void*)&sockopt, sizeof(sockopt)) != 0)
+        error("Cannot set SO_REUSEPORT on ip '%s' port's %d.", ip, port);
+#endif
+
     /* IPv6 only */
     if(setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (void*)&ipv6only, sizeof(ipv6only)) != 0)
         error("Cannot set IPV6_V6ONLY on ip '%s' port's %d.", ip, port);
@@ -301,33 +317,38 @@ static inline int bind_to_one(const char *definition, int default_port, int list
     }
 
     for (rp = result; rp != NULL; rp = rp->ai_next) {
-        int fd = -1;
-
-        char rip[INET_ADDRSTRLEN + INET6_ADDRSTRLEN] = "INVALID";
-        int rport = default_port;
+        size_t n;
+        for(n = 0; n < listen_sockets_per_address ; n++) {
+            int fd = -1;
+
+            char rip[INET_ADDRSTRLEN + INET6_ADDRSTRLEN] = "INVALID";
+            int rport = default_port;
+
+            switch (rp->ai_addr->sa_family) {
+                case AF_INET: {
+                    struct sockaddr_in *sin = (struct sockaddr_in *) rp->ai_addr;
+                    inet_ntop(AF_INET, &sin->sin_addr, rip, INET_ADDRSTRLEN);
+                    rport = ntohs(sin->sin_port);
+                    fd = create_listen_socket4(rip, rport, listen_backlog);
+                    break;
+                }
 
-        switch (rp->ai_addr->sa_family) {
-            case AF_INET: {
-                struct sockaddr_in *sin = (struct sockaddr_in *) rp->ai_addr;
-                inet_ntop(AF_INET, &sin->sin_addr, rip, INET_ADDRSTRLEN);
-                rport = ntohs(sin->sin_port);
-                fd = create_listen_socket4(rip, rport, listen_backlog);
-                break;
+                case AF_INET6: {
+                    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) rp->ai_addr;
+                    inet_ntop(AF_INET6, &sin6->sin6_addr, rip, INET6_ADDRSTRLEN);
+                    rport = ntohs(sin6->sin6_port);
+                    fd = create_listen_socket6(rip, rport, listen_backlog);
+                    break;
+                }
             }
 
-            case AF_INET6: {
-                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) rp->ai_addr;
-                inet_ntop(AF_INET6, &sin6->sin6_addr, rip, INET6_ADDRSTRLEN);
-                rport = ntohs(sin6->sin6_port);
-                fd = create_listen_socket6(rip, rport, listen_backlog);
+            if (fd == -1) {
+                error("Cannot bind to ip '%s', port %d", rip, rport);
                 break;
             }
-        }
+            else if(add_listen_socket(fd, rip, rport) == -1)
+                break;
 
-        if (fd == -1)
-            error("Cannot bind to ip '%s', port %d", rip, rport);
-        else {
-            add_listen_socket(fd, rip, rport);
             added++;
         }
     }
@@ -349,6 +370,24 @@ int create_listen_sockets(void) {
     }
     debug(D_OPTIONS, "Default listen port set to %d.", listen_port);
 
+    long sockets = config_get_number(CONFIG_SECTION_WEB, "listen sockets per address", 1);
+#ifdef SO_REUSEPORT
+    if(sockets < 1 || sockets > MAX_LISTEN_SOCKETS_PER_ADDRESS) {
+        error("Invalid number of listen sockets per address %ld given. Defaulting to 1.", sockets);
+        sockets = config_set_number(CONFIG_SECTION_WEB, "listen sockets per address", 1);
+    }
+#else
+    if(sockets != 1) {
+        error("SO_REUSEPORT is not supported on this system. Using 1 listen socket per address.");
+        sockets = config_set_number(CONFIG_SECTION_WEB, "listen sockets per address", 1);
+    }
+#endif
+    if(sockets > 1 && web_server_mode_id(config_get(CONFIG_SECTION_WEB, "mode", web_server_mode_name(web_server_mode))) != WEB_SERVER_MODE_MULTI_THREADED) {
+        info("Multiple listen sockets per address are only useful with the multi-threaded web server. Using 1.");
+        sockets = 1;
+    }
+    listen_sockets_per_address = (size_t)sockets;
+
     char *s = config_get(CONFIG_SECTION_WEB, "bind to", "*");
     while(*s) {
         char *e = s;
@@ -383,64 +422,36 @@ int create_listen_sockets(void) {
 // --------------------------------------------------------------------------------------
 // the main socket listener
 
-static inline void cleanup_web_clients(void) {
-    struct web_client *w;
-
-    for (w = web_clients; w;) {
-        if (w->obsolete) {
-            debug(D_WEB_CLIENT, "%llu: Removing client.", w->id);
-            // pthread_cancel(w->thread);
-            // pthread_join(w->thread, NULL);
-            w = web_client_free(w);
-#ifdef NETDATA_INTERNAL_CHECKS
-            log_allocations();
-#endif
-        }
-        else w = w->next;
-    }
-}
-
 // 1. it accepts new incoming requests on our port
 // 2. creates a new web_client for each connection received
 // 3. spawns a new pthread to serve the client (this is optimal for keep-alive clients)
 // 4. cleans up old web_clients that their pthreads have been exited
+//
+// when there are multiple listen sockets per address (SO_REUSEPORT),
+// the listen sockets are split in shards: shard N gets socket N of each
+// address, and each shard is serviced by its own acceptor thread, so that
+// the kernel spreads incoming connections to all of them.
+// Only shard 0 (the static "web" thread) cleans up obsolete clients.
 
 #define CLEANUP_EVERY_EVENTS 100
 
-void *socket_listen_main_multi_threaded(void *ptr) {
-    struct netdata_static_thread *static_thread = (struct netdata_static_thread *)ptr;
+struct listen_shard {
+    size_t id;
+    pthread_t thread;
 
-    web_server_mode = WEB_SERVER_MODE_MULTI_THREADED;
-    info("Multi-threaded WEB SERVER thread created with task id %d", gettid());
+    size_t fds_count;
+    struct pollfd *fds;
+};
 
+static void listen_shard_loop(struct listen_shard *shard) {
     struct web_client *w;
     int retval, counter = 0;
-
-    if(pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL) != 0)
-        error("Cannot set pthread cancel type to DEFERRED.");
-
-    if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
-        error("Cannot set pthread cancel state to ENABLE.");
-
-    if(!listen_fds_count)
-        fatal("LISTENER: No sockets to listen to.");
-
-    struct pollfd *fds = callocz(sizeof(struct pollfd), listen_fds_count);
-
-    size_t i;
-    for(i = 0; i < listen_fds_count ;i++) {
-        fds[i].fd = listen_fds[i];
-        fds[i].events = POLLIN;
-        fds[i].revents = 0;
-
-        info("Listening on '%s'", (listen_fds_names[i])?listen_fds_names[i]:"UNKNOWN");
-    }
-
     int timeout = 10 * 1000;
+    size_t i;
 
     for(;;) {
         // debug(D_WEB_CLIENT, "LISTENER: Waiting...");
-        retval = poll(fds, listen_fds_count, timeout);
+        retval = poll(shard->fds, shard->fds_count, timeout);
 
         if(unlikely(retval == -1)) {
             error("LISTENER: poll() failed.");
@@ -449,18 +460,18 @@ void *socket_listen_main_multi_threaded(void *ptr) {
         else if(unlikely(!retval)) {
             debug(D_WEB_CLIENT, "LISTENER: select() timeout.");
             counter = 0;
-            cleanup_web_clients();
+            if(!shard->id) web_client_free_obsolete();
             continue;
         }
 
-        for(i = 0 ; i < listen_fds_count ; i++) {
-            short int revents = fds[i].revents;
+        for(i = 0 ; i < shard->fds_count ; i++) {
+            short int revents = shard->fds[i].revents;
 
             // check for new incoming connections
             if(revents & POLLIN || revents & POLLPRI) {
-                fds[i].revents = 0;
+                shard->fds[i].revents = 0;
 
-                w = web_client_create(fds[i].fd);
+                w = web_client_create(shard->fds[i].fd);
                 if(unlikely(!w)) {
                     // no need for error log - web_client_create already logged the error
                     continue;
@@ -481,14 +492,130 @@ void *socket_listen_main_multi_threaded(void *ptr) {
         counter++;
         if(counter >= CLEANUP_EVERY_EVENTS) {
             counter = 0;
-            cleanup_web_clients();
+            if(!shard->id) web_client_free_obsolete();
+        }
+    }
+}
+
+static void *listen_shard_main(void *ptr) {
+    struct listen_shard *shard = (struct listen_shard *)ptr;
+
+    info("Multi-threaded WEB SERVER listener %zu thread created with task id %d", shard->id, gettid());
+
+    if(pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL) != 0)
+        error("Cannot set pthread cancel type to DEFERRED.");
+
+    if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
+        error("Cannot set pthread cancel state to ENABLE.");
+
+    listen_shard_loop(shard);
+
+    pthread_exit(NULL);
+    return NULL;
+}
+
+void *socket_listen_main_multi_threaded(void *ptr) {
+    struct netdata_static_thread *static_thread = (struct netdata_static_thread *)ptr;
+
+    web_server_mode = WEB_SERVER_MODE_MULTI_THREADED;
+    info("Multi-threaded WEB SERVER thread created with task id %d", gettid());
+
+    if(pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL) != 0)
+        error("Cannot set pthread cancel type to DEFERRED.");
+
+    if(pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) != 0)
+        error("Cannot set pthread cancel state to ENABLE.");
+
+    if(!listen_fds_count)
+        fatal("LISTENER: No sockets to listen to.");
+
+    size_t i, j;
+
+    // group the sockets by the address they are bound to
+    size_t addresses = 0;
+    size_t *address_of = mallocz(sizeof(size_t) * listen_fds_count);
+    size_t *sockets = callocz(sizeof(size_t), listen_fds_count);
+
+    for(i = 0; i < listen_fds_count ;i++) {
+        for(j = 0; j < i ;j++)
+            if(listen_fds_names[i] && listen_fds_names[j] && !strcmp(listen_fds_names[i], listen_fds_names[j]))
+                break;
+
+        address_of[i] = (j < i)?address_of[j]:addresses++;
+        sockets[address_of[i]]++;
+    }
+
+    // each shard gets one socket of each address, so there can be only as
+    // many shards as the sockets of the address with the fewest of them
+    // (binding may have failed partway, or MAX_LISTEN_FDS may have been reached)
+    size_t shards_count = listen_sockets_per_address;
+    for(i = 0; i < addresses ;i++)
+        if(sockets[i] < shards_count)
+            shards_count = sockets[i];
+
+    if(unlikely(shards_count < 1))
+        shards_count = 1;
+
+    struct listen_shard *shards = callocz(sizeof(struct listen_shard), shards_count);
+
+    for(i = 0; i < shards_count ;i++) {
+        shards[i].id = i;
+        shards[i].fds = callocz(sizeof(struct pollfd), listen_fds_count);
+    }
+
+    // the sockets of each address are numbered in the order they were bound
+    // socket N goes to shard N, and the sockets beyond the shards are closed
+    // (the kernel then spreads the connections to the remaining ones)
+    memset(sockets, 0, sizeof(size_t) * listen_fds_count);
+
+    for(i = 0; i < listen_fds_count ;i++) {
+        size_t n = sockets[address_of[i]]++;
+
+        if(unlikely(n >= shards_count)) {
+            info("LISTENER: closing extra listen socket %s, since other addresses have fewer sockets.", (listen_fds_names[i])?listen_fds_names[i]:"UNKNOWN");
+            close(listen_fds[i]);
+            listen_fds[i] = -1;
+            continue;
         }
+
+        struct listen_shard *shard = &shards[n];
+
+        shard->fds[shard->fds_count].fd = listen_fds[i];
+        shard->fds[shard->fds_count].events = POLLIN;
+        shard->fds[shard->fds_count].revents = 0;
+        shard->fds_count++;
+
+        info("Listening on '%s'", (listen_fds_names[i])?listen_fds_names[i]:"UNKNOWN");
     }
 
+    freez(address_of);
+    freez(sockets);
+
+    for(i = 1; i < shards_count ;i++) {
+        if(pthread_create(&shards[i].thread, NULL, listen_shard_main, &shards[i]) != 0) {
+            error("LISTENER: failed to create thread for listener %zu. Its sockets will be serviced by listener 0.", i);
+
+            // give its sockets to shard 0
+            size_t f;
+            for(f = 0; f < shards[i].fds_count ;f++)
+                shards[0].fds[shards[0].fds_count++] = shards[i].fds[f];
+
+            shards[i].fds_count = 0;
+        }
+        else if(pthread_detach(shards[i].thread) != 0)
+            error("LISTENER: cannot request detach of thread for listener %zu.", i);
+    }
+
+    listen_shard_loop(&shards[0]);
+
     debug(D_WEB_CLIENT, "LISTENER: exit!");
+
+    for(i = 1; i < shards_count ;i++)
+        if(shards[i].fds_count) pthread_cancel(shards[i].thread);
+
     close_listen_sockets();
 
-    freez(fds);
+    // the shards of other threads are not freed, since they may still be running
 
     static_thread->enabled = 0;
     pthread_exit(NULL);
@@ -642,6 +769,8 @@ void *socket_listen_main_single_threaded(void *ptr) {
                         web_client_free(w);
                         continue;
                     }
+
+                    web_client_process_pipelined(w);
                 }
 
                 if(unlikely(single_threaded_link_client(w, &ifds, &ofds, &efds, &fdmax) != 0)) {
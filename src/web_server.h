@@ -13,6 +13,10 @@
 #define MAX_LISTEN_FDS 100
 #endif
 
+#ifndef MAX_LISTEN_SOCKETS_PER_ADDRESS
+#define MAX_LISTEN_SOCKETS_PER_ADDRESS 32
+#endif
+
 typedef enum web_server_mode {
     WEB_SERVER_MODE_SINGLE_THREADED,
     WEB_SERVER_MODE_MULTI_THREADED,
@@ -20,6 +24,7 @@ typedef enum web_server_mode {
 } WEB_SERVER_MODE;
 
 extern WEB_SERVER_MODE web_server_mode;
+extern size_t listen_sockets_per_address;
 
 extern WEB_SERVER_MODE web_server_mode_id(const char *mode);
 extern const char *web_server_mode_name(WEB_SERVER_MODE id);